@@ -35,6 +35,8 @@
 #include "fp_handler.h"
 #include "cli_handler.h"
 #include "application_handler.h"
+#include "async_handler.h"
+#include "monitor_handler.h"
 
 #define DEF_MODULE_NAME	"app_tiresias"
 
@@ -113,12 +115,24 @@ static bool init(void)
 		return false;
 	}
 
+	ret = async_init();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate async.\n");
+		return false;
+	}
+
 	ret = application_init();
 	if(ret == false) {
 		ast_log(LOG_ERROR, "Could not initate application.\n");
 		return false;
 	}
 
+	ret = monitor_init();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate monitor.\n");
+		return false;
+	}
+
 	return true;
 }
 
@@ -126,10 +140,10 @@ static bool term(void)
 {
 	int ret;
 
-	ret = fp_term();
+	/* no more new calls of the applications, functions and cli */
+	ret = application_term();
 	if(ret == false) {
-		/* just write the notice log only. */
-		ast_log(LOG_NOTICE, "Could not terminate database.\n");
+		ast_log(LOG_NOTICE, "Could not terminate application correctly.\n");
 	}
 
 	ret = cli_term();
@@ -137,9 +151,25 @@ static bool term(void)
 		ast_log(LOG_NOTICE, "Could not terminate cli.\n");
 	}
 
-	ret = application_term();
+	/* the monitors and the async tasks are using the fp_handler.
+	 * the fp_handler can not be released while they are running.
+	 */
+	ret = monitor_term();
 	if(ret == false) {
-		ast_log(LOG_NOTICE, "Could not terminate application correctly.\n");
+		ast_log(LOG_WARNING, "Could not terminate monitor correctly.\n");
+		return false;
+	}
+
+	ret = async_term();
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not terminate async correctly.\n");
+		return false;
+	}
+
+	ret = fp_term();
+	if(ret == false) {
+		/* just write the notice log only. */
+		ast_log(LOG_NOTICE, "Could not terminate database.\n");
 	}
 
 	ast_json_unref(g_app->j_conf);
@@ -599,7 +629,8 @@ static int unload_module(void)
 
 	ret = term();
 	if(ret == false) {
-		ast_log(LOG_NOTICE, "Could not terminate the module correctly.\n");
+		ast_log(LOG_WARNING, "Could not terminate the module. Try again later.\n");
+		return -1;
 	}
 
 	return 0;
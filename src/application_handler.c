@@ -14,6 +14,8 @@
 #include <asterisk/file.h>
 #include <asterisk/channel.h>
 #include <asterisk/pbx.h>
+#include <asterisk/datastore.h>
+#include <asterisk/format_cache.h>
 
 
 #include <stdio.h>
@@ -22,6 +24,8 @@
 
 #include "app_tiresias.h"
 #include "fp_handler.h"
+#include "fp_stream_handler.h"
+#include "async_handler.h"
 #include "application_handler.h"
 
 
@@ -46,45 +50,173 @@
 			<parameter name="freq_ignore_high">
 				<para>Ignore frequency high</para>
 			</parameter>
+			<parameter name="coefs">
+				<para>Number of MFCC coefficients to match</para>
+			</parameter>
+			<parameter name="matches">
+				<para>Number of the ranked candidates to return</para>
+			</parameter>
+			<parameter name="deadline_ms">
+				<para>Time budget of the search in milliseconds. 0 for no deadline</para>
+			</parameter>
 		</syntax>
 		<description>
 			<para>Fingerprint and audio recognise with the given seconds.</para>
+			<para>If the reuse_ms is set, the recording and its extracted query frames are kept on the channel,
+			and the next Tiresias of the same duration in the reuse_ms searches them without the recording.</para>
+			<para>If the stream is set, the voice is fingerprinted and searched while it is read without the recording,
+			and the application returns as soon as the leading candidate is clear.</para>
+		</description>
+	</application>
+	<application name="TiresiasStart" language="en_US">
+		<synopsis>
+			Start the tiresias audio recognition in the background
+		</synopsis>
+		<syntax>
+			<parameter name="context" required="true">
+				<para>context name.</para>
+			</parameter>
+			<parameter name="duration">
+				<para>fingerprint duration</para>
+			</parameter>
+			<parameter name="tolerance">
+				<para>tolreance score</para>
+			</parameter>
+			<parameter name="freq_ignore_low">
+				<para>Ignore frequency low</para>
+			</parameter>
+			<parameter name="freq_ignore_high">
+				<para>Ignore frequency high</para>
+			</parameter>
+			<parameter name="coefs">
+				<para>Number of MFCC coefficients to match</para>
+			</parameter>
+			<parameter name="matches">
+				<para>Number of the ranked candidates to return</para>
+			</parameter>
+			<parameter name="deadline_ms">
+				<para>Time budget of the search in milliseconds. 0 for no deadline</para>
+			</parameter>
+		</syntax>
+		<description>
+			<para>Captures the channel's voice for the given duration and recognises it in the background,
+			and returns immediately. The voice is captured while the channel is read(i.e. Playback, Background).
+			The result is collected by the TiresiasWait or the TIRESIAS_RESULT function.</para>
 		</description>
 	</application>
+	<application name="TiresiasWait" language="en_US">
+		<synopsis>
+			Wait the background tiresias audio recognition
+		</synopsis>
+		<syntax>
+			<parameter name="timeout">
+				<para>Max wait time in milliseconds. Waits until done if not given.</para>
+			</parameter>
+		</syntax>
+		<description>
+			<para>Waits the recognition started by the TiresiasStart, and sets the same variables as the Tiresias.
+			The TIRSTATUS is RUNNING if the recognition has not been done in the timeout,
+			and NONE if no recognition has been started.</para>
+		</description>
+	</application>
+	<function name="TIRESIAS_RESULT" language="en_US">
+		<synopsis>
+			Get the background tiresias audio recognition result
+		</synopsis>
+		<syntax>
+			<parameter name="field" required="true">
+				<enumlist>
+					<enum name="status"><para>NONE, RUNNING, FOUND, NOTFOUND or HANGUP</para></enum>
+					<enum name="uuid" />
+					<enum name="name" />
+					<enum name="context" />
+					<enum name="hash" />
+					<enum name="match_count" />
+					<enum name="frame_count" />
+				</enumlist>
+			</parameter>
+		</syntax>
+		<description>
+			<para>Returns the field of the recognition started by the TiresiasStart without waiting.
+			The fields other than status are empty until the status is FOUND.</para>
+		</description>
+	</function>
  ***/
 
 #define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
 
 #define DEF_APPLICATION_TIRESIAS "Tiresias"
+#define DEF_APPLICATION_TIRESIAS_START "TiresiasStart"
+#define DEF_APPLICATION_TIRESIAS_WAIT "TiresiasWait"
 
 #define DEF_DURATION   3000
+#define DEF_COEFS      1
+#define DEF_DEADLINE   0
+#define DEF_REUSE      0
+
+/**
+ * Recording of the channel and its extracted query frames.
+ * Kept on the channel to search again with the other contexts.
+ */
+typedef struct _query_store_t {
+	char* filename;		///< recording file name without the extension
+	int duration;		///< recording duration(ms)
+	struct timeval tv;	///< recorded time
+	struct ast_json* j_frames;	///< extracted query frames
+} query_store_t;
+
+/**
+ * Options of the Tiresias and TiresiasStart applications.
+ */
+typedef struct _tiresias_option_t {
+	const char* context;
+	int duration;
+	double tolerance;
+	int freq_ignore_low;
+	int freq_ignore_high;
+	int coefs;
+	int matches;
+	int deadline_ms;
+	int reuse_ms;
+	bool stream;
+} tiresias_option_t;
+
+static void destroy_query_store(void* data);
+static void destroy_query_store_datastore(void* data);
+
+static const struct ast_datastore_info g_query_store_info = {
+	.type = "tiresias_query",
+	.destroy = destroy_query_store_datastore,
+};
 
 
 static int tiresias_exec(struct ast_channel *chan, const char *data);
+static int tiresias_start_exec(struct ast_channel *chan, const char *data);
+static int tiresias_wait_exec(struct ast_channel *chan, const char *data);
+static int tiresias_result_read(struct ast_channel *chan, const char *cmd, char *data, char *buf, size_t len);
+static bool parse_options(char* data, tiresias_option_t* option);
+static void set_result_variables(struct ast_channel *chan, struct ast_json* j_fp);
 static int record_voice(struct ast_filestream* file, struct ast_channel *chan, int duration);
+static int stream_voice(fp_stream_t* stream, struct ast_channel *chan, int duration);
+static void set_matches_variables(struct ast_channel *chan, struct ast_json* j_matches);
+static query_store_t* record_query_store(struct ast_channel *chan, const int duration, int* status);
+static query_store_t* get_query_store(struct ast_channel *chan, const int duration, const int reuse_ms);
+static void set_query_store(struct ast_channel *chan, query_store_t* store);
+
+static struct ast_custom_function g_tiresias_result_function = {
+	.name = "TIRESIAS_RESULT",
+	.read = tiresias_result_read,
+};
 
 static int tiresias_exec(struct ast_channel *chan, const char *data)
 {
 	int ret;
 	char* data_copy;
-	char* filename;
 	char* tmp;
-	const char* tmp_const;
-	const char* context;
-	int duration;
-	struct ast_filestream* file;
-	double tolerance;
 	struct ast_json* j_fp;
-	int freq_ignore_low;
-	int freq_ignore_high;
-
-	AST_DECLARE_APP_ARGS(args,
-		AST_APP_ARG(context);
-		AST_APP_ARG(duraion);
-		AST_APP_ARG(tolerance);
-		AST_APP_ARG(freq_ignore_low);
-		AST_APP_ARG(freq_ignore_high);
-	);
+	tiresias_option_t option;
+	query_store_t* store;
+	fp_stream_t* fp_stream;
 
 	if (ast_strlen_zero(data) == 1) {
 		ast_log(LOG_WARNING, "TIRESIAS requires an argument.\n");
@@ -94,102 +226,340 @@ static int tiresias_exec(struct ast_channel *chan, const char *data)
 
 	/* parse the args */
 	data_copy = ast_strdupa(data);
-	AST_STANDARD_APP_ARGS(args, data_copy);
+	ret = parse_options(data_copy, &option);
+	if(ret == false) {
+		return -1;
+	}
+
+	/* check values */
+	ast_log(LOG_VERBOSE, "Application tiresias. context[%s], durtion[%d], tolerance[%f], freq_ignore_low[%d], freq_ignore_high[%d], coefs[%d], matches[%d], deadline_ms[%d], reuse_ms[%d], stream[%d]\n",
+			option.context, option.duration, option.tolerance, option.freq_ignore_low, option.freq_ignore_high, option.coefs, option.matches, option.deadline_ms, option.reuse_ms, option.stream
+			);
+
+	/* reuse the channel's recent recording */
+	store = get_query_store(chan, option.duration, option.reuse_ms);
+	pbx_builtin_setvar_helper(chan, "TIRREUSED", (store != NULL) ? "1" : "0");
+	if(store == NULL) {
+		ret = ast_channel_state(chan);
+		ast_log(LOG_VERBOSE, "Channel state. state[%d]\n", ret);
+		if(ret != AST_STATE_UP) {
+			/* answer */
+			ret = ast_answer(chan);
+		}
+	}
+
+	/* streaming search. the recording is used if the context's engine does not support. */
+	fp_stream = NULL;
+	if((store == NULL) && (option.stream == true)) {
+		fp_stream = fp_stream_create(option.context, option.duration, option.coefs, option.tolerance, option.freq_ignore_low, option.freq_ignore_high, option.matches, option.deadline_ms);
+	}
+
+	if(fp_stream != NULL) {
+		ret = stream_voice(fp_stream, chan, option.duration);
+		if(ret == 0) {
+			pbx_builtin_setvar_helper(chan, "TIRSTATUS", "HANGUP");
+			fp_stream_destroy(fp_stream);
+			return 0;
+		}
+
+		j_fp = (ret > 0) ? fp_stream_get_result(fp_stream) : NULL;
+		fp_stream_destroy(fp_stream);
+	}
+	else {
+		if(store == NULL) {
+			/* record */
+			store = record_query_store(chan, option.duration, &ret);
+			if(ret == 0) {
+				pbx_builtin_setvar_helper(chan, "TIRSTATUS", "HANGUP");
+				return 0;
+			}
+			else if(ret < 0) {
+				pbx_builtin_setvar_helper(chan, "TIRSTATUS", "NOTFOUND");
+				return 0;
+			}
+		}
+
+		/* do the fingerprinting and recognition */
+		ast_asprintf(&tmp, "%s.wav", store->filename);
+		j_fp = fp_search_fingerprint_info(option.context, tmp, store->j_frames, option.coefs, option.tolerance, option.freq_ignore_low, option.freq_ignore_high, option.matches, option.deadline_ms);
+		sfree(tmp);
+
+		/* keep the recording for the next call, or delete */
+		if(option.reuse_ms > 0) {
+			set_query_store(chan, store);
+		}
+		else {
+			destroy_query_store(store);
+		}
+	}
+
+	if(j_fp == NULL) {
+		ast_log(LOG_VERBOSE, "Could not get fingerprint info.");
+		pbx_builtin_setvar_helper(chan, "TIRSTATUS", "NOTFOUND");
+		return 0;
+	}
+
+	set_result_variables(chan, j_fp);
+	ast_json_unref(j_fp);
+
+	return 0;
+}
+
+/**
+ * Start the background recognition. The channel keeps going on the dialplan.
+ * The reuse_ms is not used.
+ */
+static int tiresias_start_exec(struct ast_channel *chan, const char *data)
+{
+	int ret;
+	char* data_copy;
+	tiresias_option_t option;
+
+	if (ast_strlen_zero(data) == 1) {
+		ast_log(LOG_WARNING, "TIRESIASSTART requires an argument.\n");
+		return -1;
+	}
+	ast_log(LOG_DEBUG, "Check value. data[%s]\n", data);
+
+	/* parse the args */
+	data_copy = ast_strdupa(data);
+	ret = parse_options(data_copy, &option);
+	if(ret == false) {
+		return -1;
+	}
+
+	ast_log(LOG_VERBOSE, "Application tiresias start. context[%s], durtion[%d], tolerance[%f], freq_ignore_low[%d], freq_ignore_high[%d], coefs[%d], matches[%d], deadline_ms[%d], stream[%d]\n",
+			option.context, option.duration, option.tolerance, option.freq_ignore_low, option.freq_ignore_high, option.coefs, option.matches, option.deadline_ms, option.stream
+			);
+
+	ret = ast_channel_state(chan);
+	if(ret != AST_STATE_UP) {
+		/* answer */
+		ret = ast_answer(chan);
+	}
+
+	ret = async_start(chan, option.context, option.duration, option.coefs, option.tolerance, option.freq_ignore_low, option.freq_ignore_high, option.matches, option.deadline_ms, option.stream);
+	if(ret == false) {
+		ast_log(LOG_NOTICE, "Could not start the background recognition.\n");
+		pbx_builtin_setvar_helper(chan, "TIRSTATUS", "NOTFOUND");
+		return 0;
+	}
+	pbx_builtin_setvar_helper(chan, "TIRSTATUS", "RUNNING");
+
+	return 0;
+}
+
+/**
+ * Wait the background recognition and set the result variables.
+ */
+static int tiresias_wait_exec(struct ast_channel *chan, const char *data)
+{
+	int timeout;
+	struct ast_json* j_fp;
+	async_status_t status;
+
+	/* get timeout */
+	timeout = -1;
+	if(ast_strlen_zero(data) != 1) {
+		timeout = atoi(data);
+	}
+	ast_log(LOG_VERBOSE, "Application tiresias wait. timeout[%d]\n", timeout);
+
+	status = async_wait(chan, timeout, &j_fp);
+	if(status == ASYNC_STATUS_HANGUP) {
+		pbx_builtin_setvar_helper(chan, "TIRSTATUS", "HANGUP");
+		return 0;
+	}
+
+	if(j_fp == NULL) {
+		pbx_builtin_setvar_helper(chan, "TIRSTATUS", async_status_to_str(status));
+		return 0;
+	}
+
+	set_result_variables(chan, j_fp);
+	ast_json_unref(j_fp);
+
+	return 0;
+}
+
+/**
+ * TIRESIAS_RESULT(field)
+ * Returns the background recognition result without waiting.
+ */
+static int tiresias_result_read(struct ast_channel *chan, const char *cmd, char *data, char *buf, size_t len)
+{
+	int i;
+	struct ast_json* j_fp;
+	async_status_t status;
+	const char* field;
+	const char* tmp_const;
+	static const char* fields[] = {"status", "match_count", "frame_count", "uuid", "name", "context", "hash"};
+
+	if((chan == NULL) || (ast_strlen_zero(data) == 1)) {
+		ast_log(LOG_WARNING, "TIRESIAS_RESULT requires a field.\n");
+		return -1;
+	}
+
+	/* the field is case insensitive. the result's key is the lowercase one. */
+	field = NULL;
+	for(i = 0; i < ARRAY_LEN(fields); i++) {
+		if(strcasecmp(data, fields[i]) == 0) {
+			field = fields[i];
+			break;
+		}
+	}
+	if(field == NULL) {
+		ast_log(LOG_WARNING, "Unknown TIRESIAS_RESULT field. field[%s]\n", data);
+		return -1;
+	}
+
+	status = async_wait(chan, 0, &j_fp);
+	buf[0] = '\0';
+
+	if(strcmp(field, "status") == 0) {
+		ast_copy_string(buf, async_status_to_str(status), len);
+	}
+	else if((strcmp(field, "match_count") == 0) || (strcmp(field, "frame_count") == 0)) {
+		if(j_fp != NULL) {
+			snprintf(buf, len, "%d", (int)ast_json_integer_get(ast_json_object_get(j_fp, field)));
+		}
+	}
+	else {
+		tmp_const = ast_json_string_get(ast_json_object_get(j_fp, field));
+		ast_copy_string(buf, tmp_const? : "", len);
+	}
+	ast_json_unref(j_fp);
+
+	return 0;
+}
+
+/**
+ * Parse the application's args. The global options are used as the default values.
+ * @param data: args. The option's context points into it.
+ * @param option
+ * @return
+ */
+static bool parse_options(char* data, tiresias_option_t* option)
+{
+	int ret;
+	const char* tmp_const;
+
+	AST_DECLARE_APP_ARGS(args,
+		AST_APP_ARG(context);
+		AST_APP_ARG(duraion);
+		AST_APP_ARG(tolerance);
+		AST_APP_ARG(freq_ignore_low);
+		AST_APP_ARG(freq_ignore_high);
+		AST_APP_ARG(coefs);
+		AST_APP_ARG(matches);
+		AST_APP_ARG(deadline_ms);
+	);
+
+	AST_STANDARD_APP_ARGS(args, data);
 
 	/* get context */
 	ret = ast_strlen_zero(args.context);
 	if(ret == 1) {
 		ast_log(LOG_NOTICE, "Wrong context info.\n");
-		return -1;
+		return false;
 	}
-	context = args.context;
+	option->context = args.context;
 
 	/* get duration */
-	duration = DEF_DURATION;
+	option->duration = DEF_DURATION;
 	ret = ast_strlen_zero(args.duraion);
 	if(ret != 1) {
-		duration = atoi(args.duraion);
+		option->duration = atoi(args.duraion);
 	}
 
 	/* get tolerance */
-	tolerance = -1;
+	option->tolerance = -1;
 	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "global"), "tolerance"));
 	if(tmp_const != NULL) {
-		tolerance = atof(tmp_const);
+		option->tolerance = atof(tmp_const);
 	}
 	ret = ast_strlen_zero(args.tolerance);
 	if(ret != 1) {
-		tolerance = atof(args.tolerance);
+		option->tolerance = atof(args.tolerance);
 	}
 
 	/* get freq_ignore_low */
-	freq_ignore_low = -1;
+	option->freq_ignore_low = -1;
 	ret = ast_strlen_zero(args.freq_ignore_low);
 	if(ret != 1) {
-		freq_ignore_low = atoi(args.freq_ignore_low);
+		option->freq_ignore_low = atoi(args.freq_ignore_low);
 	}
 
 	/* get freq_ignore_high */
-	freq_ignore_high = -1;
+	option->freq_ignore_high = -1;
 	ret = ast_strlen_zero(args.freq_ignore_high);
 	if(ret != 1) {
-		freq_ignore_high = atoi(args.freq_ignore_high);
+		option->freq_ignore_high = atoi(args.freq_ignore_high);
 	}
 
-	/* check values */
-	ast_log(LOG_VERBOSE, "Application tiresias. context[%s], durtion[%d], tolerance[%f], freq_ignore_low[%d], freq_ignore_high[%d]\n",
-			context, duration, tolerance, freq_ignore_low, freq_ignore_high
-			);
-
-	ret = ast_channel_state(chan);
-	ast_log(LOG_VERBOSE, "Channel state. state[%d]\n", ret);
-	if(ret != AST_STATE_UP) {
-		/* answer */
-		ret = ast_answer(chan);
+	/* get coefs */
+	option->coefs = DEF_COEFS;
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "global"), "coefs"));
+	if(tmp_const != NULL) {
+		option->coefs = atoi(tmp_const);
 	}
-
-	/* create temp file */
-	tmp = fp_generate_uuid();
-	ast_asprintf(&filename, "/tmp/tiresias-%s", tmp);
-	sfree(tmp);
-	file = 	ast_writefile(filename, "wav", NULL, O_CREAT|O_TRUNC|O_WRONLY, 0, AST_FILE_MODE);
-	if(file == NULL) {
-		ast_log(LOG_NOTICE, "Could not create temp recording file.\n");
-		sfree(filename);
-		return -1;
+	ret = ast_strlen_zero(args.coefs);
+	if(ret != 1) {
+		option->coefs = atoi(args.coefs);
 	}
 
-	/* record */
-	ret = record_voice(file, chan, duration);
-	ast_closestream(file);
-	if(ret == 0) {
-		pbx_builtin_setvar_helper(chan, "TIRSTATUS", "HANGUP");
-		ast_filedelete(filename, NULL);
-		sfree(filename);
-		return 0;
+	/* get matches */
+	option->matches = DEF_SEARCH_MAX_RESULTS;
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "global"), "matches"));
+	if(tmp_const != NULL) {
+		option->matches = atoi(tmp_const);
 	}
-	else if(ret < 0) {
-		pbx_builtin_setvar_helper(chan, "TIRSTATUS", "NOTFOUND");
-		ast_filedelete(filename, NULL);
-		sfree(filename);
-		return 0;
+	ret = ast_strlen_zero(args.matches);
+	if(ret != 1) {
+		option->matches = atoi(args.matches);
 	}
 
-	/* do the fingerprinting and recognition */
-	ast_asprintf(&tmp, "%s.wav", filename);
-	j_fp = fp_search_fingerprint_info(context, tmp, 1, tolerance, freq_ignore_low, freq_ignore_high);
+	/* get deadline_ms */
+	option->deadline_ms = DEF_DEADLINE;
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "global"), "deadline_ms"));
+	if(tmp_const != NULL) {
+		option->deadline_ms = atoi(tmp_const);
+	}
+	ret = ast_strlen_zero(args.deadline_ms);
+	if(ret != 1) {
+		option->deadline_ms = atoi(args.deadline_ms);
+	}
 
-	/* delete file */
-	ast_filedelete(filename, NULL);
-	sfree(filename);
-	sfree(tmp);
+	/* get reuse_ms */
+	option->reuse_ms = DEF_REUSE;
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "global"), "reuse_ms"));
+	if(tmp_const != NULL) {
+		option->reuse_ms = atoi(tmp_const);
+	}
 
-	if(j_fp == NULL) {
-		ast_log(LOG_VERBOSE, "Could not get fingerprint info.");
-		pbx_builtin_setvar_helper(chan, "TIRSTATUS", "NOTFOUND");
-		return 0;
+	/* get stream */
+	option->stream = false;
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "global"), "stream"));
+	if((tmp_const != NULL) && (ast_true(tmp_const) != 0)) {
+		option->stream = true;
 	}
 
+	return true;
+}
+
+/**
+ * Set the found result variables.
+ * TIRSTATUS, TIRFRAMECOUNT, TIRMATCHCOUNT, TIRFILEUUID, TIRFILENAME, TIRCONTEXT, TIRFILEHASH,
+ * TIRPARTIAL, TIRPROCESSED, TIREARLY and the ranked candidates variables.
+ * @param chan
+ * @param j_fp
+ */
+static void set_result_variables(struct ast_channel *chan, struct ast_json* j_fp)
+{
+	int ret;
+	char* tmp;
+	const char* tmp_const;
+
 	/* TIRSTATUS */
 	pbx_builtin_setvar_helper(chan, "TIRSTATUS", "FOUND");
 
@@ -233,9 +603,210 @@ static int tiresias_exec(struct ast_channel *chan, const char *data)
 	}
 	pbx_builtin_setvar_helper(chan, "TIRFILEHASH", tmp_const? : "");
 
-	ast_json_unref(j_fp);
+	/* TIRPARTIAL */
+	ret = ast_json_is_true(ast_json_object_get(j_fp, "partial"));
+	pbx_builtin_setvar_helper(chan, "TIRPARTIAL", (ret == 1) ? "1" : "0");
 
-	return 0;
+	/* TIRPROCESSED */
+	ast_asprintf(&tmp, "%f", ast_json_real_get(ast_json_object_get(j_fp, "processed")));
+	pbx_builtin_setvar_helper(chan, "TIRPROCESSED", tmp);
+	sfree(tmp);
+
+	/* TIREARLY */
+	ret = ast_json_is_true(ast_json_object_get(j_fp, "early"));
+	pbx_builtin_setvar_helper(chan, "TIREARLY", (ret == 1) ? "1" : "0");
+
+	/* TIRMATCHES, TIRMATCHn_* */
+	set_matches_variables(chan, ast_json_object_get(j_fp, "matches"));
+}
+
+/**
+ * Set the ranked candidates variables.
+ * TIRMATCHES: count of the candidates.
+ * TIRMATCHn_UUID, TIRMATCHn_NAME, TIRMATCHn_COUNT, TIRMATCHn_OFFSET, TIRMATCHn_COST: n-th ranked candidate. starts from 1.
+ * @param chan
+ * @param j_matches
+ */
+static void set_matches_variables(struct ast_channel *chan, struct ast_json* j_matches)
+{
+	int i;
+	int count;
+	char name[32];
+	char value[32];
+	struct ast_json* j_match;
+	const char* tmp_const;
+
+	count = ast_json_array_size(j_matches);
+	snprintf(value, sizeof(value), "%d", count);
+	pbx_builtin_setvar_helper(chan, "TIRMATCHES", value);
+
+	for(i = 0; i < count; i++) {
+		j_match = ast_json_array_get(j_matches, i);
+
+		snprintf(name, sizeof(name), "TIRMATCH%d_UUID", i + 1);
+		tmp_const = ast_json_string_get(ast_json_object_get(j_match, "uuid"));
+		pbx_builtin_setvar_helper(chan, name, tmp_const? : "");
+
+		snprintf(name, sizeof(name), "TIRMATCH%d_NAME", i + 1);
+		tmp_const = ast_json_string_get(ast_json_object_get(j_match, "name"));
+		pbx_builtin_setvar_helper(chan, name, tmp_const? : "");
+
+		snprintf(name, sizeof(name), "TIRMATCH%d_COUNT", i + 1);
+		snprintf(value, sizeof(value), "%d", (int)ast_json_integer_get(ast_json_object_get(j_match, "match_count")));
+		pbx_builtin_setvar_helper(chan, name, value);
+
+		snprintf(name, sizeof(name), "TIRMATCH%d_OFFSET", i + 1);
+		snprintf(value, sizeof(value), "%d", (int)ast_json_integer_get(ast_json_object_get(j_match, "offset")));
+		pbx_builtin_setvar_helper(chan, name, value);
+
+		// empty if the candidate was not verified. the binary engine gives the bit error rate.
+		snprintf(name, sizeof(name), "TIRMATCH%d_COST", i + 1);
+		value[0] = '\0';
+		if(ast_json_object_get(j_match, "verify_cost") != NULL) {
+			snprintf(value, sizeof(value), "%f", ast_json_real_get(ast_json_object_get(j_match, "verify_cost")));
+		}
+		else if(ast_json_object_get(j_match, "bit_error_rate") != NULL) {
+			snprintf(value, sizeof(value), "%f", ast_json_real_get(ast_json_object_get(j_match, "bit_error_rate")));
+		}
+		pbx_builtin_setvar_helper(chan, name, value);
+	}
+}
+
+/**
+ * Record the given channel into the new temp file.
+ * @param chan
+ * @param duration
+ * @param status: 1:success, 0:hangup, -1:error
+ * @return recorded query store. NULL if the status is not success.
+ */
+static query_store_t* record_query_store(struct ast_channel *chan, const int duration, int* status)
+{
+	int ret;
+	char* tmp;
+	struct ast_filestream* file;
+	query_store_t* store;
+
+	store = ast_calloc(1, sizeof(query_store_t));
+	store->duration = duration;
+
+	/* create temp file */
+	tmp = fp_generate_uuid();
+	ast_asprintf(&store->filename, "/tmp/tiresias-%s", tmp);
+	sfree(tmp);
+	file = 	ast_writefile(store->filename, "wav", NULL, O_CREAT|O_TRUNC|O_WRONLY, 0, AST_FILE_MODE);
+	if(file == NULL) {
+		ast_log(LOG_NOTICE, "Could not create temp recording file.\n");
+		sfree(store->filename);
+		sfree(store);
+		*status = -1;
+		return NULL;
+	}
+
+	/* record */
+	ret = record_voice(file, chan, duration);
+	ast_closestream(file);
+	store->tv = ast_tvnow();
+	store->j_frames = ast_json_object_create();
+
+	*status = ret;
+	if(ret != 1) {
+		destroy_query_store(store);
+		return NULL;
+	}
+
+	return store;
+}
+
+/**
+ * Returns the channel's kept query store if it is reusable.
+ * The returned store is detached from the channel.
+ * @param chan
+ * @param duration: the store should have the same duration.
+ * @param reuse_ms: the store should be recorded in this time. 0 for no reuse.
+ * @return NULL if not reusable.
+ */
+static query_store_t* get_query_store(struct ast_channel *chan, const int duration, const int reuse_ms)
+{
+	struct ast_datastore* datastore;
+	query_store_t* store;
+
+	ast_channel_lock(chan);
+	datastore = ast_channel_datastore_find(chan, &g_query_store_info, NULL);
+	if(datastore != NULL) {
+		ast_channel_datastore_remove(chan, datastore);
+	}
+	ast_channel_unlock(chan);
+
+	if(datastore == NULL) {
+		return NULL;
+	}
+
+	/* detach the store. the datastore's module reference is released here. */
+	store = datastore->data;
+	datastore->data = NULL;
+	ast_datastore_free(datastore);
+	ast_module_unref(AST_MODULE_SELF);
+
+	if((reuse_ms <= 0) || (store->duration != duration) || (ast_tvdiff_ms(ast_tvnow(), store->tv) > reuse_ms)) {
+		ast_log(LOG_DEBUG, "Could not reuse the kept recording. filename[%s], duration[%d], reuse_ms[%d]\n", store->filename, store->duration, reuse_ms);
+		destroy_query_store(store);
+		return NULL;
+	}
+	ast_log(LOG_VERBOSE, "Reuse the kept recording. filename[%s], duration[%d]\n", store->filename, store->duration);
+
+	return store;
+}
+
+/**
+ * Keep the query store on the channel. The store is destroyed with the channel.
+ * The datastore holds the module's reference, so the module is not unloaded while
+ * any channel keeps the store.
+ * @param chan
+ * @param store
+ */
+static void set_query_store(struct ast_channel *chan, query_store_t* store)
+{
+	struct ast_datastore* datastore;
+
+	datastore = ast_datastore_alloc(&g_query_store_info, NULL);
+	if(datastore == NULL) {
+		ast_log(LOG_WARNING, "Could not create query datastore.\n");
+		destroy_query_store(store);
+		return;
+	}
+	datastore->data = store;
+	ast_module_ref(AST_MODULE_SELF);
+
+	ast_channel_lock(chan);
+	ast_channel_datastore_add(chan, datastore);
+	ast_channel_unlock(chan);
+}
+
+/**
+ * Delete the recording file and free the query store.
+ */
+static void destroy_query_store(void* data)
+{
+	query_store_t* store;
+
+	store = data;
+	if(store == NULL) {
+		return;
+	}
+
+	ast_filedelete(store->filename, NULL);
+	sfree(store->filename);
+	ast_json_unref(store->j_frames);
+	ast_free(store);
+}
+
+/**
+ * The channel has been destroyed with the kept store.
+ */
+static void destroy_query_store_datastore(void* data)
+{
+	destroy_query_store(data);
+	ast_module_unref(AST_MODULE_SELF);
 }
 
 /**
@@ -311,6 +882,88 @@ static int record_voice(struct ast_filestream* file, struct ast_channel *chan, i
 	return 1;
 }
 
+/**
+ * Read the given channel's voice into the streaming search.
+ * Returns when the stream is done or the duration is over.
+ * @param stream
+ * @param chan
+ * @param duration
+ * @return 1:success, 0:hangup, -1:error
+ */
+static int stream_voice(fp_stream_t* stream, struct ast_channel *chan, int duration)
+{
+	int ret;
+	struct timeval start;
+	struct ast_frame* frame;
+	struct ast_format* read_format;
+	int ms;
+	int err;
+
+	if((stream == NULL) || (chan == NULL) || (duration < 0)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return -1;
+	}
+
+	/* the stream takes the 8 kHz signed linear samples */
+	read_format = ao2_bump(ast_channel_readformat(chan));
+	ret = ast_set_read_format(chan, ast_format_slin);
+	if(ret != 0) {
+		ast_log(LOG_WARNING, "Could not set the read format to slin.\n");
+		ao2_cleanup(read_format);
+		return -1;
+	}
+
+	err = 0;
+	start = ast_tvnow();
+	while(fp_stream_is_done(stream) == false) {
+
+		ms = ast_remaining_ms(start, duration);
+		if(ms <= 0) {
+			break;
+		}
+
+		ms = ast_waitfor(chan, ms);
+		if(ms <= 0) {
+			break;
+		}
+
+		/* read the frame */
+		frame = ast_read(chan);
+		if(frame == NULL) {
+			/* hangup */
+			ast_log(LOG_VERBOSE, "The channel has been hungup.\n");
+			err = 1;
+			break;
+		}
+
+		if(frame->frametype != AST_FRAME_VOICE) {
+			ast_log(LOG_DEBUG, "Check frame type. frame_type[%d]\n", frame->frametype);
+			ast_frfree(frame);
+			continue;
+		}
+
+		ret = fp_stream_write(stream, frame->data.ptr, frame->samples);
+		ast_frfree(frame);
+		if(ret == false) {
+			ast_log(LOG_WARNING, "Problem writing frame.\n");
+			err = 2;
+			break;
+		}
+	}
+
+	ast_set_read_format(chan, read_format);
+	ao2_cleanup(read_format);
+
+	if(err == 1) {
+		return 0;
+	}
+	else if(err > 1) {
+		return -1;
+	}
+
+	return 1;
+}
+
 bool application_init(void)
 {
 	int ret;
@@ -318,6 +971,9 @@ bool application_init(void)
 	ast_log(LOG_VERBOSE, "init_application_handler.\n");
 
 	ret = ast_register_application2(DEF_APPLICATION_TIRESIAS, tiresias_exec, NULL, NULL, NULL);
+	ret |= ast_register_application2(DEF_APPLICATION_TIRESIAS_START, tiresias_start_exec, NULL, NULL, NULL);
+	ret |= ast_register_application2(DEF_APPLICATION_TIRESIAS_WAIT, tiresias_wait_exec, NULL, NULL, NULL);
+	ret |= ast_custom_function_register(&g_tiresias_result_function);
 
 	if(ret != 0) {
 		return false;
@@ -331,6 +987,9 @@ bool application_term(void)
 	ast_log(LOG_VERBOSE, "term_application_handler.\n");
 
 	ast_unregister_application(DEF_APPLICATION_TIRESIAS);
+	ast_unregister_application(DEF_APPLICATION_TIRESIAS_START);
+	ast_unregister_application(DEF_APPLICATION_TIRESIAS_WAIT);
+	ast_custom_function_unregister(&g_tiresias_result_function);
 
 	return true;
 }
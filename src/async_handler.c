@@ -0,0 +1,546 @@
+/*
+ * async_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Background recognition of the channel.
+ *  The task taps the channel's read audio with the spy audiohook, and the task thread
+ *  captures the audio and searches it while the dialplan goes on. The channel keeps the
+ *  task in its datastore, and the result is collected later from the datastore.
+ *  The read audio is captured only while the channel is read by someone(i.e. playback,
+ *  bridge or the TiresiasWait).
+ *  The running tasks are kept in the g_tasks, and stopped and waited at the module unload.
+ *  The task datastore holds the module's reference, so the module is not unloaded while
+ *  any channel keeps the task.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/module.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/lock.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/channel.h>
+#include <asterisk/datastore.h>
+#include <asterisk/audiohook.h>
+#include <asterisk/file.h>
+#include <asterisk/format_cache.h>
+#include <asterisk/time.h>
+
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "fp_handler.h"
+#include "fp_stream_handler.h"
+#include "async_handler.h"
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+#define DEF_ASYNC_SOURCE		"Tiresias"
+#define DEF_ASYNC_FRAME_SAMPLES	160		// 20 ms of the 8 kHz
+#define DEF_ASYNC_WAIT_STEP		1000	// ms. wait step of the no timeout wait
+#define DEF_ASYNC_TERM_WAIT		3000	// ms. max wait of the task threads at the term
+
+/**
+ * Background recognition task. ao2 object.
+ * Referenced by the channel's datastore, the task thread and the g_tasks.
+ */
+typedef struct _async_task_t {
+	struct ast_audiohook audiohook;
+	ast_cond_t cond;		///< signaled when the task is done. with the task's lock.
+
+	char* context;
+	int duration;
+	int coefs;
+	double tolerance;
+	int freq_ignore_low;
+	int freq_ignore_high;
+	int matches;
+	int deadline_ms;
+	bool stream;
+
+	bool stop;		///< the channel does not need the result anymore
+	async_status_t status;
+	struct ast_json* j_res;
+} async_task_t;
+
+static struct ao2_container* g_tasks = NULL;	///< running tasks
+
+static void destroy_task(void* obj);
+static void stop_task(async_task_t* task);
+static void destroy_task_datastore(void* data);
+static void* run_task(void* data);
+static int capture_task(async_task_t* task, fp_stream_t* stream, struct ast_filestream* file);
+static int is_task_running(void* data);
+static void remove_task(struct ast_channel* chan);
+
+static const struct ast_datastore_info g_task_datastore_info = {
+	.type = "tiresias_async",
+	.destroy = destroy_task_datastore,
+};
+
+bool async_init(void)
+{
+	g_tasks = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, 1, NULL, NULL, NULL);
+	if(g_tasks == NULL) {
+		ast_log(LOG_ERROR, "Could not create async task container.\n");
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Stop all of the running tasks, and wait their threads.
+ * @return
+ */
+bool async_term(void)
+{
+	int i;
+	async_task_t* task;
+	struct ao2_iterator iter;
+
+	if(g_tasks == NULL) {
+		return true;
+	}
+
+	iter = ao2_iterator_init(g_tasks, 0);
+	while((task = ao2_iterator_next(&iter)) != NULL) {
+		stop_task(task);
+		ao2_ref(task, -1);
+	}
+	ao2_iterator_destroy(&iter);
+
+	for(i = 0; i < DEF_ASYNC_TERM_WAIT / 10; i++) {
+		if(ao2_container_count(g_tasks) == 0) {
+			break;
+		}
+		usleep(10000);
+	}
+	if(ao2_container_count(g_tasks) != 0) {
+		ast_log(LOG_WARNING, "Could not stop all of the async tasks. count[%d]\n", ao2_container_count(g_tasks));
+		return false;
+	}
+
+	ao2_ref(g_tasks, -1);
+	g_tasks = NULL;
+
+	return true;
+}
+
+/**
+ * Start the background recognition of the given channel.
+ * The channel's previous recognition is stopped.
+ * @param chan
+ * @param context
+ * @param duration: capture duration(ms).
+ * @param coefs
+ * @param tolerance
+ * @param freq_ignore_low
+ * @param freq_ignore_high
+ * @param matches: max number of the ranked candidates.
+ * @param deadline_ms: time budget of the search after the capture. 0 for no deadline.
+ * @param stream: true searches the audio while it is captured, if the context's engine supports.
+ * @return
+ */
+bool async_start(
+		struct ast_channel* chan,
+		const char* context,
+		const int duration,
+		const int coefs,
+		const double tolerance,
+		const int freq_ignore_low,
+		const int freq_ignore_high,
+		const int matches,
+		const int deadline_ms,
+		const bool stream
+		)
+{
+	int ret;
+	pthread_t thread;
+	async_task_t* task;
+	struct ast_datastore* datastore;
+
+	if((chan == NULL) || (context == NULL) || (duration <= 0)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	task = ao2_alloc(sizeof(async_task_t), destroy_task);
+	if(task == NULL) {
+		ast_log(LOG_ERROR, "Could not create async task.\n");
+		return false;
+	}
+	ast_cond_init(&task->cond, NULL);
+	task->context = ast_strdup(context);
+	task->duration = duration;
+	task->coefs = coefs;
+	task->tolerance = tolerance;
+	task->freq_ignore_low = freq_ignore_low;
+	task->freq_ignore_high = freq_ignore_high;
+	task->matches = matches;
+	task->deadline_ms = deadline_ms;
+	task->stream = stream;
+	task->status = ASYNC_STATUS_RUNNING;
+
+	ast_audiohook_init(&task->audiohook, AST_AUDIOHOOK_TYPE_SPY, DEF_ASYNC_SOURCE, 0);
+
+	datastore = ast_datastore_alloc(&g_task_datastore_info, NULL);
+	if(datastore == NULL) {
+		ast_log(LOG_ERROR, "Could not create async task datastore.\n");
+		ao2_ref(task, -1);
+		return false;
+	}
+	datastore->data = ao2_bump(task);
+	ast_module_ref(AST_MODULE_SELF);
+
+	/* replace the previous task */
+	remove_task(chan);
+	ast_channel_lock(chan);
+	ast_channel_datastore_add(chan, datastore);
+	ast_channel_unlock(chan);
+
+	ret = ast_audiohook_attach(chan, &task->audiohook);
+	if(ret != 0) {
+		ast_log(LOG_ERROR, "Could not attach the audiohook. channel[%s]\n", ast_channel_name(chan));
+		ao2_lock(task);
+		task->status = ASYNC_STATUS_NOTFOUND;
+		ao2_unlock(task);
+		ao2_ref(task, -1);
+		return false;
+	}
+
+	/* the thread takes the reference */
+	ao2_link(g_tasks, task);
+	ret = ast_pthread_create_detached_background(&thread, NULL, run_task, task);
+	if(ret != 0) {
+		ast_log(LOG_ERROR, "Could not create async task thread. channel[%s]\n", ast_channel_name(chan));
+		ao2_unlink(g_tasks, task);
+		ast_audiohook_detach(&task->audiohook);
+		ao2_lock(task);
+		task->status = ASYNC_STATUS_NOTFOUND;
+		ao2_unlock(task);
+		ao2_ref(task, -1);
+		return false;
+	}
+	ast_log(LOG_VERBOSE, "Started async recognition. channel[%s], context[%s], duration[%d], stream[%d]\n", ast_channel_name(chan), context, duration, stream);
+
+	return true;
+}
+
+/**
+ * Wait the channel's background recognition.
+ * The channel is read(and the read frames are dropped) while waiting, so the audio
+ * keeps being captured.
+ * @param chan
+ * @param timeout_ms: max wait time. 0 does not wait. negative waits until done.
+ * @param j_res: result same as the fp_search_fingerprint_info's if the status is FOUND. Need to unref after use.
+ * @return
+ */
+async_status_t async_wait(struct ast_channel* chan, const int timeout_ms, struct ast_json** j_res)
+{
+	int ms;
+	int ret;
+	struct timeval start;
+	async_task_t* task;
+	struct ast_datastore* datastore;
+	async_status_t status;
+
+	if((chan == NULL) || (j_res == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return ASYNC_STATUS_NONE;
+	}
+	*j_res = NULL;
+
+	ast_channel_lock(chan);
+	datastore = ast_channel_datastore_find(chan, &g_task_datastore_info, NULL);
+	task = (datastore != NULL) ? ao2_bump(datastore->data) : NULL;
+	ast_channel_unlock(chan);
+	if(task == NULL) {
+		return ASYNC_STATUS_NONE;
+	}
+
+	start = ast_tvnow();
+	while((timeout_ms != 0) && (is_task_running(task) == 1)) {
+		ms = (timeout_ms < 0) ? DEF_ASYNC_WAIT_STEP : ast_remaining_ms(start, timeout_ms);
+		if(ms <= 0) {
+			break;
+		}
+
+		ret = ast_safe_sleep_conditional(chan, ms, is_task_running, task);
+		if(ret < 0) {
+			ast_log(LOG_VERBOSE, "The channel has been hungup.\n");
+			break;
+		}
+	}
+
+	ao2_lock(task);
+	status = task->status;
+	if(task->j_res != NULL) {
+		*j_res = ast_json_ref(task->j_res);
+	}
+	ao2_unlock(task);
+	ao2_ref(task, -1);
+
+	return status;
+}
+
+const char* async_status_to_str(const async_status_t status)
+{
+	switch(status) {
+		case ASYNC_STATUS_RUNNING:	return "RUNNING";
+		case ASYNC_STATUS_FOUND:	return "FOUND";
+		case ASYNC_STATUS_NOTFOUND:	return "NOTFOUND";
+		case ASYNC_STATUS_HANGUP:	return "HANGUP";
+		default:					return "NONE";
+	}
+}
+
+static void destroy_task(void* obj)
+{
+	async_task_t* task;
+
+	task = obj;
+
+	ast_audiohook_destroy(&task->audiohook);
+	ast_cond_destroy(&task->cond);
+	ast_json_unref(task->j_res);
+	sfree(task->context);
+}
+
+/**
+ * Stop the task's capture. The task thread is woken up and ends without the search.
+ */
+static void stop_task(async_task_t* task)
+{
+	ao2_lock(task);
+	task->stop = true;
+	ao2_unlock(task);
+
+	ast_audiohook_update_status(&task->audiohook, AST_AUDIOHOOK_STATUS_SHUTDOWN);
+}
+
+/**
+ * The channel does not need the task anymore.
+ * The running task is stopped, and the module's reference is released.
+ */
+static void destroy_task_datastore(void* data)
+{
+	async_task_t* task;
+
+	task = data;
+	if(task == NULL) {
+		return;
+	}
+
+	stop_task(task);
+	ao2_ref(task, -1);
+	ast_module_unref(AST_MODULE_SELF);
+}
+
+/**
+ * Task thread. Captures the audio and searches it.
+ * Holds the task's reference.
+ */
+static void* run_task(void* data)
+{
+	int ret;
+	char* tmp;
+	char* filename;
+	async_task_t* task;
+	fp_stream_t* stream;
+	struct ast_filestream* file;
+	struct ast_json* j_res;
+	async_status_t status;
+
+	task = data;
+	stream = NULL;
+	file = NULL;
+	filename = NULL;
+
+	/* streaming search, or the temp recording file */
+	if(task->stream == true) {
+		stream = fp_stream_create(task->context, task->duration, task->coefs, task->tolerance, task->freq_ignore_low, task->freq_ignore_high, task->matches, task->deadline_ms);
+	}
+	if(stream == NULL) {
+		tmp = fp_generate_uuid();
+		ast_asprintf(&filename, "/tmp/tiresias-%s", tmp);
+		sfree(tmp);
+		file = ast_writefile(filename, "wav", NULL, O_CREAT|O_TRUNC|O_WRONLY, 0, AST_FILE_MODE);
+		if(file == NULL) {
+			ast_log(LOG_NOTICE, "Could not create temp recording file.\n");
+		}
+	}
+
+	j_res = NULL;
+	ret = -1;
+	if((stream != NULL) || (file != NULL)) {
+		ret = capture_task(task, stream, file);
+	}
+	ast_audiohook_detach(&task->audiohook);
+
+	if(file != NULL) {
+		ast_closestream(file);
+	}
+
+	/* search */
+	if(ret > 0) {
+		if(stream != NULL) {
+			j_res = fp_stream_get_result(stream);
+		}
+		else {
+			ast_asprintf(&tmp, "%s.wav", filename);
+			j_res = fp_search_fingerprint_info(task->context, tmp, NULL, task->coefs, task->tolerance, task->freq_ignore_low, task->freq_ignore_high, task->matches, task->deadline_ms);
+			sfree(tmp);
+		}
+	}
+	fp_stream_destroy(stream);
+	if(filename != NULL) {
+		ast_filedelete(filename, NULL);
+		sfree(filename);
+	}
+
+	if(ret == 0) {
+		status = ASYNC_STATUS_HANGUP;
+	}
+	else if(j_res == NULL) {
+		status = ASYNC_STATUS_NOTFOUND;
+	}
+	else {
+		status = ASYNC_STATUS_FOUND;
+	}
+	ast_log(LOG_VERBOSE, "Finished async recognition. context[%s], status[%s]\n", task->context, async_status_to_str(status));
+
+	ao2_lock(task);
+	task->status = status;
+	task->j_res = j_res;
+	ast_cond_broadcast(&task->cond);
+	ao2_unlock(task);
+
+	ao2_unlink(g_tasks, task);
+	ao2_ref(task, -1);
+
+	return NULL;
+}
+
+/**
+ * Capture the task's read audio into the stream or the file.
+ * @param task
+ * @param stream: NULL for the file.
+ * @param file
+ * @return 1:success, 0:hangup, -1:error or stopped
+ */
+static int capture_task(async_task_t* task, fp_stream_t* stream, struct ast_filestream* file)
+{
+	int ret;
+	int err;
+	long captured;
+	long samples;
+	bool stop;
+	struct ast_frame* frame;
+
+	samples = (long)task->duration * 8;
+	captured = 0;
+	err = 0;
+
+	ast_audiohook_lock(&task->audiohook);
+	while(captured < samples) {
+		ao2_lock(task);
+		stop = task->stop;
+		ao2_unlock(task);
+		if(stop == true) {
+			err = 2;
+			break;
+		}
+
+		if(task->audiohook.status != AST_AUDIOHOOK_STATUS_RUNNING) {
+			/* detached by the hangup */
+			err = 1;
+			break;
+		}
+
+		ast_audiohook_trigger_wait(&task->audiohook);
+
+		while(captured < samples) {
+			frame = ast_audiohook_read_frame(&task->audiohook, DEF_ASYNC_FRAME_SAMPLES, AST_AUDIOHOOK_DIRECTION_READ, ast_format_slin);
+			if(frame == NULL) {
+				break;
+			}
+
+			ast_audiohook_unlock(&task->audiohook);
+			if(stream != NULL) {
+				ret = (fp_stream_write(stream, frame->data.ptr, frame->samples) == true) ? 0 : -1;
+			}
+			else {
+				ret = ast_writestream(file, frame);
+			}
+			captured += frame->samples;
+			ast_frfree(frame);
+			ast_audiohook_lock(&task->audiohook);
+
+			if(ret != 0) {
+				ast_log(LOG_WARNING, "Problem writing frame.\n");
+				err = 2;
+				break;
+			}
+		}
+
+		if((err != 0) || ((stream != NULL) && (fp_stream_is_done(stream) == true))) {
+			break;
+		}
+	}
+	ast_audiohook_unlock(&task->audiohook);
+	ast_log(LOG_DEBUG, "Captured async audio. context[%s], samples[%ld], err[%d]\n", task->context, captured, err);
+
+	if(err == 1) {
+		return 0;
+	}
+	else if(err > 1) {
+		return -1;
+	}
+
+	return 1;
+}
+
+/**
+ * Returns 1 while the task is running, 0 otherwise.
+ * The continue condition of the ast_safe_sleep_conditional.
+ */
+static int is_task_running(void* data)
+{
+	int ret;
+	async_task_t* task;
+
+	task = data;
+
+	ao2_lock(task);
+	ret = (task->status == ASYNC_STATUS_RUNNING) ? 1 : 0;
+	ao2_unlock(task);
+
+	return ret;
+}
+
+/**
+ * Remove the channel's task datastore. The task is stopped.
+ * @param chan
+ */
+static void remove_task(struct ast_channel* chan)
+{
+	struct ast_datastore* datastore;
+
+	ast_channel_lock(chan);
+	datastore = ast_channel_datastore_find(chan, &g_task_datastore_info, NULL);
+	if(datastore != NULL) {
+		ast_channel_datastore_remove(chan, datastore);
+	}
+	ast_channel_unlock(chan);
+
+	if(datastore != NULL) {
+		ast_datastore_free(datastore);
+	}
+}
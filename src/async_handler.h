@@ -0,0 +1,43 @@
+/*
+ * async_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_ASYNC_HANDLER_H_
+#define SRC_ASYNC_HANDLER_H_
+
+#include <asterisk.h>
+#include <asterisk/channel.h>
+#include <asterisk/json.h>
+
+#include <stdbool.h>
+
+typedef enum _async_status_t {
+	ASYNC_STATUS_NONE = 0,		///< no recognition has been started
+	ASYNC_STATUS_RUNNING,
+	ASYNC_STATUS_FOUND,
+	ASYNC_STATUS_NOTFOUND,
+	ASYNC_STATUS_HANGUP,
+} async_status_t;
+
+bool async_init(void);
+bool async_term(void);
+
+bool async_start(
+		struct ast_channel* chan,
+		const char* context,
+		const int duration,
+		const int coefs,
+		const double tolerance,
+		const int freq_ignore_low,
+		const int freq_ignore_high,
+		const int matches,
+		const int deadline_ms,
+		const bool stream
+		);
+async_status_t async_wait(struct ast_channel* chan, const int timeout_ms, struct ast_json** j_res);
+const char* async_status_to_str(const async_status_t status);
+
+#endif /* SRC_ASYNC_HANDLER_H_ */
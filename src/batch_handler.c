@@ -0,0 +1,217 @@
+/*
+ * batch_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Search request batching.
+ *  The concurrent requests of the same key(i.e. context and search options) are
+ *  collected over the short window and run at once. The first request of the key
+ *  opens the group and waits the window(or until the group is full), then runs
+ *  all of the group's requests in its own thread. The other requests wait until
+ *  the group is done, and take their results from their own request.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/lock.h>
+#include <asterisk/time.h>
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "batch_handler.h"
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+#define DEF_BATCH_MAX_REQUESTS	32		// max requests of each group
+
+typedef struct _batch_group_t {
+	char* key;
+	batch_fn fn;
+
+	void* requests[DEF_BATCH_MAX_REQUESTS];
+	int count;
+
+	int refs;		///< callers of the group
+	bool done;
+
+	struct _batch_group_t* next;
+} batch_group_t;
+
+static ast_mutex_t g_batch_lock;
+static ast_cond_t g_batch_cond;		///< signaled when the group is full or done
+static batch_group_t* g_groups = NULL;	///< open groups. accept the new requests.
+static int g_window = 0;		///< ms. 0 disables the batching.
+
+static batch_group_t* find_group(const char* key);
+static void unlink_group(batch_group_t* group);
+static void release_group(batch_group_t* group);
+
+/**
+ * Initiate the request batching.
+ * @param window_ms: time to collect the requests. 0 disables the batching.
+ * @return
+ */
+bool batch_init(const int window_ms)
+{
+	if(window_ms < 0) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	ast_mutex_init(&g_batch_lock);
+	ast_cond_init(&g_batch_cond, NULL);
+	g_groups = NULL;
+	g_window = window_ms;
+	ast_log(LOG_VERBOSE, "Initiated search batching. window[%d]\n", g_window);
+
+	return true;
+}
+
+void batch_term(void)
+{
+	g_window = 0;
+
+	ast_cond_destroy(&g_batch_cond);
+	ast_mutex_destroy(&g_batch_lock);
+}
+
+/**
+ * Returns true if the requests are batched.
+ */
+bool batch_is_enabled(void)
+{
+	return (g_window > 0) ? true : false;
+}
+
+/**
+ * Run the request with the other requests of the same key.
+ * Returns after the request has been run. If the batching is disabled,
+ * runs the request alone in the caller thread.
+ * @param key: requests of the same key are run together with the same fn.
+ * @param request: caller's request. The fn sets the result into it.
+ * @param fn
+ * @return
+ */
+bool batch_run(const char* key, void* request, batch_fn fn)
+{
+	struct timeval deadline;
+	struct timespec ts;
+	batch_group_t* group;
+
+	if((key == NULL) || (request == NULL) || (fn == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	if(g_window == 0) {
+		fn(&request, 1);
+		return true;
+	}
+
+	ast_mutex_lock(&g_batch_lock);
+
+	/* join to the open group */
+	group = find_group(key);
+	if(group != NULL) {
+		group->requests[group->count] = request;
+		group->count++;
+		group->refs++;
+		if(group->count == DEF_BATCH_MAX_REQUESTS) {
+			unlink_group(group);
+			ast_cond_broadcast(&g_batch_cond);
+		}
+
+		while(group->done == false) {
+			ast_cond_wait(&g_batch_cond, &g_batch_lock);
+		}
+		release_group(group);
+		ast_mutex_unlock(&g_batch_lock);
+
+		return true;
+	}
+
+	/* open the new group and wait the others */
+	group = ast_calloc(1, sizeof(batch_group_t));
+	group->key = ast_strdup(key);
+	group->fn = fn;
+	group->requests[0] = request;
+	group->count = 1;
+	group->refs = 1;
+	group->next = g_groups;
+	g_groups = group;
+
+	deadline = ast_tvadd(ast_tvnow(), ast_samp2tv(g_window, 1000));
+	ts.tv_sec = deadline.tv_sec;
+	ts.tv_nsec = deadline.tv_usec * 1000;
+	while((group->count < DEF_BATCH_MAX_REQUESTS) && (ast_tvcmp(ast_tvnow(), deadline) < 0)) {
+		ast_cond_timedwait(&g_batch_cond, &g_batch_lock, &ts);
+	}
+	unlink_group(group);
+	ast_mutex_unlock(&g_batch_lock);
+
+	/* the group is closed. the requests are not changed anymore. */
+	ast_log(LOG_DEBUG, "Running batched requests. key[%s], count[%d]\n", group->key, group->count);
+	group->fn(group->requests, group->count);
+
+	ast_mutex_lock(&g_batch_lock);
+	group->done = true;
+	ast_cond_broadcast(&g_batch_cond);
+	release_group(group);
+	ast_mutex_unlock(&g_batch_lock);
+
+	return true;
+}
+
+/**
+ * Returns the open group of the given key. NULL if not exists.
+ * Must be called with the g_batch_lock.
+ */
+static batch_group_t* find_group(const char* key)
+{
+	batch_group_t* group;
+
+	for(group = g_groups; group != NULL; group = group->next) {
+		if(strcmp(group->key, key) == 0) {
+			return group;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Remove the group from the open groups. The group does not accept the new requests.
+ * Must be called with the g_batch_lock.
+ */
+static void unlink_group(batch_group_t* group)
+{
+	batch_group_t** tmp;
+
+	for(tmp = &g_groups; *tmp != NULL; tmp = &(*tmp)->next) {
+		if(*tmp == group) {
+			*tmp = group->next;
+			group->next = NULL;
+			return;
+		}
+	}
+}
+
+/**
+ * Release the caller's reference of the group. The last caller frees the group.
+ * Must be called with the g_batch_lock.
+ */
+static void release_group(batch_group_t* group)
+{
+	group->refs--;
+	if(group->refs > 0) {
+		return;
+	}
+
+	sfree(group->key);
+	ast_free(group);
+}
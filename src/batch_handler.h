@@ -0,0 +1,24 @@
+/*
+ * batch_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_BATCH_HANDLER_H_
+#define SRC_BATCH_HANDLER_H_
+
+#include <stdbool.h>
+
+/**
+ * Runs the collected requests of the same key at once.
+ */
+typedef void (*batch_fn)(void** requests, const int count);
+
+bool batch_init(const int window_ms);
+void batch_term(void);
+
+bool batch_is_enabled(void);
+bool batch_run(const char* key, void* request, batch_fn fn);
+
+#endif /* SRC_BATCH_HANDLER_H_ */
@@ -0,0 +1,686 @@
+/*
+ * binary_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Binary sub-fingerprint matching(Haitsma-Kalker style).
+ *  Each frame is the 32 bits sub-fingerprint of the band energy differences.
+ *  The sub-fingerprints of each context are kept in one packed uint32 array,
+ *  and the entries of each audio are kept in one range in the frame order.
+ *
+ *  The search slides the query block over each audio's range, and the distance of
+ *  each alignment is the hamming distance(XOR + POPCNT of each frame pair).
+ *  The alignment is abandoned at the chunk boundary when its distance already exceeds
+ *  the audio's best alignment or the bit error rate threshold, so the most of the
+ *  random alignments are compared only for the first chunks.
+ *  The hamming distance is done with AVX2 or POPCNT if the cpu supports it,
+ *  otherwise with the scalar code.
+ *
+ *  The silent frame is 0 bits sub-fingerprint. The silence of the both ends of the
+ *  query is not compared.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/json.h>
+#include <asterisk/lock.h>
+#include <asterisk/astobj2.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BINARY_X86
+#endif
+
+#include "binary_handler.h"
+#include "worker_handler.h"
+#include "registry_handler.h"
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+#define DEF_BINARY_CTX_BUCKETS		31
+#define DEF_BINARY_BITS				32		// bits of each sub-fingerprint
+#define DEF_BINARY_BLOCK			256		// max query frames to compare
+#define DEF_BINARY_MIN_FRAMES		16		// min query frames to search
+#define DEF_BINARY_MIN_OVERLAP		64		// min overlapped frames of the alignment
+#define DEF_BINARY_CHUNK			32		// frames compared before the early abandon check
+#define DEF_BINARY_MAX_BER			0.35	// max bit error rate of the matched alignment
+#define DEF_BINARY_FRAME_BITS		8		// max bit errors of the matched frame. for the match count.
+
+typedef struct _binary_ctx_t {
+	registry_t reg;		///< context name and audio uuids. must be the first member.
+
+	int* audio_starts;		///< first entry position of each audio.
+	int* audio_counts;		///< entry count of each audio. the entry i of the audio is the frame i.
+
+	int count;
+	int size;
+	uint32_t* subfprints;
+} binary_ctx_t;
+
+typedef struct _binary_result_t {
+	bool searched;	///< false if the audio was skipped by the deadline
+	bool found;
+	int dist;		///< bit errors of the best alignment
+	int overlap;	///< overlapped frames of the best alignment
+	int offset;		///< reference frame - query frame
+	int match_count;
+} binary_result_t;
+
+typedef struct _binary_search_t {
+	const binary_ctx_t* ctx;
+
+	const uint32_t* query;
+	int query_count;
+	int query_start;	///< frame idx of the query[0]
+	int min_overlap;
+	struct timeval deadline;	///< zero for no deadline
+
+	int parts;
+	binary_result_t* results;	///< result of each audio
+} binary_search_t;
+
+/**
+ * Returns the hamming distance of the given sub-fingerprints.
+ * May return early with the partial distance if it exceeds the limit.
+ */
+typedef int (*binary_hamming_fn)(const uint32_t* a, const uint32_t* b, const int count, const int limit);
+
+static struct ao2_container* g_binary_ctxs = NULL;	///< binary ctxs. key: context name
+static binary_hamming_fn g_hamming = NULL;
+
+static void destroy_binary_ctx(void* obj);
+static binary_ctx_t* get_binary_ctx(const char* name);
+
+static uint32_t* create_subfprints(struct ast_json* j_subfprints, int* count);
+static void search_part(void* data, const int idx);
+static void search_audio(const binary_search_t* search, const int audio_id, binary_result_t* result);
+static int compare_result(const void* a, const void* b, void* arg);
+
+static int hamming_scalar(const uint32_t* a, const uint32_t* b, const int count, const int limit);
+#ifdef BINARY_X86
+static int hamming_popcnt(const uint32_t* a, const uint32_t* b, const int count, const int limit);
+static int hamming_avx2(const uint32_t* a, const uint32_t* b, const int count, const int limit);
+#endif
+
+/**
+ * Initiate the binary engine.
+ * @return
+ */
+bool binary_init(void)
+{
+	const char* hamming;
+
+	g_binary_ctxs = registry_container_create(DEF_BINARY_CTX_BUCKETS);
+	if(g_binary_ctxs == NULL) {
+		ast_log(LOG_ERROR, "Could not create binary ctx container.\n");
+		return false;
+	}
+
+	g_hamming = hamming_scalar;
+	hamming = "scalar";
+#ifdef BINARY_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) {
+		g_hamming = hamming_avx2;
+		hamming = "avx2";
+	}
+	else if(__builtin_cpu_supports("popcnt")) {
+		g_hamming = hamming_popcnt;
+		hamming = "popcnt";
+	}
+#endif
+	ast_log(LOG_VERBOSE, "Initiated binary engine. hamming[%s]\n", hamming);
+
+	return true;
+}
+
+bool binary_term(void)
+{
+	ao2_cleanup(g_binary_ctxs);
+	g_binary_ctxs = NULL;
+
+	return true;
+}
+
+/**
+ * Add the given audio's sub-fingerprints into the context's array.
+ * @param context
+ * @param uuid
+ * @param j_subfprints: [{"frame_idx": <idx>, "bits": <sub-fingerprint>}, ...]
+ * @return
+ */
+bool binary_add_audio(const char* context, const char* uuid, struct ast_json* j_subfprints)
+{
+	int count;
+	int audio_id;
+	uint32_t* subfprints;
+	binary_ctx_t* ctx;
+
+	if((context == NULL) || (uuid == NULL) || (j_subfprints == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	subfprints = create_subfprints(j_subfprints, &count);
+
+	/* get or create the context's segment */
+	ao2_lock(g_binary_ctxs);
+	ctx = ao2_find(g_binary_ctxs, context, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if(ctx == NULL) {
+		ctx = registry_ctx_create(sizeof(binary_ctx_t), destroy_binary_ctx, context);
+		ao2_link_flags(g_binary_ctxs, ctx, OBJ_NOLOCK);
+	}
+	ao2_unlock(g_binary_ctxs);
+
+	ao2_wrlock(ctx);
+
+	audio_id = registry_get_audio_id(&ctx->reg, uuid);
+	if(audio_id >= 0) {
+		ast_log(LOG_NOTICE, "The given audio is already indexed. context[%s], uuid[%s]\n", context, uuid);
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		sfree(subfprints);
+		return true;
+	}
+	audio_id = registry_create_audio_id(&ctx->reg, uuid);
+	if(audio_id == ctx->reg.audio_size - 1) {
+		/* new audio id. grow the per audio arrays */
+		ctx->audio_starts = ast_realloc(ctx->audio_starts, sizeof(int) * ctx->reg.audio_size);
+		ctx->audio_starts[audio_id] = 0;
+		ctx->audio_counts = ast_realloc(ctx->audio_counts, sizeof(int) * ctx->reg.audio_size);
+		ctx->audio_counts[audio_id] = 0;
+	}
+
+	/* append the audio's range */
+	if(ctx->count + count > ctx->size) {
+		ctx->size = MAX(ctx->size * 2, ctx->count + count) + 256;
+		ctx->subfprints = ast_realloc(ctx->subfprints, sizeof(uint32_t) * ctx->size);
+	}
+	if(count > 0) {
+		memcpy(&ctx->subfprints[ctx->count], subfprints, sizeof(uint32_t) * count);
+	}
+	ctx->audio_starts[audio_id] = ctx->count;
+	ctx->audio_counts[audio_id] = count;
+	ctx->count += count;
+
+	ao2_unlock(ctx);
+	ao2_ref(ctx, -1);
+	sfree(subfprints);
+
+	ast_log(LOG_DEBUG, "Added sub-fingerprint info. context[%s], uuid[%s], audio_id[%d], count[%d]\n", context, uuid, audio_id, count);
+
+	return true;
+}
+
+/**
+ * Delete the given audio's sub-fingerprints from the context's array.
+ * @param context
+ * @param uuid
+ * @return
+ */
+bool binary_delete_audio(const char* context, const char* uuid)
+{
+	int i;
+	int start;
+	int count;
+	int audio_id;
+	binary_ctx_t* ctx;
+
+	if((context == NULL) || (uuid == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	ctx = get_binary_ctx(context);
+	if(ctx == NULL) {
+		return false;
+	}
+
+	ao2_wrlock(ctx);
+
+	audio_id = registry_get_audio_id(&ctx->reg, uuid);
+	if(audio_id < 0) {
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		return false;
+	}
+
+	/* close the audio's range */
+	start = ctx->audio_starts[audio_id];
+	count = ctx->audio_counts[audio_id];
+	memmove(&ctx->subfprints[start], &ctx->subfprints[start + count], sizeof(uint32_t) * (ctx->count - start - count));
+	ctx->count -= count;
+	for(i = 0; i < ctx->reg.audio_size; i++) {
+		if((ctx->reg.audios[i] != NULL) && (ctx->audio_starts[i] > start)) {
+			ctx->audio_starts[i] -= count;
+		}
+	}
+
+	/* release the audio id */
+	registry_release_audio_id(&ctx->reg, audio_id);
+	ctx->audio_starts[audio_id] = 0;
+	ctx->audio_counts[audio_id] = 0;
+
+	ao2_unlock(ctx);
+	ao2_ref(ctx, -1);
+
+	ast_log(LOG_DEBUG, "Deleted sub-fingerprint info. context[%s], uuid[%s], audio_id[%d]\n", context, uuid, audio_id);
+
+	return true;
+}
+
+/**
+ * Delete the given context's sub-fingerprints.
+ * @param context
+ * @return
+ */
+bool binary_delete_context(const char* context)
+{
+	binary_ctx_t* ctx;
+
+	if(context == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	/* the segment is released after the running searches are done */
+	ctx = ao2_find(g_binary_ctxs, context, OBJ_SEARCH_KEY | OBJ_UNLINK);
+	if(ctx == NULL) {
+		return false;
+	}
+	ao2_ref(ctx, -1);
+
+	return true;
+}
+
+/**
+ * Search the given sub-fingerprints from the context.
+ * Finds the best alignment of the query block in each audio, and returns the audios
+ * which have the bit error rate less than DEF_BINARY_MAX_BER.
+ * @param context
+ * @param j_subfprints: query sub-fingerprints.
+ * @param max_results: max number of the ranked results.
+ * @param deadline: the audios are not searched after this. zero for no deadline.
+ * @param processed: ratio(0 ~ 1) of the searched reference frames. NULL for ignore.
+ * @return [{"audio_uuid": <uuid>, "match_count": <count>, "offset": <frame offset>, "bit_error_rate": <ber>}, ...] sorted by the rank, NULL if not found.
+ */
+struct ast_json* binary_search(const char* context, struct ast_json* j_subfprints, const int max_results, const struct timeval deadline, double* processed)
+{
+	int i;
+	int count;
+	int searched;
+	int total;
+	int start;
+	int end;
+	int* ranks;
+	uint32_t* query;
+	binary_ctx_t* ctx;
+	binary_search_t search;
+	binary_result_t* result;
+	struct ast_json* j_res;
+	struct ast_json* j_tmp;
+
+	if((context == NULL) || (j_subfprints == NULL) || (max_results < 1)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	/* trim the silence of the both ends */
+	query = create_subfprints(j_subfprints, &count);
+	start = 0;
+	while((start < count) && (query[start] == 0)) {
+		start++;
+	}
+	end = count;
+	while((end > start) && (query[end - 1] == 0)) {
+		end--;
+	}
+	if(end - start < DEF_BINARY_MIN_FRAMES) {
+		ast_log(LOG_NOTICE, "Too few query frames to search. context[%s], frames[%d], min[%d]\n", context, end - start, DEF_BINARY_MIN_FRAMES);
+		sfree(query);
+		return NULL;
+	}
+
+	ctx = get_binary_ctx(context);
+	if(ctx == NULL) {
+		ast_log(LOG_NOTICE, "Could not find sub-fingerprint info. context[%s]\n", context);
+		sfree(query);
+		return NULL;
+	}
+
+	memset(&search, 0x00, sizeof(search));
+	search.query = &query[start];
+	search.query_count = MIN(end - start, DEF_BINARY_BLOCK);
+	search.query_start = start;
+	search.min_overlap = MIN(search.query_count, DEF_BINARY_MIN_OVERLAP);
+	search.deadline = deadline;
+
+	ao2_rdlock(ctx);
+	if(ctx->count == 0) {
+		ast_log(LOG_NOTICE, "Could not find sub-fingerprint info. context[%s]\n", context);
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		sfree(query);
+		return NULL;
+	}
+
+	/* each part searches its own audios. each chunk of the reference is one observation. */
+	search.ctx = ctx;
+	search.results = ast_calloc(ctx->reg.audio_size + 1, sizeof(binary_result_t));
+	search.parts = worker_get_parts(ctx->count / DEF_BINARY_CHUNK);
+	search.parts = MAX(1, MIN(search.parts, ctx->reg.audio_size));
+	worker_run(search_part, &search, search.parts);
+
+	/* rank with the bit error rate */
+	ranks = ast_calloc(ctx->reg.audio_size + 1, sizeof(int));
+	count = 0;
+	searched = 0;
+	total = 0;
+	for(i = 0; i < ctx->reg.audio_size; i++) {
+		if(ctx->reg.audios[i] != NULL) {
+			total += ctx->audio_counts[i];
+		}
+		if(search.results[i].searched == true) {
+			searched += ctx->audio_counts[i];
+		}
+		if(search.results[i].found == true) {
+			ranks[count] = i;
+			count++;
+		}
+	}
+	qsort_r(ranks, count, sizeof(int), compare_result, search.results);
+	if(processed != NULL) {
+		*processed = (searched < total) ? (double)searched / total : 1;
+	}
+
+	j_res = ast_json_array_create();
+	for(i = 0; i < MIN(count, max_results); i++) {
+		result = &search.results[ranks[i]];
+		j_tmp = ast_json_pack("{s:s, s:i, s:i, s:f}",
+				"audio_uuid",		ctx->reg.audios[ranks[i]],
+				"match_count",		result->match_count,
+				"offset",			result->offset,
+				"bit_error_rate",	(double)result->dist / (result->overlap * DEF_BINARY_BITS)
+				);
+		if(j_tmp == NULL) {
+			ast_log(LOG_ERROR, "Could not create search result.\n");
+			continue;
+		}
+		ast_json_array_append(j_res, j_tmp);
+	}
+	ao2_unlock(ctx);
+	ao2_ref(ctx, -1);
+
+	sfree(ranks);
+	sfree(search.results);
+	sfree(query);
+
+	return j_res;
+}
+
+/**
+ * Search the idx'th part of the audios.
+ * Runs on the worker thread for the split search. Must be called with the ctx's read lock.
+ * @param data: binary_search_t
+ * @param idx
+ */
+static void search_part(void* data, const int idx)
+{
+	int i;
+	int start;
+	int end;
+	binary_search_t* search;
+
+	search = data;
+	start = (int)((int64_t)search->ctx->reg.audio_size * idx / search->parts);
+	end = (int)((int64_t)search->ctx->reg.audio_size * (idx + 1) / search->parts);
+	for(i = start; i < end; i++) {
+		if(search->ctx->reg.audios[i] == NULL) {
+			continue;
+		}
+		if((ast_tvzero(search->deadline) == 0) && (ast_tvcmp(ast_tvnow(), search->deadline) >= 0)) {
+			break;
+		}
+		search_audio(search, i, &search->results[i]);
+		search->results[i].searched = true;
+	}
+}
+
+/**
+ * Find the best alignment of the query block in the given audio.
+ * The query frame i is aligned to the reference frame (i + o) for each offset o
+ * which has at least min_overlap overlapped frames.
+ * @param search
+ * @param audio_id
+ * @param result
+ */
+static void search_audio(const binary_search_t* search, const int audio_id, binary_result_t* result)
+{
+	int i;
+	int o;
+	int dist;
+	int limit;
+	int overlap;
+	int query_start;
+	int query_end;
+	int ref_count;
+	const uint32_t* ref;
+
+	ref = &search->ctx->subfprints[search->ctx->audio_starts[audio_id]];
+	ref_count = search->ctx->audio_counts[audio_id];
+	if(ref_count < search->min_overlap) {
+		return;
+	}
+
+	for(o = search->min_overlap - search->query_count; o <= ref_count - search->min_overlap; o++) {
+		query_start = MAX(0, -o);
+		query_end = MIN(search->query_count, ref_count - o);
+		overlap = query_end - query_start;
+
+		/* max bit errors which can beat the best one */
+		limit = (int)(DEF_BINARY_MAX_BER * overlap * DEF_BINARY_BITS);
+		if(result->found == true) {
+			limit = MIN(limit, (int)((int64_t)result->dist * overlap / result->overlap));
+		}
+
+		dist = g_hamming(&search->query[query_start], &ref[query_start + o], overlap, limit);
+		if(dist > limit) {
+			continue;
+		}
+		if((result->found == true) && ((int64_t)dist * result->overlap >= (int64_t)result->dist * overlap)) {
+			continue;
+		}
+
+		result->found = true;
+		result->dist = dist;
+		result->overlap = overlap;
+		result->offset = o - search->query_start;
+	}
+	if(result->found == false) {
+		return;
+	}
+
+	/* matched frames of the best alignment */
+	o = result->offset + search->query_start;
+	query_start = MAX(0, -o);
+	query_end = MIN(search->query_count, ref_count - o);
+	for(i = query_start; i < query_end; i++) {
+		if(__builtin_popcount(search->query[i] ^ ref[i + o]) <= DEF_BINARY_FRAME_BITS) {
+			result->match_count++;
+		}
+	}
+}
+
+/**
+ * Lower bit error rate first. Keeps the audio id order of the same rates.
+ */
+static int compare_result(const void* a, const void* b, void* arg)
+{
+	int64_t diff;
+	const int id_a = *(const int*)a;
+	const int id_b = *(const int*)b;
+	const binary_result_t* results = arg;
+
+	diff = (int64_t)results[id_a].dist * results[id_b].overlap - (int64_t)results[id_b].dist * results[id_a].overlap;
+	if(diff != 0) {
+		return (diff < 0) ? -1 : 1;
+	}
+
+	return id_a - id_b;
+}
+
+/**
+ * Returns the sub-fingerprints of the given info in the frame order.
+ * The entry i is the frame i. The missing frame is 0(silence).
+ * @param j_subfprints
+ * @param count: entry count.
+ * @return Need to free after use.
+ */
+static uint32_t* create_subfprints(struct ast_json* j_subfprints, int* count)
+{
+	int i;
+	int frame_idx;
+	uint32_t* res;
+	struct ast_json* j_tmp;
+
+	*count = 0;
+	for(i = 0; i < ast_json_array_size(j_subfprints); i++) {
+		frame_idx = ast_json_integer_get(ast_json_object_get(ast_json_array_get(j_subfprints, i), "frame_idx"));
+		*count = MAX(*count, frame_idx + 1);
+	}
+
+	res = ast_calloc(*count + 1, sizeof(uint32_t));
+	for(i = 0; i < ast_json_array_size(j_subfprints); i++) {
+		j_tmp = ast_json_array_get(j_subfprints, i);
+		frame_idx = ast_json_integer_get(ast_json_object_get(j_tmp, "frame_idx"));
+		if(frame_idx < 0) {
+			continue;
+		}
+		res[frame_idx] = (uint32_t)ast_json_integer_get(ast_json_object_get(j_tmp, "bits"));
+	}
+
+	return res;
+}
+
+/**
+ * Hamming distance with the early abandon at each chunk.
+ * Inlined into each of the target specific functions.
+ */
+static inline __attribute__((always_inline)) int hamming_range(const uint32_t* a, const uint32_t* b, const int count, const int limit)
+{
+	int i;
+	int j;
+	int end;
+	int dist;
+
+	dist = 0;
+	for(i = 0; i < count; i += DEF_BINARY_CHUNK) {
+		end = MIN(count, i + DEF_BINARY_CHUNK);
+		for(j = i; j < end; j++) {
+			dist += __builtin_popcount(a[j] ^ b[j]);
+		}
+		if(dist > limit) {
+			break;
+		}
+	}
+
+	return dist;
+}
+
+static int hamming_scalar(const uint32_t* a, const uint32_t* b, const int count, const int limit)
+{
+	return hamming_range(a, b, count, limit);
+}
+
+#ifdef BINARY_X86
+__attribute__((target("popcnt")))
+static int hamming_popcnt(const uint32_t* a, const uint32_t* b, const int count, const int limit)
+{
+	return hamming_range(a, b, count, limit);
+}
+
+/**
+ * AVX2 hamming distance. 8 frames of each vector.
+ * The bits of each byte are counted with the nibble lookup table,
+ * and the byte counts of the chunk are summed with the sad.
+ */
+__attribute__((target("avx2,popcnt")))
+static int hamming_avx2(const uint32_t* a, const uint32_t* b, const int count, const int limit)
+{
+	int i;
+	int j;
+	int dist;
+	__m256i lut;
+	__m256i mask;
+	__m256i zero;
+	__m256i x;
+	__m256i acc;
+
+	lut = _mm256_setr_epi8(
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+			);
+	mask = _mm256_set1_epi8(0x0f);
+	zero = _mm256_setzero_si256();
+
+	dist = 0;
+	for(i = 0; i + DEF_BINARY_CHUNK <= count; i += DEF_BINARY_CHUNK) {
+		/* max 32 bits of each byte in the chunk. fits in the byte. */
+		acc = zero;
+		for(j = 0; j < DEF_BINARY_CHUNK; j += 8) {
+			x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)&a[i + j]), _mm256_loadu_si256((const __m256i*)&b[i + j]));
+			acc = _mm256_add_epi8(acc, _mm256_shuffle_epi8(lut, _mm256_and_si256(x, mask)));
+			acc = _mm256_add_epi8(acc, _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), mask)));
+		}
+		acc = _mm256_sad_epu8(acc, zero);
+		dist += _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) + _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3);
+		if(dist > limit) {
+			return dist;
+		}
+	}
+
+	for(; i < count; i++) {
+		dist += __builtin_popcount(a[i] ^ b[i]);
+	}
+
+	return dist;
+}
+#endif
+
+/**
+ * ao2 destructor of the binary ctx.
+ * @param obj
+ */
+static void destroy_binary_ctx(void* obj)
+{
+	binary_ctx_t* ctx;
+
+	ctx = obj;
+
+	sfree(ctx->audio_starts);
+	sfree(ctx->audio_counts);
+
+	sfree(ctx->subfprints);
+	registry_ctx_clear(&ctx->reg);
+}
+
+/**
+ * Returns the binary ctx of the given context name.
+ * The returned ctx is reference counted. Need to unref after use.
+ * @param name
+ * @return
+ */
+static binary_ctx_t* get_binary_ctx(const char* name)
+{
+	return ao2_find(g_binary_ctxs, name, OBJ_SEARCH_KEY);
+}
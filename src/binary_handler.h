@@ -0,0 +1,25 @@
+/*
+ * binary_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_BINARY_HANDLER_H_
+#define SRC_BINARY_HANDLER_H_
+
+#include <asterisk/json.h>
+
+#include <stdbool.h>
+#include <sys/time.h>
+
+bool binary_init(void);
+bool binary_term(void);
+
+bool binary_add_audio(const char* context, const char* uuid, struct ast_json* j_subfprints);
+bool binary_delete_audio(const char* context, const char* uuid);
+bool binary_delete_context(const char* context);
+
+struct ast_json* binary_search(const char* context, struct ast_json* j_subfprints, const int max_results, const struct timeval deadline, double* processed);
+
+#endif /* SRC_BINARY_HANDLER_H_ */
@@ -0,0 +1,496 @@
+/*
+ * cache_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Bounded LRU cache of the search results.
+ *  The key is the context name and the caller made key(the digest of the query).
+ *  The least recently used result is evicted when the cache is full.
+ *  The context's results are invalidated when the context's audios are changed.
+ *  Each context has the generation which is renewed by the invalidation. The caller reads
+ *  the generation before the search, and the result searched before the invalidation is
+ *  dropped at the cache_set.
+ *  The generations are taken from one sequence and never reused, so the deleted context's
+ *  generation can be removed(cache_remove_context). The contexts which have no generation
+ *  share the g_base, which is renewed at the removal.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/json.h>
+#include <asterisk/lock.h>
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "cache_handler.h"
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+#define DEF_CACHE_BUCKETS	1021
+
+typedef struct _cache_entry_t {
+	char* context;
+	char* key;
+	struct ast_json* j_data;
+
+	struct _cache_entry_t* prev;	///< lru list. more recently used one.
+	struct _cache_entry_t* next;	///< lru list. less recently used one.
+	struct _cache_entry_t* hnext;	///< bucket chain
+} cache_entry_t;
+
+typedef struct _cache_generation_t {
+	char* context;
+	unsigned long generation;	///< renewed by the context's invalidation
+
+	struct _cache_generation_t* next;
+} cache_generation_t;
+
+AST_MUTEX_DEFINE_STATIC(g_cache_lock);
+static cache_entry_t* g_buckets[DEF_CACHE_BUCKETS];
+static cache_entry_t* g_head = NULL;	///< most recently used
+static cache_entry_t* g_tail = NULL;	///< least recently used
+static cache_generation_t* g_generations = NULL;	///< generations of the invalidated contexts
+static unsigned long g_sequence = 0;	///< last given generation
+static unsigned long g_base = 0;		///< generation of the contexts which are not in the g_generations
+static int g_size = 0;		///< max entries. 0 disables the cache.
+static int g_count = 0;
+
+static unsigned long g_hits = 0;
+static unsigned long g_misses = 0;
+static unsigned long g_evictions = 0;
+static unsigned long g_invalidations = 0;
+static unsigned long g_stales = 0;
+
+static unsigned int get_bucket(const char* context, const char* key);
+static cache_entry_t* find_entry(const char* context, const char* key);
+static void unlink_lru(cache_entry_t* entry);
+static void link_lru_head(cache_entry_t* entry);
+static void delete_entry(cache_entry_t* entry);
+static cache_generation_t* find_generation(const char* context);
+static unsigned long get_generation(const char* context);
+static int delete_context_entries(const char* context);
+
+/**
+ * Initiate the cache.
+ * @param size: max number of the cached results. 0 disables the cache.
+ * @return
+ */
+bool cache_init(const int size)
+{
+	if(size < 0) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	ast_mutex_lock(&g_cache_lock);
+	memset(g_buckets, 0x00, sizeof(g_buckets));
+	g_head = NULL;
+	g_tail = NULL;
+	g_size = size;
+	g_count = 0;
+	g_sequence = 0;
+	g_base = 0;
+	g_hits = 0;
+	g_misses = 0;
+	g_evictions = 0;
+	g_invalidations = 0;
+	g_stales = 0;
+	ast_mutex_unlock(&g_cache_lock);
+	ast_log(LOG_VERBOSE, "Initiated search result cache. size[%d]\n", size);
+
+	return true;
+}
+
+void cache_term(void)
+{
+	cache_generation_t* generation;
+
+	ast_mutex_lock(&g_cache_lock);
+	while(g_head != NULL) {
+		delete_entry(g_head);
+	}
+	while(g_generations != NULL) {
+		generation = g_generations;
+		g_generations = generation->next;
+		sfree(generation->context);
+		sfree(generation);
+	}
+	g_size = 0;
+	ast_mutex_unlock(&g_cache_lock);
+}
+
+/**
+ * Returns the given context's cache generation.
+ * Must be read before the search, and be given to the cache_set of the search result.
+ * @param context
+ * @return
+ */
+unsigned long cache_get_generation(const char* context)
+{
+	unsigned long res;
+
+	if(context == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return 0;
+	}
+
+	ast_mutex_lock(&g_cache_lock);
+	res = get_generation(context);
+	ast_mutex_unlock(&g_cache_lock);
+
+	return res;
+}
+
+/**
+ * Returns the cached data of the given context and key.
+ * @param context
+ * @param key
+ * @return copy of the cached data. Need to unref after use. NULL if not cached.
+ */
+struct ast_json* cache_get(const char* context, const char* key)
+{
+	cache_entry_t* entry;
+	struct ast_json* j_res;
+
+	if((context == NULL) || (key == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	ast_mutex_lock(&g_cache_lock);
+	if(g_size == 0) {
+		ast_mutex_unlock(&g_cache_lock);
+		return NULL;
+	}
+
+	entry = find_entry(context, key);
+	if(entry == NULL) {
+		g_misses++;
+		ast_mutex_unlock(&g_cache_lock);
+		return NULL;
+	}
+	g_hits++;
+
+	/* move to the most recently used */
+	unlink_lru(entry);
+	link_lru_head(entry);
+
+	j_res = ast_json_deep_copy(entry->j_data);
+	ast_mutex_unlock(&g_cache_lock);
+
+	return j_res;
+}
+
+/**
+ * Cache the given data. Replaces the old one if exists.
+ * Evicts the least recently used one if the cache is full.
+ * The data is dropped if the context has been invalidated after the given generation.
+ * @param context
+ * @param key
+ * @param j_data: copied into the cache.
+ * @param generation: context's generation read before the search(cache_get_generation).
+ * @return false if not cached.
+ */
+bool cache_set(const char* context, const char* key, struct ast_json* j_data, const unsigned long generation)
+{
+	unsigned int idx;
+	unsigned long current;
+	cache_entry_t* entry;
+
+	if((context == NULL) || (key == NULL) || (j_data == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	ast_mutex_lock(&g_cache_lock);
+	if(g_size == 0) {
+		ast_mutex_unlock(&g_cache_lock);
+		return false;
+	}
+
+	/* searched before the invalidation */
+	current = get_generation(context);
+	if(current != generation) {
+		g_stales++;
+		ast_mutex_unlock(&g_cache_lock);
+		ast_log(LOG_DEBUG, "Dropped the stale search result. context[%s], generation[%lu], current[%lu]\n", context, generation, current);
+		return false;
+	}
+
+	entry = find_entry(context, key);
+	if(entry != NULL) {
+		ast_json_unref(entry->j_data);
+		entry->j_data = ast_json_deep_copy(j_data);
+		unlink_lru(entry);
+		link_lru_head(entry);
+		ast_mutex_unlock(&g_cache_lock);
+		return true;
+	}
+
+	if(g_count >= g_size) {
+		delete_entry(g_tail);
+		g_evictions++;
+	}
+
+	entry = ast_calloc(1, sizeof(cache_entry_t));
+	entry->context = ast_strdup(context);
+	entry->key = ast_strdup(key);
+	entry->j_data = ast_json_deep_copy(j_data);
+
+	idx = get_bucket(context, key);
+	entry->hnext = g_buckets[idx];
+	g_buckets[idx] = entry;
+	link_lru_head(entry);
+	g_count++;
+	ast_mutex_unlock(&g_cache_lock);
+
+	return true;
+}
+
+/**
+ * Invalidate all of the given context's cached data, and renew the context's generation.
+ * Must be called after the context's audios are added or removed.
+ * @param context
+ */
+void cache_delete_context(const char* context)
+{
+	int count;
+	cache_generation_t* generation;
+
+	if(context == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return;
+	}
+
+	ast_mutex_lock(&g_cache_lock);
+	generation = find_generation(context);
+	if(generation == NULL) {
+		generation = ast_calloc(1, sizeof(cache_generation_t));
+		generation->context = ast_strdup(context);
+		generation->next = g_generations;
+		g_generations = generation;
+	}
+	g_sequence++;
+	generation->generation = g_sequence;
+
+	count = delete_context_entries(context);
+	ast_mutex_unlock(&g_cache_lock);
+
+	if(count > 0) {
+		ast_log(LOG_DEBUG, "Invalidated cached results. context[%s], count[%d]\n", context, count);
+	}
+}
+
+/**
+ * Remove the deleted context from the cache. The context's cached data and its generation are removed.
+ * The searches of the removed context, and of the other contexts which have no generation,
+ * which have been started before this are dropped at the cache_set.
+ * Must be called after the context has been deleted.
+ * @param context
+ */
+void cache_remove_context(const char* context)
+{
+	int count;
+	cache_generation_t* generation;
+	cache_generation_t* prev;
+
+	if(context == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return;
+	}
+
+	ast_mutex_lock(&g_cache_lock);
+	prev = NULL;
+	for(generation = g_generations; generation != NULL; generation = generation->next) {
+		if(strcmp(generation->context, context) == 0) {
+			break;
+		}
+		prev = generation;
+	}
+	if(generation != NULL) {
+		if(prev == NULL) {
+			g_generations = generation->next;
+		}
+		else {
+			prev->next = generation->next;
+		}
+		sfree(generation->context);
+		sfree(generation);
+	}
+	g_sequence++;
+	g_base = g_sequence;
+
+	count = delete_context_entries(context);
+	ast_mutex_unlock(&g_cache_lock);
+
+	ast_log(LOG_DEBUG, "Removed the context from the cache. context[%s], count[%d]\n", context, count);
+}
+
+/**
+ * Returns the cache statistics.
+ * @return {"size": <max entries>, "count": <entries>, "hits": <count>, "misses": <count>, "evictions": <count>, "invalidations": <count>, "stales": <count>}
+ */
+struct ast_json* cache_get_stats(void)
+{
+	struct ast_json* j_res;
+
+	ast_mutex_lock(&g_cache_lock);
+	j_res = ast_json_pack("{s:i, s:i}",
+			"size",		g_size,
+			"count",	g_count
+			);
+	ast_json_object_set(j_res, "hits", ast_json_integer_create(g_hits));
+	ast_json_object_set(j_res, "misses", ast_json_integer_create(g_misses));
+	ast_json_object_set(j_res, "evictions", ast_json_integer_create(g_evictions));
+	ast_json_object_set(j_res, "invalidations", ast_json_integer_create(g_invalidations));
+	ast_json_object_set(j_res, "stales", ast_json_integer_create(g_stales));
+	ast_mutex_unlock(&g_cache_lock);
+
+	return j_res;
+}
+
+static unsigned int get_bucket(const char* context, const char* key)
+{
+	unsigned int hash;
+
+	hash = (unsigned int)ast_str_hash(context) * 31 + (unsigned int)ast_str_hash(key);
+
+	return hash % DEF_CACHE_BUCKETS;
+}
+
+/**
+ * Must be called with the g_cache_lock.
+ */
+static cache_entry_t* find_entry(const char* context, const char* key)
+{
+	cache_entry_t* entry;
+
+	for(entry = g_buckets[get_bucket(context, key)]; entry != NULL; entry = entry->hnext) {
+		if((strcmp(entry->key, key) == 0) && (strcmp(entry->context, context) == 0)) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Must be called with the g_cache_lock.
+ * The contexts are few, so the list is enough.
+ */
+static cache_generation_t* find_generation(const char* context)
+{
+	cache_generation_t* generation;
+
+	for(generation = g_generations; generation != NULL; generation = generation->next) {
+		if(strcmp(generation->context, context) == 0) {
+			return generation;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Returns the current generation of the given context.
+ * Must be called with the g_cache_lock.
+ */
+static unsigned long get_generation(const char* context)
+{
+	cache_generation_t* generation;
+
+	generation = find_generation(context);
+	if(generation == NULL) {
+		return g_base;
+	}
+
+	return generation->generation;
+}
+
+/**
+ * Delete the given context's cached data.
+ * Must be called with the g_cache_lock.
+ * @return deleted count
+ */
+static int delete_context_entries(const char* context)
+{
+	int count;
+	cache_entry_t* entry;
+	cache_entry_t* next;
+
+	count = 0;
+	for(entry = g_head; entry != NULL; entry = next) {
+		next = entry->next;
+		if(strcmp(entry->context, context) != 0) {
+			continue;
+		}
+
+		delete_entry(entry);
+		count++;
+	}
+	g_invalidations += count;
+
+	return count;
+}
+
+static void unlink_lru(cache_entry_t* entry)
+{
+	if(entry->prev != NULL) {
+		entry->prev->next = entry->next;
+	}
+	else {
+		g_head = entry->next;
+	}
+
+	if(entry->next != NULL) {
+		entry->next->prev = entry->prev;
+	}
+	else {
+		g_tail = entry->prev;
+	}
+
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+static void link_lru_head(cache_entry_t* entry)
+{
+	entry->prev = NULL;
+	entry->next = g_head;
+	if(g_head != NULL) {
+		g_head->prev = entry;
+	}
+	g_head = entry;
+
+	if(g_tail == NULL) {
+		g_tail = entry;
+	}
+}
+
+/**
+ * Remove the entry from the bucket and the lru list, and free it.
+ * Must be called with the g_cache_lock.
+ */
+static void delete_entry(cache_entry_t* entry)
+{
+	cache_entry_t** tmp;
+
+	for(tmp = &g_buckets[get_bucket(entry->context, entry->key)]; *tmp != NULL; tmp = &(*tmp)->hnext) {
+		if(*tmp == entry) {
+			*tmp = entry->hnext;
+			break;
+		}
+	}
+	unlink_lru(entry);
+	g_count--;
+
+	ast_json_unref(entry->j_data);
+	sfree(entry->context);
+	sfree(entry->key);
+	sfree(entry);
+}
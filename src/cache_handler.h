@@ -0,0 +1,26 @@
+/*
+ * cache_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_CACHE_HANDLER_H_
+#define SRC_CACHE_HANDLER_H_
+
+#include <asterisk/json.h>
+
+#include <stdbool.h>
+
+bool cache_init(const int size);
+void cache_term(void);
+
+unsigned long cache_get_generation(const char* context);
+struct ast_json* cache_get(const char* context, const char* key);
+bool cache_set(const char* context, const char* key, struct ast_json* j_data, const unsigned long generation);
+void cache_delete_context(const char* context);
+void cache_remove_context(const char* context);
+
+struct ast_json* cache_get_stats(void);
+
+#endif /* SRC_CACHE_HANDLER_H_ */
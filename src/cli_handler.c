@@ -15,6 +15,8 @@
 
 #include "cli_handler.h"
 #include "fp_handler.h"
+#include "cache_handler.h"
+#include "index_handler.h"
 
 static char* tiresias_show_contexts(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a);
 static char* tiresias_remove_context(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a);
@@ -22,12 +24,18 @@ static char* tiresias_remove_context(struct ast_cli_entry *e, int cmd, struct as
 static char* tiresias_show_audios(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a);
 static char* tiresias_remove_audio(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a);
 
+static char* tiresias_show_cache(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a);
+static char* tiresias_show_index(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a);
+static char* tiresias_show_engines(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a);
 
 struct ast_cli_entry cli_tiresias[] = {
 		AST_CLI_DEFINE(tiresias_show_contexts, "List all registered tiresias contexts"),
 		AST_CLI_DEFINE(tiresias_remove_context, "Remove tiresias context info"),
 		AST_CLI_DEFINE(tiresias_show_audios, "Show tiresias context detail info"),
 		AST_CLI_DEFINE(tiresias_remove_audio, "Remove tiresias audio info"),
+		AST_CLI_DEFINE(tiresias_show_cache, "Show tiresias search result cache statistics"),
+		AST_CLI_DEFINE(tiresias_show_index, "Show tiresias index search statistics"),
+		AST_CLI_DEFINE(tiresias_show_engines, "Show tiresias search engine of each context"),
 };
 
 bool cli_init(void)
@@ -224,3 +232,147 @@ static char* tiresias_remove_context(struct ast_cli_entry *e, int cmd, struct as
 
 	return CLI_SUCCESS;
 }
+
+/**
+ * Shows the search result cache statistics
+ * @param e
+ * @param cmd
+ * @param a
+ * @return
+ */
+static char* tiresias_show_cache(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct ast_json* j_tmp;
+
+	if(cmd == CLI_INIT) {
+		e->command = "tiresias show cache";
+		e->usage =
+			"Usage: tiresias show cache\n"
+			"	   Shows the search result cache statistics.\n";
+		return NULL;
+	}
+	else if(cmd == CLI_GENERATE) {
+		return NULL;
+	}
+
+	j_tmp = cache_get_stats();
+	if(j_tmp == NULL) {
+		ast_log(LOG_WARNING, "Could not get cache stats.\n");
+		return CLI_FAILURE;
+	}
+
+	ast_cli(a->fd, "%-15.15s %-15.15s %-15.15s %-15.15s %-15.15s %-15.15s %-15.15s\n", "Size", "Count", "Hits", "Misses", "Evictions", "Invalidations", "Stales");
+	ast_cli(a->fd, "%-15d %-15d %-15ld %-15ld %-15ld %-15ld %-15ld\n",
+			(int)ast_json_integer_get(ast_json_object_get(j_tmp, "size")),
+			(int)ast_json_integer_get(ast_json_object_get(j_tmp, "count")),
+			(long)ast_json_integer_get(ast_json_object_get(j_tmp, "hits")),
+			(long)ast_json_integer_get(ast_json_object_get(j_tmp, "misses")),
+			(long)ast_json_integer_get(ast_json_object_get(j_tmp, "evictions")),
+			(long)ast_json_integer_get(ast_json_object_get(j_tmp, "invalidations")),
+			(long)ast_json_integer_get(ast_json_object_get(j_tmp, "stales"))
+			);
+	ast_json_unref(j_tmp);
+
+	return CLI_SUCCESS;
+}
+
+/**
+ * Shows the index search statistics of each context
+ * @param e
+ * @param cmd
+ * @param a
+ * @return
+ */
+static char* tiresias_show_index(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	int idx;
+	struct ast_json* j_stats;
+	struct ast_json* j_tmp;
+
+	if(cmd == CLI_INIT) {
+		e->command = "tiresias show index";
+		e->usage =
+			"Usage: tiresias show index\n"
+			"	   Shows the index search statistics of each context.\n";
+		return NULL;
+	}
+	else if(cmd == CLI_GENERATE) {
+		return NULL;
+	}
+
+	j_stats = index_get_stats();
+	if(j_stats == NULL) {
+		ast_log(LOG_WARNING, "Could not get index stats.\n");
+		return CLI_FAILURE;
+	}
+
+	ast_cli(a->fd, "%-20.20s %-12.12s %-12.12s %-12.12s %-12.12s %-15.15s %-12.12s\n", "Context", "Entries", "Searches", "Frames", "Narrowed", "Candidates", "Tolerance");
+	for(idx = 0; idx < ast_json_array_size(j_stats); idx++) {
+		j_tmp = ast_json_array_get(j_stats, idx);
+		if(j_tmp == NULL) {
+			continue;
+		}
+
+		ast_cli(a->fd, "%-20.20s %-12d %-12ld %-12ld %-12ld %-15ld %-12f\n",
+				ast_json_string_get(ast_json_object_get(j_tmp, "context")),
+				(int)ast_json_integer_get(ast_json_object_get(j_tmp, "entries")),
+				(long)ast_json_integer_get(ast_json_object_get(j_tmp, "searches")),
+				(long)ast_json_integer_get(ast_json_object_get(j_tmp, "frames")),
+				(long)ast_json_integer_get(ast_json_object_get(j_tmp, "narrowed")),
+				(long)ast_json_integer_get(ast_json_object_get(j_tmp, "candidates")),
+				ast_json_real_get(ast_json_object_get(j_tmp, "tolerance"))
+				);
+	}
+	ast_json_unref(j_stats);
+
+	return CLI_SUCCESS;
+}
+
+/**
+ * Shows the search engine of each context
+ * @param e
+ * @param cmd
+ * @param a
+ * @return
+ */
+static char* tiresias_show_engines(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	int idx;
+	struct ast_json* j_engines;
+	struct ast_json* j_tmp;
+
+	if(cmd == CLI_INIT) {
+		e->command = "tiresias show engines";
+		e->usage =
+			"Usage: tiresias show engines\n"
+			"	   Shows the configured and the running search engine of each context.\n";
+		return NULL;
+	}
+	else if(cmd == CLI_GENERATE) {
+		return NULL;
+	}
+
+	j_engines = fp_get_context_engines();
+	if(j_engines == NULL) {
+		ast_log(LOG_WARNING, "Could not get context engine info.\n");
+		return CLI_FAILURE;
+	}
+
+	ast_cli(a->fd, "%-36.36s %-12.12s %-12.12s %-15.15s\n", "Context", "Config", "Engine", "Stored");
+	for(idx = 0; idx < ast_json_array_size(j_engines); idx++) {
+		j_tmp = ast_json_array_get(j_engines, idx);
+		if(j_tmp == NULL) {
+			continue;
+		}
+
+		ast_cli(a->fd, "%-36.36s %-12.12s %-12.12s %-15.15s\n",
+				ast_json_string_get(ast_json_object_get(j_tmp, "context")),
+				ast_json_string_get(ast_json_object_get(j_tmp, "config")),
+				ast_json_string_get(ast_json_object_get(j_tmp, "engine")),
+				ast_json_string_get(ast_json_object_get(j_tmp, "stored"))
+				);
+	}
+	ast_json_unref(j_engines);
+
+	return CLI_SUCCESS;
+}
@@ -25,6 +25,21 @@ typedef struct {
   int sleep_ms;   /* Time to sleep before retry again. */
 } busy_handler_attr;
 
+/**
+ * Named prepared statement.
+ * The statement is prepared once and reused.
+ * Locked from the db_ctx_stmt_get() to the db_ctx_stmt_release().
+ */
+struct _db_stmt_t {
+	char* name;
+	struct sqlite3* db;
+	struct sqlite3_stmt* stmt;
+
+	ast_mutex_t lock;
+
+	struct _db_stmt_t* next;
+};
+
 
 static bool db_ctx_connect(db_ctx_t* ctx, const char* filename);
 static db_ctx_t* db_ctx_create(void);
@@ -34,6 +49,9 @@ static bool db_ctx_insert_basic(db_ctx_t* ctx, const char* table, const struct a
 static int process_ddl_row(void* pData, int nColumns, char** values, char** columns);
 static int process_dml_row(void *pData, int nColumns, char **values, char **columns);
 
+static struct ast_json* create_record(sqlite3* db, sqlite3_stmt* stmt);
+static void destroy_stmts(db_ctx_t* ctx);
+
 
 static db_ctx_t* db_ctx_create(void)
 {
@@ -46,6 +64,9 @@ static db_ctx_t* db_ctx_create(void)
 	}
 	ctx->db = NULL;
 	ctx->stmt = NULL;
+	ctx->stmts = NULL;
+	ast_mutex_init(&ctx->stmts_lock);
+	ast_mutex_init(&ctx->trans_lock);
 
 	return ctx;
 }
@@ -165,6 +186,8 @@ db_ctx_t* db_ctx_init(const char* name)
   // connect db
   ret = db_ctx_connect(db_ctx, name);
   if(ret == false) {
+    ast_mutex_destroy(&db_ctx->stmts_lock);
+    ast_mutex_destroy(&db_ctx->trans_lock);
     sfree(db_ctx);
     return NULL;
   }
@@ -184,6 +207,7 @@ void db_ctx_term(db_ctx_t* ctx)
     return;
   }
   db_ctx_free(ctx);
+  destroy_stmts(ctx);
 
   ret = sqlite3_close(ctx->db);
   if(ret != SQLITE_OK) {
@@ -194,6 +218,8 @@ void db_ctx_term(db_ctx_t* ctx)
   ast_log(LOG_DEBUG, "Released database context.\n");
   ctx->db = NULL;
 
+  ast_mutex_destroy(&ctx->stmts_lock);
+  ast_mutex_destroy(&ctx->trans_lock);
   sfree(ctx);
 }
 
@@ -258,6 +284,70 @@ bool db_ctx_exec(db_ctx_t* ctx, const char* query)
   return true;
 }
 
+/**
+ * Begin the transaction.
+ * The other transactions wait until this is committed or rolled back.
+ * The statements of the other threads without the transaction are run in this transaction.
+ * @param ctx
+ * @return
+ */
+bool db_ctx_begin(db_ctx_t* ctx)
+{
+	int ret;
+
+	if(ctx == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	ast_mutex_lock(&ctx->trans_lock);
+	ret = db_ctx_exec(ctx, "begin;");
+	if(ret == false) {
+		ast_mutex_unlock(&ctx->trans_lock);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Commit the transaction. Rolled back if the commit fails.
+ * @param ctx
+ * @return
+ */
+bool db_ctx_commit(db_ctx_t* ctx)
+{
+	int ret;
+
+	if(ctx == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	ret = db_ctx_exec(ctx, "commit;");
+	if(ret == false) {
+		db_ctx_exec(ctx, "rollback;");
+	}
+	ast_mutex_unlock(&ctx->trans_lock);
+
+	return ret;
+}
+
+/**
+ * Roll back the transaction.
+ * @param ctx
+ */
+void db_ctx_rollback(db_ctx_t* ctx)
+{
+	if(ctx == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return;
+	}
+
+	db_ctx_exec(ctx, "rollback;");
+	ast_mutex_unlock(&ctx->trans_lock);
+}
+
 /**
  * Return 1 record info by json.
  * If there's no more record or error happened, it will return NULL.
@@ -265,6 +355,23 @@ bool db_ctx_exec(db_ctx_t* ctx, const char* query)
  * @return  success:json_t*, fail:NULL
  */
 struct ast_json* db_ctx_get_record(db_ctx_t* ctx)
+{
+	if(ctx == NULL) {
+	ast_log(LOG_WARNING, "Wrong input parameter.\n");
+	return NULL;
+	}
+
+	return create_record(ctx->db, ctx->stmt);
+}
+
+/**
+ * Step the given stmt and return the record by json.
+ * If there's no more record or error happened, it will return NULL.
+ * @param db
+ * @param stmt
+ * @return
+ */
+static struct ast_json* create_record(sqlite3* db, sqlite3_stmt* stmt)
 {
 	int ret;
 	int cols;
@@ -274,32 +381,27 @@ struct ast_json* db_ctx_get_record(db_ctx_t* ctx)
 	int type;
 	const char* tmp_const;
 
-	if(ctx == NULL) {
-	ast_log(LOG_WARNING, "Wrong input parameter.\n");
-	return NULL;
-	}
-
-	ret = sqlite3_step(ctx->stmt);
+	ret = sqlite3_step(stmt);
 	if(ret != SQLITE_ROW) {
 		if(ret != SQLITE_DONE) {
-			ast_log(LOG_ERROR, "Could not patch the result. ret[%d], err[%s]\n", ret, sqlite3_errmsg(ctx->db));
+			ast_log(LOG_ERROR, "Could not patch the result. ret[%d], err[%s]\n", ret, sqlite3_errmsg(db));
 		}
 		return NULL;
 	}
 
-	cols = sqlite3_column_count(ctx->stmt);
+	cols = sqlite3_column_count(stmt);
 	j_res = ast_json_object_create();
 	for(i = 0; i < cols; i++) {
 		j_tmp = NULL;
-		type = sqlite3_column_type(ctx->stmt, i);
+		type = sqlite3_column_type(stmt, i);
 		switch(type) {
 			case SQLITE_INTEGER: {
-				j_tmp = ast_json_integer_create(sqlite3_column_int(ctx->stmt, i));
+				j_tmp = ast_json_integer_create(sqlite3_column_int(stmt, i));
 			}
 			break;
 
 			case SQLITE_FLOAT: {
-				j_tmp = ast_json_real_create(sqlite3_column_double(ctx->stmt, i));
+				j_tmp = ast_json_real_create(sqlite3_column_double(stmt, i));
 			}
 			break;
 
@@ -310,14 +412,14 @@ struct ast_json* db_ctx_get_record(db_ctx_t* ctx)
 
 			case SQLITE3_TEXT: {
 				// if the text is loadable, create json object.
-				tmp_const = (const char*)sqlite3_column_text(ctx->stmt, i);
+				tmp_const = (const char*)sqlite3_column_text(stmt, i);
 				if(tmp_const == NULL) {
 					j_tmp = ast_json_null();
 				}
 				else {
 					j_tmp = ast_json_load_string(tmp_const, NULL);
 					if(j_tmp == NULL) {
-						j_tmp = ast_json_string_create((const char*)sqlite3_column_text(ctx->stmt, i));
+						j_tmp = ast_json_string_create((const char*)sqlite3_column_text(stmt, i));
 					}
 					else {
 						// check type
@@ -328,7 +430,7 @@ struct ast_json* db_ctx_get_record(db_ctx_t* ctx)
 						ret = ast_json_typeof(j_tmp);
 						if((ret != AST_JSON_ARRAY) && (ret != AST_JSON_OBJECT) && (ret != AST_JSON_STRING)) {
 							ast_json_unref(j_tmp);
-							j_tmp = ast_json_string_create((const char*)sqlite3_column_text(ctx->stmt, i));
+							j_tmp = ast_json_string_create((const char*)sqlite3_column_text(stmt, i));
 						}
 					}
 				}
@@ -347,10 +449,10 @@ struct ast_json* db_ctx_get_record(db_ctx_t* ctx)
 
 		if(j_tmp == NULL) {
 		ast_log(LOG_ERROR, "Could not parse result column. name[%s], type[%d]\n",
-		sqlite3_column_name(ctx->stmt, i), type);
+		sqlite3_column_name(stmt, i), type);
 		j_tmp = ast_json_null();
 		}
-		ast_json_object_set(j_res, sqlite3_column_name(ctx->stmt, i), j_tmp);
+		ast_json_object_set(j_res, sqlite3_column_name(stmt, i), j_tmp);
 	}
 
 	return j_res;
@@ -840,3 +942,219 @@ static int process_dml_row(void *pData, int nColumns, char **values, char **colu
 	return 0;
 }
 
+/**
+ * Returns the named prepared statement. Prepares and caches it at the first call.
+ * The returned stmt is locked. Must be released with db_ctx_stmt_release().
+ * @param ctx
+ * @param name: statement name. The same name must be used with the same query.
+ * @param query: sql with the parameters(?).
+ * @return
+ */
+db_stmt_t* db_ctx_stmt_get(db_ctx_t* ctx, const char* name, const char* query)
+{
+	int ret;
+	db_stmt_t* stmt;
+
+	if((ctx == NULL) || (ctx->db == NULL) || (name == NULL) || (query == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	ast_mutex_lock(&ctx->stmts_lock);
+	for(stmt = ctx->stmts; stmt != NULL; stmt = stmt->next) {
+		if(strcmp(stmt->name, name) == 0) {
+			break;
+		}
+	}
+
+	if(stmt == NULL) {
+		stmt = ast_calloc(1, sizeof(db_stmt_t));
+		if(stmt == NULL) {
+			ast_log(LOG_ERROR, "Could not allocate statement. name[%s]\n", name);
+			ast_mutex_unlock(&ctx->stmts_lock);
+			return NULL;
+		}
+		ret = sqlite3_prepare_v2(ctx->db, query, -1, &stmt->stmt, NULL);
+		if(ret != SQLITE_OK) {
+			ast_log(LOG_ERROR, "Could not prepare statement. name[%s], query[%s], err[%s]\n", name, query, sqlite3_errmsg(ctx->db));
+			ast_mutex_unlock(&ctx->stmts_lock);
+			sfree(stmt);
+			return NULL;
+		}
+		stmt->name = ast_strdup(name);
+		stmt->db = ctx->db;
+		ast_mutex_init(&stmt->lock);
+
+		stmt->next = ctx->stmts;
+		ctx->stmts = stmt;
+		ast_log(LOG_DEBUG, "Prepared statement. name[%s], query[%s]\n", name, query);
+	}
+	ast_mutex_unlock(&ctx->stmts_lock);
+
+	ast_mutex_lock(&stmt->lock);
+
+	return stmt;
+}
+
+/**
+ * Reset the statement for the next use. The statement is kept locked.
+ * Used to run the same statement several times with the different parameters.
+ * @param stmt
+ */
+void db_ctx_stmt_reset(db_stmt_t* stmt)
+{
+	if(stmt == NULL) {
+		return;
+	}
+
+	sqlite3_reset(stmt->stmt);
+	sqlite3_clear_bindings(stmt->stmt);
+}
+
+/**
+ * Reset the statement for the next use and unlock it.
+ * @param stmt
+ */
+void db_ctx_stmt_release(db_stmt_t* stmt)
+{
+	if(stmt == NULL) {
+		return;
+	}
+
+	db_ctx_stmt_reset(stmt);
+
+	ast_mutex_unlock(&stmt->lock);
+}
+
+/**
+ * Bind the text value. The idx starts from 1.
+ */
+bool db_ctx_stmt_bind_text(db_stmt_t* stmt, const int idx, const char* value)
+{
+	int ret;
+
+	if(stmt == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	if(value == NULL) {
+		ret = sqlite3_bind_null(stmt->stmt, idx);
+	}
+	else {
+		ret = sqlite3_bind_text(stmt->stmt, idx, value, -1, SQLITE_TRANSIENT);
+	}
+	if(ret != SQLITE_OK) {
+		ast_log(LOG_ERROR, "Could not bind the value. name[%s], idx[%d], err[%s]\n", stmt->name, idx, sqlite3_errmsg(stmt->db));
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Bind the integer value. The idx starts from 1.
+ */
+bool db_ctx_stmt_bind_int(db_stmt_t* stmt, const int idx, const int value)
+{
+	int ret;
+
+	if(stmt == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	ret = sqlite3_bind_int(stmt->stmt, idx, value);
+	if(ret != SQLITE_OK) {
+		ast_log(LOG_ERROR, "Could not bind the value. name[%s], idx[%d], err[%s]\n", stmt->name, idx, sqlite3_errmsg(stmt->db));
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Bind the real value. The idx starts from 1.
+ */
+bool db_ctx_stmt_bind_double(db_stmt_t* stmt, const int idx, const double value)
+{
+	int ret;
+
+	if(stmt == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	ret = sqlite3_bind_double(stmt->stmt, idx, value);
+	if(ret != SQLITE_OK) {
+		ast_log(LOG_ERROR, "Could not bind the value. name[%s], idx[%d], err[%s]\n", stmt->name, idx, sqlite3_errmsg(stmt->db));
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Execute the statement. (update, delete, insert)
+ * The statement is reset, so it can be executed again with the new bindings.
+ * @param stmt
+ * @return
+ */
+bool db_ctx_stmt_step(db_stmt_t* stmt)
+{
+	int ret;
+
+	if(stmt == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	ret = sqlite3_step(stmt->stmt);
+	sqlite3_reset(stmt->stmt);
+	if(ret != SQLITE_DONE) {
+		ast_log(LOG_ERROR, "Could not execute statement. name[%s], ret[%d], err[%s]\n", stmt->name, ret, sqlite3_errmsg(stmt->db));
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Return 1 record of the statement by json.
+ * If there's no more record or error happened, it will return NULL.
+ * @param stmt
+ * @return
+ */
+struct ast_json* db_ctx_stmt_get_record(db_stmt_t* stmt)
+{
+	if(stmt == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	return create_record(stmt->db, stmt->stmt);
+}
+
+/**
+ * Finalize all of cached statements.
+ * @param ctx
+ */
+static void destroy_stmts(db_ctx_t* ctx)
+{
+	db_stmt_t* stmt;
+
+	ast_mutex_lock(&ctx->stmts_lock);
+	while(1) {
+		stmt = ctx->stmts;
+		if(stmt == NULL) {
+			break;
+		}
+		ctx->stmts = stmt->next;
+
+		sqlite3_finalize(stmt->stmt);
+		ast_mutex_destroy(&stmt->lock);
+		sfree(stmt->name);
+		sfree(stmt);
+	}
+	ast_mutex_unlock(&ctx->stmts_lock);
+}
@@ -9,21 +9,33 @@
 #define DB_CTX_HANDLER_H_
 
 #include <asterisk/json.h>
+#include <asterisk/lock.h>
 
 #include <sqlite3.h>
 #include <stdbool.h>
 
+typedef struct _db_stmt_t db_stmt_t;
+
 typedef struct _db_ctx_t
 {
   struct sqlite3* db;
 
   struct sqlite3_stmt* stmt;
+
+  /* prepared statement cache */
+  ast_mutex_t stmts_lock;
+  db_stmt_t* stmts;
+
+  ast_mutex_t trans_lock;   ///< one transaction at a time
 } db_ctx_t;
 
 db_ctx_t* db_ctx_init(const char* name);
 void db_ctx_term(db_ctx_t* ctx);
 
 bool db_ctx_exec(db_ctx_t* ctx, const char* query);
+bool db_ctx_begin(db_ctx_t* ctx);
+bool db_ctx_commit(db_ctx_t* ctx);
+void db_ctx_rollback(db_ctx_t* ctx);
 bool db_ctx_query(db_ctx_t* ctx, const char* query);
 struct ast_json* db_ctx_get_record(db_ctx_t* ctx);
 
@@ -41,6 +53,15 @@ bool db_ctx_load_db_data(db_ctx_t* ctx, const char* filename);
 
 bool db_ctx_free(db_ctx_t* ctx);
 
+db_stmt_t* db_ctx_stmt_get(db_ctx_t* ctx, const char* name, const char* query);
+void db_ctx_stmt_reset(db_stmt_t* stmt);
+void db_ctx_stmt_release(db_stmt_t* stmt);
+bool db_ctx_stmt_bind_text(db_stmt_t* stmt, const int idx, const char* value);
+bool db_ctx_stmt_bind_int(db_stmt_t* stmt, const int idx, const int value);
+bool db_ctx_stmt_bind_double(db_stmt_t* stmt, const int idx, const double value);
+bool db_ctx_stmt_step(db_stmt_t* stmt);
+struct ast_json* db_ctx_stmt_get_record(db_stmt_t* stmt);
+
 
 
 
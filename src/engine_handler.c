@@ -0,0 +1,214 @@
+/*
+ * engine_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Registry of the search engine backends.
+ *  The backends are registered at the module load, and each context picks
+ *  its backend by name(engine option of the context).
+ *
+ *  The engine=auto context is planned with its stored audios and frames.
+ *  The small context is scanned, the medium and the large context is indexed,
+ *  and the large context of the long audios is indexed with the coarse frames(cascade).
+ *  The planned engines share the same stored fingerprint info, so the plan can be
+ *  changed at the next module load without re-fingerprinting.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/json.h>
+
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+
+#include "engine_handler.h"
+
+#define DEF_ENGINE_MAX					16
+
+#define DEF_PLAN_SCAN_FRAMES			262144		// max frames of the scanned context
+#define DEF_PLAN_INDEX_FRAMES			8388608		// max frames of the fine frames indexed context
+#define DEF_PLAN_CASCADE_AUDIO_FRAMES	1024		// min mean frames of the audio for the cascade
+
+/* registered at the module load only. read without the lock. */
+static const engine_t* g_engines[DEF_ENGINE_MAX];
+static int g_engine_count = 0;
+
+bool engine_init(void)
+{
+	memset(g_engines, 0x00, sizeof(g_engines));
+	g_engine_count = 0;
+
+	return true;
+}
+
+/**
+ * Terminate the registered engines.
+ * The engines which share the same backend module have only one term.
+ */
+void engine_term(void)
+{
+	int i;
+
+	for(i = 0; i < g_engine_count; i++) {
+		if(g_engines[i]->term == NULL) {
+			continue;
+		}
+		g_engines[i]->term();
+	}
+
+	memset(g_engines, 0x00, sizeof(g_engines));
+	g_engine_count = 0;
+}
+
+/**
+ * Register the search engine backend.
+ * @param engine: Must be alive until the engine_term().
+ * @return
+ */
+bool engine_register(const engine_t* engine)
+{
+	if((engine == NULL) || (engine->name == NULL) || (engine->add_audio == NULL) || (engine->search == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	if(engine_get(engine->name) != NULL) {
+		ast_log(LOG_WARNING, "The engine has been registered already. name[%s]\n", engine->name);
+		return false;
+	}
+
+	if(g_engine_count >= DEF_ENGINE_MAX) {
+		ast_log(LOG_ERROR, "Too many engines. name[%s], max[%d]\n", engine->name, DEF_ENGINE_MAX);
+		return false;
+	}
+
+	g_engines[g_engine_count] = engine;
+	g_engine_count++;
+	ast_log(LOG_DEBUG, "Registered engine. name[%s]\n", engine->name);
+
+	return true;
+}
+
+/**
+ * Returns the registered engine of the given name.
+ * @param name
+ * @return NULL if not registered.
+ */
+const engine_t* engine_get(const char* name)
+{
+	int i;
+
+	if(name == NULL) {
+		return NULL;
+	}
+
+	for(i = 0; i < g_engine_count; i++) {
+		if(strcasecmp(g_engines[i]->name, name) == 0) {
+			return g_engines[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Returns the registered engine names.
+ * @return ["index", ...]
+ */
+struct ast_json* engine_get_names(void)
+{
+	int i;
+	struct ast_json* j_res;
+
+	j_res = ast_json_array_create();
+	for(i = 0; i < g_engine_count; i++) {
+		ast_json_array_append(j_res, ast_json_string_create(g_engines[i]->name));
+	}
+
+	return j_res;
+}
+
+/**
+ * Delete the audio from the all registered engines.
+ * @param context
+ * @param uuid
+ * @return
+ */
+bool engine_delete_audio(const char* context, const char* uuid)
+{
+	int i;
+
+	if((context == NULL) || (uuid == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	for(i = 0; i < g_engine_count; i++) {
+		if(g_engines[i]->delete_audio == NULL) {
+			continue;
+		}
+		g_engines[i]->delete_audio(context, uuid);
+	}
+
+	return true;
+}
+
+/**
+ * Delete the context from the all registered engines.
+ * @param context
+ * @return
+ */
+bool engine_delete_context(const char* context)
+{
+	int i;
+
+	if(context == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	for(i = 0; i < g_engine_count; i++) {
+		if(g_engines[i]->delete_context == NULL) {
+			continue;
+		}
+		g_engines[i]->delete_context(context);
+	}
+
+	return true;
+}
+
+/**
+ * Plan the engine of the engine=auto context.
+ * @param audios: number of the context's audios.
+ * @param frames: number of the context's stored fingerprint frames.
+ * @return
+ */
+const engine_t* engine_plan(const int audios, const int frames)
+{
+	const char* name;
+	const engine_t* engine;
+
+	if(frames <= DEF_PLAN_SCAN_FRAMES) {
+		// the column scan is faster than the index lookups
+		name = DEF_ENGINE_SCAN;
+	}
+	else if((frames <= DEF_PLAN_INDEX_FRAMES) || (audios <= 0) || (frames / audios < DEF_PLAN_CASCADE_AUDIO_FRAMES)) {
+		// the short audios have too few coarse frames to be found
+		name = DEF_ENGINE_INDEX;
+	}
+	else {
+		name = DEF_ENGINE_CASCADE;
+	}
+
+	engine = engine_get(name);
+	if(engine == NULL) {
+		engine = engine_get(DEF_ENGINE_INDEX);
+	}
+
+	return engine;
+}
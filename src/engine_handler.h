@@ -0,0 +1,118 @@
+/*
+ * engine_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_ENGINE_HANDLER_H_
+#define SRC_ENGINE_HANDLER_H_
+
+#include <asterisk/json.h>
+
+#include <stdbool.h>
+#include <sys/time.h>
+
+#define DEF_ENGINE_AUTO				"auto"
+#define DEF_ENGINE_INDEX			"index"
+#define DEF_ENGINE_LANDMARK			"landmark"
+#define DEF_ENGINE_SCAN				"scan"
+#define DEF_ENGINE_IVFPQ			"ivfpq"
+#define DEF_ENGINE_NGRAM			"ngram"
+#define DEF_ENGINE_BINARY			"binary"
+#define DEF_ENGINE_CASCADE			"cascade"
+#define DEF_ENGINE_SQL				"sql"
+
+/**
+ * Stored fingerprint info of the engine.
+ */
+typedef enum _engine_data_t {
+	ENGINE_DATA_FINGERPRINT = 0,	///< mfcc max1 ~ maxN of each frame. audio_fingerprint
+	ENGINE_DATA_LANDMARK,			///< spectral peak pair hashes. audio_landmark
+	ENGINE_DATA_VECTOR,				///< full mfcc vector of each frame. audio_vector
+	ENGINE_DATA_SUBFINGERPRINT,		///< binary sub-fingerprint of each frame. audio_subfingerprint
+} engine_data_t;
+
+/**
+ * Frame alignment verification of the engine's candidates.
+ */
+typedef enum _engine_verify_t {
+	ENGINE_VERIFY_NONE = 0,		///< not verified
+	ENGINE_VERIFY_OPTION,		///< verified if the verify_candidates is not 0
+	ENGINE_VERIFY_FORCE,		///< always verified
+} engine_verify_t;
+
+/**
+ * Search options.
+ */
+typedef struct _engine_query_t {
+	int coefs;
+	double tolerance;
+	int freq_ignore_low;
+	int freq_ignore_high;
+	int max_results;			///< max number of the ranked candidates
+	struct timeval deadline;	///< zero for no deadline
+} engine_query_t;
+
+/**
+ * Search engine backend.
+ * The fp_handler keeps the engine's stored fingerprint info(data) in the database,
+ * and gives it to the engine at the module load and when the audio is added.
+ */
+typedef struct _engine_t {
+	const char* name;
+	engine_data_t data;
+	engine_verify_t verify;
+	int min_candidates;		///< min number of the candidates to verify
+
+	/**
+	 * Add the audio's stored fingerprint info into the engine's index.
+	 */
+	bool (*add_audio)(const char* context, const char* uuid, struct ast_json* j_data);
+	bool (*delete_audio)(const char* context, const char* uuid);
+	bool (*delete_context)(const char* context);
+
+	/**
+	 * Search the query fingerprint info.
+	 * Returns [{"audio_uuid": <uuid>, "match_count": <count>, "offset": <frame offset>}, ...] sorted by the rank.
+	 * processed: searched ratio(0 ~ 1) of the query.
+	 */
+	struct ast_json* (*search)(const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed);
+
+	/**
+	 * Search the several queries at once. optional.
+	 * The queries have the same search options except the deadline.
+	 * Sets the result and the processed of each query same as the search.
+	 */
+	bool (*search_batch)(const char* context, struct ast_json** j_queries, const engine_query_t** queries, const int count, struct ast_json** j_results, double* processed);
+
+	/**
+	 * Streaming search. optional.
+	 * The query is added in pieces as it is extracted, and the votes are accumulated in the stream.
+	 * count: expected number of the query observations.
+	 * window: only the votes of the last window observations are kept(i.e. the monitor). 0 keeps all.
+	 * stream_add searches the added observations until the deadline, and sets the processed same as the search.
+	 * stream_get_results returns the current ranked candidates same as the search.
+	 */
+	void* (*stream_create)(const char* context, const engine_query_t* query, const int count, const int window);
+	bool (*stream_add)(void* stream, struct ast_json* j_query, const struct timeval deadline, double* processed);
+	struct ast_json* (*stream_get_results)(void* stream, const int max_results);
+	void (*stream_destroy)(void* stream);
+
+	struct ast_json* (*get_stats)(void);	///< optional
+	bool (*term)(void);						///< optional
+} engine_t;
+
+bool engine_init(void);
+void engine_term(void);
+
+bool engine_register(const engine_t* engine);
+const engine_t* engine_get(const char* name);
+struct ast_json* engine_get_names(void);
+
+bool engine_delete_audio(const char* context, const char* uuid);
+bool engine_delete_context(const char* context);
+
+const engine_t* engine_plan(const int audios, const int frames);
+
+#endif /* SRC_ENGINE_HANDLER_H_ */
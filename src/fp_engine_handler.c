@@ -0,0 +1,572 @@
+/*
+ * fp_engine_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Search engine backends of the fingerprint info.
+ *  Adapts each engine module(index, scan, landmark, ivfpq, binary) to the engine_t,
+ *  and registers them into the engine_handler.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/json.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "db_ctx_handler.h"
+#include "fp_handler.h"
+#include "fp_engine_handler.h"
+#include "engine_handler.h"
+#include "index_handler.h"
+#include "landmark_handler.h"
+#include "scan_handler.h"
+#include "ivfpq_handler.h"
+#include "binary_handler.h"
+#include "vote_handler.h"
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+#define DEF_NGRAM_LENGTH		4		// consecutive frames of each n-gram. 8 bits code of each frame.
+#define DEF_NGRAM_STEP			3.0		// quantization step(dB) of the maxN for the frame code
+#define DEF_NGRAM_FLOOR			-24.0	// lowest quantized maxN(dB). the levels are clamped into floor ~ floor + step * levels.
+
+#define DEF_CASCADE_DECIMATION	4		// fine frames of each coarse frame. coarse hop is DEF_AUBIO_HOPSIZE * this.
+#define DEF_CASCADE_CANDIDATES	10		// coarse candidates verified with the fine frames
+
+static bool engine_cascade_add_audio(const char* context, const char* uuid, struct ast_json* j_data);
+static struct ast_json* engine_index_search(const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed);
+static bool engine_index_search_batch(const char* context, struct ast_json** j_queries, const engine_query_t** queries, const int count, struct ast_json** j_results, double* processed);
+static void* engine_index_stream_create(const char* context, const engine_query_t* query, const int count, const int window);
+static bool engine_index_stream_add(void* stream, struct ast_json* j_query, const struct timeval deadline, double* processed);
+static struct ast_json* engine_index_stream_get_results(void* stream, const int max_results);
+static void engine_index_stream_destroy(void* stream);
+static struct ast_json* engine_scan_search(const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed);
+static bool engine_ngram_add_audio(const char* context, const char* uuid, struct ast_json* j_data);
+static struct ast_json* engine_ngram_search(const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed);
+static struct ast_json* engine_landmark_search(const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed);
+static struct ast_json* engine_ivfpq_search(const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed);
+static struct ast_json* engine_binary_search(const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed);
+static bool engine_sql_add_audio(const char* context, const char* uuid, struct ast_json* j_data);
+static struct ast_json* engine_sql_search(const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed);
+static struct ast_json* create_audio_ngrams(struct ast_json* j_fprints);
+static struct ast_json* create_audio_coarse_fingerprints(struct ast_json* j_fprints);
+
+extern db_ctx_t* g_db_ctx;
+
+/* mfcc range matching with the sorted index */
+static const engine_t g_engine_index = {
+	.name = DEF_ENGINE_INDEX,
+	.data = ENGINE_DATA_FINGERPRINT,
+	.verify = ENGINE_VERIFY_OPTION,
+	.add_audio = index_add_audio,
+	.delete_audio = index_delete_audio,
+	.delete_context = index_delete_context,
+	.search = engine_index_search,
+	.search_batch = engine_index_search_batch,
+	.stream_create = engine_index_stream_create,
+	.stream_add = engine_index_stream_add,
+	.stream_get_results = engine_index_stream_get_results,
+	.stream_destroy = engine_index_stream_destroy,
+	.get_stats = index_get_stats,
+	.term = index_term,
+};
+
+/* mfcc range matching of the coarse frames, verified with the fine frames. shares the index. */
+static const engine_t g_engine_cascade = {
+	.name = DEF_ENGINE_CASCADE,
+	.data = ENGINE_DATA_FINGERPRINT,
+	.verify = ENGINE_VERIFY_FORCE,
+	.min_candidates = DEF_CASCADE_CANDIDATES,
+	.add_audio = engine_cascade_add_audio,
+	.delete_audio = index_delete_audio,
+	.delete_context = index_delete_context,
+	.search = engine_index_search,
+	.search_batch = engine_index_search_batch,
+	.stream_create = engine_index_stream_create,
+	.stream_add = engine_index_stream_add,
+	.stream_get_results = engine_index_stream_get_results,
+	.stream_destroy = engine_index_stream_destroy,
+};
+
+/* mfcc range matching with the brute force column scan */
+static const engine_t g_engine_scan = {
+	.name = DEF_ENGINE_SCAN,
+	.data = ENGINE_DATA_FINGERPRINT,
+	.verify = ENGINE_VERIFY_OPTION,
+	.add_audio = scan_add_audio,
+	.delete_audio = scan_delete_audio,
+	.delete_context = scan_delete_context,
+	.search = engine_scan_search,
+	.term = scan_term,
+};
+
+/* spectral peak pair hashing with the inverted index */
+static const engine_t g_engine_landmark = {
+	.name = DEF_ENGINE_LANDMARK,
+	.data = ENGINE_DATA_LANDMARK,
+	.verify = ENGINE_VERIFY_NONE,
+	.add_audio = landmark_add_audio,
+	.delete_audio = landmark_delete_audio,
+	.delete_context = landmark_delete_context,
+	.search = engine_landmark_search,
+	.term = landmark_term,
+};
+
+/* quantized mfcc n-gram hashing. shares the landmark's inverted index. */
+static const engine_t g_engine_ngram = {
+	.name = DEF_ENGINE_NGRAM,
+	.data = ENGINE_DATA_FINGERPRINT,
+	.verify = ENGINE_VERIFY_OPTION,
+	.add_audio = engine_ngram_add_audio,
+	.delete_audio = landmark_delete_audio,
+	.delete_context = landmark_delete_context,
+	.search = engine_ngram_search,
+};
+
+/* full mfcc vector nearest neighbours with the ivf-pq index */
+static const engine_t g_engine_ivfpq = {
+	.name = DEF_ENGINE_IVFPQ,
+	.data = ENGINE_DATA_VECTOR,
+	.verify = ENGINE_VERIFY_OPTION,
+	.add_audio = ivfpq_add_audio,
+	.delete_audio = ivfpq_delete_audio,
+	.delete_context = ivfpq_delete_context,
+	.search = engine_ivfpq_search,
+	.term = ivfpq_term,
+};
+
+/* binary sub-fingerprint hamming distance matching */
+static const engine_t g_engine_binary = {
+	.name = DEF_ENGINE_BINARY,
+	.data = ENGINE_DATA_SUBFINGERPRINT,
+	.verify = ENGINE_VERIFY_NONE,
+	.add_audio = binary_add_audio,
+	.delete_audio = binary_delete_audio,
+	.delete_context = binary_delete_context,
+	.search = engine_binary_search,
+	.term = binary_term,
+};
+
+/* mfcc range matching with the database queries. no memory index. */
+static const engine_t g_engine_sql = {
+	.name = DEF_ENGINE_SQL,
+	.data = ENGINE_DATA_FINGERPRINT,
+	.verify = ENGINE_VERIFY_OPTION,
+	.add_audio = engine_sql_add_audio,
+	.search = engine_sql_search,
+};
+
+/**
+ * Register the search engine backends.
+ * @return
+ */
+bool fp_engine_init(void)
+{
+	int i;
+	int ret;
+	const engine_t* engines[] = {
+			&g_engine_index,
+			&g_engine_cascade,
+			&g_engine_scan,
+			&g_engine_landmark,
+			&g_engine_ngram,
+			&g_engine_ivfpq,
+			&g_engine_binary,
+			&g_engine_sql,
+	};
+
+	ret = engine_init();
+	if(ret == false) {
+		return false;
+	}
+
+	for(i = 0; i < ARRAY_LEN(engines); i++) {
+		ret = engine_register(engines[i]);
+		if(ret == false) {
+			ast_log(LOG_ERROR, "Could not register engine. name[%s]\n", engines[i]->name);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * engine add_audio of the cascade engine.
+ * Only the coarse frames are indexed. The fine frames are in the database for the verification.
+ */
+static bool engine_cascade_add_audio(const char* context, const char* uuid, struct ast_json* j_data)
+{
+	int ret;
+	struct ast_json* j_coarse;
+
+	j_coarse = create_audio_coarse_fingerprints(j_data);
+	ret = index_add_audio(context, uuid, j_coarse);
+	ast_json_unref(j_coarse);
+
+	return ret;
+}
+/**
+ * engine search of the index and cascade engines.
+ */
+static struct ast_json* engine_index_search(const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed)
+{
+	return index_search(context, j_query, query->coefs, query->tolerance, query->freq_ignore_low, query->freq_ignore_high, query->max_results, query->deadline, processed);
+}
+/**
+ * engine search_batch of the index and cascade engines.
+ */
+static bool engine_index_search_batch(const char* context, struct ast_json** j_queries, const engine_query_t** queries, const int count, struct ast_json** j_results, double* processed)
+{
+	int i;
+	int ret;
+	struct timeval* deadlines;
+
+	deadlines = ast_calloc(count, sizeof(struct timeval));
+	for(i = 0; i < count; i++) {
+		deadlines[i] = queries[i]->deadline;
+	}
+
+	ret = index_search_batch(context, j_queries, deadlines, count,
+			queries[0]->coefs, queries[0]->tolerance, queries[0]->freq_ignore_low, queries[0]->freq_ignore_high, queries[0]->max_results,
+			j_results, processed);
+	sfree(deadlines);
+
+	return ret;
+}
+/**
+ * engine stream_create of the index and cascade engines.
+ */
+static void* engine_index_stream_create(const char* context, const engine_query_t* query, const int count, const int window)
+{
+	return index_stream_create(context, count, window, query->coefs, query->tolerance, query->freq_ignore_low, query->freq_ignore_high, query->max_results);
+}
+static bool engine_index_stream_add(void* stream, struct ast_json* j_query, const struct timeval deadline, double* processed)
+{
+	return index_stream_add(stream, j_query, deadline, processed);
+}
+static struct ast_json* engine_index_stream_get_results(void* stream, const int max_results)
+{
+	return index_stream_get_results(stream, max_results);
+}
+static void engine_index_stream_destroy(void* stream)
+{
+	index_stream_destroy(stream);
+}
+/**
+ * engine search of the scan engine.
+ */
+static struct ast_json* engine_scan_search(const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed)
+{
+	return scan_search(context, j_query, query->coefs, query->tolerance, query->freq_ignore_low, query->freq_ignore_high, query->max_results, query->deadline, processed);
+}
+/**
+ * engine add_audio of the ngram engine.
+ * The n-gram hashes share the landmark's inverted index.
+ */
+static bool engine_ngram_add_audio(const char* context, const char* uuid, struct ast_json* j_data)
+{
+	int ret;
+	struct ast_json* j_ngrams;
+
+	j_ngrams = create_audio_ngrams(j_data);
+	ret = landmark_add_audio(context, uuid, j_ngrams);
+	ast_json_unref(j_ngrams);
+
+	return ret;
+}
+/**
+ * engine search of the ngram engine.
+ */
+static struct ast_json* engine_ngram_search(const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed)
+{
+	struct ast_json* j_ngrams;
+	struct ast_json* j_res;
+
+	j_ngrams = create_audio_ngrams(j_query);
+	j_res = landmark_search(context, j_ngrams, query->max_results, query->deadline, processed);
+	ast_json_unref(j_ngrams);
+
+	return j_res;
+}
+/**
+ * engine search of the landmark engine.
+ */
+static struct ast_json* engine_landmark_search(const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed)
+{
+	return landmark_search(context, j_query, query->max_results, query->deadline, processed);
+}
+/**
+ * engine search of the ivfpq engine.
+ */
+static struct ast_json* engine_ivfpq_search(const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed)
+{
+	return ivfpq_search(context, j_query, query->max_results, query->deadline, processed);
+}
+/**
+ * engine search of the binary engine.
+ */
+static struct ast_json* engine_binary_search(const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed)
+{
+	return binary_search(context, j_query, query->max_results, query->deadline, processed);
+}
+/**
+ * engine add_audio of the sql engine.
+ * The fingerprints are in the database already.
+ */
+static bool engine_sql_add_audio(const char* context, const char* uuid, struct ast_json* j_data)
+{
+	return true;
+}
+/**
+ * engine search of the sql engine.
+ * Queries the stored fingerprints of each query frame in the tolerance range,
+ * and votes the matched frames with the time offset(same as the index engine).
+ * Needs no memory except the query, but slower than the memory index engines.
+ * @param context
+ * @param j_query: query fingerprints
+ * @param query
+ * @param processed
+ * @return
+ */
+static struct ast_json* engine_sql_search(const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed)
+{
+	int i;
+	int j;
+	int audio_size;
+	int audio_id;
+	char* sql;
+	char* tmp;
+	char name[32];
+	char col_max[10];
+	char** audios;
+	double freq;
+	double freq_low;
+	double freq_high;
+	vote_t* vote;
+	db_stmt_t* stmt;
+	struct ast_json* j_audios;
+	struct ast_json* j_ids;
+	struct ast_json* j_fprint;
+	struct ast_json* j_record;
+	struct ast_json* j_id;
+	struct ast_json* j_res;
+
+	// audio ids of the context's audios
+	j_audios = fp_get_audio_lists_by_contextname(context);
+	audio_size = ast_json_array_size(j_audios);
+	if(audio_size == 0) {
+		ast_log(LOG_NOTICE, "Could not find audio info. context[%s]\n", context);
+		ast_json_unref(j_audios);
+		return NULL;
+	}
+	audios = ast_calloc(audio_size, sizeof(char*));
+	j_ids = ast_json_object_create();
+	for(i = 0; i < audio_size; i++) {
+		audios[i] = (char*)ast_json_string_get(ast_json_object_get(ast_json_array_get(j_audios, i), "uuid"));
+		if(audios[i] == NULL) {
+			audios[i] = "";
+			continue;
+		}
+		ast_json_object_set(j_ids, audios[i], ast_json_integer_create(i));
+	}
+
+	// context, max1 range, max2 ~ maxN range
+	ast_asprintf(&sql, "%s", "select audio_uuid, frame_idx from audio_fingerprint where context = ?");
+	for(j = 0; j < query->coefs; j++) {
+		ast_asprintf(&tmp, "%s and max%d >= ? and max%d <= ?", sql, j + 1, j + 1);
+		sfree(sql);
+		sql = tmp;
+	}
+	ast_asprintf(&tmp, "%s;", sql);
+	sfree(sql);
+	sql = tmp;
+	snprintf(name, sizeof(name), "sql_search_%d", query->coefs);
+
+	freq_low = (query->freq_ignore_low > 0) ? 10 * log10(query->freq_ignore_low) : 0;
+	freq_high = (query->freq_ignore_high > 0) ? 10 * log10(query->freq_ignore_high) : 0;
+
+	// one statement for all of the query frames. locked until the end of the search.
+	stmt = db_ctx_stmt_get(g_db_ctx, name, sql);
+	sfree(sql);
+	if(stmt == NULL) {
+		ast_log(LOG_ERROR, "Could not get the search statement. context[%s]\n", context);
+		sfree(audios);
+		ast_json_unref(j_ids);
+		ast_json_unref(j_audios);
+		return NULL;
+	}
+
+	vote = vote_create(audio_size, ast_json_array_size(j_query), query->max_results, NULL, query->deadline);
+	for(i = 0; i < ast_json_array_size(j_query); i++) {
+		j_fprint = ast_json_array_get(j_query, i);
+		if(j_fprint == NULL) {
+			continue;
+		}
+		if(vote_next(vote, i, ast_json_integer_get(ast_json_object_get(j_fprint, "frame_idx"))) == false) {
+			break;
+		}
+
+		/* validate frequency range */
+		freq = (int)ast_json_real_get(ast_json_object_get(j_fprint, "max1"));
+		if(((query->freq_ignore_low > 0) && (freq < freq_low)) || ((query->freq_ignore_high > 0) && (freq > freq_high))) {
+			continue;
+		}
+
+		db_ctx_stmt_bind_text(stmt, 1, context);
+		for(j = 0; j < query->coefs; j++) {
+			snprintf(col_max, sizeof(col_max), "max%d", j + 1);
+			freq = (j == 0) ? freq : ast_json_real_get(ast_json_object_get(j_fprint, col_max));
+			if((j > 0) && (((query->freq_ignore_low > 0) && (freq < freq_low)) || ((query->freq_ignore_high > 0) && (freq > freq_high)))) {
+				/* out of ranged coefs are not checked */
+				db_ctx_stmt_bind_double(stmt, j * 2 + 2, -HUGE_VAL);
+				db_ctx_stmt_bind_double(stmt, j * 2 + 3, HUGE_VAL);
+				continue;
+			}
+			db_ctx_stmt_bind_double(stmt, j * 2 + 2, freq - query->tolerance);
+			db_ctx_stmt_bind_double(stmt, j * 2 + 3, freq + query->tolerance);
+		}
+
+		while(1) {
+			j_record = db_ctx_stmt_get_record(stmt);
+			if(j_record == NULL) {
+				break;
+			}
+
+			j_id = ast_json_object_get(j_ids, ast_json_string_get(ast_json_object_get(j_record, "audio_uuid")));
+			if(j_id != NULL) {
+				audio_id = ast_json_integer_get(j_id);
+				vote_add(vote, audio_id, ast_json_integer_get(ast_json_object_get(j_record, "frame_idx")));
+			}
+			ast_json_unref(j_record);
+		}
+		db_ctx_stmt_reset(stmt);
+	}
+	db_ctx_stmt_release(stmt);
+
+	*processed = vote_get_processed(vote);
+	j_res = vote_get_results(vote, audios, query->max_results);
+	vote_destroy(vote);
+
+	sfree(audios);
+	ast_json_unref(j_ids);
+	ast_json_unref(j_audios);
+
+	return j_res;
+}
+/**
+ * Create the n-gram hashes of the given mfcc fingerprints.
+ * Each frame is quantized to the 8 bits code. Each of the max1 ~ maxN gets 8 / DEF_AUBIO_COEFS bits
+ * (4 bits, 16 levels of DEF_NGRAM_STEP from DEF_NGRAM_FLOOR), and the out of range values are clamped
+ * to the lowest or highest level. The codes of DEF_NGRAM_LENGTH consecutive frames are packed into the hash.
+ * The silent frame has no maxN(log of 0 can not be kept in the json), and the n-gram which has
+ * the silent frame is skipped.
+ * @param j_fprints: mfcc fingerprints in the frame order.
+ * @return [{"hash": <hash>, "frame_idx": <first frame idx>}, ...]
+ */
+static struct ast_json* create_audio_ngrams(struct ast_json* j_fprints)
+{
+	int i;
+	int j;
+	int count;
+	int bits;
+	int levels;
+	int level;
+	int valids;
+	double val;
+	uint32_t code;
+	uint32_t hash;
+	char col_max[10];
+	struct ast_json* j_fprint;
+	struct ast_json* j_res;
+	struct ast_json* j_tmp;
+	struct ast_json* j_val;
+
+	j_res = ast_json_array_create();
+	if(j_fprints == NULL) {
+		return j_res;
+	}
+
+	bits = 8 / DEF_AUBIO_COEFS;
+	levels = 1 << bits;
+	count = ast_json_array_size(j_fprints);
+	hash = 0;
+	valids = 0;
+	for(i = 0; i < count; i++) {
+		j_fprint = ast_json_array_get(j_fprints, i);
+
+		// frame code
+		code = 0;
+		for(j = 0; j < DEF_AUBIO_COEFS; j++) {
+			snprintf(col_max, sizeof(col_max), "max%d", j + 1);
+			j_val = ast_json_object_get(j_fprint, col_max);
+			if((j_val == NULL) || (ast_json_typeof(j_val) != AST_JSON_REAL)) {
+				// silence
+				break;
+			}
+			val = ast_json_real_get(j_val);
+			if(isfinite(val) == 0) {
+				break;
+			}
+
+			level = (int)floor((val - DEF_NGRAM_FLOOR) / DEF_NGRAM_STEP);
+			level = MAX(0, MIN(levels - 1, level));
+			code = (code << bits) | (uint32_t)level;
+		}
+		if(j < DEF_AUBIO_COEFS) {
+			valids = 0;
+			continue;
+		}
+
+		hash = (hash << 8) | code;
+		valids++;
+		if(valids < DEF_NGRAM_LENGTH) {
+			continue;
+		}
+
+		j_tmp = ast_json_pack("{s:i, s:i}",
+				"hash",			(int)(hash & (uint32_t)(((uint64_t)1 << (8 * DEF_NGRAM_LENGTH)) - 1)),
+				"frame_idx",	(int)ast_json_integer_get(ast_json_object_get(ast_json_array_get(j_fprints, i - DEF_NGRAM_LENGTH + 1), "frame_idx"))
+				);
+		if(j_tmp == NULL) {
+			ast_log(LOG_ERROR, "Could not create n-gram data.\n");
+			continue;
+		}
+		ast_json_array_append(j_res, j_tmp);
+	}
+
+	return j_res;
+}
+/**
+ * Returns the coarse frames of the given mfcc fingerprints.
+ * The coarse frame is every DEF_CASCADE_DECIMATION'th fine frame, which is the same frame
+ * of the DEF_AUBIO_HOPSIZE * DEF_CASCADE_DECIMATION hop. Keeps the fine frame_idx, so
+ * the offsets of the coarse matches are the fine frame offsets.
+ * @param j_fprints: mfcc fingerprints.
+ * @return
+ */
+static struct ast_json* create_audio_coarse_fingerprints(struct ast_json* j_fprints)
+{
+	int i;
+	struct ast_json* j_fprint;
+	struct ast_json* j_res;
+
+	j_res = ast_json_array_create();
+	for(i = 0; i < ast_json_array_size(j_fprints); i++) {
+		j_fprint = ast_json_array_get(j_fprints, i);
+		if((ast_json_integer_get(ast_json_object_get(j_fprint, "frame_idx")) % DEF_CASCADE_DECIMATION) != 0) {
+			continue;
+		}
+		ast_json_array_append(j_res, ast_json_ref(j_fprint));
+	}
+
+	return j_res;
+}
@@ -0,0 +1,15 @@
+/*
+ * fp_engine_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_FP_ENGINE_HANDLER_H_
+#define SRC_FP_ENGINE_HANDLER_H_
+
+#include <stdbool.h>
+
+bool fp_engine_init(void);
+
+#endif /* SRC_FP_ENGINE_HANDLER_H_ */
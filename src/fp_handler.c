@@ -11,59 +11,163 @@
 #include <asterisk/logger.h>
 #include <asterisk/utils.h>
 #include <asterisk/json.h>
+#include <asterisk/lock.h>
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <aubio/aubio.h>
 #include <math.h>
 #include <openssl/md5.h>
 #include <libgen.h>
+#include <unistd.h>
 #include <uuid/uuid.h>
 
 #include "app_tiresias.h"
 #include "db_ctx_handler.h"
 #include "fp_handler.h"
+#include "index_handler.h"
+#include "landmark_handler.h"
+#include "scan_handler.h"
+#include "ivfpq_handler.h"
+#include "binary_handler.h"
+#include "worker_handler.h"
+#include "cache_handler.h"
+#include "sketch_handler.h"
+#include "verify_handler.h"
+#include "engine_handler.h"
+#include "batch_handler.h"
+#include "fp_stream_handler.h"
+#include "fp_engine_handler.h"
 
 #define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
 
 #define DEF_DATABASE_NAME			":memory:"
 #define DEF_BACKUP_DATABASE			"/var/lib/asterisk/third-party/tiresias/audio_recongition.db"
 
-#define DEF_AUBIO_HOPSIZE		256
-#define DEF_AUBIO_BUFSIZE		512
-//#define DEF_AUBIO_HOPSIZE		512
-//#define DEF_AUBIO_BUFSIZE		1024
-#define DEF_AUBIO_SAMPLERATE	0		// read samplerate from the file
-#define DEF_AUBIO_FILTER		40
-#define DEF_AUBIO_COEFS			2
-
-#define DEF_SEARCH_TOLERANCE		0.001
+#define DEF_LANDMARK_SAMPLERATE		8000	// resample to the telephony rate. keeps the bins and frames comparable.
+#define DEF_LANDMARK_PEAKS			3		// max peaks of each frame
+#define DEF_LANDMARK_PEAK_RATIO		3.0		// peak should be louder than the frame's average * ratio
+#define DEF_LANDMARK_PEAK_FLOOR		0.001
+#define DEF_LANDMARK_FAN_OUT		5		// max pairs of each anchor peak
+#define DEF_LANDMARK_TARGET_ZONE	63		// max frame distance of the pair. 6 bits.
+#define DEF_LANDMARK_FREQ_ZONE		64		// max bin distance of the pair
+
+#define DEF_SUBFP_BANDS			33		// log spaced energy bands. 32 bits of the band differences.
+#define DEF_SUBFP_FREQ_LOW		300		// Hz
+#define DEF_SUBFP_FREQ_HIGH		2000	// Hz
+#define DEF_SUBFP_ENERGY_FLOOR	0.000001	// the quieter frame is the silence(0 bits)
+
+#define DEF_SEARCH_THRESHOLD		256		// minimum query observations(frames or landmarks) to split the search
+#define DEF_SEARCH_CACHE_SIZE		256		// max cached search results
+#define DEF_SEARCH_CACHE_STEP		0.5		// quantization step of the mfcc coefs for the cache key
+#define DEF_SEARCH_SKETCH_THRESHOLD	0.0		// min ratio of the query frames which can match to the audio. 0 skips only the audios which can not match.
+#define DEF_SEARCH_VECTOR_PROBES	8		// inverted lists probed by each query frame of the ivfpq engine
+#define DEF_SEARCH_STOP_DENSITY		0.0		// max ratio of the index entries in the query frame's max1 range. 0 disables.
+#define DEF_SEARCH_CANDIDATE_BUDGET	0		// target max index candidates of each query frame. 0 disables.
+#define DEF_SEARCH_VERIFY_CANDIDATES	0	// top candidates of the coarse vote to verify with the frame alignment. 0 disables.
+#define DEF_SEARCH_VERIFY_THRESHOLD		0	// max alignment cost of the confirmed candidate. 0 confirms all.
+#define DEF_SEARCH_BATCH_WINDOW		0		// ms to collect the concurrent searches. 0 disables.
+#define DEF_SEARCH_BATCH_WINDOW_MAX	1000
+
+#define DEF_FINGERPRINT_VERSION		"2"		// increase when the fingerprint data format has been changed.
 
 #define DEF_UUID_STR_LEN 37
 
+typedef struct _verify_load_t {
+	const char* context;
+	bool vector;		///< true: audio_vector(mfcc1 ~ mfccN), false: audio_fingerprint(max1 ~ maxN)
+} verify_load_t;
+
+typedef struct _batch_search_t {
+	const engine_t* engine;
+	const char* context;
+	struct ast_json* j_query;
+	const engine_query_t* query;
+
+	struct ast_json* j_res;
+	double processed;
+} batch_search_t;
+
+/**
+ * Incremental mfcc extraction of the voice samples.
+ */
+struct _fp_extractor_t {
+	aubio_pvoc_t* pv;
+	cvec_t*	fftgrain;
+	aubio_mfcc_t* mfcc;
+	fvec_t* mfcc_out;
+	fvec_t* mfcc_buf;
+	int buf_len;			///< samples in the mfcc_buf
+};
+
+typedef struct _landmark_peak_t {
+	int frame_idx;
+	int bin;
+	float magnitude;
+} landmark_peak_t;
+
 db_ctx_t* g_db_ctx;	// database context
 
 static bool init_database(void);
+static bool init_index(void);
+static bool init_worker(void);
+static bool init_cache(void);
+static bool init_batch(void);
+static bool init_sketch(void);
+static bool init_verify(void);
+static bool check_fingerprint_version(void);
+static bool load_audio_index(struct ast_json* j_audio);
+static const engine_t* get_context_plan(const char* context);
+static bool get_context_counts(const char* context, int* audios, int* frames);
+static void replan_context(const char* context);
 
 static int create_audio_list_info(const char* context, const char* filename, const char* uuid);
 static bool create_audio_fingerprint_info(const char* context, const char* filename, const char* uuid);
 static struct ast_json* create_audio_fingerprints(const char* filename, const char* uuid);
+static struct ast_json* create_audio_mfccs(const char* filename, const char* uuid, const int coefs, const bool vector);
+static struct ast_json* create_mfcc_frame(const fvec_t* mfcc_out, const int frame_idx, const char* uuid, const int coefs, const bool vector);
+static struct ast_json* search_fingerprint(const engine_t* engine, const char* context, const char* filename, struct ast_json* j_frames, const engine_query_t* query, int* frame_count, double* processed);
+static struct ast_json* search_landmark(const engine_t* engine, const char* context, const char* filename, struct ast_json* j_frames, const engine_query_t* query, int* frame_count, double* processed);
+static struct ast_json* search_vector(const engine_t* engine, const char* context, const char* filename, struct ast_json* j_frames, const engine_query_t* query, int* frame_count, double* processed);
+static struct ast_json* search_binary(const engine_t* engine, const char* context, const char* filename, struct ast_json* j_frames, const engine_query_t* query, int* frame_count, double* processed);
+static struct ast_json* search_cached(const engine_t* engine, const char* context, const char* key, struct ast_json* j_query, const engine_query_t* query, double* processed);
+static struct ast_json* get_query_frames(struct ast_json* j_frames, const char* key, int* frame_count);
+static void set_query_frames(struct ast_json* j_frames, const char* key, struct ast_json* j_data, const int frame_count);
+static struct ast_json* run_engine_search(const engine_t* engine, const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed);
+static void run_batch_search(void** requests, const int count);
+static bool load_verify_frames(void* data, const char* uuid, const int start, const int count, float* frames, bool* exists);
+
+static bool create_audio_landmark_info(const char* context, const char* filename, const char* uuid);
+static struct ast_json* create_audio_landmarks(const char* filename, const int freq_ignore_low, const int freq_ignore_high, int* frame_count);
+
+static bool create_audio_vector_info(const char* context, const char* filename, const char* uuid);
+static struct ast_json* create_audio_vectors(const char* filename, const char* uuid);
+
+static bool create_audio_subfingerprint_info(const char* context, const char* filename, const char* uuid);
+static struct ast_json* create_audio_subfingerprints(const char* filename, int* frame_count);
 
 static struct ast_json* get_audio_list_info(const char* uuid);
+static struct ast_json* get_audio_fingerprints(const char* context, const char* uuid);
+static struct ast_json* get_audio_landmarks(const char* context, const char* uuid);
+static struct ast_json* get_audio_vectors(const char* context, const char* uuid);
+static struct ast_json* get_audio_subfingerprints(const char* context, const char* uuid);
 static struct ast_json* get_audio_list_info_by_context_and_hash(const char* context, const char* hash);
 static char* create_file_hash(const char* filename);
+static char* create_search_key(const char* params, struct ast_json* j_items, const char** names, const int name_count, const double step);
 
 static bool create_context_list_info(const char* name, const char* directory, const bool replace);
 static bool delete_context_list_info(const char* name);
 
-static bool create_temp_search_table(const char* tablename);
-static bool delete_temp_search_table(const char* tablename);
-
-static char* replace_string_char(const char* str, const char org, const char target);
-
 static db_ctx_t* create_db_ctx(void);
 static void destroy_db_ctx(db_ctx_t* db_ctx);
+static struct ast_json* get_stmt_records(db_stmt_t* stmt);
+
+AST_MUTEX_DEFINE_STATIC(g_plans_lock);
+static struct ast_json* g_plans = NULL;	///< planned engine name of the engine=auto contexts. key: context name
 
 bool fp_init(void)
 {
@@ -86,6 +190,62 @@ bool fp_init(void)
 		return false;
 	}
 
+	// the old fingerprints will be re-created at the index init
+	ret = check_fingerprint_version();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not check the fingerprint version.\n");
+		return false;
+	}
+
+	/* initiate search workers */
+	ret = init_worker();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate search workers.\n");
+		return false;
+	}
+
+	/* initiate search result cache */
+	ret = init_cache();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate search result cache.\n");
+		return false;
+	}
+
+	/* initiate search batching */
+	ret = init_batch();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate search batching.\n");
+		return false;
+	}
+
+	/* initiate streaming search */
+	ret = fp_stream_init();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate streaming search.\n");
+		return false;
+	}
+
+	/* initiate search verification */
+	ret = init_verify();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate search verification.\n");
+		return false;
+	}
+
+	/* initiate sketch prefilter. the sketches are built with the index. */
+	ret = init_sketch();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate sketch prefilter.\n");
+		return false;
+	}
+
+	/* initiate index */
+	ret = init_index();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate index.\n");
+		return false;
+	}
+
 	return true;
 }
 
@@ -94,17 +254,28 @@ bool fp_term(void)
 	int ret;
 	db_ctx_t* db_ctx;
 
+	/* stop the searches first. the batched searches run on the workers, and the engines use the database. */
+	batch_term();
+	worker_term();
+	cache_term();
+	engine_term();
+
+	ast_mutex_lock(&g_plans_lock);
+	ast_json_unref(g_plans);
+	g_plans = NULL;
+	ast_mutex_unlock(&g_plans_lock);
+
 	db_ctx = create_db_ctx();
 	ret = db_ctx_backup(db_ctx, DEF_BACKUP_DATABASE);
 	destroy_db_ctx(db_ctx);
 	if(ret == false) {
 		ast_log(LOG_ERROR, "Could not write database.\n");
-		return false;
 	}
 
 	db_ctx_term(g_db_ctx);
+	g_db_ctx = NULL;
 
-	return true;
+	return ret;
 }
 
 /**
@@ -116,8 +287,8 @@ bool fp_delete_audio_list_info(const char* uuid)
 {
 	int ret;
 	struct ast_json* j_tmp;
-	char* sql;
-	db_ctx_t* db_ctx;
+	const char* context;
+	db_stmt_t* stmt;
 
 	if(uuid == NULL) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
@@ -130,13 +301,17 @@ bool fp_delete_audio_list_info(const char* uuid)
 		ast_log(LOG_NOTICE, "Could not find audio list info.\n");
 		return false;
 	}
+	context = ast_json_string_get(ast_json_object_get(j_tmp, "context"));
 
 	// delete audio list info
-	ast_asprintf(&sql, "delete from audio_list where uuid='%s';", uuid);
-	db_ctx = create_db_ctx();
-	ret = db_ctx_exec(db_ctx, sql);
-	destroy_db_ctx(db_ctx);
-	sfree(sql);
+	stmt = db_ctx_stmt_get(g_db_ctx, "delete_audio_list", "delete from audio_list where uuid = ?;");
+	if(stmt == NULL) {
+		ast_json_unref(j_tmp);
+		return false;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, uuid);
+	ret = db_ctx_stmt_step(stmt);
+	db_ctx_stmt_release(stmt);
 	if(ret == false) {
 		ast_log(LOG_WARNING, "Could not delete audio list info. uuid[%s]\n", uuid);
 		ast_json_unref(j_tmp);
@@ -144,17 +319,75 @@ bool fp_delete_audio_list_info(const char* uuid)
 	}
 
 	// delete related audio fingerprint info
-	ast_asprintf(&sql, "delete from audio_fingerprint where audio_uuid='%s';", uuid);
-	db_ctx = create_db_ctx();
-	ret = db_ctx_exec(db_ctx, sql);
-	destroy_db_ctx(db_ctx);
-	sfree(sql);
+	stmt = db_ctx_stmt_get(g_db_ctx, "delete_audio_fingerprint", "delete from audio_fingerprint where context = ? and audio_uuid = ?;");
+	if(stmt == NULL) {
+		ast_json_unref(j_tmp);
+		return false;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, context);
+	db_ctx_stmt_bind_text(stmt, 2, uuid);
+	ret = db_ctx_stmt_step(stmt);
+	db_ctx_stmt_release(stmt);
 	if(ret == false) {
 		ast_log(LOG_WARNING, "Could not delete audio fingerprint info. audio_uuid[%s]\n", uuid);
 		ast_json_unref(j_tmp);
 		return false;
 	}
 
+	// delete related audio landmark info
+	stmt = db_ctx_stmt_get(g_db_ctx, "delete_audio_landmark", "delete from audio_landmark where context = ? and audio_uuid = ?;");
+	if(stmt == NULL) {
+		ast_json_unref(j_tmp);
+		return false;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, context);
+	db_ctx_stmt_bind_text(stmt, 2, uuid);
+	ret = db_ctx_stmt_step(stmt);
+	db_ctx_stmt_release(stmt);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not delete audio landmark info. audio_uuid[%s]\n", uuid);
+		ast_json_unref(j_tmp);
+		return false;
+	}
+
+	// delete related audio vector info
+	stmt = db_ctx_stmt_get(g_db_ctx, "delete_audio_vector", "delete from audio_vector where context = ? and audio_uuid = ?;");
+	if(stmt == NULL) {
+		ast_json_unref(j_tmp);
+		return false;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, context);
+	db_ctx_stmt_bind_text(stmt, 2, uuid);
+	ret = db_ctx_stmt_step(stmt);
+	db_ctx_stmt_release(stmt);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not delete audio vector info. audio_uuid[%s]\n", uuid);
+		ast_json_unref(j_tmp);
+		return false;
+	}
+
+	// delete related audio sub-fingerprint info
+	stmt = db_ctx_stmt_get(g_db_ctx, "delete_audio_subfingerprint", "delete from audio_subfingerprint where context = ? and audio_uuid = ?;");
+	if(stmt == NULL) {
+		ast_json_unref(j_tmp);
+		return false;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, context);
+	db_ctx_stmt_bind_text(stmt, 2, uuid);
+	ret = db_ctx_stmt_step(stmt);
+	db_ctx_stmt_release(stmt);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not delete audio sub-fingerprint info. audio_uuid[%s]\n", uuid);
+		ast_json_unref(j_tmp);
+		return false;
+	}
+
+	// delete index info
+	engine_delete_audio(context, uuid);
+	cache_delete_context(context);
+	replan_context(context);
+	ast_json_unref(j_tmp);
+
 	return true;
 }
 
@@ -184,290 +417,881 @@ bool fp_craete_audio_list_info(const char* context, const char* filename)
 		return true;
 	}
 
-	// create audio fingerprint info
+	// create audio fingerprint info. the audio without the fingerprints is not kept.
 	ret = create_audio_fingerprint_info(context, filename, uuid);
-	sfree(uuid);
 	if(ret == false) {
 		ast_log(LOG_NOTICE, "Could not create audio fingerprint info.\n");
-		fp_delete_audio_list_info(filename);
+		fp_delete_audio_list_info(uuid);
+		sfree(uuid);
 		return false;
 	}
+	sfree(uuid);
+
+	// the cached results do not know the new audio
+	cache_delete_context(context);
+	replan_context(context);
 
 	return true;
 }
 
 /**
  * Search fingerprint info of given file.
+ * Returns the best matched audio info with the ranked candidates("matches").
+ * If the search could not be done in the deadline_ms, returns the best candidates so far
+ * with the "partial" flag and the searched ratio of the query("processed").
+ * The query frames extracted from the file are kept in the j_frames, and the next search of
+ * the same file with the same j_frames uses them instead of the extracting again.
  * @param context
  * @param filename
+ * @param j_frames: extracted query frames of the file. Empty object for the new file. NULL for not to keep.
  * @param coefs
  * @param tolerance
+ * @param freq_ignore_low
+ * @param freq_ignore_high
+ * @param max_results: max number of the ranked candidates.
+ * @param deadline_ms: time budget of the search including the fingerprinting. 0 for no deadline.
  * @return
  */
 struct ast_json* fp_search_fingerprint_info(
 		const char* context,
 		const char* filename,
+		struct ast_json* j_frames,
 		const int coefs,
 		const double tolerance,
 		const int freq_ignore_low,
-		const int freq_ignore_high
+		const int freq_ignore_high,
+		const int max_results,
+		const int deadline_ms
 		)
 {
-	int ret;
-	char* uuid;
-	char* sql;
-	char* tmp;
-	char* tmp_max;
-	char* tablename;
-	struct ast_json* j_fprints;
-	struct ast_json* j_tmp;
 	struct ast_json* j_search;
 	struct ast_json* j_res;
 	int frame_count;
-	int i;
-	int j;
-	db_ctx_t* db_ctx;
-	double tole;
-	double freq;
-	double freq_tmp;
+	int results;
+	double processed;
+	engine_query_t query;
+	const engine_t* engine;
 
 	if((context == NULL) || (filename == NULL)) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
 		return NULL;
 	}
-	ast_log(LOG_DEBUG, "Fired fp_search_fingerprint_info. context[%s], filename[%s], coefs[%d], tolerance[%f], freq_ignore_low[%d], freq_ignore_high[%d]\n",
+	ast_log(LOG_DEBUG, "Fired fp_search_fingerprint_info. context[%s], filename[%s], coefs[%d], tolerance[%f], freq_ignore_low[%d], freq_ignore_high[%d], max_results[%d], deadline_ms[%d]\n",
 			context,
 			filename,
 			coefs,
 			tolerance,
 			freq_ignore_low,
-			freq_ignore_high
+			freq_ignore_high,
+			max_results,
+			deadline_ms
 			);
 
-	if((coefs < 1) || (coefs > DEF_AUBIO_COEFS)) {
-		ast_log(LOG_WARNING, "Wrong coefs count. max[%d], coefs[%d]\n", DEF_AUBIO_COEFS, coefs);
-		return NULL;
-	}
-	
-	tole = tolerance;
-	if(tole < 0) {
-		ast_log(LOG_NOTICE, "Wrong tolerance setting. Set to default. tolerance[%f], default[%f]\n", tolerance, DEF_SEARCH_TOLERANCE);
-		tole = DEF_SEARCH_TOLERANCE;
+	query.deadline = ast_tv(0, 0);
+	if(deadline_ms > 0) {
+		query.deadline = ast_tvadd(ast_tvnow(), ast_samp2tv(deadline_ms, 1000));
 	}
 
-	uuid = fp_generate_uuid();
-
-	// create tablename
-	tmp = replace_string_char(uuid, '-', '_');
-	ast_asprintf(&tablename, "temp_%s", tmp);
-	sfree(tmp);
-
-	// create tmp search table
-	ret = create_temp_search_table(tablename);
-	if(ret == false) {
-		ast_log(LOG_WARNING, "Could not create temp search table. tablename[%s]\n", tablename);
-		sfree(tablename);
-		sfree(uuid);
-		return NULL;
+	results = max_results;
+	if(results < 1) {
+		ast_log(LOG_NOTICE, "Wrong max results setting. Set to default. max_results[%d], default[%d]\n", max_results, DEF_SEARCH_MAX_RESULTS);
+		results = DEF_SEARCH_MAX_RESULTS;
 	}
+	query.coefs = coefs;
+	query.tolerance = tolerance;
+	query.freq_ignore_low = freq_ignore_low;
+	query.freq_ignore_high = freq_ignore_high;
+	query.max_results = results;
 
-	// create fingerprint info
-	j_fprints = create_audio_fingerprints(filename, uuid);
-	sfree(uuid);
-	if(j_fprints == NULL) {
-		ast_log(LOG_ERROR, "Could not create fingerprint info.\n");
-		delete_temp_search_table(tablename);
-		sfree(tablename);
+	// search
+	processed = 1;
+	engine = fp_get_context_engine(context);
+	if(engine->data == ENGINE_DATA_LANDMARK) {
+		j_search = search_landmark(engine, context, filename, j_frames, &query, &frame_count, &processed);
+	}
+	else if(engine->data == ENGINE_DATA_VECTOR) {
+		j_search = search_vector(engine, context, filename, j_frames, &query, &frame_count, &processed);
+	}
+	else if(engine->data == ENGINE_DATA_SUBFINGERPRINT) {
+		j_search = search_binary(engine, context, filename, j_frames, &query, &frame_count, &processed);
+	}
+	else {
+		j_search = search_fingerprint(engine, context, filename, j_frames, &query, &frame_count, &processed);
+	}
+	if(processed < 1) {
+		ast_log(LOG_NOTICE, "The search has been stopped by the deadline. context[%s], engine[%s], deadline_ms[%d], processed[%f]\n", context, engine->name, deadline_ms, processed);
+	}
+	if((j_search == NULL) || (ast_json_array_size(j_search) == 0)) {
+		// not found
+		ast_log(LOG_NOTICE, "Could not find data.\n");
+		ast_json_unref(j_search);
 		return NULL;
 	}
-	ast_log(LOG_DEBUG, "Created search info.\n");
-
-	// search
-	frame_count = ast_json_array_size(j_fprints);
-	for(i = 0; i < frame_count; i++) {
-		j_tmp = ast_json_array_get(j_fprints, i);
-
-		freq = (int)ast_json_real_get(ast_json_object_get(j_tmp, "max1"));
-
-		/* validate frequency range */
-		if(freq_ignore_low > 0) {
-			freq_tmp = 10 * log10(freq_ignore_low);
-			if(freq < freq_tmp) {
-				/* ignore. frequency is too low */
-				continue;
-			}
-		}
-		if(freq_ignore_high > 0) {
-			freq_tmp = 10 * log10(freq_ignore_high);
-			if(freq > freq_tmp) {
-				/* ignore. frequency is too high */
-				continue;
-			}
-		}
-
-		ast_asprintf(&sql, "insert into %s select * from audio_fingerprint where "
-				" max1 >= %f "
-				" and max1 <= %f ",
-				tablename,
-				freq - tole,
-				freq + tole
-				);
-
-
-		// add more conditions if the more coefs has given.
-		for(j = 1; j < coefs; j++) {
-			ast_asprintf(&tmp_max, "max%d", j + 1);
+	ast_log(LOG_DEBUG, "Search complete. results[%zu], processed[%f]\n", ast_json_array_size(j_search), processed);
 
-			freq = ast_json_real_get(ast_json_object_get(j_tmp, tmp_max));
+	j_res = fp_create_search_result(j_search, frame_count, processed);
 
-			/* validate frequency range */
-			if(freq_ignore_low > 0) {
-				freq_tmp = 10 * log10(freq_ignore_low);
-				if(freq < freq_tmp) {
-					/* ignore. frequency is too low */
-					continue;
-				}
-			}
-			if(freq_ignore_high > 0) {
-				freq_tmp = 10 * log10(freq_ignore_high);
-				if(freq > freq_tmp) {
-					/* ignore. frequency is too high */
-					continue;
-				}
-			}
-
-			ast_asprintf(&tmp, "%s and %s >= %f and %s <= %f",
-					sql,
-
-					tmp_max,
-					freq - tole,
-
-					tmp_max,
-					freq + tole
-					);
-			sfree(tmp_max);
-			sfree(sql);
-			sql = tmp;
-		}
-
-		ast_asprintf(&tmp, "%s group by audio_uuid", sql);
-		sfree(sql);
-		sql = tmp;
+	return j_res;
+}
 
-		db_ctx = create_db_ctx();
-		db_ctx_exec(db_ctx, sql);
-		destroy_db_ctx(db_ctx);
+/**
+ * Create the incremental mfcc extractor of the voice samples.
+ * The frames are same as the fingerprints of the audio file(max1 ~ maxN).
+ * @return
+ */
+fp_extractor_t* fp_extractor_create(void)
+{
+	fp_extractor_t* extractor;
 
-		sfree(sql);
+	extractor = ast_calloc(1, sizeof(fp_extractor_t));
+	if(extractor == NULL) {
+		return NULL;
 	}
-	ast_json_unref(j_fprints);
-	ast_log(LOG_DEBUG, "Inserted search info.\n");
 
-	// get result
-	ast_asprintf(&sql, "select *, count(*) from %s group by audio_uuid order by count(*) DESC", tablename);
-	db_ctx = create_db_ctx();
-	db_ctx_query(db_ctx, sql);
-	sfree(sql);
+	extractor->pv = new_aubio_pvoc(DEF_AUBIO_BUFSIZE, DEF_AUBIO_HOPSIZE);
+	extractor->fftgrain = new_cvec(DEF_AUBIO_BUFSIZE);
+	extractor->mfcc = new_aubio_mfcc(DEF_AUBIO_BUFSIZE, DEF_AUBIO_FILTER, DEF_AUBIO_COEFS, DEF_AUBIO_SAMPLERATE);
+	extractor->mfcc_buf = new_fvec(DEF_AUBIO_HOPSIZE);
+	extractor->mfcc_out = new_fvec(DEF_AUBIO_COEFS);
+	extractor->buf_len = 0;
+	if((extractor->pv == NULL) || (extractor->fftgrain == NULL) || (extractor->mfcc == NULL) || (extractor->mfcc_buf == NULL) || (extractor->mfcc_out == NULL)) {
+		ast_log(LOG_ERROR, "Could not create mfcc extractor.\n");
+		fp_extractor_destroy(extractor);
+		return NULL;
+	}
 
-	j_search = db_ctx_get_record(db_ctx);
-	destroy_db_ctx(db_ctx);
-	ast_log(LOG_DEBUG, "Executed query.\n");
+	return extractor;
+}
 
-	// delete temp search table
-	ret = delete_temp_search_table(tablename);
-	if(ret == false) {
-		ast_log(LOG_WARNING, "Could not delete temp search table. tablename[%s]\n", tablename);
-		sfree(tablename);
-		ast_json_unref(j_search);
-		return false;
+void fp_extractor_destroy(fp_extractor_t* extractor)
+{
+	if(extractor == NULL) {
+		return;
 	}
-	sfree(tablename);
 
-	if(j_search == NULL) {
-		// not found
-		ast_log(LOG_NOTICE, "Could not find data.\n");
-		return NULL;
+	if(extractor->pv != NULL) {
+		del_aubio_pvoc(extractor->pv);
+	}
+	if(extractor->fftgrain != NULL) {
+		del_cvec(extractor->fftgrain);
+	}
+	if(extractor->mfcc != NULL) {
+		del_aubio_mfcc(extractor->mfcc);
+	}
+	if(extractor->mfcc_out != NULL) {
+		del_fvec(extractor->mfcc_out);
 	}
-	ast_log(LOG_DEBUG, "Search complete.\n");
+	if(extractor->mfcc_buf != NULL) {
+		del_fvec(extractor->mfcc_buf);
+	}
+	ast_free(extractor);
+}
 
-	// create result
-	j_res = get_audio_list_info(ast_json_string_get(ast_json_object_get(j_search, "audio_uuid")));
-	if(j_res == NULL) {
-		ast_log(LOG_WARNING, "Could not find audio list info.\n");
-		ast_json_unref(j_search);
+/**
+ * Add the voice sample into the extractor.
+ * @param extractor
+ * @param sample: signed linear sample of the 8 kHz.
+ * @param frame_idx: frame_idx of the new frame.
+ * @param uuid: audio_uuid of the new frame.
+ * @return the new frame's fingerprint if the hop is full. NULL if not.
+ */
+struct ast_json* fp_extractor_write(fp_extractor_t* extractor, const int16_t sample, const int frame_idx, const char* uuid)
+{
+	// same scale with the aubio source
+	extractor->mfcc_buf->data[extractor->buf_len] = sample / 32768.0;
+	extractor->buf_len++;
+	if(extractor->buf_len < DEF_AUBIO_HOPSIZE) {
 		return NULL;
 	}
-	ast_log(LOG_DEBUG, "Created result.\n");
+	extractor->buf_len = 0;
 
+	aubio_pvoc_do(extractor->pv, extractor->mfcc_buf, extractor->fftgrain);
+	aubio_mfcc_do(extractor->mfcc, extractor->fftgrain, extractor->mfcc_out);
 
-	ast_json_object_set(j_res, "frame_count", ast_json_integer_create(frame_count));
-	ast_json_object_set(j_res, "match_count", ast_json_ref(ast_json_object_get(j_search, "count(*)")));
-	ast_json_unref(j_search);
-
-	return j_res;
+	return create_mfcc_frame(extractor->mfcc_out, frame_idx, uuid, DEF_AUBIO_COEFS, false);
 }
 
 /**
- * Returns all list of fingerprinted info.
- * @return
+ * Create the search result with the ranked candidates.
+ * @param j_search: ranked candidates of the engine. Stolen.
+ * @param frame_count
+ * @param processed
+ * @return the best matched audio info with the ranked candidates("matches"). NULL if the audio info is not found.
  */
-struct ast_json* fp_get_audio_lists_all(void)
+struct ast_json* fp_create_search_result(struct ast_json* j_search, const int frame_count, const double processed)
 {
-	char* sql;
+	int i;
 	struct ast_json* j_res;
+	struct ast_json* j_matches;
+	struct ast_json* j_match;
 	struct ast_json* j_tmp;
-	db_ctx_t* db_ctx;
 
-	// get result
-	ast_asprintf(&sql, "%s", "select * from audio_list;");
-	db_ctx = create_db_ctx();
-	db_ctx_query(db_ctx, sql);
-	sfree(sql);
+	// create ranked candidates
+	j_matches = ast_json_array_create();
+	for(i = 0; i < ast_json_array_size(j_search); i++) {
+		j_tmp = ast_json_array_get(j_search, i);
 
-	j_res = ast_json_array_create();
-	while(1) {
-		j_tmp = db_ctx_get_record(db_ctx);
-		if(j_tmp == NULL) {
-			break;
+		j_match = get_audio_list_info(ast_json_string_get(ast_json_object_get(j_tmp, "audio_uuid")));
+		if(j_match == NULL) {
+			ast_log(LOG_WARNING, "Could not find audio list info. uuid[%s]\n", ast_json_string_get(ast_json_object_get(j_tmp, "audio_uuid")));
+			continue;
 		}
+		ast_json_object_set(j_match, "match_count", ast_json_ref(ast_json_object_get(j_tmp, "match_count")));
+		ast_json_object_set(j_match, "offset", ast_json_ref(ast_json_object_get(j_tmp, "offset")));
+		if(ast_json_object_get(j_tmp, "verify_cost") != NULL) {
+			ast_json_object_set(j_match, "verify_cost", ast_json_ref(ast_json_object_get(j_tmp, "verify_cost")));
+		}
+		if(ast_json_object_get(j_tmp, "bit_error_rate") != NULL) {
+			ast_json_object_set(j_match, "bit_error_rate", ast_json_ref(ast_json_object_get(j_tmp, "bit_error_rate")));
+		}
+		ast_json_array_append(j_matches, j_match);
+	}
+	ast_json_unref(j_search);
 
-		ast_json_array_append(j_res, j_tmp);
+	if(ast_json_array_size(j_matches) == 0) {
+		ast_log(LOG_WARNING, "Could not find audio list info.\n");
+		ast_json_unref(j_matches);
+		return NULL;
 	}
-	destroy_db_ctx(db_ctx);
+
+	// create result with the best one
+	j_res = ast_json_deep_copy(ast_json_array_get(j_matches, 0));
+	ast_json_object_set(j_res, "frame_count", ast_json_integer_create(frame_count));
+	ast_json_object_set(j_res, "partial", ast_json_boolean(processed < 1));
+	ast_json_object_set(j_res, "processed", ast_json_real_create(processed));
+	ast_json_object_set(j_res, "matches", j_matches);
+	ast_log(LOG_DEBUG, "Created result.\n");
 
 	return j_res;
 }
 
-struct ast_json* fp_get_audio_lists_by_contextname(const char* name)
+/**
+ * Search the given file with the mfcc fingerprints engine(index, cascade, scan, ngram, sql).
+ * @param engine
+ * @param context
+ * @param filename
+ * @param j_frames: extracted query frames of the file. NULL for none.
+ * @param query
+ * @param frame_count
+ * @param processed: searched ratio of the query. The partial result is not verified and cached.
+ * @return
+ */
+static struct ast_json* search_fingerprint(
+		const engine_t* engine,
+		const char* context,
+		const char* filename,
+		struct ast_json* j_frames,
+		const engine_query_t* query,
+		int* frame_count,
+		double* processed
+		)
 {
-	struct ast_json* j_res;
-	struct ast_json* j_tmp;
-	char* sql;
-	db_ctx_t* db_ctx;
+	int i;
+	char* uuid;
+	char* params;
+	char* key;
+	char cols[DEF_AUBIO_COEFS][10];
+	const char* names[DEF_AUBIO_COEFS];
+	struct ast_json* j_fprints;
+	struct ast_json* j_search;
+	engine_query_t fp_query;
 
-	if(name == NULL) {
-		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+	if((query->coefs < 1) || (query->coefs > DEF_AUBIO_COEFS)) {
+		ast_log(LOG_WARNING, "Wrong coefs count. max[%d], coefs[%d]\n", DEF_AUBIO_COEFS, query->coefs);
 		return NULL;
 	}
 
-	ast_asprintf(&sql, "select * from audio_list where context = '%s';", name);
-	db_ctx = create_db_ctx();
-	db_ctx_query(db_ctx, sql);
-	sfree(sql);
+	fp_query = *query;
+	if(fp_query.tolerance < 0) {
+		ast_log(LOG_NOTICE, "Wrong tolerance setting. Set to default. tolerance[%f], default[%f]\n", query->tolerance, DEF_SEARCH_TOLERANCE);
+		fp_query.tolerance = DEF_SEARCH_TOLERANCE;
+	}
 
-	j_res = ast_json_array_create();
-	while(1) {
-		j_tmp = db_ctx_get_record(db_ctx);
-		if(j_tmp == NULL) {
-			break;
+	// create fingerprint info
+	j_fprints = get_query_frames(j_frames, "fingerprints", frame_count);
+	if(j_fprints == NULL) {
+		uuid = fp_generate_uuid();
+		j_fprints = create_audio_fingerprints(filename, uuid);
+		sfree(uuid);
+		if(j_fprints == NULL) {
+			ast_log(LOG_ERROR, "Could not create fingerprint info.\n");
+			return NULL;
 		}
+		ast_log(LOG_DEBUG, "Created search info.\n");
 
-		ast_json_array_append(j_res, j_tmp);
+		*frame_count = ast_json_array_size(j_fprints);
+		set_query_frames(j_frames, "fingerprints", j_fprints, *frame_count);
 	}
-	destroy_db_ctx(db_ctx);
 
-	return j_res;
-}
+	// create cache key with the search options and the quantized coefs
+	for(i = 0; i < fp_query.coefs; i++) {
+		snprintf(cols[i], sizeof(cols[i]), "max%d", i + 1);
+		names[i] = cols[i];
+	}
+	ast_asprintf(&params, "%s:%d:%f:%d:%d:%d", engine->name, fp_query.coefs, fp_query.tolerance, fp_query.freq_ignore_low, fp_query.freq_ignore_high, fp_query.max_results);
+	key = create_search_key(params, j_fprints, names, fp_query.coefs, DEF_SEARCH_CACHE_STEP);
+	sfree(params);
+
+	j_search = search_cached(engine, context, key, j_fprints, &fp_query, processed);
+	ast_json_unref(j_fprints);
+	sfree(key);
+
+	return j_search;
+}
+
+/**
+ * Search the given file with the landmark engine.
+ * The peaks out of freq_ignore_low ~ freq_ignore_high(Hz) are ignored.
+ * @param engine
+ * @param context
+ * @param filename
+ * @param j_frames: extracted query frames of the file. NULL for none.
+ * @param query
+ * @param frame_count
+ * @param processed: searched ratio of the query. The partial result is not cached.
+ * @return
+ */
+static struct ast_json* search_landmark(
+		const engine_t* engine,
+		const char* context,
+		const char* filename,
+		struct ast_json* j_frames,
+		const engine_query_t* query,
+		int* frame_count,
+		double* processed
+		)
+{
+	char* params;
+	char* key;
+	char* name;
+	const char* names[] = {"hash", "frame_idx"};
+	struct ast_json* j_landmarks;
+	struct ast_json* j_search;
+
+	// create landmark info. the peaks depend on the frequency range.
+	ast_asprintf(&name, "landmarks:%d:%d", query->freq_ignore_low, query->freq_ignore_high);
+	j_landmarks = get_query_frames(j_frames, name, frame_count);
+	if(j_landmarks == NULL) {
+		j_landmarks = create_audio_landmarks(filename, query->freq_ignore_low, query->freq_ignore_high, frame_count);
+		if(j_landmarks == NULL) {
+			ast_log(LOG_ERROR, "Could not create landmark info.\n");
+			sfree(name);
+			return NULL;
+		}
+		ast_log(LOG_DEBUG, "Created search info. landmarks[%zu]\n", ast_json_array_size(j_landmarks));
+
+		set_query_frames(j_frames, name, j_landmarks, *frame_count);
+	}
+	sfree(name);
+
+	// create cache key with the search options and the landmarks
+	ast_asprintf(&params, "%s:%d:%d:%d", engine->name, query->freq_ignore_low, query->freq_ignore_high, query->max_results);
+	key = create_search_key(params, j_landmarks, names, ARRAY_LEN(names), 0);
+	sfree(params);
+
+	j_search = search_cached(engine, context, key, j_landmarks, query, processed);
+	ast_json_unref(j_landmarks);
+	sfree(key);
+
+	return j_search;
+}
+
+/**
+ * Search the given file with the full mfcc vector engine.
+ * The coefs, tolerance and freq_ignore options are not used.
+ * @param engine
+ * @param context
+ * @param filename
+ * @param j_frames: extracted query frames of the file. NULL for none.
+ * @param query
+ * @param frame_count
+ * @param processed: searched ratio of the query. The partial result is not verified and cached.
+ * @return
+ */
+static struct ast_json* search_vector(
+		const engine_t* engine,
+		const char* context,
+		const char* filename,
+		struct ast_json* j_frames,
+		const engine_query_t* query,
+		int* frame_count,
+		double* processed
+		)
+{
+	int i;
+	char* uuid;
+	char* params;
+	char* key;
+	char cols[DEF_AUBIO_VECTOR_COEFS][10];
+	const char* names[DEF_AUBIO_VECTOR_COEFS];
+	struct ast_json* j_vectors;
+	struct ast_json* j_search;
+
+	// create vector info
+	j_vectors = get_query_frames(j_frames, "vectors", frame_count);
+	if(j_vectors == NULL) {
+		uuid = fp_generate_uuid();
+		j_vectors = create_audio_vectors(filename, uuid);
+		sfree(uuid);
+		if(j_vectors == NULL) {
+			ast_log(LOG_ERROR, "Could not create vector info.\n");
+			return NULL;
+		}
+		ast_log(LOG_DEBUG, "Created search info. vectors[%zu]\n", ast_json_array_size(j_vectors));
+
+		*frame_count = ast_json_array_size(j_vectors);
+		set_query_frames(j_frames, "vectors", j_vectors, *frame_count);
+	}
+
+	// create cache key with the search options and the quantized vectors
+	for(i = 0; i < DEF_AUBIO_VECTOR_COEFS; i++) {
+		snprintf(cols[i], sizeof(cols[i]), "mfcc%d", i + 1);
+		names[i] = cols[i];
+	}
+	ast_asprintf(&params, "%s:%d", engine->name, query->max_results);
+	key = create_search_key(params, j_vectors, names, DEF_AUBIO_VECTOR_COEFS, DEF_SEARCH_CACHE_STEP);
+	sfree(params);
+
+	j_search = search_cached(engine, context, key, j_vectors, query, processed);
+	ast_json_unref(j_vectors);
+	sfree(key);
+
+	return j_search;
+}
+
+/**
+ * Search the given file with the binary sub-fingerprint engine.
+ * The coefs, tolerance and freq_ignore options are not used.
+ * @param engine
+ * @param context
+ * @param filename
+ * @param j_frames: extracted query frames of the file. NULL for none.
+ * @param query
+ * @param frame_count
+ * @param processed: searched ratio of the reference frames. The partial result is not cached.
+ * @return
+ */
+static struct ast_json* search_binary(
+		const engine_t* engine,
+		const char* context,
+		const char* filename,
+		struct ast_json* j_frames,
+		const engine_query_t* query,
+		int* frame_count,
+		double* processed
+		)
+{
+	char* params;
+	char* key;
+	const char* names[] = {"bits"};
+	struct ast_json* j_subfprints;
+	struct ast_json* j_search;
+
+	// create sub-fingerprint info
+	j_subfprints = get_query_frames(j_frames, "subfingerprints", frame_count);
+	if(j_subfprints == NULL) {
+		j_subfprints = create_audio_subfingerprints(filename, frame_count);
+		if(j_subfprints == NULL) {
+			ast_log(LOG_ERROR, "Could not create sub-fingerprint info.\n");
+			return NULL;
+		}
+		ast_log(LOG_DEBUG, "Created search info. subfingerprints[%zu]\n", ast_json_array_size(j_subfprints));
+
+		set_query_frames(j_frames, "subfingerprints", j_subfprints, *frame_count);
+	}
+
+	// create cache key with the search options and the sub-fingerprints
+	ast_asprintf(&params, "%s:%d", engine->name, query->max_results);
+	key = create_search_key(params, j_subfprints, names, ARRAY_LEN(names), 0);
+	sfree(params);
+
+	j_search = search_cached(engine, context, key, j_subfprints, query, processed);
+	ast_json_unref(j_subfprints);
+	sfree(key);
+
+	return j_search;
+}
+
+/**
+ * Returns the cached search result of the given key, or searches with the engine and caches the result.
+ * The partial result is not cached.
+ * @param engine
+ * @param context
+ * @param key: cache key of the query and the search options.
+ * @param j_query: query of the engine's data type.
+ * @param query
+ * @param processed
+ * @return
+ */
+static struct ast_json* search_cached(const engine_t* engine, const char* context, const char* key, struct ast_json* j_query, const engine_query_t* query, double* processed)
+{
+	unsigned long generation;
+	struct ast_json* j_search;
+
+	// the result searched before the context's change is dropped at the cache_set
+	generation = cache_get_generation(context);
+
+	j_search = cache_get(context, key);
+	if(j_search != NULL) {
+		ast_log(LOG_DEBUG, "Found cached search result. context[%s], key[%s]\n", context, key);
+		*processed = 1;
+		return j_search;
+	}
+
+	j_search = run_engine_search(engine, context, j_query, query, processed);
+	if((j_search != NULL) && (*processed >= 1)) {
+		cache_set(context, key, j_search, generation);
+	}
+
+	return j_search;
+}
+
+/**
+ * Returns the kept query frames of the given key.
+ * @param j_frames: extracted query frames of the file. NULL for none.
+ * @param key: frame type. i.e. fingerprints, vectors
+ * @param frame_count: frame count of the file.
+ * @return new reference. NULL if not kept.
+ */
+static struct ast_json* get_query_frames(struct ast_json* j_frames, const char* key, int* frame_count)
+{
+	struct ast_json* j_tmp;
+
+	j_tmp = ast_json_object_get(j_frames, key);
+	if(j_tmp == NULL) {
+		return NULL;
+	}
+	ast_log(LOG_DEBUG, "Reuse the extracted query frames. key[%s]\n", key);
+
+	*frame_count = ast_json_integer_get(ast_json_object_get(j_tmp, "frame_count"));
+
+	return ast_json_ref(ast_json_object_get(j_tmp, "frames"));
+}
+
+/**
+ * Keep the extracted query frames of the given key.
+ * @param j_frames: extracted query frames of the file. NULL for not to keep.
+ * @param key
+ * @param j_data: extracted frames. Not stolen.
+ * @param frame_count
+ */
+static void set_query_frames(struct ast_json* j_frames, const char* key, struct ast_json* j_data, const int frame_count)
+{
+	struct ast_json* j_tmp;
+
+	if(j_frames == NULL) {
+		return;
+	}
+
+	j_tmp = ast_json_pack("{s:i}",
+			"frame_count",	frame_count
+			);
+	ast_json_object_set(j_tmp, "frames", ast_json_ref(j_data));
+	ast_json_object_set(j_frames, key, j_tmp);
+}
+
+/**
+ * Search the query with the engine.
+ * The top candidates of the engine are verified with the frame alignment, if the engine needs.
+ * The partial result(stopped by the deadline) is not verified.
+ * @param engine
+ * @param context
+ * @param j_query: query fingerprint info of the engine's data type.
+ * @param query
+ * @param processed
+ * @return
+ */
+static struct ast_json* run_engine_search(const engine_t* engine, const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed)
+{
+	engine_query_t coarse;
+	struct ast_json* j_search;
+
+	// the coarse search gives more candidates to verify
+	coarse = *query;
+	if(engine->verify != ENGINE_VERIFY_NONE) {
+		coarse.max_results = MAX(coarse.max_results, verify_get_candidates());
+	}
+	if(engine->verify == ENGINE_VERIFY_FORCE) {
+		coarse.max_results = MAX(coarse.max_results, engine->min_candidates);
+	}
+
+	j_search = fp_search_engine(engine, context, j_query, &coarse, processed);
+	if(engine->verify == ENGINE_VERIFY_NONE) {
+		return j_search;
+	}
+
+	if(*processed < 1) {
+		// out of time. the coarse candidates as it is.
+		fp_trim_search_results(j_search, query->max_results);
+		return j_search;
+	}
+
+	j_search = fp_verify_search(context, j_search, j_query, (engine->data == ENGINE_DATA_VECTOR), (engine->verify == ENGINE_VERIFY_FORCE), query->max_results);
+
+	return j_search;
+}
+
+/**
+ * Search the query with the engine.
+ * If the batching is enabled and the engine supports, the concurrent searches of
+ * the same context and search options are collected and searched at once.
+ * @param engine
+ * @param context
+ * @param j_query
+ * @param query
+ * @param processed
+ * @return
+ */
+struct ast_json* fp_search_engine(const engine_t* engine, const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed)
+{
+	char* key;
+	batch_search_t request;
+
+	if((engine->search_batch == NULL) || (batch_is_enabled() == false)) {
+		return engine->search(context, j_query, query, processed);
+	}
+
+	// the deadline is kept in each query
+	ast_asprintf(&key, "%s:%s:%d:%f:%d:%d:%d",
+			engine->name,
+			context,
+			query->coefs,
+			query->tolerance,
+			query->freq_ignore_low,
+			query->freq_ignore_high,
+			query->max_results
+			);
+
+	memset(&request, 0x00, sizeof(request));
+	request.engine = engine;
+	request.context = context;
+	request.j_query = j_query;
+	request.query = query;
+	request.processed = 1;
+
+	batch_run(key, &request, run_batch_search);
+	sfree(key);
+
+	if(processed != NULL) {
+		*processed = request.processed;
+	}
+
+	return request.j_res;
+}
+
+/**
+ * Run the batched search requests(batch_search_t) of the same key.
+ * The single request is searched alone, so it can be split into the worker threads.
+ * @param requests
+ * @param count
+ */
+static void run_batch_search(void** requests, const int count)
+{
+	int i;
+	batch_search_t* request;
+	struct ast_json** j_queries;
+	struct ast_json** j_results;
+	const engine_query_t** queries;
+	double* processed;
+
+	request = requests[0];
+	if(count == 1) {
+		request->j_res = request->engine->search(request->context, request->j_query, request->query, &request->processed);
+		return;
+	}
+
+	j_queries = ast_calloc(count, sizeof(struct ast_json*));
+	j_results = ast_calloc(count, sizeof(struct ast_json*));
+	queries = ast_calloc(count, sizeof(engine_query_t*));
+	processed = ast_calloc(count, sizeof(double));
+	for(i = 0; i < count; i++) {
+		request = requests[i];
+		j_queries[i] = request->j_query;
+		queries[i] = request->query;
+	}
+
+	request = requests[0];
+	request->engine->search_batch(request->context, j_queries, queries, count, j_results, processed);
+
+	for(i = 0; i < count; i++) {
+		request = requests[i];
+		request->j_res = j_results[i];
+		request->processed = processed[i];
+	}
+	ast_log(LOG_DEBUG, "Searched batched queries. context[%s], engine[%s], count[%d]\n", request->context, request->engine->name, count);
+
+	sfree(j_queries);
+	sfree(j_results);
+	sfree(queries);
+	sfree(processed);
+}
+
+/**
+ * Drop the candidates over the max_results.
+ * @param j_search: ranked candidates.
+ * @param max_results
+ */
+void fp_trim_search_results(struct ast_json* j_search, const int max_results)
+{
+	if(j_search == NULL) {
+		return;
+	}
+
+	while(ast_json_array_size(j_search) > max_results) {
+		ast_json_array_remove(j_search, ast_json_array_size(j_search) - 1);
+	}
+}
+
+/**
+ * Verify the coarse candidates with the frame alignment of the query and the candidate's stored frames.
+ * Returns the given coarse candidates as it is if the verification is disabled.
+ * @param context
+ * @param j_search: coarse candidates. Stolen.
+ * @param j_query: query fingerprints(max1 ~ maxN) or vectors(mfcc1 ~ mfccN)
+ * @param vector: true if the j_query is vectors.
+ * @param force: true verifies even if the verification is disabled.
+ * @param max_results
+ * @return
+ */
+struct ast_json* fp_verify_search(const char* context, struct ast_json* j_search, struct ast_json* j_query, const bool vector, const bool force, const int max_results)
+{
+	int i;
+	int j;
+	int dims;
+	int count;
+	char col[10];
+	float* query;
+	verify_load_t load;
+	struct ast_json* j_res;
+
+	if((j_search == NULL) || (ast_json_array_size(j_search) == 0) || ((verify_get_candidates() == 0) && (force == false))) {
+		return j_search;
+	}
+
+	// query frames in the frame order
+	dims = (vector == true) ? DEF_AUBIO_VECTOR_COEFS : DEF_AUBIO_COEFS;
+	count = ast_json_array_size(j_query);
+	query = ast_calloc(count + 1, sizeof(float) * dims);
+	for(i = 0; i < count; i++) {
+		for(j = 0; j < dims; j++) {
+			snprintf(col, sizeof(col), (vector == true) ? "mfcc%d" : "max%d", j + 1);
+			query[i * dims + j] = ast_json_real_get(ast_json_object_get(ast_json_array_get(j_query, i), col));
+		}
+	}
+
+	load.context = context;
+	load.vector = vector;
+	j_res = verify_rank(j_search, query, count, dims, load_verify_frames, &load, max_results);
+	sfree(query);
+	if(j_res == NULL) {
+		ast_log(LOG_WARNING, "Could not verify the candidates. Use the coarse candidates.\n");
+		return j_search;
+	}
+	ast_json_unref(j_search);
+
+	return j_res;
+}
+
+/**
+ * verify_load_fn of the stored fingerprints and vectors.
+ * @param data: verify_load_t
+ * @param uuid
+ * @param start
+ * @param count
+ * @param frames
+ * @param exists
+ * @return
+ */
+static bool load_verify_frames(void* data, const char* uuid, const int start, const int count, float* frames, bool* exists)
+{
+	int i;
+	int j;
+	int dims;
+	int idx;
+	char col[10];
+	const verify_load_t* load;
+	struct ast_json* j_frames;
+	struct ast_json* j_frame;
+	db_stmt_t* stmt;
+
+	load = data;
+	if(load->vector == true) {
+		dims = DEF_AUBIO_VECTOR_COEFS;
+		stmt = db_ctx_stmt_get(g_db_ctx, "get_verify_vectors", "select * from audio_vector where context = ? and audio_uuid = ? and frame_idx >= ? and frame_idx < ? order by frame_idx;");
+	}
+	else {
+		dims = DEF_AUBIO_COEFS;
+		stmt = db_ctx_stmt_get(g_db_ctx, "get_verify_fingerprints", "select * from audio_fingerprint where context = ? and audio_uuid = ? and frame_idx >= ? and frame_idx < ? order by frame_idx;");
+	}
+	if(stmt == NULL) {
+		return false;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, load->context);
+	db_ctx_stmt_bind_text(stmt, 2, uuid);
+	db_ctx_stmt_bind_int(stmt, 3, start);
+	db_ctx_stmt_bind_int(stmt, 4, start + count);
+	j_frames = get_stmt_records(stmt);
+	db_ctx_stmt_release(stmt);
+
+	for(i = 0; i < ast_json_array_size(j_frames); i++) {
+		j_frame = ast_json_array_get(j_frames, i);
+
+		idx = ast_json_integer_get(ast_json_object_get(j_frame, "frame_idx")) - start;
+		if((idx < 0) || (idx >= count)) {
+			continue;
+		}
+
+		for(j = 0; j < dims; j++) {
+			snprintf(col, sizeof(col), (load->vector == true) ? "mfcc%d" : "max%d", j + 1);
+			frames[idx * dims + j] = ast_json_real_get(ast_json_object_get(j_frame, col));
+		}
+		exists[idx] = true;
+	}
+	ast_json_unref(j_frames);
+
+	return true;
+}
+
+/**
+ * Returns all list of fingerprinted info.
+ * @return
+ */
+struct ast_json* fp_get_audio_lists_all(void)
+{
+	struct ast_json* j_res;
+	db_stmt_t* stmt;
+
+	// get result
+	stmt = db_ctx_stmt_get(g_db_ctx, "get_audio_lists_all", "select * from audio_list;");
+	if(stmt == NULL) {
+		return NULL;
+	}
+	j_res = get_stmt_records(stmt);
+	db_ctx_stmt_release(stmt);
+
+	return j_res;
+}
+
+struct ast_json* fp_get_audio_lists_by_contextname(const char* name)
+{
+	struct ast_json* j_res;
+	db_stmt_t* stmt;
+
+	if(name == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	stmt = db_ctx_stmt_get(g_db_ctx, "get_audio_lists_by_context", "select * from audio_list where context = ?;");
+	if(stmt == NULL) {
+		return NULL;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, name);
+	j_res = get_stmt_records(stmt);
+	db_ctx_stmt_release(stmt);
+
+	return j_res;
+}
 
 /**
  * Create audio list data and insert it.
@@ -483,6 +1307,7 @@ static int create_audio_list_info(const char* context, const char* filename, con
 	char* tmp;
 	const char* name;
 	struct ast_json* j_tmp;
+	db_stmt_t* stmt;
 
 	if((context == NULL) || (filename == NULL) || (uuid == NULL)) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
@@ -502,25 +1327,28 @@ static int create_audio_list_info(const char* context, const char* filename, con
 	j_tmp = get_audio_list_info_by_context_and_hash(context, hash);
 	if(j_tmp != NULL) {
 		ast_log(LOG_VERBOSE, "The given file is already fingerprinted. context[%s], filename[%s]\n", context, filename);
+		ast_json_unref(j_tmp);
 		sfree(hash);
 		return 0;
 	}
 
-	// craete data
+	// insert
 	tmp = ast_strdup(filename);
 	name = basename(tmp);
-	j_tmp = ast_json_pack("{s:s, s:s, s:s, s:s}",
-			"uuid", 	uuid,
-			"name",		name,
-			"context",	context,
-			"hash",		hash
-			);
+	stmt = db_ctx_stmt_get(g_db_ctx, "insert_audio_list", "insert into audio_list(uuid, name, context, hash) values (?, ?, ?, ?);");
+	if(stmt == NULL) {
+		sfree(tmp);
+		sfree(hash);
+		return -1;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, uuid);
+	db_ctx_stmt_bind_text(stmt, 2, name);
+	db_ctx_stmt_bind_text(stmt, 3, context);
+	db_ctx_stmt_bind_text(stmt, 4, hash);
+	ret = db_ctx_stmt_step(stmt);
+	db_ctx_stmt_release(stmt);
 	sfree(tmp);
 	sfree(hash);
-
-	// insert
-	ret = db_ctx_insert(g_db_ctx, "audio_list", j_tmp);
-	ast_json_unref(j_tmp);
 	if(ret == false) {
 		ast_log(LOG_ERROR, "Could not create fingerprint info.\n");
 		return -1;
@@ -539,8 +1367,14 @@ static bool create_audio_fingerprint_info(const char* context, const char* filen
 {
 	int ret;
 	int idx;
+	int i;
+	char* sql;
+	char* tmp;
+	char col_max[10];
 	struct ast_json* j_fprint;
 	struct ast_json* j_fprints;
+	db_stmt_t* stmt;
+	const engine_t* engine;
 
 	if((filename == NULL) || (uuid == NULL)) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
@@ -548,6 +1382,21 @@ static bool create_audio_fingerprint_info(const char* context, const char* filen
 	}
 	ast_log(LOG_DEBUG, "Fired create_audio_fingerprint_info. filename[%s], uuid[%s]\n", filename, uuid);
 
+	// each context keeps its engine's fingerprint info only
+	engine = fp_get_context_engine(context);
+	if(engine->data == ENGINE_DATA_LANDMARK) {
+		ret = create_audio_landmark_info(context, filename, uuid);
+		return ret;
+	}
+	else if(engine->data == ENGINE_DATA_VECTOR) {
+		ret = create_audio_vector_info(context, filename, uuid);
+		return ret;
+	}
+	else if(engine->data == ENGINE_DATA_SUBFINGERPRINT) {
+		ret = create_audio_subfingerprint_info(context, filename, uuid);
+		return ret;
+	}
+
 	// craete fingerprint data
 	j_fprints = create_audio_fingerprints(filename, uuid);
 	if(j_fprints == NULL) {
@@ -555,26 +1404,106 @@ static bool create_audio_fingerprint_info(const char* context, const char* filen
 		return false;
 	}
 
-	// insert data
-	for(idx = 0; idx < ast_json_array_size(j_fprints); idx++) {
+	// create insert sql. context, audio_uuid, frame_idx, max1 ~ maxN
+	ast_asprintf(&sql, "%s", "insert into audio_fingerprint values (?, ?, ?");
+	for(i = 0; i < DEF_AUBIO_COEFS; i++) {
+		ast_asprintf(&tmp, "%s, ?", sql);
+		sfree(sql);
+		sql = tmp;
+	}
+	ast_asprintf(&tmp, "%s);", sql);
+	sfree(sql);
+	sql = tmp;
+
+	// insert data. the audio's frames are inserted in one transaction.
+	ret = db_ctx_begin(g_db_ctx);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not begin the transaction.\n");
+		sfree(sql);
+		ast_json_unref(j_fprints);
+		return false;
+	}
+	stmt = db_ctx_stmt_get(g_db_ctx, "insert_audio_fingerprint", sql);
+	sfree(sql);
+	if(stmt == NULL) {
+		db_ctx_rollback(g_db_ctx);
+		ast_json_unref(j_fprints);
+		return false;
+	}
+	for(idx = 0; idx < ast_json_array_size(j_fprints); idx++) {
 		j_fprint = ast_json_array_get(j_fprints, idx);
 		if(j_fprint == NULL) {
 			continue;
 		}
 
-		ast_json_object_set(j_fprint, "context", ast_json_string_create(context));
-		ret = db_ctx_insert(g_db_ctx, "audio_fingerprint", j_fprint);
+		db_ctx_stmt_bind_text(stmt, 1, context);
+		db_ctx_stmt_bind_text(stmt, 2, uuid);
+		db_ctx_stmt_bind_int(stmt, 3, ast_json_integer_get(ast_json_object_get(j_fprint, "frame_idx")));
+		for(i = 0; i < DEF_AUBIO_COEFS; i++) {
+			snprintf(col_max, sizeof(col_max), "max%d", i + 1);
+			db_ctx_stmt_bind_double(stmt, i + 4, ast_json_real_get(ast_json_object_get(j_fprint, col_max)));
+		}
+		ret = db_ctx_stmt_step(stmt);
 		if(ret == false) {
-			ast_log(LOG_WARNING, "Could not insert fingerprint data.\n");
-			continue;
+			break;
 		}
 	}
+	db_ctx_stmt_release(stmt);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not insert fingerprint data. context[%s], uuid[%s]\n", context, uuid);
+		db_ctx_rollback(g_db_ctx);
+		ast_json_unref(j_fprints);
+		return false;
+	}
+	ret = db_ctx_commit(g_db_ctx);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not commit fingerprint data. context[%s], uuid[%s]\n", context, uuid);
+		ast_json_unref(j_fprints);
+		return false;
+	}
+
+	// add to index
+	ret = engine->add_audio(context, uuid, j_fprints);
 	ast_json_unref(j_fprints);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not add fingerprint data to index. context[%s], uuid[%s]\n", context, uuid);
+		return false;
+	}
 
 	return true;
 }
 
+/**
+ * Create the mfcc fingerprints of the given file.
+ * @param filename
+ * @param uuid
+ * @return [{"frame_idx": <idx>, "audio_uuid": <uuid>, "max1": <coef>, ..., "maxN": <coef>}, ...]
+ */
 static struct ast_json* create_audio_fingerprints(const char* filename, const char* uuid)
+{
+	return create_audio_mfccs(filename, uuid, DEF_AUBIO_COEFS, false);
+}
+
+/**
+ * Create the full mfcc frame vectors of the given file.
+ * @param filename
+ * @param uuid
+ * @return [{"frame_idx": <idx>, "audio_uuid": <uuid>, "mfcc1": <coef>, ..., "mfccN": <coef>}, ...]
+ */
+static struct ast_json* create_audio_vectors(const char* filename, const char* uuid)
+{
+	return create_audio_mfccs(filename, uuid, DEF_AUBIO_VECTOR_COEFS, true);
+}
+
+/**
+ * Create the mfcc data of each frame of the given file.
+ * @param filename
+ * @param uuid
+ * @param coefs
+ * @param vector: true gives the raw coefs as mfcc1 ~ mfccN. false gives the coefs in dB as max1 ~ maxN.
+ * @return
+ */
+static struct ast_json* create_audio_mfccs(const char* filename, const char* uuid, const int coefs, const bool vector)
 {
 	struct ast_json* j_res;
 	struct ast_json* j_tmp;
@@ -582,8 +1511,6 @@ static struct ast_json* create_audio_fingerprints(const char* filename, const ch
 	int count;
 	int samplerate;
 	char* source;
-	int i;
-	char col_max[10];
 
 	aubio_pvoc_t* pv;
 	cvec_t*	fftgrain;
@@ -597,7 +1524,7 @@ static struct ast_json* create_audio_fingerprints(const char* filename, const ch
 		fprintf(stderr, "Wrong input parameter.\n");
 		return NULL;
 	}
-	ast_log(LOG_DEBUG, "Fired create_audio_fingerprints. filename[%s], uuid[%s]\n", filename, uuid);
+	ast_log(LOG_DEBUG, "Fired create_audio_mfccs. filename[%s], uuid[%s], coefs[%d]\n", filename, uuid, coefs);
 
 	// initiate aubio src
 	source = ast_strdup(filename);
@@ -612,9 +1539,9 @@ static struct ast_json* create_audio_fingerprints(const char* filename, const ch
 	samplerate = aubio_source_get_samplerate(aubio_src);
 	pv = new_aubio_pvoc(DEF_AUBIO_BUFSIZE, DEF_AUBIO_HOPSIZE);
 	fftgrain = new_cvec(DEF_AUBIO_BUFSIZE);
-	mfcc = new_aubio_mfcc(DEF_AUBIO_BUFSIZE, DEF_AUBIO_FILTER, DEF_AUBIO_COEFS, samplerate);
+	mfcc = new_aubio_mfcc(DEF_AUBIO_BUFSIZE, DEF_AUBIO_FILTER, coefs, samplerate);
 	mfcc_buf = new_fvec(DEF_AUBIO_HOPSIZE);
-	mfcc_out = new_fvec(DEF_AUBIO_COEFS);
+	mfcc_out = new_fvec(coefs);
 	if((pv == NULL) || (fftgrain == NULL) || (mfcc == NULL) || (mfcc_buf == NULL) || (mfcc_out == NULL)) {
 		ast_log(LOG_ERROR, "Could not initiate aubio parameters.\n");
 
@@ -642,15 +1569,7 @@ static struct ast_json* create_audio_fingerprints(const char* filename, const ch
 		aubio_mfcc_do(mfcc, fftgrain, mfcc_out);
 
 		// create mfcc data
-		j_tmp = ast_json_pack("{s:i, s:s}",
-				"frame_idx",	count,
-				"audio_uuid",	uuid
-				);
-		for(i = 0; i < DEF_AUBIO_COEFS; i++) {
-			snprintf(col_max, sizeof(col_max), "max%d", i + 1);
-			ast_json_object_set(j_tmp, col_max, ast_json_real_create(10 * log10(fabs(mfcc_out->data[i]))));
-		}
-
+		j_tmp = create_mfcc_frame(mfcc_out, count, uuid, coefs, vector);
 		if(j_tmp == NULL) {
 			ast_log(LOG_ERROR, "Could not create mfcc data.\n");
 			continue;
@@ -670,89 +1589,1414 @@ static struct ast_json* create_audio_fingerprints(const char* filename, const ch
 	return j_res;
 }
 
-static bool init_database(void)
+/**
+ * Create the mfcc data of one frame.
+ * @param mfcc_out
+ * @param frame_idx
+ * @param uuid
+ * @param coefs
+ * @param vector: true gives the raw coefs as mfcc1 ~ mfccN. false gives the coefs in dB as max1 ~ maxN.
+ * @return
+ */
+static struct ast_json* create_mfcc_frame(const fvec_t* mfcc_out, const int frame_idx, const char* uuid, const int coefs, const bool vector)
+{
+	int i;
+	char col_max[10];
+	struct ast_json* j_res;
+
+	j_res = ast_json_pack("{s:i, s:s}",
+			"frame_idx",	frame_idx,
+			"audio_uuid",	uuid
+			);
+	if(j_res == NULL) {
+		return NULL;
+	}
+
+	for(i = 0; i < coefs; i++) {
+		if(vector == true) {
+			snprintf(col_max, sizeof(col_max), "mfcc%d", i + 1);
+			ast_json_object_set(j_res, col_max, ast_json_real_create(mfcc_out->data[i]));
+		}
+		else {
+			snprintf(col_max, sizeof(col_max), "max%d", i + 1);
+			ast_json_object_set(j_res, col_max, ast_json_real_create(10 * log10(fabs(mfcc_out->data[i]))));
+		}
+	}
+
+	return j_res;
+}
+
+/**
+ * Create audio landmark data and insert it.
+ * @param context
+ * @param filename
+ * @param uuid
+ * @return
+ */
+static bool create_audio_landmark_info(const char* context, const char* filename, const char* uuid)
+{
+	int ret;
+	int idx;
+	int frame_count;
+	struct ast_json* j_landmark;
+	struct ast_json* j_landmarks;
+	db_stmt_t* stmt;
+
+	if((context == NULL) || (filename == NULL) || (uuid == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+	ast_log(LOG_DEBUG, "Fired create_audio_landmark_info. filename[%s], uuid[%s]\n", filename, uuid);
+
+	// create landmark data
+	j_landmarks = create_audio_landmarks(filename, -1, -1, &frame_count);
+	if(j_landmarks == NULL) {
+		ast_log(LOG_ERROR, "Could not create landmark data.\n");
+		return false;
+	}
+
+	// insert data. the audio's frames are inserted in one transaction.
+	ret = db_ctx_begin(g_db_ctx);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not begin the transaction.\n");
+		ast_json_unref(j_landmarks);
+		return false;
+	}
+	stmt = db_ctx_stmt_get(g_db_ctx, "insert_audio_landmark", "insert into audio_landmark(context, audio_uuid, hash, frame_idx) values (?, ?, ?, ?);");
+	if(stmt == NULL) {
+		db_ctx_rollback(g_db_ctx);
+		ast_json_unref(j_landmarks);
+		return false;
+	}
+	for(idx = 0; idx < ast_json_array_size(j_landmarks); idx++) {
+		j_landmark = ast_json_array_get(j_landmarks, idx);
+		if(j_landmark == NULL) {
+			continue;
+		}
+
+		db_ctx_stmt_bind_text(stmt, 1, context);
+		db_ctx_stmt_bind_text(stmt, 2, uuid);
+		db_ctx_stmt_bind_int(stmt, 3, ast_json_integer_get(ast_json_object_get(j_landmark, "hash")));
+		db_ctx_stmt_bind_int(stmt, 4, ast_json_integer_get(ast_json_object_get(j_landmark, "frame_idx")));
+		ret = db_ctx_stmt_step(stmt);
+		if(ret == false) {
+			break;
+		}
+	}
+	db_ctx_stmt_release(stmt);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not insert landmark data. context[%s], uuid[%s]\n", context, uuid);
+		db_ctx_rollback(g_db_ctx);
+		ast_json_unref(j_landmarks);
+		return false;
+	}
+	ret = db_ctx_commit(g_db_ctx);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not commit landmark data. context[%s], uuid[%s]\n", context, uuid);
+		ast_json_unref(j_landmarks);
+		return false;
+	}
+
+	// add to index
+	ret = fp_get_context_engine(context)->add_audio(context, uuid, j_landmarks);
+	ast_json_unref(j_landmarks);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not add landmark data to index. context[%s], uuid[%s]\n", context, uuid);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Create the landmarks of the given file.
+ * Picks the spectral peaks of each frame and hashes the peak pairs as (f1, f2, dt).
+ * @param filename
+ * @param freq_ignore_low: ignore the peaks lower than this(Hz). Ignored if it's not positive.
+ * @param freq_ignore_high: ignore the peaks higher than this(Hz). Ignored if it's not positive.
+ * @param frame_count: the number of read frames.
+ * @return [{"hash": <hash>, "frame_idx": <anchor frame idx>}, ...]
+ */
+static struct ast_json* create_audio_landmarks(const char* filename, const int freq_ignore_low, const int freq_ignore_high, int* frame_count)
+{
+	struct ast_json* j_res;
+	struct ast_json* j_tmp;
+	unsigned int reads;
+	int count;
+	char* source;
+	int i;
+	int j;
+	int bin;
+	int bins;
+	int bin_low;
+	int bin_high;
+	int dt;
+	int pairs;
+	int peak_count;
+	int peak_size;
+	int frame_peak_count;
+	uint32_t hash;
+	double avg;
+	double threshold;
+	float magnitude;
+	landmark_peak_t* peaks;
+	landmark_peak_t frame_peaks[DEF_LANDMARK_PEAKS];
+
+	aubio_pvoc_t* pv;
+	cvec_t*	fftgrain;
+	fvec_t* buf;
+
+	aubio_source_t* aubio_src;
+
+	if((filename == NULL) || (frame_count == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+	ast_log(LOG_DEBUG, "Fired create_audio_landmarks. filename[%s]\n", filename);
+
+	// initiate aubio src
+	source = ast_strdup(filename);
+	aubio_src = new_aubio_source(source, DEF_LANDMARK_SAMPLERATE, DEF_AUBIO_HOPSIZE);
+	sfree(source);
+	if(aubio_src == NULL) {
+		ast_log(LOG_ERROR, "Could not initiate aubio src.\n");
+		return NULL;
+	}
+
+	// initiate aubio parameters
+	pv = new_aubio_pvoc(DEF_AUBIO_BUFSIZE, DEF_AUBIO_HOPSIZE);
+	fftgrain = new_cvec(DEF_AUBIO_BUFSIZE);
+	buf = new_fvec(DEF_AUBIO_HOPSIZE);
+	if((pv == NULL) || (fftgrain == NULL) || (buf == NULL)) {
+		ast_log(LOG_ERROR, "Could not initiate aubio parameters.\n");
+
+		del_aubio_pvoc(pv);
+		del_cvec(fftgrain);
+		del_fvec(buf);
+		del_aubio_source(aubio_src);
+		return NULL;
+	}
+
+	// valid bin range
+	bins = fftgrain->length;
+	bin_low = 1;
+	bin_high = bins - 2;
+	if(freq_ignore_low > 0) {
+		bin_low = MAX(bin_low, (int)ceil((double)freq_ignore_low * DEF_AUBIO_BUFSIZE / DEF_LANDMARK_SAMPLERATE));
+	}
+	if(freq_ignore_high > 0) {
+		bin_high = MIN(bin_high, (int)floor((double)freq_ignore_high * DEF_AUBIO_BUFSIZE / DEF_LANDMARK_SAMPLERATE));
+	}
+
+	// pick peaks
+	peaks = NULL;
+	peak_count = 0;
+	peak_size = 0;
+	count = 0;
+	while(1) {
+		aubio_source_do(aubio_src, buf, &reads);
+		if(reads == 0) {
+		  break;
+		}
+
+		// compute mag spectrum
+		aubio_pvoc_do(pv, buf, fftgrain);
+
+		avg = 0;
+		for(bin = 0; bin < bins; bin++) {
+			avg += fftgrain->norm[bin];
+		}
+		avg = avg / bins;
+		threshold = MAX(avg * DEF_LANDMARK_PEAK_RATIO, DEF_LANDMARK_PEAK_FLOOR);
+
+		// keep the loudest local maximums
+		frame_peak_count = 0;
+		for(bin = bin_low; bin <= bin_high; bin++) {
+			magnitude = fftgrain->norm[bin];
+			if((magnitude < threshold) || (magnitude <= fftgrain->norm[bin - 1]) || (magnitude < fftgrain->norm[bin + 1])) {
+				continue;
+			}
+
+			for(i = frame_peak_count; i > 0; i--) {
+				if(frame_peaks[i - 1].magnitude >= magnitude) {
+					break;
+				}
+				if(i < DEF_LANDMARK_PEAKS) {
+					frame_peaks[i] = frame_peaks[i - 1];
+				}
+			}
+			if(i >= DEF_LANDMARK_PEAKS) {
+				continue;
+			}
+
+			frame_peaks[i].frame_idx = count;
+			frame_peaks[i].bin = bin;
+			frame_peaks[i].magnitude = magnitude;
+			if(frame_peak_count < DEF_LANDMARK_PEAKS) {
+				frame_peak_count++;
+			}
+		}
+
+		if(peak_count + frame_peak_count > peak_size) {
+			peak_size = (peak_size * 2) + DEF_LANDMARK_PEAKS;
+			peaks = ast_realloc(peaks, sizeof(landmark_peak_t) * peak_size);
+		}
+		memcpy(&peaks[peak_count], frame_peaks, sizeof(landmark_peak_t) * frame_peak_count);
+		peak_count += frame_peak_count;
+
+		count++;
+	}
+	*frame_count = count;
+
+	del_aubio_pvoc(pv);
+	del_cvec(fftgrain);
+	del_fvec(buf);
+	del_aubio_source(aubio_src);
+
+	// hash the peak pairs in the target zone
+	j_res = ast_json_array_create();
+	for(i = 0; i < peak_count; i++) {
+		pairs = 0;
+		for(j = i + 1; (j < peak_count) && (pairs < DEF_LANDMARK_FAN_OUT); j++) {
+			dt = peaks[j].frame_idx - peaks[i].frame_idx;
+			if(dt == 0) {
+				continue;
+			}
+			if(dt > DEF_LANDMARK_TARGET_ZONE) {
+				break;
+			}
+			if(abs(peaks[j].bin - peaks[i].bin) > DEF_LANDMARK_FREQ_ZONE) {
+				continue;
+			}
+
+			hash = ((uint32_t)peaks[i].bin << 15) | ((uint32_t)peaks[j].bin << 6) | (uint32_t)dt;
+			j_tmp = ast_json_pack("{s:i, s:i}",
+					"hash",			hash,
+					"frame_idx",	peaks[i].frame_idx
+					);
+			if(j_tmp == NULL) {
+				ast_log(LOG_ERROR, "Could not create landmark data.\n");
+				continue;
+			}
+
+			ast_json_array_append(j_res, j_tmp);
+			pairs++;
+		}
+	}
+	sfree(peaks);
+
+	return j_res;
+}
+
+/**
+ * Create audio vector data and insert it.
+ * @param context
+ * @param filename
+ * @param uuid
+ * @return
+ */
+static bool create_audio_vector_info(const char* context, const char* filename, const char* uuid)
 {
 	int ret;
+	int idx;
+	int i;
 	char* sql;
 	char* tmp;
-	int i;
+	char col[10];
+	struct ast_json* j_vector;
+	struct ast_json* j_vectors;
+	db_stmt_t* stmt;
 
-	g_db_ctx = db_ctx_init(DEF_DATABASE_NAME);
-	if(g_db_ctx == NULL) {
+	if((context == NULL) || (filename == NULL) || (uuid == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
 		return false;
 	}
+	ast_log(LOG_DEBUG, "Fired create_audio_vector_info. filename[%s], uuid[%s]\n", filename, uuid);
 
-	/* context_list */
-	sql = "create table context_list("
+	// create vector data
+	j_vectors = create_audio_vectors(filename, uuid);
+	if(j_vectors == NULL) {
+		ast_log(LOG_ERROR, "Could not create vector data.\n");
+		return false;
+	}
 
-			"   name        varchar(255),"
-			"   directory   varchar(1023),"
+	// create insert sql. context, audio_uuid, frame_idx, mfcc1 ~ mfccN
+	ast_asprintf(&sql, "%s", "insert into audio_vector values (?, ?, ?");
+	for(i = 0; i < DEF_AUBIO_VECTOR_COEFS; i++) {
+		ast_asprintf(&tmp, "%s, ?", sql);
+		sfree(sql);
+		sql = tmp;
+	}
+	ast_asprintf(&tmp, "%s);", sql);
+	sfree(sql);
+	sql = tmp;
+
+	// insert data. the audio's frames are inserted in one transaction.
+	ret = db_ctx_begin(g_db_ctx);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not begin the transaction.\n");
+		sfree(sql);
+		ast_json_unref(j_vectors);
+		return false;
+	}
+	stmt = db_ctx_stmt_get(g_db_ctx, "insert_audio_vector", sql);
+	sfree(sql);
+	if(stmt == NULL) {
+		db_ctx_rollback(g_db_ctx);
+		ast_json_unref(j_vectors);
+		return false;
+	}
+	for(idx = 0; idx < ast_json_array_size(j_vectors); idx++) {
+		j_vector = ast_json_array_get(j_vectors, idx);
+		if(j_vector == NULL) {
+			continue;
+		}
+
+		db_ctx_stmt_bind_text(stmt, 1, context);
+		db_ctx_stmt_bind_text(stmt, 2, uuid);
+		db_ctx_stmt_bind_int(stmt, 3, ast_json_integer_get(ast_json_object_get(j_vector, "frame_idx")));
+		for(i = 0; i < DEF_AUBIO_VECTOR_COEFS; i++) {
+			snprintf(col, sizeof(col), "mfcc%d", i + 1);
+			db_ctx_stmt_bind_double(stmt, i + 4, ast_json_real_get(ast_json_object_get(j_vector, col)));
+		}
+		ret = db_ctx_stmt_step(stmt);
+		if(ret == false) {
+			break;
+		}
+	}
+	db_ctx_stmt_release(stmt);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not insert vector data. context[%s], uuid[%s]\n", context, uuid);
+		db_ctx_rollback(g_db_ctx);
+		ast_json_unref(j_vectors);
+		return false;
+	}
+	ret = db_ctx_commit(g_db_ctx);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not commit vector data. context[%s], uuid[%s]\n", context, uuid);
+		ast_json_unref(j_vectors);
+		return false;
+	}
+
+	// add to index
+	ret = fp_get_context_engine(context)->add_audio(context, uuid, j_vectors);
+	ast_json_unref(j_vectors);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not add vector data to index. context[%s], uuid[%s]\n", context, uuid);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Create audio sub-fingerprint data and insert it.
+ * @param context
+ * @param filename
+ * @param uuid
+ * @return
+ */
+static bool create_audio_subfingerprint_info(const char* context, const char* filename, const char* uuid)
+{
+	int ret;
+	int idx;
+	int frame_count;
+	struct ast_json* j_subfprint;
+	struct ast_json* j_subfprints;
+	db_stmt_t* stmt;
+
+	if((context == NULL) || (filename == NULL) || (uuid == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+	ast_log(LOG_DEBUG, "Fired create_audio_subfingerprint_info. filename[%s], uuid[%s]\n", filename, uuid);
+
+	// create sub-fingerprint data
+	j_subfprints = create_audio_subfingerprints(filename, &frame_count);
+	if(j_subfprints == NULL) {
+		ast_log(LOG_ERROR, "Could not create sub-fingerprint data.\n");
+		return false;
+	}
+
+	// insert data. the audio's frames are inserted in one transaction.
+	ret = db_ctx_begin(g_db_ctx);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not begin the transaction.\n");
+		ast_json_unref(j_subfprints);
+		return false;
+	}
+	stmt = db_ctx_stmt_get(g_db_ctx, "insert_audio_subfingerprint", "insert into audio_subfingerprint(context, audio_uuid, frame_idx, bits) values (?, ?, ?, ?);");
+	if(stmt == NULL) {
+		db_ctx_rollback(g_db_ctx);
+		ast_json_unref(j_subfprints);
+		return false;
+	}
+	for(idx = 0; idx < ast_json_array_size(j_subfprints); idx++) {
+		j_subfprint = ast_json_array_get(j_subfprints, idx);
+		if(j_subfprint == NULL) {
+			continue;
+		}
+
+		db_ctx_stmt_bind_text(stmt, 1, context);
+		db_ctx_stmt_bind_text(stmt, 2, uuid);
+		db_ctx_stmt_bind_int(stmt, 3, ast_json_integer_get(ast_json_object_get(j_subfprint, "frame_idx")));
+		db_ctx_stmt_bind_int(stmt, 4, ast_json_integer_get(ast_json_object_get(j_subfprint, "bits")));
+		ret = db_ctx_stmt_step(stmt);
+		if(ret == false) {
+			break;
+		}
+	}
+	db_ctx_stmt_release(stmt);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not insert sub-fingerprint data. context[%s], uuid[%s]\n", context, uuid);
+		db_ctx_rollback(g_db_ctx);
+		ast_json_unref(j_subfprints);
+		return false;
+	}
+	ret = db_ctx_commit(g_db_ctx);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not commit sub-fingerprint data. context[%s], uuid[%s]\n", context, uuid);
+		ast_json_unref(j_subfprints);
+		return false;
+	}
+
+	// add to the context's array
+	ret = fp_get_context_engine(context)->add_audio(context, uuid, j_subfprints);
+	ast_json_unref(j_subfprints);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not add sub-fingerprint data. context[%s], uuid[%s]\n", context, uuid);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Create the 32 bits binary sub-fingerprint of each frame of the given file.
+ * Uses the same phase vocoder as the mfcc fingerprints. The spectrum of DEF_SUBFP_FREQ_LOW ~ DEF_SUBFP_FREQ_HIGH
+ * is split into DEF_SUBFP_BANDS log spaced bands, and the bit m of the frame n is
+ * 1 if (E(n, m) - E(n, m + 1)) - (E(n - 1, m) - E(n - 1, m + 1)) > 0.
+ * The first frame and the silent frame are 0 bits.
+ * @param filename
+ * @param frame_count: the number of read frames.
+ * @return [{"frame_idx": <idx>, "bits": <sub-fingerprint>}, ...]
+ */
+static struct ast_json* create_audio_subfingerprints(const char* filename, int* frame_count)
+{
+	struct ast_json* j_res;
+	struct ast_json* j_tmp;
+	unsigned int reads;
+	int count;
+	char* source;
+	int i;
+	int bin;
+	int edges[DEF_SUBFP_BANDS + 1];
+	uint32_t bits;
+	double total;
+	double diff;
+	double energies[DEF_SUBFP_BANDS];
+	double prev_diffs[DEF_SUBFP_BANDS - 1];
+
+	aubio_pvoc_t* pv;
+	cvec_t*	fftgrain;
+	fvec_t* buf;
+
+	aubio_source_t* aubio_src;
+
+	if((filename == NULL) || (frame_count == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+	ast_log(LOG_DEBUG, "Fired create_audio_subfingerprints. filename[%s]\n", filename);
+
+	// initiate aubio src
+	source = ast_strdup(filename);
+	aubio_src = new_aubio_source(source, DEF_AUBIO_SAMPLERATE, DEF_AUBIO_HOPSIZE);
+	sfree(source);
+	if(aubio_src == NULL) {
+		ast_log(LOG_ERROR, "Could not initiate aubio src.\n");
+		return NULL;
+	}
+
+	// initiate aubio parameters
+	pv = new_aubio_pvoc(DEF_AUBIO_BUFSIZE, DEF_AUBIO_HOPSIZE);
+	fftgrain = new_cvec(DEF_AUBIO_BUFSIZE);
+	buf = new_fvec(DEF_AUBIO_HOPSIZE);
+	if((pv == NULL) || (fftgrain == NULL) || (buf == NULL)) {
+		ast_log(LOG_ERROR, "Could not initiate aubio parameters.\n");
+
+		del_aubio_pvoc(pv);
+		del_cvec(fftgrain);
+		del_fvec(buf);
+		del_aubio_source(aubio_src);
+		return NULL;
+	}
+
+	// log spaced band edges. each band has one bin at least.
+	for(i = 0; i <= DEF_SUBFP_BANDS; i++) {
+		edges[i] = (int)round(DEF_SUBFP_FREQ_LOW * pow((double)DEF_SUBFP_FREQ_HIGH / DEF_SUBFP_FREQ_LOW, (double)i / DEF_SUBFP_BANDS) * DEF_AUBIO_BUFSIZE / DEF_AUBIO_SAMPLERATE);
+		if(i > 0) {
+			edges[i] = MAX(edges[i], edges[i - 1] + 1);
+		}
+	}
+
+	j_res = ast_json_array_create();
+	memset(prev_diffs, 0x00, sizeof(prev_diffs));
+	count = 0;
+	while(1) {
+		aubio_source_do(aubio_src, buf, &reads);
+		if(reads == 0) {
+		  break;
+		}
+
+		// compute mag spectrum
+		aubio_pvoc_do(pv, buf, fftgrain);
+
+		total = 0;
+		for(i = 0; i < DEF_SUBFP_BANDS; i++) {
+			energies[i] = 0;
+			for(bin = edges[i]; (bin < edges[i + 1]) && (bin < fftgrain->length); bin++) {
+				energies[i] += fftgrain->norm[bin] * fftgrain->norm[bin];
+			}
+			total += energies[i];
+		}
+
+		// band energy differences of the time and the frequency
+		bits = 0;
+		for(i = 0; i < DEF_SUBFP_BANDS - 1; i++) {
+			diff = energies[i] - energies[i + 1];
+			if((count > 0) && (total >= DEF_SUBFP_ENERGY_FLOOR) && (diff - prev_diffs[i] > 0)) {
+				bits |= (uint32_t)1 << (DEF_SUBFP_BANDS - 2 - i);
+			}
+			prev_diffs[i] = diff;
+		}
+
+		j_tmp = ast_json_pack("{s:i, s:i}",
+				"frame_idx",	count,
+				"bits",			(int)bits
+				);
+		if(j_tmp == NULL) {
+			ast_log(LOG_ERROR, "Could not create sub-fingerprint data.\n");
+			count++;
+			continue;
+		}
+
+		ast_json_array_append(j_res, j_tmp);
+		count++;
+	}
+	*frame_count = count;
+
+	del_aubio_pvoc(pv);
+	del_cvec(fftgrain);
+	del_fvec(buf);
+	del_aubio_source(aubio_src);
+
+	return j_res;
+}
+
+static bool init_database(void)
+{
+	int ret;
+	char* sql;
+	char* tmp;
+	int i;
+
+	g_db_ctx = db_ctx_init(DEF_DATABASE_NAME);
+	if(g_db_ctx == NULL) {
+		return false;
+	}
+
+	/* context_list */
+	sql = "create table context_list("
+
+			"   name        varchar(255),"
+			"   directory   varchar(1023),"
+
+			"   primary key(name)"
+			");";
+	ret = db_ctx_exec(g_db_ctx, sql);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not create context_list table.\n");
+		return false;
+	}
+
+	/* audio_list */
+	sql = "create table audio_list("
+
+			"   uuid           varchar(255),"
+			"   name           varchar(255),"
+			"   context        varchar(255),"	// context name
+			"	hash           varchar(1023)"
+			");";
+	ret = db_ctx_exec(g_db_ctx, sql);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not create auido_list table.\n");
+		return false;
+	}
+
+	/* audio_fingerprint */
+	ast_asprintf(&sql, "%s",
+			"create table audio_fingerprint("
+
+			" context        varchar(255),"
+			" audio_uuid     varchar(255),"
+			" frame_idx      integer");
+	for(i = 0; i < DEF_AUBIO_COEFS; i++) {
+		ast_asprintf(&tmp, "%s, max%d real", sql, i + 1);
+		sfree(sql);
+		sql = tmp;
+	}
+	ast_asprintf(&tmp, "%s);", sql);
+	sfree(sql);
+	sql = tmp;
+	ret = db_ctx_exec(g_db_ctx, sql);
+	sfree(sql);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not create fingerprint table.\n");
+		return false;
+	}
+
+	// create index for context segment.
+	sql = "create index idx_audio_fingerprint_context_audio_uuid on audio_fingerprint(context, audio_uuid, frame_idx);";
+	ret = db_ctx_exec(g_db_ctx, sql);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not create idx_audio_fingerprint_context_audio_uuid.\n");
+		return false;
+	}
+
+	// create index for the sql engine's range query.
+	// the other engines search with the in-memory index, so the max2 ~ maxN are not indexed.
+	sql = "create index idx_audio_fingerprint_context_max1 on audio_fingerprint(context, max1);";
+	ret = db_ctx_exec(g_db_ctx, sql);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not create idx_audio_fingerprint_context_max1.\n");
+		return false;
+	}
+
+	/* audio_landmark */
+	sql = "create table audio_landmark("
+
+			" context        varchar(255),"
+			" audio_uuid     varchar(255),"
+			" hash           integer,"
+			" frame_idx      integer"
+			");";
+	ret = db_ctx_exec(g_db_ctx, sql);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not create audio_landmark table.\n");
+		return false;
+	}
+
+	sql = "create index idx_audio_landmark_context_audio_uuid on audio_landmark(context, audio_uuid);";
+	ret = db_ctx_exec(g_db_ctx, sql);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not create idx_audio_landmark_context_audio_uuid.\n");
+		return false;
+	}
+
+	/* audio_vector */
+	ast_asprintf(&sql, "%s",
+			"create table audio_vector("
+
+			" context        varchar(255),"
+			" audio_uuid     varchar(255),"
+			" frame_idx      integer");
+	for(i = 0; i < DEF_AUBIO_VECTOR_COEFS; i++) {
+		ast_asprintf(&tmp, "%s, mfcc%d real", sql, i + 1);
+		sfree(sql);
+		sql = tmp;
+	}
+	ast_asprintf(&tmp, "%s);", sql);
+	sfree(sql);
+	sql = tmp;
+	ret = db_ctx_exec(g_db_ctx, sql);
+	sfree(sql);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not create audio_vector table.\n");
+		return false;
+	}
+
+	sql = "create index idx_audio_vector_context_audio_uuid on audio_vector(context, audio_uuid, frame_idx);";
+	ret = db_ctx_exec(g_db_ctx, sql);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not create idx_audio_vector_context_audio_uuid.\n");
+		return false;
+	}
+
+	/* audio_subfingerprint */
+	sql = "create table audio_subfingerprint("
+
+			" context        varchar(255),"
+			" audio_uuid     varchar(255),"
+			" frame_idx      integer,"
+			" bits           integer"
+			");";
+	ret = db_ctx_exec(g_db_ctx, sql);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not create audio_subfingerprint table.\n");
+		return false;
+	}
+
+	sql = "create index idx_audio_subfingerprint_context_audio_uuid on audio_subfingerprint(context, audio_uuid, frame_idx);";
+	ret = db_ctx_exec(g_db_ctx, sql);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not create idx_audio_subfingerprint_context_audio_uuid.\n");
+		return false;
+	}
+
+	/* tiresias_info */
+	sql = "create table tiresias_info("
+
+			" name           varchar(255),"
+			" value          varchar(1023),"
+
+			" primary key(name)"
+			");";
+	ret = db_ctx_exec(g_db_ctx, sql);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not create tiresias_info table.\n");
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Build the in-memory index with the loaded fingerprint info.
+ * @return
+ */
+static bool init_index(void)
+{
+	int ret;
+	int idx;
+	int probes;
+	int budget;
+	double stop_density;
+	const char* tmp_const;
+	struct ast_json* j_audios;
+	struct ast_json* j_audio;
+
+	// stop_density: max ratio of the index entries in the query frame's max1 range. 0 disables.
+	stop_density = DEF_SEARCH_STOP_DENSITY;
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "global"), "stop_density"));
+	if(tmp_const != NULL) {
+		stop_density = atof(tmp_const);
+	}
+	if((stop_density < 0) || (stop_density > 1)) {
+		ast_log(LOG_WARNING, "Wrong stop_density. Set to default. stop_density[%f], default[%f]\n", stop_density, DEF_SEARCH_STOP_DENSITY);
+		stop_density = DEF_SEARCH_STOP_DENSITY;
+	}
+
+	// candidate_budget: target max index candidates of each query frame. 0 disables.
+	budget = DEF_SEARCH_CANDIDATE_BUDGET;
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "global"), "candidate_budget"));
+	if(tmp_const != NULL) {
+		budget = atoi(tmp_const);
+	}
+	if(budget < 0) {
+		ast_log(LOG_WARNING, "Wrong candidate_budget. Set to default. candidate_budget[%d], default[%d]\n", budget, DEF_SEARCH_CANDIDATE_BUDGET);
+		budget = DEF_SEARCH_CANDIDATE_BUDGET;
+	}
+
+	ret = index_init(DEF_AUBIO_COEFS, stop_density, budget);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate index_handler.\n");
+		return false;
+	}
+
+	ret = landmark_init();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate landmark_handler.\n");
+		return false;
+	}
+
+	ret = scan_init(DEF_AUBIO_COEFS);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate scan_handler.\n");
+		return false;
+	}
+
+	// vector_probes: inverted lists probed by each query frame of the ivfpq engine.
+	probes = DEF_SEARCH_VECTOR_PROBES;
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "global"), "vector_probes"));
+	if(tmp_const != NULL) {
+		probes = atoi(tmp_const);
+	}
+	if(probes < 1) {
+		ast_log(LOG_WARNING, "Wrong vector_probes. Set to default. vector_probes[%d], default[%d]\n", probes, DEF_SEARCH_VECTOR_PROBES);
+		probes = DEF_SEARCH_VECTOR_PROBES;
+	}
+
+	ret = ivfpq_init(DEF_AUBIO_VECTOR_COEFS, probes);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate ivfpq_handler.\n");
+		return false;
+	}
+
+	ret = binary_init();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate binary_handler.\n");
+		return false;
+	}
+
+	ret = fp_engine_init();
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not initiate engines.\n");
+		return false;
+	}
+
+	j_audios = fp_get_audio_lists_all();
+	for(idx = 0; idx < ast_json_array_size(j_audios); idx++) {
+		j_audio = ast_json_array_get(j_audios, idx);
+		if(j_audio == NULL) {
+			continue;
+		}
+
+		ret = load_audio_index(j_audio);
+		if(ret == false) {
+			ast_log(LOG_WARNING, "Could not load index info. uuid[%s]\n", ast_json_string_get(ast_json_object_get(j_audio, "uuid")));
+			continue;
+		}
+	}
+	ast_log(LOG_VERBOSE, "Loaded index info. audios[%zu]\n", ast_json_array_size(j_audios));
+	ast_json_unref(j_audios);
+
+	return true;
+}
+
+/**
+ * Start the search worker threads with the global configuration.
+ * search_threads: number of the worker threads. Default is the online cpu count - 1. 0 disables the split search.
+ * search_threshold: minimum query observations to split the search.
+ * @return
+ */
+static bool init_worker(void)
+{
+	int ret;
+	int threads;
+	int threshold;
+	const char* tmp_const;
+	struct ast_json* j_global;
+
+	j_global = ast_json_object_get(g_app->j_conf, "global");
+
+	threads = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+	tmp_const = ast_json_string_get(ast_json_object_get(j_global, "search_threads"));
+	if(tmp_const != NULL) {
+		threads = atoi(tmp_const);
+	}
+	if(threads < 0) {
+		threads = 0;
+	}
+
+	threshold = DEF_SEARCH_THRESHOLD;
+	tmp_const = ast_json_string_get(ast_json_object_get(j_global, "search_threshold"));
+	if(tmp_const != NULL) {
+		threshold = atoi(tmp_const);
+	}
+	if(threshold < 1) {
+		ast_log(LOG_WARNING, "Wrong search_threshold. Set to default. threshold[%d], default[%d]\n", threshold, DEF_SEARCH_THRESHOLD);
+		threshold = DEF_SEARCH_THRESHOLD;
+	}
+
+	ret = worker_init(threads, threshold);
+	if(ret == false) {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Initiate the search result cache with the global configuration.
+ * cache_size: max number of the cached search results. 0 disables the cache.
+ * @return
+ */
+static bool init_cache(void)
+{
+	int ret;
+	int size;
+	const char* tmp_const;
+
+	size = DEF_SEARCH_CACHE_SIZE;
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "global"), "cache_size"));
+	if(tmp_const != NULL) {
+		size = atoi(tmp_const);
+	}
+	if(size < 0) {
+		ast_log(LOG_WARNING, "Wrong cache_size. Set to default. cache_size[%d], default[%d]\n", size, DEF_SEARCH_CACHE_SIZE);
+		size = DEF_SEARCH_CACHE_SIZE;
+	}
+
+	ret = cache_init(size);
+	if(ret == false) {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Initiate the search batching with the global configuration.
+ * batch_window_ms: time(ms) to collect the concurrent searches of the same context. 0 disables.
+ * @return
+ */
+static bool init_batch(void)
+{
+	int ret;
+	int window;
+	const char* tmp_const;
+
+	window = DEF_SEARCH_BATCH_WINDOW;
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "global"), "batch_window_ms"));
+	if(tmp_const != NULL) {
+		window = atoi(tmp_const);
+	}
+	if((window < 0) || (window > DEF_SEARCH_BATCH_WINDOW_MAX)) {
+		ast_log(LOG_WARNING, "Wrong batch_window_ms. Set to default. batch_window_ms[%d], default[%d]\n", window, DEF_SEARCH_BATCH_WINDOW);
+		window = DEF_SEARCH_BATCH_WINDOW;
+	}
+
+	ret = batch_init(window);
+	if(ret == false) {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Initiate the sketch prefilter with the global configuration.
+ * sketch_threshold: min ratio(0 ~ 1) of the query frames which can match to the audio.
+ * @return
+ */
+static bool init_sketch(void)
+{
+	int ret;
+	double threshold;
+	const char* tmp_const;
+
+	threshold = DEF_SEARCH_SKETCH_THRESHOLD;
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "global"), "sketch_threshold"));
+	if(tmp_const != NULL) {
+		threshold = atof(tmp_const);
+	}
+	if((threshold < 0) || (threshold > 1)) {
+		ast_log(LOG_WARNING, "Wrong sketch_threshold. Set to default. sketch_threshold[%f], default[%f]\n", threshold, DEF_SEARCH_SKETCH_THRESHOLD);
+		threshold = DEF_SEARCH_SKETCH_THRESHOLD;
+	}
+
+	ret = sketch_init(threshold);
+	if(ret == false) {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Initiate the search verification with the global configuration.
+ * verify_candidates: top candidates of the coarse vote to verify. 0 disables the verification.
+ * verify_threshold: max alignment cost of the confirmed candidate. 0 confirms all.
+ * @return
+ */
+static bool init_verify(void)
+{
+	int ret;
+	int candidates;
+	double threshold;
+	const char* tmp_const;
+	struct ast_json* j_global;
+
+	j_global = ast_json_object_get(g_app->j_conf, "global");
+
+	candidates = DEF_SEARCH_VERIFY_CANDIDATES;
+	tmp_const = ast_json_string_get(ast_json_object_get(j_global, "verify_candidates"));
+	if(tmp_const != NULL) {
+		candidates = atoi(tmp_const);
+	}
+	if(candidates < 0) {
+		ast_log(LOG_WARNING, "Wrong verify_candidates. Set to default. verify_candidates[%d], default[%d]\n", candidates, DEF_SEARCH_VERIFY_CANDIDATES);
+		candidates = DEF_SEARCH_VERIFY_CANDIDATES;
+	}
+
+	threshold = DEF_SEARCH_VERIFY_THRESHOLD;
+	tmp_const = ast_json_string_get(ast_json_object_get(j_global, "verify_threshold"));
+	if(tmp_const != NULL) {
+		threshold = atof(tmp_const);
+	}
+	if(threshold < 0) {
+		ast_log(LOG_WARNING, "Wrong verify_threshold. Set to default. verify_threshold[%f], default[%d]\n", threshold, DEF_SEARCH_VERIFY_THRESHOLD);
+		threshold = DEF_SEARCH_VERIFY_THRESHOLD;
+	}
+
+	ret = verify_init(candidates, threshold);
+	if(ret == false) {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Check the loaded fingerprint data's version.
+ * If the version is different, deletes the old fingerprint data.
+ * The deleted data will be re-created from the audio files at the index init.
+ * @return
+ */
+static bool check_fingerprint_version(void)
+{
+	int ret;
+	const char* version;
+	struct ast_json* j_info;
+	db_stmt_t* stmt;
+
+	stmt = db_ctx_stmt_get(g_db_ctx, "get_tiresias_info", "select * from tiresias_info where name = ?;");
+	if(stmt == NULL) {
+		return false;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, "fingerprint_version");
+	j_info = db_ctx_stmt_get_record(stmt);
+	db_ctx_stmt_release(stmt);
+
+	version = ast_json_string_get(ast_json_object_get(j_info, "value"));
+	if((version != NULL) && (strcmp(version, DEF_FINGERPRINT_VERSION) == 0)) {
+		ast_json_unref(j_info);
+		return true;
+	}
+	ast_log(LOG_NOTICE, "Fingerprint version has been changed. Deleting the old fingerprints. old[%s], new[%s]\n",
+			version ? : "", DEF_FINGERPRINT_VERSION);
+	ast_json_unref(j_info);
+
+	ret = db_ctx_exec(g_db_ctx, "delete from audio_fingerprint;");
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not delete the old fingerprints.\n");
+		return false;
+	}
+
+	stmt = db_ctx_stmt_get(g_db_ctx, "replace_tiresias_info", "insert or replace into tiresias_info(name, value) values (?, ?);");
+	if(stmt == NULL) {
+		return false;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, "fingerprint_version");
+	db_ctx_stmt_bind_text(stmt, 2, DEF_FINGERPRINT_VERSION);
+	ret = db_ctx_stmt_step(stmt);
+	db_ctx_stmt_release(stmt);
+	if(ret == false) {
+		ast_log(LOG_ERROR, "Could not update the fingerprint version.\n");
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Load the given audio's fingerprint info into the context engine's index.
+ * If the engine's fingerprint info is not exist(i.e. the context's engine has been changed),
+ * creates it from the audio file.
+ * @param j_audio
+ * @return
+ */
+static bool load_audio_index(struct ast_json* j_audio)
+{
+	int ret;
+	char* filename;
+	const char* uuid;
+	const char* context;
+	const char* name;
+	const char* directory;
+	const engine_t* engine;
+	struct ast_json* j_context;
+	struct ast_json* j_data;
+
+	uuid = ast_json_string_get(ast_json_object_get(j_audio, "uuid"));
+	context = ast_json_string_get(ast_json_object_get(j_audio, "context"));
+	name = ast_json_string_get(ast_json_object_get(j_audio, "name"));
+	if((uuid == NULL) || (context == NULL) || (name == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	engine = fp_get_context_engine(context);
+	if(engine->data == ENGINE_DATA_LANDMARK) {
+		j_data = get_audio_landmarks(context, uuid);
+	}
+	else if(engine->data == ENGINE_DATA_VECTOR) {
+		j_data = get_audio_vectors(context, uuid);
+	}
+	else if(engine->data == ENGINE_DATA_SUBFINGERPRINT) {
+		j_data = get_audio_subfingerprints(context, uuid);
+	}
+	else {
+		j_data = get_audio_fingerprints(context, uuid);
+	}
+
+	if(ast_json_array_size(j_data) > 0) {
+		ret = engine->add_audio(context, uuid, j_data);
+		ast_json_unref(j_data);
+		return ret;
+	}
+	ast_json_unref(j_data);
+
+	// create it from the audio file
+	j_context = fp_get_context_list_info(context);
+	directory = ast_json_string_get(ast_json_object_get(j_context, "directory"));
+	if(directory == NULL) {
+		ast_log(LOG_NOTICE, "Could not get directory info. context[%s]\n", context);
+		ast_json_unref(j_context);
+		return false;
+	}
+	ast_asprintf(&filename, "%s/%s", directory, name);
+	ast_json_unref(j_context);
+	ast_log(LOG_VERBOSE, "Creating fingerprint info for the context engine. context[%s], filename[%s]\n", context, filename);
+
+	ret = create_audio_fingerprint_info(context, filename, uuid);
+	sfree(filename);
+
+	return ret;
+}
+
+/**
+ * Returns the search engine of the given context.
+ * The engine=auto context's engine is planned at the first use.
+ * @param context
+ * @return
+ */
+const engine_t* fp_get_context_engine(const char* context)
+{
+	const char* tmp_const;
+	const engine_t* engine;
+
+	if(context == NULL) {
+		return engine_get(DEF_ENGINE_INDEX);
+	}
+
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, context), "engine"));
+	if(tmp_const == NULL) {
+		return engine_get(DEF_ENGINE_INDEX);
+	}
+
+	if(strcasecmp(tmp_const, DEF_ENGINE_AUTO) == 0) {
+		return get_context_plan(context);
+	}
+
+	engine = engine_get(tmp_const);
+	if(engine == NULL) {
+		ast_log(LOG_WARNING, "Unknown engine. Set to default. context[%s], engine[%s], default[%s]\n", context, tmp_const, DEF_ENGINE_INDEX);
+		return engine_get(DEF_ENGINE_INDEX);
+	}
+
+	return engine;
+}
+
+/**
+ * Returns the planned engine of the engine=auto context.
+ * The context is planned at the first use with its audios and stored fingerprint frames.
+ * The new audios are added to the planned engine, and the context is re-planned
+ * when the audios are added or deleted(replan_context).
+ * @param context
+ * @return
+ */
+static const engine_t* get_context_plan(const char* context)
+{
+	int ret;
+	int audios;
+	int frames;
+	const engine_t* engine;
+	const engine_t* planned;
+
+	ast_mutex_lock(&g_plans_lock);
+	engine = engine_get(ast_json_string_get(ast_json_object_get(g_plans, context)));
+	ast_mutex_unlock(&g_plans_lock);
+	if(engine != NULL) {
+		return engine;
+	}
+
+	// count without the lock. the other searches keep going.
+	ret = get_context_counts(context, &audios, &frames);
+	if(ret == false) {
+		ast_log(LOG_WARNING, "Could not count the context. Use the default engine. context[%s], default[%s]\n", context, DEF_ENGINE_INDEX);
+		return engine_get(DEF_ENGINE_INDEX);
+	}
+
+	engine = engine_plan(audios, frames);
+	if(engine == NULL) {
+		engine = engine_get(DEF_ENGINE_INDEX);
+	}
+
+	// the other thread could have planned meanwhile
+	ast_mutex_lock(&g_plans_lock);
+	if(g_plans == NULL) {
+		g_plans = ast_json_object_create();
+	}
+	planned = engine_get(ast_json_string_get(ast_json_object_get(g_plans, context)));
+	if(planned != NULL) {
+		ast_mutex_unlock(&g_plans_lock);
+		return planned;
+	}
+	ast_json_object_set(g_plans, context, ast_json_string_create(engine->name));
+	ast_mutex_unlock(&g_plans_lock);
+	ast_log(LOG_VERBOSE, "Planned the context engine. context[%s], audios[%d], frames[%d], engine[%s]\n", context, audios, frames, engine->name);
+
+	return engine;
+}
+
+/**
+ * Re-plan the engine=auto context with its current audios and frames.
+ * The context which was planned with the few audios(i.e. the first ingest) moves to the
+ * larger engine when its counts cross the planner's threshold.
+ * The context's audios are added to the new engine before the plan is switched, so the
+ * searches meanwhile keep using the old engine. The old engine's index is deleted after.
+ * @param context
+ */
+static void replan_context(const char* context)
+{
+	int i;
+	int ret;
+	int audios;
+	int frames;
+	const char* tmp_const;
+	const char* uuid;
+	const engine_t* engine;
+	const engine_t* planned;
+	struct ast_json* j_audios;
+	struct ast_json* j_data;
+
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, context), "engine"));
+	if((tmp_const == NULL) || (strcasecmp(tmp_const, DEF_ENGINE_AUTO) != 0)) {
+		return;
+	}
+
+	// not planned yet. planned at the first use.
+	ast_mutex_lock(&g_plans_lock);
+	planned = engine_get(ast_json_string_get(ast_json_object_get(g_plans, context)));
+	ast_mutex_unlock(&g_plans_lock);
+	if(planned == NULL) {
+		return;
+	}
+
+	ret = get_context_counts(context, &audios, &frames);
+	if(ret == false) {
+		return;
+	}
+
+	// the planned engines share the stored fingerprints
+	engine = engine_plan(audios, frames);
+	if((engine == NULL) || (engine == planned) || (engine->data != planned->data)) {
+		return;
+	}
+
+	j_audios = fp_get_audio_lists_by_contextname(context);
+	for(i = 0; i < ast_json_array_size(j_audios); i++) {
+		uuid = ast_json_string_get(ast_json_object_get(ast_json_array_get(j_audios, i), "uuid"));
+		if(uuid == NULL) {
+			continue;
+		}
+
+		j_data = get_audio_fingerprints(context, uuid);
+		if(ast_json_array_size(j_data) > 0) {
+			engine->add_audio(context, uuid, j_data);
+		}
+		ast_json_unref(j_data);
+	}
+	ast_json_unref(j_audios);
+
+	ast_mutex_lock(&g_plans_lock);
+	ast_json_object_set(g_plans, context, ast_json_string_create(engine->name));
+	ast_mutex_unlock(&g_plans_lock);
+
+	if(planned->delete_context != NULL) {
+		planned->delete_context(context);
+	}
+	cache_delete_context(context);
+	ast_log(LOG_VERBOSE, "Re-planned the context engine. context[%s], audios[%d], frames[%d], old[%s], engine[%s]\n",
+			context, audios, frames, planned->name, engine->name);
+}
+
+/**
+ * Count the context's audios and stored fingerprint frames for the planner.
+ * @param context
+ * @param audios
+ * @param frames
+ * @return
+ */
+static bool get_context_counts(const char* context, int* audios, int* frames)
+{
+	struct ast_json* j_tmp;
+	db_stmt_t* stmt;
 
-			"   primary key(name)"
-			");";
-	ret = db_ctx_exec(g_db_ctx, sql);
-	if(ret == false) {
-		ast_log(LOG_ERROR, "Could not create context_list table.\n");
+	stmt = db_ctx_stmt_get(g_db_ctx, "get_plan_audios", "select count(*) as count from audio_list where context = ?;");
+	if(stmt == NULL) {
+		ast_log(LOG_ERROR, "Could not get the plan audios statement.\n");
 		return false;
 	}
-
-	/* audio_list */
-	sql = "create table audio_list("
-
-			"   uuid           varchar(255),"
-			"   name           varchar(255),"
-			"   context        varchar(255),"	// context name
-			"	hash           varchar(1023)"
-			");";
-	ret = db_ctx_exec(g_db_ctx, sql);
-	if(ret == false) {
-		ast_log(LOG_ERROR, "Could not create auido_list table.\n");
+	db_ctx_stmt_bind_text(stmt, 1, context);
+	j_tmp = db_ctx_stmt_get_record(stmt);
+	db_ctx_stmt_release(stmt);
+	if(j_tmp == NULL) {
 		return false;
 	}
+	*audios = ast_json_integer_get(ast_json_object_get(j_tmp, "count"));
+	ast_json_unref(j_tmp);
 
-	/* audio_fingerprint */
-	ast_asprintf(&sql, "%s",
-			"create table audio_fingerprint("
-
-			" context        varchar(255),"
-			" audio_uuid     varchar(255),"
-			" frame_idx      integer");
-	for(i = 0; i < DEF_AUBIO_COEFS; i++) {
-		ast_asprintf(&tmp, "%s, max%d real", sql, i + 1);
-		sfree(sql);
-		sql = tmp;
+	stmt = db_ctx_stmt_get(g_db_ctx, "get_plan_frames", "select count(*) as count from audio_fingerprint where context = ?;");
+	if(stmt == NULL) {
+		ast_log(LOG_ERROR, "Could not get the plan frames statement.\n");
+		return false;
 	}
-	ast_asprintf(&tmp, "%s);", sql);
-	sfree(sql);
-	sql = tmp;
-	ret = db_ctx_exec(g_db_ctx, sql);
-	sfree(sql);
-	if(ret == false) {
-		ast_log(LOG_ERROR, "Could not create fingerprint table.\n");
+	db_ctx_stmt_bind_text(stmt, 1, context);
+	j_tmp = db_ctx_stmt_get_record(stmt);
+	db_ctx_stmt_release(stmt);
+	if(j_tmp == NULL) {
 		return false;
 	}
+	*frames = ast_json_integer_get(ast_json_object_get(j_tmp, "count"));
+	ast_json_unref(j_tmp);
 
-	// create index for context
-	ast_asprintf(&sql, "%s", "create index idx_audio_fingerprint_context on audio_fingerprint(context);");
-	ret = db_ctx_exec(g_db_ctx, sql);
-	sfree(sql);
-	if(ret == false) {
-		ast_log(LOG_ERROR, "Could not create idx_audio_fingerprint_max%d table.\n", i);
-		return false;
+	return true;
+}
+
+/**
+ * Returns the engine info of each context.
+ * @return [{"context": <name>, "config": <configured engine>, "engine": <engine in use>, "stored": <stored fingerprint info>}, ...]
+ */
+struct ast_json* fp_get_context_engines(void)
+{
+	int idx;
+	const char* name;
+	const char* config;
+	const engine_t* engine;
+	struct ast_json* j_contexts;
+	struct ast_json* j_res;
+	static const char* datas[] = {"fingerprint", "landmark", "vector", "subfingerprint"};
+
+	j_contexts = fp_get_context_lists_all();
+	if(j_contexts == NULL) {
+		ast_log(LOG_WARNING, "Could not get context list info.\n");
+		return NULL;
 	}
 
-	// create indices for max
-	for(i = 1; i <= DEF_AUBIO_COEFS; i++) {
-		ast_asprintf(&sql, "create index idx_audio_fingerprint_max%d on audio_fingerprint(max%d);", i, i);
-		ret = db_ctx_exec(g_db_ctx, sql);
-		sfree(sql);
-		if(ret == false) {
-			ast_log(LOG_ERROR, "Could not create idx_audio_fingerprint_max%d table.\n", i);
-			return false;
+	j_res = ast_json_array_create();
+	for(idx = 0; idx < ast_json_array_size(j_contexts); idx++) {
+		name = ast_json_string_get(ast_json_object_get(ast_json_array_get(j_contexts, idx), "name"));
+		if(name == NULL) {
+			continue;
 		}
+
+		config = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, name), "engine"));
+		engine = fp_get_context_engine(name);
+		ast_json_array_append(j_res,
+				ast_json_pack("{s:s, s:s, s:s, s:s}",
+						"context",	name,
+						"config",	config ? : DEF_ENGINE_INDEX,
+						"engine",	engine->name,
+						"stored",	datas[engine->data]
+						)
+				);
 	}
+	ast_json_unref(j_contexts);
 
-	return true;
+	return j_res;
 }
 
 static char* create_file_hash(const char* filename)
@@ -806,22 +3050,22 @@ static char* create_file_hash(const char* filename)
 
 static struct ast_json* get_audio_list_info_by_context_and_hash(const char* context, const char* hash)
 {
-	char* sql;
 	struct ast_json* j_res;
-	db_ctx_t* db_ctx;
+	db_stmt_t* stmt;
 
 	if((context == NULL) || (hash == NULL)) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
 		return NULL;
 	}
 
-	ast_asprintf(&sql, "select * from audio_list where context = '%s' and hash = '%s';", context, hash);
-	db_ctx = create_db_ctx();
-	db_ctx_query(db_ctx, sql);
-	sfree(sql);
-
-	j_res = db_ctx_get_record(db_ctx);
-	destroy_db_ctx(db_ctx);
+	stmt = db_ctx_stmt_get(g_db_ctx, "get_audio_list_by_context_and_hash", "select * from audio_list where context = ? and hash = ?;");
+	if(stmt == NULL) {
+		return NULL;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, context);
+	db_ctx_stmt_bind_text(stmt, 2, hash);
+	j_res = db_ctx_stmt_get_record(stmt);
+	db_ctx_stmt_release(stmt);
 	if(j_res == NULL) {
 		return NULL;
 	}
@@ -831,22 +3075,21 @@ static struct ast_json* get_audio_list_info_by_context_and_hash(const char* cont
 
 static struct ast_json* get_audio_list_info(const char* uuid)
 {
-	char* sql;
 	struct ast_json* j_res;
-	db_ctx_t* db_ctx;
+	db_stmt_t* stmt;
 
 	if(uuid == NULL) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
 		return NULL;
 	}
 
-	ast_asprintf(&sql, "select * from audio_list where uuid = '%s';", uuid);
-	db_ctx = create_db_ctx();
-	db_ctx_query(db_ctx, sql);
-	sfree(sql);
-
-	j_res = db_ctx_get_record(db_ctx);
-	destroy_db_ctx(db_ctx);
+	stmt = db_ctx_stmt_get(g_db_ctx, "get_audio_list", "select * from audio_list where uuid = ?;");
+	if(stmt == NULL) {
+		return NULL;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, uuid);
+	j_res = db_ctx_stmt_get_record(stmt);
+	db_ctx_stmt_release(stmt);
 	if(j_res == NULL) {
 		return NULL;
 	}
@@ -854,105 +3097,150 @@ static struct ast_json* get_audio_list_info(const char* uuid)
 	return j_res;
 }
 
-static bool create_temp_search_table(const char* tablename)
+/**
+ * Returns all fingerprint info of the given audio.
+ * @param context
+ * @param uuid
+ * @return
+ */
+static struct ast_json* get_audio_fingerprints(const char* context, const char* uuid)
 {
-	char* sql;
-	char* tmp;
-	int i;
-	int ret;
+	struct ast_json* j_res;
+	db_stmt_t* stmt;
 
-	if(tablename == NULL) {
+	if((context == NULL) || (uuid == NULL)) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
-		return false;
+		return NULL;
 	}
 
-	// create audio_fingerprint table
-	ast_asprintf(&sql, "create table %s("
+	stmt = db_ctx_stmt_get(g_db_ctx, "get_audio_fingerprints", "select * from audio_fingerprint where context = ? and audio_uuid = ? order by frame_idx;");
+	if(stmt == NULL) {
+		return NULL;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, context);
+	db_ctx_stmt_bind_text(stmt, 2, uuid);
+	j_res = get_stmt_records(stmt);
+	db_ctx_stmt_release(stmt);
 
-			" context        varchar(255),"
-			" audio_uuid     varchar(255),"
-			" frame_idx      integer",
-			tablename
-			);
-	for(i = 0; i < DEF_AUBIO_COEFS; i++) {
-		ast_asprintf(&tmp, "%s, max%d real", sql, i + 1);
-		sfree(sql);
-		sql = tmp;
+	return j_res;
+}
+
+/**
+ * Returns all landmark info of the given audio.
+ * @param context
+ * @param uuid
+ * @return
+ */
+static struct ast_json* get_audio_landmarks(const char* context, const char* uuid)
+{
+	struct ast_json* j_res;
+	db_stmt_t* stmt;
+
+	if((context == NULL) || (uuid == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
 	}
-	ast_asprintf(&tmp, "%s);", sql);
-	sfree(sql);
-	sql = tmp;
-	ret = db_ctx_exec(g_db_ctx, sql);
-	sfree(sql);
-	if(ret == false) {
-		ast_log(LOG_ERROR, "Could not create fingerprint search table.\n");
-		return false;
+
+	stmt = db_ctx_stmt_get(g_db_ctx, "get_audio_landmarks", "select * from audio_landmark where context = ? and audio_uuid = ?;");
+	if(stmt == NULL) {
+		return NULL;
 	}
+	db_ctx_stmt_bind_text(stmt, 1, context);
+	db_ctx_stmt_bind_text(stmt, 2, uuid);
+	j_res = get_stmt_records(stmt);
+	db_ctx_stmt_release(stmt);
 
-	return true;
+	return j_res;
 }
 
-static bool delete_temp_search_table(const char* tablename)
+/**
+ * Returns all vector info of the given audio.
+ * @param context
+ * @param uuid
+ * @return
+ */
+static struct ast_json* get_audio_vectors(const char* context, const char* uuid)
 {
-	char* sql;
+	struct ast_json* j_res;
+	db_stmt_t* stmt;
 
-	if(tablename == NULL) {
+	if((context == NULL) || (uuid == NULL)) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
-		return false;
+		return NULL;
 	}
 
-	ast_asprintf(&sql, "drop table %s;", tablename);
-
-	db_ctx_exec(g_db_ctx, sql);
-	sfree(sql);
+	stmt = db_ctx_stmt_get(g_db_ctx, "get_audio_vectors", "select * from audio_vector where context = ? and audio_uuid = ? order by frame_idx;");
+	if(stmt == NULL) {
+		return NULL;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, context);
+	db_ctx_stmt_bind_text(stmt, 2, uuid);
+	j_res = get_stmt_records(stmt);
+	db_ctx_stmt_release(stmt);
 
-	return true;
+	return j_res;
 }
 
-struct ast_json* fp_get_context_lists_all(void)
+/**
+ * Returns all sub-fingerprint info of the given audio.
+ * @param context
+ * @param uuid
+ * @return
+ */
+static struct ast_json* get_audio_subfingerprints(const char* context, const char* uuid)
 {
-	char* sql;
 	struct ast_json* j_res;
-	struct ast_json* j_tmp;
-	db_ctx_t* db_ctx;
+	db_stmt_t* stmt;
 
-	ast_asprintf(&sql, "%s", "select * from context_list;");
-	db_ctx = create_db_ctx();
-	db_ctx_query(db_ctx, sql);
-	sfree(sql);
+	if((context == NULL) || (uuid == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
 
-	j_res = ast_json_array_create();
-	while(1) {
-		j_tmp = db_ctx_get_record(db_ctx);
-		if(j_tmp == NULL) {
-			break;
-		}
+	stmt = db_ctx_stmt_get(g_db_ctx, "get_audio_subfingerprints", "select * from audio_subfingerprint where context = ? and audio_uuid = ? order by frame_idx;");
+	if(stmt == NULL) {
+		return NULL;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, context);
+	db_ctx_stmt_bind_text(stmt, 2, uuid);
+	j_res = get_stmt_records(stmt);
+	db_ctx_stmt_release(stmt);
 
-		ast_json_array_append(j_res, j_tmp);
+	return j_res;
+}
+
+struct ast_json* fp_get_context_lists_all(void)
+{
+	struct ast_json* j_res;
+	db_stmt_t* stmt;
+
+	stmt = db_ctx_stmt_get(g_db_ctx, "get_context_lists_all", "select * from context_list;");
+	if(stmt == NULL) {
+		return NULL;
 	}
-	destroy_db_ctx(db_ctx);
+	j_res = get_stmt_records(stmt);
+	db_ctx_stmt_release(stmt);
 
 	return j_res;
 }
 
 struct ast_json* fp_get_context_list_info(const char* name)
 {
-	char* sql;
 	struct ast_json* j_res;
-	db_ctx_t* db_ctx;
+	db_stmt_t* stmt;
 
 	if(name == NULL) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
 		return NULL;
 	}
 
-	ast_asprintf(&sql, "select * from context_list where name == '%s';", name);
-	db_ctx = create_db_ctx();
-	db_ctx_query(db_ctx, sql);
-	sfree(sql);
-
-	j_res = db_ctx_get_record(db_ctx);
-	destroy_db_ctx(db_ctx);
+	stmt = db_ctx_stmt_get(g_db_ctx, "get_context_list", "select * from context_list where name = ?;");
+	if(stmt == NULL) {
+		return NULL;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, name);
+	j_res = db_ctx_stmt_get_record(stmt);
+	db_ctx_stmt_release(stmt);
 	if(j_res == NULL) {
 		return NULL;
 	}
@@ -964,25 +3252,26 @@ struct ast_json* fp_get_context_list_info(const char* name)
 static bool create_context_list_info(const char* name, const char* directory, const bool replace)
 {
 	int ret;
-	struct ast_json* j_data;
+	db_stmt_t* stmt;
 
 	if(name == NULL) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
 		return false;
 	}
 
-	j_data = ast_json_pack("{s:s, s:s}",
-			"name",			name,
-			"directory",	directory
-			);
-
 	if(replace == false) {
-		ret = db_ctx_insert(g_db_ctx, "context_list", j_data);
+		stmt = db_ctx_stmt_get(g_db_ctx, "insert_context_list", "insert into context_list(name, directory) values (?, ?);");
 	}
 	else {
-		ret = db_ctx_insert_or_replace(g_db_ctx, "context_list", j_data);
+		stmt = db_ctx_stmt_get(g_db_ctx, "replace_context_list", "insert or replace into context_list(name, directory) values (?, ?);");
 	}
-	ast_json_unref(j_data);
+	if(stmt == NULL) {
+		return false;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, name);
+	db_ctx_stmt_bind_text(stmt, 2, directory);
+	ret = db_ctx_stmt_step(stmt);
+	db_ctx_stmt_release(stmt);
 	if(ret == false) {
 		ast_log(LOG_WARNING, "Could not insert data into database.\n");
 		return false;
@@ -994,17 +3283,20 @@ static bool create_context_list_info(const char* name, const char* directory, co
 static bool delete_context_list_info(const char* name)
 {
 	int ret;
-	char* sql;
+	db_stmt_t* stmt;
 
 	if(name == NULL) {
 		ast_log(LOG_WARNING, "Wrong input parameter.\n");
 		return false;
 	}
 
-	ast_asprintf(&sql, "delete from context_list where name == '%s';", name);
-
-	ret = db_ctx_exec(g_db_ctx, sql);
-	sfree(sql);
+	stmt = db_ctx_stmt_get(g_db_ctx, "delete_context_list", "delete from context_list where name = ?;");
+	if(stmt == NULL) {
+		return false;
+	}
+	db_ctx_stmt_bind_text(stmt, 1, name);
+	ret = db_ctx_stmt_step(stmt);
+	db_ctx_stmt_release(stmt);
 	if(ret == false) {
 		ast_log(LOG_NOTICE, "Could not delete context_list info. name[%s]\n", name);
 		return false;
@@ -1091,6 +3383,15 @@ bool fp_delete_context_list_info(const char* name)
 		return false;
 	}
 
+	/* delete index */
+	engine_delete_context(name);
+	cache_remove_context(name);
+
+	/* the new context of the same name is planned again */
+	ast_mutex_lock(&g_plans_lock);
+	ast_json_object_del(g_plans, name);
+	ast_mutex_unlock(&g_plans_lock);
+
 	return true;
 }
 
@@ -1125,39 +3426,6 @@ char* fp_create_hash(const char* filename)
 	return res;
 }
 
-/**
- * Copy the given str and replace given org character to target character from str.
- * Return string should be freed after use it.
- * @param uuid
- * @return
- */
-static char* replace_string_char(const char* str, const char org, const char target)
-{
-	char* tmp;
-	int len;
-	int i;
-	int j;
-
-	if(str == NULL) {
-		return NULL;
-	}
-
-	len = strlen(str);
-	tmp = ast_calloc(len + 1, sizeof(char));
-	j = 0;
-	for(i = 0; i < len; i++) {
-		if(str[i] == org) {
-			tmp[j] = target;
-		}
-		else {
-			tmp[j] = str[i];
-		}
-		j++;
-	}
-	tmp[j] = '\0';
-	return tmp;
-}
-
 static db_ctx_t* create_db_ctx(void)
 {
 	db_ctx_t* db_ctx;
@@ -1179,3 +3447,82 @@ static void destroy_db_ctx(db_ctx_t* db_ctx)
 
 	return;
 }
+
+/**
+ * Returns the all records of the given statement by json array.
+ * @param stmt
+ * @return
+ */
+static struct ast_json* get_stmt_records(db_stmt_t* stmt)
+{
+	struct ast_json* j_res;
+	struct ast_json* j_tmp;
+
+	j_res = ast_json_array_create();
+	if(stmt == NULL) {
+		return j_res;
+	}
+
+	while(1) {
+		j_tmp = db_ctx_stmt_get_record(stmt);
+		if(j_tmp == NULL) {
+			break;
+		}
+
+		ast_json_array_append(j_res, j_tmp);
+	}
+
+	return j_res;
+}
+
+/**
+ * Create the search cache key.
+ * The key is the search options and the md5 digest of the quantized query observations,
+ * so the near identical recordings get the same key.
+ * @param params: search options string
+ * @param j_items: query observations(fingerprints or landmarks)
+ * @param names: the observation's values to digest
+ * @param name_count
+ * @param step: quantization step of the real values. 0 for the integer values.
+ * @return
+ */
+static char* create_search_key(const char* params, struct ast_json* j_items, const char** names, const int name_count, const double step)
+{
+	int i;
+	int j;
+	int64_t val;
+	MD5_CTX md_ctx;
+	unsigned char hash[MD5_DIGEST_LENGTH];
+	char digest[MD5_DIGEST_LENGTH * 2 + 1];
+	struct ast_json* j_item;
+	struct ast_json* j_val;
+	char* res;
+
+	MD5_Init(&md_ctx);
+	for(i = 0; i < ast_json_array_size(j_items); i++) {
+		j_item = ast_json_array_get(j_items, i);
+		if(j_item == NULL) {
+			continue;
+		}
+
+		for(j = 0; j < name_count; j++) {
+			j_val = ast_json_object_get(j_item, names[j]);
+			if(step > 0) {
+				val = (int64_t)floor(ast_json_real_get(j_val) / step);
+			}
+			else {
+				val = ast_json_integer_get(j_val);
+			}
+			MD5_Update(&md_ctx, &val, sizeof(val));
+		}
+	}
+	MD5_Final(hash, &md_ctx);
+
+	for(i = 0; i < MD5_DIGEST_LENGTH; i++) {
+		snprintf(digest + i * 2, 3, "%02x", hash[i]);
+	}
+
+	ast_asprintf(&res, "%s:%s", params, digest);
+
+	return res;
+}
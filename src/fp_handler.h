@@ -10,6 +10,25 @@
 
 #include <asterisk/json.h>
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "engine_handler.h"
+
+#define DEF_AUBIO_HOPSIZE		256
+#define DEF_AUBIO_BUFSIZE		512
+//#define DEF_AUBIO_HOPSIZE		512
+//#define DEF_AUBIO_BUFSIZE		1024
+#define DEF_AUBIO_SAMPLERATE	8000	// resample to the telephony rate. keeps the frame offsets comparable.
+#define DEF_AUBIO_FILTER		40
+#define DEF_AUBIO_COEFS			2
+#define DEF_AUBIO_VECTOR_COEFS	13		// full mfcc vector of the ivfpq engine
+
+#define DEF_SEARCH_TOLERANCE		0.001
+#define DEF_SEARCH_MAX_RESULTS		3		// ranked candidates. the runner-ups tell the ambiguous match.
+
+typedef struct _fp_extractor_t fp_extractor_t;
+
 bool fp_init(void);
 bool fp_term(void);
 
@@ -28,12 +47,27 @@ bool fp_delete_audio_list_info(const char* uuid);
 struct ast_json* fp_search_fingerprint_info(
 		const char* context,
 		const char* filename,
+		struct ast_json* j_frames,
 		const int coefs,
 		const double tolerance,
 		const int freq_ignore_low,
-		const int freq_ignore_high
+		const int freq_ignore_high,
+		const int max_results,
+		const int deadline_ms
 		);
 
+fp_extractor_t* fp_extractor_create(void);
+void fp_extractor_destroy(fp_extractor_t* extractor);
+struct ast_json* fp_extractor_write(fp_extractor_t* extractor, const int16_t sample, const int frame_idx, const char* uuid);
+
+const engine_t* fp_get_context_engine(const char* context);
+struct ast_json* fp_search_engine(const engine_t* engine, const char* context, struct ast_json* j_query, const engine_query_t* query, double* processed);
+struct ast_json* fp_verify_search(const char* context, struct ast_json* j_search, struct ast_json* j_query, const bool vector, const bool force, const int max_results);
+void fp_trim_search_results(struct ast_json* j_search, const int max_results);
+struct ast_json* fp_create_search_result(struct ast_json* j_search, const int frame_count, const double processed);
+
+struct ast_json* fp_get_context_engines(void);
+
 char* fp_generate_uuid(void);
 char* fp_create_hash(const char* filename);
 
@@ -0,0 +1,734 @@
+/*
+ * fp_stream_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Streaming and sliding window searches of the voice samples.
+ *  The voice samples are fingerprinted as they are written(fp_extractor),
+ *  and searched with the context's engine while the voice is still coming.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/json.h>
+#include <asterisk/time.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "app_tiresias.h"
+#include "fp_handler.h"
+#include "fp_stream_handler.h"
+#include "engine_handler.h"
+#include "verify_handler.h"
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+#define DEF_STREAM_STEP				8		// query frames between the leader checks of the streaming search
+#define DEF_STREAM_MIN_MATCHES		20		// min match count of the leader to stop the streaming search
+#define DEF_STREAM_MARGIN			2.0		// min ratio of the leader's match count to the runner-up's
+
+#define DEF_MONITOR_WINDOW_MAX		30000	// ms. max window of the monitor. bounds the monitor's memory.
+#define DEF_MONITOR_BUDGET			50		// percent of the step given to each window search
+
+/**
+ * Streaming search of the mfcc fingerprints.
+ */
+struct _fp_stream_t {
+	char* context;
+	char* uuid;
+	const engine_t* engine;
+	engine_query_t query;	///< coarse query of the engine
+	int max_results;
+	void* search;			///< engine's stream
+	int count;				///< expected frames
+	int deadline_ms;		///< time budget of the search after the capture
+	int searched;			///< searched frames
+
+	fp_extractor_t* extractor;
+
+	struct ast_json* j_fprints;	///< extracted frames
+	struct ast_json* j_pending;	///< extracted, but not searched yet
+	bool confident;			///< the leader is clear
+};
+
+/**
+ * Sliding window search of the mfcc fingerprints.
+ * Keeps the last window's frames in the ring buffer, and judges the window in every step.
+ * The streaming engine votes only the new frames of each step, and expires the frames out of the window.
+ */
+struct _fp_monitor_t {
+	char* context;
+	char* uuid;
+	const engine_t* engine;
+	engine_query_t query;	///< coarse query of the engine
+	void* search;			///< engine's sliding window stream. NULL if the engine does not support the streaming.
+	int budget_ms;			///< time budget of each window search
+
+	fp_extractor_t* extractor;
+
+	struct ast_json** ring;	///< extracted frames of the window. numbered from the monitor's start.
+	int window;				///< ring size(frames)
+	int step;				///< frames between the window searches
+	int head;				///< next slot of the ring
+	long frames;			///< extracted frames
+	int pending;			///< extracted frames since the last window search
+
+	long searches;			///< window searches
+	long skipped;			///< window searches stopped by the time budget
+	char* detected;			///< last detected audio's uuid. not detected again while it is leading.
+	struct ast_json* j_detection;	///< detection not taken yet
+};
+
+static void search_stream_pending(fp_stream_t* stream, const struct timeval deadline);
+static bool is_leader_clear(struct ast_json* j_search);
+static void search_monitor_window(fp_monitor_t* monitor);
+static struct ast_json* search_monitor_stream(fp_monitor_t* monitor, const int count, double* processed);
+static struct ast_json* create_monitor_window(fp_monitor_t* monitor);
+
+static int g_stream_min_matches = DEF_STREAM_MIN_MATCHES;
+static double g_stream_margin = DEF_STREAM_MARGIN;
+
+/**
+ * Initiate the streaming search with the global configuration.
+ * stream_min_matches: min match count of the leading candidate to stop the streaming search.
+ * stream_margin: min ratio of the leading candidate's match count to the runner-up's.
+ * @return
+ */
+bool fp_stream_init(void)
+{
+	const char* tmp_const;
+	struct ast_json* j_global;
+
+	j_global = ast_json_object_get(g_app->j_conf, "global");
+
+	g_stream_min_matches = DEF_STREAM_MIN_MATCHES;
+	tmp_const = ast_json_string_get(ast_json_object_get(j_global, "stream_min_matches"));
+	if(tmp_const != NULL) {
+		g_stream_min_matches = atoi(tmp_const);
+	}
+	if(g_stream_min_matches < 1) {
+		ast_log(LOG_WARNING, "Wrong stream_min_matches. Set to default. stream_min_matches[%d], default[%d]\n", g_stream_min_matches, DEF_STREAM_MIN_MATCHES);
+		g_stream_min_matches = DEF_STREAM_MIN_MATCHES;
+	}
+
+	g_stream_margin = DEF_STREAM_MARGIN;
+	tmp_const = ast_json_string_get(ast_json_object_get(j_global, "stream_margin"));
+	if(tmp_const != NULL) {
+		g_stream_margin = atof(tmp_const);
+	}
+	if(g_stream_margin < 1) {
+		ast_log(LOG_WARNING, "Wrong stream_margin. Set to default. stream_margin[%f], default[%f]\n", g_stream_margin, DEF_STREAM_MARGIN);
+		g_stream_margin = DEF_STREAM_MARGIN;
+	}
+	ast_log(LOG_VERBOSE, "Initiated streaming search. min_matches[%d], margin[%f]\n", g_stream_min_matches, g_stream_margin);
+
+	return true;
+}
+
+/**
+ * Create the streaming search of the given context.
+ * The voice samples are fingerprinted as they are written, and the fingerprints are searched
+ * in every few frames. The search is done when the leading candidate is clear(stream_min_matches
+ * and stream_margin) or when the duration's frames are written.
+ * Only the engines which support the streaming search(index, cascade) can be used.
+ * @param context
+ * @param duration: max duration(ms) of the voice.
+ * @param coefs
+ * @param tolerance
+ * @param freq_ignore_low
+ * @param freq_ignore_high
+ * @param max_results: max number of the ranked candidates.
+ * @param deadline_ms: time budget of the search after the voice has been written(fp_stream_get_result).
+ *        Most of the frames are searched while they are written, so this limits the last frames' search. 0 for no deadline.
+ * @return NULL if the context's engine does not support the streaming search.
+ */
+fp_stream_t* fp_stream_create(
+		const char* context,
+		const int duration,
+		const int coefs,
+		const double tolerance,
+		const int freq_ignore_low,
+		const int freq_ignore_high,
+		const int max_results,
+		const int deadline_ms
+		)
+{
+	fp_stream_t* stream;
+	const engine_t* engine;
+
+	if((context == NULL) || (duration <= 0)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	if((coefs < 1) || (coefs > DEF_AUBIO_COEFS)) {
+		ast_log(LOG_WARNING, "Wrong coefs count. max[%d], coefs[%d]\n", DEF_AUBIO_COEFS, coefs);
+		return NULL;
+	}
+
+	engine = fp_get_context_engine(context);
+	if(engine->stream_create == NULL) {
+		ast_log(LOG_NOTICE, "The engine does not support the streaming search. context[%s], engine[%s]\n", context, engine->name);
+		return NULL;
+	}
+
+	stream = ast_calloc(1, sizeof(fp_stream_t));
+	stream->context = ast_strdup(context);
+	stream->uuid = fp_generate_uuid();
+	stream->engine = engine;
+	stream->count = (int)((long)duration * DEF_AUBIO_SAMPLERATE / 1000 / DEF_AUBIO_HOPSIZE);
+	stream->deadline_ms = deadline_ms;
+
+	stream->max_results = (max_results < 1) ? DEF_SEARCH_MAX_RESULTS : max_results;
+	stream->query.coefs = coefs;
+	stream->query.tolerance = (tolerance < 0) ? DEF_SEARCH_TOLERANCE : tolerance;
+	stream->query.freq_ignore_low = freq_ignore_low;
+	stream->query.freq_ignore_high = freq_ignore_high;
+	stream->query.deadline = ast_tv(0, 0);
+
+	// the coarse candidates to verify
+	stream->query.max_results = stream->max_results;
+	if(engine->verify != ENGINE_VERIFY_NONE) {
+		stream->query.max_results = MAX(stream->query.max_results, verify_get_candidates());
+	}
+	if(engine->verify == ENGINE_VERIFY_FORCE) {
+		stream->query.max_results = MAX(stream->query.max_results, engine->min_candidates);
+	}
+
+	stream->j_fprints = ast_json_array_create();
+	stream->j_pending = ast_json_array_create();
+	stream->search = engine->stream_create(context, &stream->query, MAX(stream->count, 1), 0);
+	stream->extractor = fp_extractor_create();
+	if((stream->extractor == NULL) || (stream->search == NULL)) {
+		ast_log(LOG_ERROR, "Could not initiate streaming search. context[%s]\n", context);
+		fp_stream_destroy(stream);
+		return NULL;
+	}
+	ast_log(LOG_DEBUG, "Created streaming search. context[%s], engine[%s], frames[%d]\n", context, engine->name, stream->count);
+
+	return stream;
+}
+/**
+ * Write the voice samples into the stream.
+ * The samples over the duration are ignored.
+ * @param stream
+ * @param samples: signed linear samples of the 8 kHz.
+ * @param count
+ * @return
+ */
+bool fp_stream_write(fp_stream_t* stream, const int16_t* samples, const int count)
+{
+	int i;
+	int frame_idx;
+	struct ast_json* j_tmp;
+
+	if((stream == NULL) || (samples == NULL) || (count < 0)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	for(i = 0; i < count; i++) {
+		frame_idx = ast_json_array_size(stream->j_fprints);
+		if(frame_idx >= stream->count) {
+			break;
+		}
+
+		j_tmp = fp_extractor_write(stream->extractor, samples[i], frame_idx, stream->uuid);
+		if(j_tmp == NULL) {
+			continue;
+		}
+		ast_json_array_append(stream->j_fprints, j_tmp);
+		ast_json_array_append(stream->j_pending, ast_json_ref(j_tmp));
+	}
+
+	if((ast_json_array_size(stream->j_pending) >= DEF_STREAM_STEP) || (fp_stream_is_done(stream) == true)) {
+		search_stream_pending(stream, ast_tv(0, 0));
+	}
+
+	return true;
+}
+/**
+ * Returns true if the stream does not need more samples.
+ * The leading candidate is clear, or the duration's frames are written.
+ */
+bool fp_stream_is_done(fp_stream_t* stream)
+{
+	if(stream == NULL) {
+		return true;
+	}
+
+	if(stream->confident == true) {
+		return true;
+	}
+
+	if(ast_json_array_size(stream->j_fprints) >= stream->count) {
+		return true;
+	}
+
+	return false;
+}
+/**
+ * Returns the stream's search result. The result is same as the fp_search_fingerprint_info's,
+ * and has the "early" flag if the stream was done before the duration.
+ * The candidates are verified with the frames written so far.
+ * If the last frames could not be searched in the deadline_ms, returns the best candidates so far
+ * without the verification same as the fp_search_fingerprint_info.
+ * @param stream
+ * @return NULL if not found.
+ */
+struct ast_json* fp_stream_get_result(fp_stream_t* stream)
+{
+	int frame_count;
+	double processed;
+	struct timeval deadline;
+	const engine_t* engine;
+	struct ast_json* j_search;
+	struct ast_json* j_res;
+
+	if(stream == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	deadline = ast_tv(0, 0);
+	if(stream->deadline_ms > 0) {
+		deadline = ast_tvadd(ast_tvnow(), ast_samp2tv(stream->deadline_ms, 1000));
+	}
+	search_stream_pending(stream, deadline);
+
+	engine = stream->engine;
+	frame_count = ast_json_array_size(stream->j_fprints);
+	processed = (frame_count > 0) ? (double)stream->searched / frame_count : 1;
+	if(processed < 1) {
+		ast_log(LOG_NOTICE, "The streaming search has been stopped by the deadline. context[%s], engine[%s], deadline_ms[%d], processed[%f]\n",
+				stream->context, engine->name, stream->deadline_ms, processed);
+	}
+
+	j_search = engine->stream_get_results(stream->search, stream->query.max_results);
+	if((engine->verify == ENGINE_VERIFY_NONE) || (processed < 1)) {
+		// out of time. the coarse candidates as it is.
+		fp_trim_search_results(j_search, stream->max_results);
+	}
+	else {
+		j_search = fp_verify_search(stream->context, j_search, stream->j_fprints, false, (engine->verify == ENGINE_VERIFY_FORCE), stream->max_results);
+	}
+	if((j_search == NULL) || (ast_json_array_size(j_search) == 0)) {
+		ast_log(LOG_NOTICE, "Could not find data. context[%s], frames[%d]\n", stream->context, frame_count);
+		ast_json_unref(j_search);
+		return NULL;
+	}
+	ast_log(LOG_DEBUG, "Streaming search complete. context[%s], frames[%d], expected[%d], results[%zu]\n",
+			stream->context, frame_count, stream->count, ast_json_array_size(j_search));
+
+	j_res = fp_create_search_result(j_search, frame_count, processed);
+	if(j_res == NULL) {
+		return NULL;
+	}
+	ast_json_object_set(j_res, "early", ast_json_boolean(frame_count < stream->count));
+
+	return j_res;
+}
+void fp_stream_destroy(fp_stream_t* stream)
+{
+	if(stream == NULL) {
+		return;
+	}
+
+	if(stream->search != NULL) {
+		stream->engine->stream_destroy(stream->search);
+	}
+
+	fp_extractor_destroy(stream->extractor);
+
+	ast_json_unref(stream->j_fprints);
+	ast_json_unref(stream->j_pending);
+	sfree(stream->context);
+	sfree(stream->uuid);
+	ast_free(stream);
+}
+/**
+ * Create the sliding window search of the given context.
+ * The voice samples are fingerprinted as they are written, and the last window's frames are
+ * kept in the ring buffer. The window is judged in every step, and detected if the leading
+ * candidate is clear(stream_min_matches and stream_margin).
+ * The streaming engines(index, cascade) search only the step's new frames, and the votes of the
+ * frames out of the window are expired. The other engines search the whole window in every step.
+ * Each window search is given the DEF_MONITOR_BUDGET percent of the step as the time budget,
+ * so the monitor never falls behind the voice and leaves the cpu for the other channels.
+ * Only the mfcc fingerprint engines(index, cascade, scan, ngram, sql) can be used.
+ * @param context
+ * @param window_ms: window duration(ms).
+ * @param step_ms: time(ms) between the window searches.
+ * @param coefs
+ * @param tolerance
+ * @param freq_ignore_low
+ * @param freq_ignore_high
+ * @return NULL if the context's engine does not support the mfcc fingerprints.
+ */
+fp_monitor_t* fp_monitor_create(
+		const char* context,
+		const int window_ms,
+		const int step_ms,
+		const int coefs,
+		const double tolerance,
+		const int freq_ignore_low,
+		const int freq_ignore_high
+		)
+{
+	fp_monitor_t* monitor;
+	const engine_t* engine;
+
+	if((context == NULL) || (window_ms <= 0) || (window_ms > DEF_MONITOR_WINDOW_MAX) || (step_ms <= 0)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	if((coefs < 1) || (coefs > DEF_AUBIO_COEFS)) {
+		ast_log(LOG_WARNING, "Wrong coefs count. max[%d], coefs[%d]\n", DEF_AUBIO_COEFS, coefs);
+		return NULL;
+	}
+
+	engine = fp_get_context_engine(context);
+	if(engine->data != ENGINE_DATA_FINGERPRINT) {
+		ast_log(LOG_NOTICE, "The engine does not support the monitoring. context[%s], engine[%s]\n", context, engine->name);
+		return NULL;
+	}
+
+	monitor = ast_calloc(1, sizeof(fp_monitor_t));
+	monitor->context = ast_strdup(context);
+	monitor->uuid = fp_generate_uuid();
+	monitor->engine = engine;
+	monitor->budget_ms = MAX(step_ms * DEF_MONITOR_BUDGET / 100, 1);
+	monitor->window = MAX((int)((long)window_ms * DEF_AUBIO_SAMPLERATE / 1000 / DEF_AUBIO_HOPSIZE), 1);
+	monitor->step = MAX((int)((long)step_ms * DEF_AUBIO_SAMPLERATE / 1000 / DEF_AUBIO_HOPSIZE), 1);
+	monitor->ring = ast_calloc(monitor->window, sizeof(struct ast_json*));
+
+	monitor->query.coefs = coefs;
+	monitor->query.tolerance = (tolerance < 0) ? DEF_SEARCH_TOLERANCE : tolerance;
+	monitor->query.freq_ignore_low = freq_ignore_low;
+	monitor->query.freq_ignore_high = freq_ignore_high;
+
+	// the coarse candidates to verify
+	monitor->query.max_results = 2;
+	if(engine->verify != ENGINE_VERIFY_NONE) {
+		monitor->query.max_results = MAX(monitor->query.max_results, verify_get_candidates());
+	}
+	if(engine->verify == ENGINE_VERIFY_FORCE) {
+		monitor->query.max_results = MAX(monitor->query.max_results, engine->min_candidates);
+	}
+
+	monitor->extractor = fp_extractor_create();
+	if(monitor->extractor == NULL) {
+		ast_log(LOG_ERROR, "Could not initiate monitor. context[%s]\n", context);
+		fp_monitor_destroy(monitor);
+		return NULL;
+	}
+
+	// the monitor runs until the channel hangs up
+	if(engine->stream_create != NULL) {
+		monitor->search = engine->stream_create(context, &monitor->query, INT_MAX, monitor->window);
+	}
+	ast_log(LOG_DEBUG, "Created monitor. context[%s], engine[%s], window[%d], step[%d], stream[%d]\n",
+			context, engine->name, monitor->window, monitor->step, (monitor->search != NULL) ? 1 : 0);
+
+	return monitor;
+}
+/**
+ * Write the voice samples into the monitor.
+ * The window is searched in the caller's thread when the step's frames are written.
+ * @param monitor
+ * @param samples: signed linear samples of the 8 kHz.
+ * @param count
+ * @return
+ */
+bool fp_monitor_write(fp_monitor_t* monitor, const int16_t* samples, const int count)
+{
+	int i;
+	struct ast_json* j_tmp;
+
+	if((monitor == NULL) || (samples == NULL) || (count < 0)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	for(i = 0; i < count; i++) {
+		j_tmp = fp_extractor_write(monitor->extractor, samples[i], (int)monitor->frames, monitor->uuid);
+		if(j_tmp == NULL) {
+			continue;
+		}
+
+		// overwrite the oldest frame
+		ast_json_unref(monitor->ring[monitor->head]);
+		monitor->ring[monitor->head] = j_tmp;
+		monitor->head = (monitor->head + 1) % monitor->window;
+		monitor->frames++;
+		monitor->pending++;
+
+		if((monitor->frames >= monitor->window) && (monitor->pending >= monitor->step)) {
+			search_monitor_window(monitor);
+		}
+	}
+
+	return true;
+}
+/**
+ * Returns the monitor's new detection, and clears it.
+ * The result is same as the fp_search_fingerprint_info's, and has the "position"(ms) of the
+ * window's end from the monitor's start.
+ * @param monitor
+ * @return NULL if nothing has been detected since the last call.
+ */
+struct ast_json* fp_monitor_get_detection(fp_monitor_t* monitor)
+{
+	struct ast_json* j_res;
+
+	if(monitor == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	j_res = monitor->j_detection;
+	monitor->j_detection = NULL;
+
+	return j_res;
+}
+/**
+ * Returns the monitor's statistics.
+ * @param monitor
+ * @return {"frames": <extracted frames>, "searches": <window searches>, "skipped": <window searches stopped by the time budget>}
+ */
+struct ast_json* fp_monitor_get_stats(fp_monitor_t* monitor)
+{
+	if(monitor == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	return ast_json_pack("{s:i, s:i, s:i}",
+			"frames",	(int)monitor->frames,
+			"searches",	(int)monitor->searches,
+			"skipped",	(int)monitor->skipped
+			);
+}
+void fp_monitor_destroy(fp_monitor_t* monitor)
+{
+	int i;
+
+	if(monitor == NULL) {
+		return;
+	}
+
+	if(monitor->search != NULL) {
+		monitor->engine->stream_destroy(monitor->search);
+	}
+
+	fp_extractor_destroy(monitor->extractor);
+
+	for(i = 0; (monitor->ring != NULL) && (i < monitor->window); i++) {
+		ast_json_unref(monitor->ring[i]);
+	}
+	sfree(monitor->ring);
+
+	ast_json_unref(monitor->j_detection);
+	sfree(monitor->detected);
+	sfree(monitor->context);
+	sfree(monitor->uuid);
+	ast_free(monitor);
+}
+/**
+ * Search the stream's pending frames, and check the leading candidate.
+ * @param stream
+ * @param deadline: the pending frames after this are not searched. zero for no deadline.
+ */
+static void search_stream_pending(fp_stream_t* stream, const struct timeval deadline)
+{
+	int count;
+	double processed;
+	struct ast_json* j_search;
+
+	count = ast_json_array_size(stream->j_pending);
+	if(count == 0) {
+		return;
+	}
+
+	processed = 1;
+	stream->engine->stream_add(stream->search, stream->j_pending, deadline, &processed);
+	stream->searched += (int)(count * processed);
+	ast_json_unref(stream->j_pending);
+	stream->j_pending = ast_json_array_create();
+
+	j_search = stream->engine->stream_get_results(stream->search, 2);
+	if(is_leader_clear(j_search) == true) {
+		ast_log(LOG_DEBUG, "The leading candidate is clear. context[%s], frames[%zu]\n", stream->context, ast_json_array_size(stream->j_fprints));
+		stream->confident = true;
+	}
+	ast_json_unref(j_search);
+}
+/**
+ * Returns true if the leading candidate of the ranked candidates is clear.
+ * The leader is clear if it has the stream_min_matches at least,
+ * and the stream_margin times of the runner-up's match count.
+ * @param j_search: ranked candidates of the engine.
+ * @return
+ */
+static bool is_leader_clear(struct ast_json* j_search)
+{
+	int leader;
+	int runner_up;
+
+	leader = ast_json_integer_get(ast_json_object_get(ast_json_array_get(j_search, 0), "match_count"));
+	runner_up = ast_json_integer_get(ast_json_object_get(ast_json_array_get(j_search, 1), "match_count"));
+	ast_log(LOG_DEBUG, "Check leading candidate. leader[%d], runner_up[%d]\n", leader, runner_up);
+
+	if((leader > 0) && (leader >= g_stream_min_matches) && (leader >= runner_up * g_stream_margin)) {
+		return true;
+	}
+
+	return false;
+}
+/**
+ * Search the monitor's window, and keep the detection if the leading candidate is clear.
+ * The same audio is not detected again until the other audio leads or nothing leads.
+ * @param monitor
+ */
+static void search_monitor_window(fp_monitor_t* monitor)
+{
+	int count;
+	double processed;
+	const char* uuid;
+	char* candidate;
+	struct ast_json* j_window;
+	struct ast_json* j_search;
+	struct ast_json* j_res;
+
+	// new frames since the last search. the older ones have been overwritten.
+	count = MIN(monitor->pending, monitor->window);
+	monitor->pending = 0;
+	monitor->searches++;
+
+	monitor->query.deadline = ast_tvadd(ast_tvnow(), ast_samp2tv(monitor->budget_ms, 1000));
+	processed = 1;
+	if(monitor->search != NULL) {
+		j_search = search_monitor_stream(monitor, count, &processed);
+	}
+	else {
+		j_window = create_monitor_window(monitor);
+		j_search = fp_search_engine(monitor->engine, monitor->context, j_window, &monitor->query, &processed);
+		ast_json_unref(j_window);
+	}
+	if(processed < 1) {
+		// out of time. the window is not judged with the partial votes.
+		monitor->skipped++;
+		ast_json_unref(j_search);
+		return;
+	}
+
+	if(is_leader_clear(j_search) == false) {
+		sfree(monitor->detected);
+		ast_json_unref(j_search);
+		return;
+	}
+
+	uuid = ast_json_string_get(ast_json_object_get(ast_json_array_get(j_search, 0), "audio_uuid"));
+	if((monitor->detected != NULL) && (uuid != NULL) && (strcmp(monitor->detected, uuid) == 0)) {
+		// still leading
+		ast_json_unref(j_search);
+		return;
+	}
+
+	// confirm the leader with the frame alignment
+	candidate = ast_strdup(uuid);
+	if(monitor->engine->verify == ENGINE_VERIFY_NONE) {
+		fp_trim_search_results(j_search, 1);
+	}
+	else {
+		j_window = create_monitor_window(monitor);
+		j_search = fp_verify_search(monitor->context, j_search, j_window, false, (monitor->engine->verify == ENGINE_VERIFY_FORCE), 1);
+		ast_json_unref(j_window);
+	}
+	if((j_search == NULL) || (ast_json_array_size(j_search) == 0)) {
+		ast_log(LOG_DEBUG, "The leading candidate has not been confirmed. context[%s], uuid[%s]\n", monitor->context, candidate);
+		ast_json_unref(j_search);
+		sfree(candidate);
+		return;
+	}
+	sfree(candidate);
+
+	// detected only after the confirmation. the unconfirmed leader is tried again in the next window.
+	sfree(monitor->detected);
+	monitor->detected = ast_strdup(ast_json_string_get(ast_json_object_get(ast_json_array_get(j_search, 0), "audio_uuid")));
+
+	j_res = fp_create_search_result(j_search, monitor->window, 1);
+	if(j_res == NULL) {
+		return;
+	}
+	ast_json_object_set(j_res, "position", ast_json_integer_create(monitor->frames * DEF_AUBIO_HOPSIZE * 1000 / DEF_AUBIO_SAMPLERATE));
+	ast_log(LOG_DEBUG, "Detected. context[%s], uuid[%s], frames[%ld]\n", monitor->context, monitor->detected, monitor->frames);
+
+	ast_json_unref(monitor->j_detection);
+	monitor->j_detection = j_res;
+}
+/**
+ * Vote the monitor's new frames into the sliding window stream.
+ * The stream expires the votes of the frames out of the window.
+ * @param monitor
+ * @param count: new frames in the ring.
+ * @param processed: ratio(0 ~ 1) of the new frames searched.
+ * @return ranked candidates of the window. The offsets are from the window's start.
+ */
+static struct ast_json* search_monitor_stream(fp_monitor_t* monitor, const int count, double* processed)
+{
+	int i;
+	int start;
+	struct ast_json* j_frames;
+	struct ast_json* j_search;
+	struct ast_json* j_tmp;
+
+	// the ring's frames are shared, not copied
+	j_frames = ast_json_array_create();
+	for(i = count; i > 0; i--) {
+		ast_json_array_append(j_frames, ast_json_ref(monitor->ring[(monitor->head - i + monitor->window) % monitor->window]));
+	}
+	monitor->engine->stream_add(monitor->search, j_frames, monitor->query.deadline, processed);
+	ast_json_unref(j_frames);
+
+	j_search = monitor->engine->stream_get_results(monitor->search, monitor->query.max_results);
+
+	// the frames are numbered from the monitor's start
+	start = (int)(monitor->frames - monitor->window);
+	for(i = 0; i < ast_json_array_size(j_search); i++) {
+		j_tmp = ast_json_array_get(j_search, i);
+		ast_json_object_set(j_tmp, "offset", ast_json_integer_create(ast_json_integer_get(ast_json_object_get(j_tmp, "offset")) + start));
+	}
+
+	return j_search;
+}
+/**
+ * Returns the monitor's window frames from the oldest. Numbered from the window's start.
+ * The ring's frames are shared with the stream, so the copies are numbered.
+ * @param monitor
+ * @return
+ */
+static struct ast_json* create_monitor_window(fp_monitor_t* monitor)
+{
+	int i;
+	struct ast_json* j_window;
+	struct ast_json* j_frame;
+
+	j_window = ast_json_array_create();
+	for(i = 0; i < monitor->window; i++) {
+		j_frame = ast_json_copy(monitor->ring[(monitor->head + i) % monitor->window]);
+		ast_json_object_set(j_frame, "frame_idx", ast_json_integer_create(i));
+		ast_json_array_append(j_window, j_frame);
+	}
+
+	return j_window;
+}
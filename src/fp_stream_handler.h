@@ -0,0 +1,50 @@
+/*
+ * fp_stream_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_FP_STREAM_HANDLER_H_
+#define SRC_FP_STREAM_HANDLER_H_
+
+#include <asterisk/json.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct _fp_stream_t fp_stream_t;
+typedef struct _fp_monitor_t fp_monitor_t;
+
+bool fp_stream_init(void);
+
+fp_stream_t* fp_stream_create(
+		const char* context,
+		const int duration,
+		const int coefs,
+		const double tolerance,
+		const int freq_ignore_low,
+		const int freq_ignore_high,
+		const int max_results,
+		const int deadline_ms
+		);
+bool fp_stream_write(fp_stream_t* stream, const int16_t* samples, const int count);
+bool fp_stream_is_done(fp_stream_t* stream);
+struct ast_json* fp_stream_get_result(fp_stream_t* stream);
+void fp_stream_destroy(fp_stream_t* stream);
+
+fp_monitor_t* fp_monitor_create(
+		const char* context,
+		const int window_ms,
+		const int step_ms,
+		const int coefs,
+		const double tolerance,
+		const int freq_ignore_low,
+		const int freq_ignore_high
+		);
+bool fp_monitor_write(fp_monitor_t* monitor, const int16_t* samples, const int count);
+struct ast_json* fp_monitor_get_detection(fp_monitor_t* monitor);
+struct ast_json* fp_monitor_get_stats(fp_monitor_t* monitor);
+void fp_monitor_destroy(fp_monitor_t* monitor);
+
+#endif /* SRC_FP_STREAM_HANDLER_H_ */
@@ -0,0 +1,1667 @@
+/*
+ * index_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  In-memory fingerprint index.
+ *  Keeps the fingerprints of each context in arrays sorted by max1,
+ *  so the search can do the range lookup with the binary search
+ *  and count the votes without touching the database.
+ *
+ *  For the multi coefs search, the entries are also kept in the k-d tree
+ *  over the max1 ~ maxN. The box query costs in proportion to the hits,
+ *  not the entries in the max1 range.
+ *
+ *  The index keeps the occupancy of each max1 bucket. The quiet and silent frames
+ *  pile up in the few buckets, and the query frame in such bucket matches the large part
+ *  of the entries. The query frame whose range has more entries than the stop density of
+ *  the context is skipped like the stop word, so the cost of each query frame is bounded.
+ *
+ *  With the candidate budget, the tolerance of each query frame is narrowed by the
+ *  occupancy of its bucket, so the frame matches about the budget entries at most
+ *  regardless of the context size. The effective tolerances and the candidate counts
+ *  are kept in the context's search statistics.
+ *
+ *  Each context is a separated segment in the hash container and has its own lock.
+ *  The search touches only the target context's segment.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/json.h>
+#include <asterisk/lock.h>
+#include <asterisk/astobj2.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "index_handler.h"
+#include "vote_handler.h"
+#include "registry_handler.h"
+#include "sketch_handler.h"
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+#define DEF_INDEX_MAX_COEFS		8
+#define DEF_INDEX_KD_LEAF_SIZE	16
+#define DEF_INDEX_CTX_BUCKETS	31
+#define DEF_INDEX_BUCKET_STEP	1.0		// max1 width of each occupancy bucket
+#define DEF_INDEX_MAX_BUCKETS	4096
+
+typedef struct _index_entry_t {
+	float max[DEF_INDEX_MAX_COEFS];
+	int audio_id;
+	int frame_idx;
+} index_entry_t;
+
+typedef struct _index_ctx_t {
+	registry_t reg;		///< context name and audio uuids. must be the first member.
+
+	sketch_t** sketches;	///< prefilter sketch of each audio.
+
+	/* sorted entries. All arrays are sorted by max1. */
+	int count;
+	int size;
+	float* keys;		///< max1
+	float* coefs;		///< max2 ~ maxN. (g_coefs - 1) values for each entry.
+	int* audio_ids;
+	int* frame_idxs;
+
+	/* added, but not merged into the sorted entries yet. */
+	int pending_count;
+	int pending_size;
+	index_entry_t* pending;
+
+	/* implicit k-d tree. median split of [lo, hi) with the depth % g_coefs dimension. */
+	bool kd_dirty;
+	float* kd_points;	///< max1 ~ maxN. g_coefs values for each node.
+	int* kd_refs;		///< entry position of the sorted arrays.
+
+	/* occupancy of each max1 bucket. the bucket i is [bucket_min + i, bucket_min + i + 1) * DEF_INDEX_BUCKET_STEP. */
+	bool stats_dirty;
+	int bucket_min;
+	int bucket_count;
+	int* buckets;
+	int stop_limit;		///< max entries of the query frame's range. 0 for no limit.
+
+	/* search statistics. protected by the g_stats_lock. */
+	unsigned long stat_searches;
+	unsigned long stat_frames;		///< searched query frames
+	unsigned long stat_narrowed;	///< query frames searched with the narrowed tolerance
+	unsigned long stat_candidates;	///< matched entries
+	double stat_tolerance_sum;		///< sum of the effective tolerances of the searched frames
+} index_ctx_t;
+
+typedef struct _index_query_t {
+	const index_ctx_t* ctx;
+
+	struct ast_json* j_fprints;
+	int coefs;
+	double tolerance;
+	int freq_ignore_low;
+	int freq_ignore_high;
+
+	/* search statistics. summed from the parts with the g_stats_lock. */
+	int frames;
+	int narrowed;
+	long candidates;
+	double tolerance_sum;
+	double tolerance_min;
+} index_query_t;
+
+typedef struct _index_search_t {
+	const index_ctx_t* ctx;
+
+	vote_t* vote;
+
+	double min[DEF_INDEX_MAX_COEFS];	///< search box
+	double max[DEF_INDEX_MAX_COEFS];
+	double tolerance;		///< effective tolerance of the max1
+
+	/* search statistics. added into the query at the end. */
+	int frames;
+	int narrowed;
+	long candidates;		///< matched entries
+	double tolerance_sum;
+	double tolerance_min;
+} index_search_t;
+
+/**
+ * Streaming search. The query frames are searched as they are added.
+ * Holds the ctx's reference, and takes the ctx's read lock for each add.
+ */
+struct _index_stream_t {
+	index_ctx_t* ctx;
+	index_query_t query;
+	index_search_t search;
+	vote_t* vote;
+	int count;		///< expected query frames
+	int idx;		///< next query frame
+};
+
+/**
+ * Query frame of the batched search.
+ */
+typedef struct _index_batch_item_t {
+	float key;		///< max1
+	int query;		///< query index of the batch
+	int idx;		///< frame index of the query
+} index_batch_item_t;
+
+static int g_coefs = 0;
+static double g_stop_density = 0;		///< max ratio of the entries in the query frame's range. 0 disables the stop buckets.
+static int g_budget = 0;		///< target max candidates of each query frame. 0 disables the adaptive tolerance.
+AST_MUTEX_DEFINE_STATIC(g_stats_lock);
+static struct ao2_container* g_index_ctxs = NULL;	///< index ctxs. key: context name
+
+static void destroy_index_ctx(void* obj);
+static index_ctx_t* get_index_ctx(const char* name);
+
+static bool prepare_index_ctx(index_ctx_t* ctx);
+static bool is_index_ctx_ready(const index_ctx_t* ctx);
+static void lock_search_index_ctx(index_ctx_t* ctx);
+static bool merge_pending_entries(index_ctx_t* ctx);
+static bool build_kd_tree(index_ctx_t* ctx);
+static void update_bucket_stats(index_ctx_t* ctx);
+static int get_bucket(const index_ctx_t* ctx, const double value);
+static bool is_stop_range(const index_ctx_t* ctx, const double min, const double max);
+static double get_budget_tolerance(const index_ctx_t* ctx, const double value, const double tolerance);
+static void update_search_stats(index_ctx_t* ctx, const index_query_t* query);
+static void build_kd_node(index_ctx_t* ctx, int lo, int hi, int depth);
+static void select_kd_node(index_ctx_t* ctx, int lo, int hi, int nth, int dim);
+static void swap_kd_node(index_ctx_t* ctx, int a, int b);
+static void init_query(index_query_t* query, const index_ctx_t* ctx, struct ast_json* j_fprints, const int coefs, const double tolerance, const int freq_ignore_low, const int freq_ignore_high);
+static bool* create_excludes(const index_query_t* query);
+static void search_range(void* data, vote_t* vote, const int start, const int end);
+static void search_frame(const index_query_t* query, index_search_t* search, struct ast_json* j_fprint);
+static void add_query_stats(index_query_t* query, const index_search_t* search);
+static int set_search_box(const index_query_t* query, struct ast_json* j_fprint, index_search_t* search);
+static void search_kd_node(index_search_t* search, int lo, int hi, int depth);
+static void add_vote(index_search_t* search, int pos);
+static int compare_entry(const void* a, const void* b);
+static int compare_batch_item(const void* a, const void* b);
+static int lower_bound(const float* keys, int count, double value);
+static int upper_bound(const float* keys, int count, double value);
+
+/**
+ * Initiate the index engine.
+ * @param coefs
+ * @param stop_density: max ratio(0 ~ 1) of the context's entries in the query frame's range.
+ * The query frame over this is skipped. 0 disables.
+ * @param budget: target max candidates of each query frame. The tolerance is narrowed to fit in. 0 disables.
+ * @return
+ */
+bool index_init(const int coefs, const double stop_density, const int budget)
+{
+	if((coefs < 1) || (coefs > DEF_INDEX_MAX_COEFS)) {
+		ast_log(LOG_ERROR, "Wrong coefs count. max[%d], coefs[%d]\n", DEF_INDEX_MAX_COEFS, coefs);
+		return false;
+	}
+
+	if((stop_density < 0) || (stop_density > 1)) {
+		ast_log(LOG_ERROR, "Wrong stop density. stop_density[%f]\n", stop_density);
+		return false;
+	}
+
+	if(budget < 0) {
+		ast_log(LOG_ERROR, "Wrong candidate budget. budget[%d]\n", budget);
+		return false;
+	}
+
+	g_coefs = coefs;
+	g_stop_density = stop_density;
+	g_budget = budget;
+
+	g_index_ctxs = registry_container_create(DEF_INDEX_CTX_BUCKETS);
+	if(g_index_ctxs == NULL) {
+		ast_log(LOG_ERROR, "Could not create index ctx container.\n");
+		return false;
+	}
+
+	return true;
+}
+
+bool index_term(void)
+{
+	ao2_cleanup(g_index_ctxs);
+	g_index_ctxs = NULL;
+
+	return true;
+}
+
+/**
+ * Add the given audio's fingerprints into the context's index.
+ * The entries are merged into the sorted arrays at the next search.
+ * @param context
+ * @param uuid
+ * @param j_fprints
+ * @return
+ */
+bool index_add_audio(const char* context, const char* uuid, struct ast_json* j_fprints)
+{
+	int i;
+	int j;
+	int count;
+	int audio_id;
+	char col_max[10];
+	index_ctx_t* ctx;
+	index_entry_t* entry;
+	sketch_t* sketch;
+	struct ast_json* j_fprint;
+
+	if((context == NULL) || (uuid == NULL) || (j_fprints == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	/* get or create the context's segment */
+	ao2_lock(g_index_ctxs);
+	ctx = ao2_find(g_index_ctxs, context, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if(ctx == NULL) {
+		ctx = registry_ctx_create(sizeof(index_ctx_t), destroy_index_ctx, context);
+		ao2_link_flags(g_index_ctxs, ctx, OBJ_NOLOCK);
+	}
+	ao2_unlock(g_index_ctxs);
+
+	ao2_wrlock(ctx);
+
+	audio_id = registry_get_audio_id(&ctx->reg, uuid);
+	if(audio_id >= 0) {
+		ast_log(LOG_NOTICE, "The given audio is already indexed. context[%s], uuid[%s]\n", context, uuid);
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		return true;
+	}
+	audio_id = registry_create_audio_id(&ctx->reg, uuid);
+	if(audio_id == ctx->reg.audio_size - 1) {
+		/* new audio id. grow the per audio arrays */
+		ctx->sketches = ast_realloc(ctx->sketches, sizeof(sketch_t*) * ctx->reg.audio_size);
+		ctx->sketches[audio_id] = NULL;
+	}
+
+	count = ast_json_array_size(j_fprints);
+	if(ctx->pending_count + count > ctx->pending_size) {
+		ctx->pending_size = ctx->pending_count + count;
+		ctx->pending = ast_realloc(ctx->pending, sizeof(index_entry_t) * ctx->pending_size);
+	}
+	sketch = sketch_create(count, g_coefs);
+
+	for(i = 0; i < count; i++) {
+		j_fprint = ast_json_array_get(j_fprints, i);
+		if(j_fprint == NULL) {
+			continue;
+		}
+
+		entry = &ctx->pending[ctx->pending_count];
+		memset(entry, 0x00, sizeof(index_entry_t));
+		entry->audio_id = audio_id;
+		entry->frame_idx = ast_json_integer_get(ast_json_object_get(j_fprint, "frame_idx"));
+		for(j = 0; j < g_coefs; j++) {
+			snprintf(col_max, sizeof(col_max), "max%d", j + 1);
+			entry->max[j] = ast_json_real_get(ast_json_object_get(j_fprint, col_max));
+		}
+		sketch_add(sketch, entry->max);
+		ctx->pending_count++;
+	}
+	ctx->sketches[audio_id] = sketch;
+	ao2_unlock(ctx);
+	ao2_ref(ctx, -1);
+
+	ast_log(LOG_DEBUG, "Added index info. context[%s], uuid[%s], audio_id[%d], count[%d]\n", context, uuid, audio_id, count);
+
+	return true;
+}
+
+/**
+ * Delete the given audio's fingerprints from the context's index.
+ * @param context
+ * @param uuid
+ * @return
+ */
+bool index_delete_audio(const char* context, const char* uuid)
+{
+	int i;
+	int j;
+	int audio_id;
+	int stride;
+	index_ctx_t* ctx;
+
+	if((context == NULL) || (uuid == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	ctx = get_index_ctx(context);
+	if(ctx == NULL) {
+		return false;
+	}
+
+	ao2_wrlock(ctx);
+
+	audio_id = registry_get_audio_id(&ctx->reg, uuid);
+	if(audio_id < 0) {
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		return false;
+	}
+
+	/* compact sorted entries. keeps the order. */
+	stride = g_coefs - 1;
+	j = 0;
+	for(i = 0; i < ctx->count; i++) {
+		if(ctx->audio_ids[i] == audio_id) {
+			continue;
+		}
+
+		ctx->keys[j] = ctx->keys[i];
+		ctx->audio_ids[j] = ctx->audio_ids[i];
+		ctx->frame_idxs[j] = ctx->frame_idxs[i];
+		if(stride > 0) {
+			memmove(&ctx->coefs[j * stride], &ctx->coefs[i * stride], sizeof(float) * stride);
+		}
+		j++;
+	}
+	ctx->count = j;
+	ctx->kd_dirty = true;
+	ctx->stats_dirty = true;
+
+	/* compact pending entries */
+	j = 0;
+	for(i = 0; i < ctx->pending_count; i++) {
+		if(ctx->pending[i].audio_id == audio_id) {
+			continue;
+		}
+		ctx->pending[j] = ctx->pending[i];
+		j++;
+	}
+	ctx->pending_count = j;
+
+	/* release the audio id */
+	registry_release_audio_id(&ctx->reg, audio_id);
+	sketch_destroy(ctx->sketches[audio_id]);
+	ctx->sketches[audio_id] = NULL;
+
+	ao2_unlock(ctx);
+	ao2_ref(ctx, -1);
+
+	ast_log(LOG_DEBUG, "Deleted index info. context[%s], uuid[%s], audio_id[%d]\n", context, uuid, audio_id);
+
+	return true;
+}
+
+/**
+ * Delete the given context's index.
+ * @param context
+ * @return
+ */
+bool index_delete_context(const char* context)
+{
+	index_ctx_t* ctx;
+
+	if(context == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	/* the segment is released after the running searches are done */
+	ctx = ao2_find(g_index_ctxs, context, OBJ_SEARCH_KEY | OBJ_UNLINK);
+	if(ctx == NULL) {
+		return false;
+	}
+	ao2_ref(ctx, -1);
+
+	return true;
+}
+
+/**
+ * Search the given fingerprints from the context's index.
+ * Each query frame gives one vote to the each (audio, time offset) which has the matched frame in range.
+ * Returns the audio which has the most voted time offset.
+ * @param context
+ * @param j_fprints
+ * @param coefs
+ * @param tolerance
+ * @param freq_ignore_low
+ * @param freq_ignore_high
+ * @param max_results: max number of the ranked results.
+ * @param deadline: the query observations after this are not searched. zero for no deadline.
+ * @param processed: ratio(0 ~ 1) of the searched query observations. NULL for ignore.
+ * @return [{"audio_uuid": <uuid>, "match_count": <count>, "offset": <frame offset>}, ...] sorted by the rank, NULL if not found.
+ */
+struct ast_json* index_search(
+		const char* context,
+		struct ast_json* j_fprints,
+		const int coefs,
+		const double tolerance,
+		const int freq_ignore_low,
+		const int freq_ignore_high,
+		const int max_results,
+		const struct timeval deadline,
+		double* processed
+		)
+{
+	index_ctx_t* ctx;
+	index_query_t query;
+	vote_t* vote;
+	bool* excludes;
+	struct ast_json* j_res;
+
+	if((context == NULL) || (j_fprints == NULL) || (max_results < 1)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	if((coefs < 1) || (coefs > g_coefs)) {
+		ast_log(LOG_WARNING, "Wrong coefs count. max[%d], coefs[%d]\n", g_coefs, coefs);
+		return NULL;
+	}
+
+	ctx = get_index_ctx(context);
+	if(ctx == NULL) {
+		ast_log(LOG_NOTICE, "Could not find index info. context[%s]\n", context);
+		return NULL;
+	}
+
+	/* merge the pending entries and build the k-d tree first */
+	lock_search_index_ctx(ctx);
+	if(ctx->count == 0) {
+		ast_log(LOG_NOTICE, "Could not find index info. context[%s]\n", context);
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		return NULL;
+	}
+
+	init_query(&query, ctx, j_fprints, coefs, tolerance, freq_ignore_low, freq_ignore_high);
+
+	/* skip the audios which can not match */
+	excludes = create_excludes(&query);
+	vote = vote_run(ctx->reg.audio_size, ast_json_array_size(j_fprints), max_results, excludes, deadline, search_range, &query);
+	sfree(excludes);
+	update_search_stats(ctx, &query);
+
+	if(processed != NULL) {
+		*processed = vote_get_processed(vote);
+	}
+
+	/* get the top ranked audios */
+	j_res = vote_get_results(vote, ctx->reg.audios, max_results);
+	ao2_unlock(ctx);
+	ao2_ref(ctx, -1);
+
+	vote_destroy(vote);
+
+	return j_res;
+}
+
+/**
+ * Search the several queries of the same search options in one pass over the index.
+ * The query frames of all queries are searched in the max1 order, so the close frames of
+ * the different queries walk the same part of the sorted keys and the k-d tree one after another.
+ * Each query is voted into its own vote table with its own deadline. Runs in the caller thread.
+ * @param context
+ * @param j_fprints_list: query fingerprints of each query. count items.
+ * @param deadlines: deadline of each query. zero for no deadline. count items.
+ * @param count
+ * @param coefs
+ * @param tolerance
+ * @param freq_ignore_low
+ * @param freq_ignore_high
+ * @param max_results: max number of the ranked results.
+ * @param j_results: result of each query. Same as the index_search's. count items.
+ * @param processed: ratio(0 ~ 1) of the searched query observations of each query. count items.
+ * @return
+ */
+bool index_search_batch(
+		const char* context,
+		struct ast_json** j_fprints_list,
+		const struct timeval* deadlines,
+		const int count,
+		const int coefs,
+		const double tolerance,
+		const int freq_ignore_low,
+		const int freq_ignore_high,
+		const int max_results,
+		struct ast_json** j_results,
+		double* processed
+		)
+{
+	int i;
+	int j;
+	int idx;
+	int size;
+	int total;
+	index_ctx_t* ctx;
+	index_query_t* queries;
+	index_search_t* searches;
+	index_batch_item_t* items;
+	vote_t** votes;
+	bool* excludes;
+	struct ast_json* j_fprint;
+
+	if((context == NULL) || (j_fprints_list == NULL) || (deadlines == NULL) || (count < 1) || (max_results < 1) || (j_results == NULL) || (processed == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	if((coefs < 1) || (coefs > g_coefs)) {
+		ast_log(LOG_WARNING, "Wrong coefs count. max[%d], coefs[%d]\n", g_coefs, coefs);
+		return false;
+	}
+
+	for(i = 0; i < count; i++) {
+		j_results[i] = NULL;
+		processed[i] = 1;
+	}
+
+	ctx = get_index_ctx(context);
+	if(ctx == NULL) {
+		ast_log(LOG_NOTICE, "Could not find index info. context[%s]\n", context);
+		return false;
+	}
+
+	lock_search_index_ctx(ctx);
+	if(ctx->count == 0) {
+		ast_log(LOG_NOTICE, "Could not find index info. context[%s]\n", context);
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		return false;
+	}
+
+	queries = ast_calloc(count, sizeof(index_query_t));
+	searches = ast_calloc(count, sizeof(index_search_t));
+	votes = ast_calloc(count, sizeof(vote_t*));
+	total = 0;
+	for(i = 0; i < count; i++) {
+		init_query(&queries[i], ctx, j_fprints_list[i], coefs, tolerance, freq_ignore_low, freq_ignore_high);
+
+		searches[i].ctx = ctx;
+		searches[i].tolerance_min = tolerance;
+
+		excludes = create_excludes(&queries[i]);
+		votes[i] = vote_create(ctx->reg.audio_size, ast_json_array_size(j_fprints_list[i]), max_results, excludes, deadlines[i]);
+		sfree(excludes);
+		searches[i].vote = votes[i];
+
+		total += ast_json_array_size(j_fprints_list[i]);
+	}
+
+	/* all query frames in the max1 order */
+	items = ast_calloc(total + 1, sizeof(index_batch_item_t));
+	size = 0;
+	for(i = 0; i < count; i++) {
+		for(j = 0; j < ast_json_array_size(j_fprints_list[i]); j++) {
+			j_fprint = ast_json_array_get(j_fprints_list[i], j);
+			if(j_fprint == NULL) {
+				continue;
+			}
+
+			items[size].key = ast_json_real_get(ast_json_object_get(j_fprint, "max1"));
+			items[size].query = i;
+			items[size].idx = j;
+			size++;
+		}
+	}
+	qsort(items, size, sizeof(index_batch_item_t), compare_batch_item);
+
+	for(i = 0; i < size; i++) {
+		idx = items[i].query;
+		j_fprint = ast_json_array_get(queries[idx].j_fprints, items[i].idx);
+
+		/* the expired query's frames are skipped. the other queries go on. */
+		if(vote_next(votes[idx], items[i].idx, ast_json_integer_get(ast_json_object_get(j_fprint, "frame_idx"))) == false) {
+			continue;
+		}
+
+		search_frame(&queries[idx], &searches[idx], j_fprint);
+	}
+	sfree(items);
+
+	for(i = 0; i < count; i++) {
+		add_query_stats(&queries[i], &searches[i]);
+		update_search_stats(ctx, &queries[i]);
+
+		processed[i] = vote_get_processed(votes[i]);
+		j_results[i] = vote_get_results(votes[i], ctx->reg.audios, max_results);
+		vote_destroy(votes[i]);
+	}
+	ao2_unlock(ctx);
+	ast_log(LOG_DEBUG, "Searched index batch. context[%s], queries[%d], frames[%d]\n", ctx->reg.name, count, size);
+	ao2_ref(ctx, -1);
+
+	sfree(votes);
+	sfree(searches);
+	sfree(queries);
+
+	return true;
+}
+
+/**
+ * Create the streaming search of the given context.
+ * The query frames are voted as they are added, so the leading audios can be checked
+ * before all of the query frames are ready. The sketch prefilter is not used.
+ * @param context
+ * @param count: expected number of the query frames. The frames over this are not searched.
+ * @param window: only the votes of the last window frames are kept(i.e. the monitor). 0 keeps all.
+ * @param coefs
+ * @param tolerance
+ * @param freq_ignore_low
+ * @param freq_ignore_high
+ * @param max_results: max number of the ranked candidates. The top 2 are always kept exact
+ *        to compare the leader with the runner-up.
+ * @return
+ */
+index_stream_t* index_stream_create(
+		const char* context,
+		const int count,
+		const int window,
+		const int coefs,
+		const double tolerance,
+		const int freq_ignore_low,
+		const int freq_ignore_high,
+		const int max_results
+		)
+{
+	index_ctx_t* ctx;
+	index_stream_t* stream;
+
+	if((context == NULL) || (count < 1) || (window < 0)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	if((coefs < 1) || (coefs > g_coefs)) {
+		ast_log(LOG_WARNING, "Wrong coefs count. max[%d], coefs[%d]\n", g_coefs, coefs);
+		return NULL;
+	}
+
+	ctx = get_index_ctx(context);
+	if(ctx == NULL) {
+		ast_log(LOG_NOTICE, "Could not find index info. context[%s]\n", context);
+		return NULL;
+	}
+
+	stream = ast_calloc(1, sizeof(index_stream_t));
+	stream->ctx = ctx;
+	stream->count = count;
+	init_query(&stream->query, ctx, NULL, coefs, tolerance, freq_ignore_low, freq_ignore_high);
+
+	/* the audios added after this are not voted */
+	ao2_rdlock(ctx);
+	stream->vote = vote_create(ctx->reg.audio_size, count, MAX(max_results, 2), NULL, ast_tv(0, 0));
+	ao2_unlock(ctx);
+	if(window > 0) {
+		vote_set_window(stream->vote, window);
+	}
+
+	stream->search.ctx = ctx;
+	stream->search.vote = stream->vote;
+	stream->search.tolerance_min = tolerance;
+
+	return stream;
+}
+
+/**
+ * Search the given query frames and add the votes into the stream.
+ * @param stream
+ * @param j_fprints: new query frames in the frame order.
+ * @param deadline: the frames after this are not searched. zero for no deadline.
+ * @param processed: ratio(0 ~ 1) of the given frames searched.
+ * @return
+ */
+bool index_stream_add(index_stream_t* stream, struct ast_json* j_fprints, const struct timeval deadline, double* processed)
+{
+	int i;
+	int size;
+	struct ast_json* j_fprint;
+
+	if((stream == NULL) || (j_fprints == NULL) || (processed == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	size = ast_json_array_size(j_fprints);
+	*processed = 1;
+
+	lock_search_index_ctx(stream->ctx);
+	vote_set_deadline(stream->vote, deadline);
+	for(i = 0; i < size; i++) {
+		if(stream->idx >= stream->count) {
+			break;
+		}
+
+		j_fprint = ast_json_array_get(j_fprints, i);
+		if(vote_next(stream->vote, stream->idx, ast_json_integer_get(ast_json_object_get(j_fprint, "frame_idx"))) == false) {
+			*processed = (double)i / size;
+			break;
+		}
+		stream->idx++;
+
+		search_frame(&stream->query, &stream->search, j_fprint);
+	}
+	vote_update_scores(stream->vote);
+	ao2_unlock(stream->ctx);
+
+	return true;
+}
+
+/**
+ * Returns the current top ranked audios of the stream.
+ * @param stream
+ * @param max_results
+ * @return Same as the index_search's. NULL if not found.
+ */
+struct ast_json* index_stream_get_results(index_stream_t* stream, const int max_results)
+{
+	struct ast_json* j_res;
+
+	if((stream == NULL) || (max_results < 1)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	ao2_rdlock(stream->ctx);
+	j_res = vote_get_results(stream->vote, stream->ctx->reg.audios, max_results);
+	ao2_unlock(stream->ctx);
+
+	return j_res;
+}
+
+void index_stream_destroy(index_stream_t* stream)
+{
+	if(stream == NULL) {
+		return;
+	}
+
+	add_query_stats(&stream->query, &stream->search);
+	update_search_stats(stream->ctx, &stream->query);
+
+	vote_destroy(stream->vote);
+	ao2_ref(stream->ctx, -1);
+	ast_free(stream);
+}
+
+/**
+ * Returns the search statistics of each context.
+ * @return [{"context": <name>, "entries": <count>, "searches": <count>, "frames": <count>, "narrowed": <count>, "candidates": <count>, "tolerance": <mean effective tolerance>}, ...]
+ */
+struct ast_json* index_get_stats(void)
+{
+	index_ctx_t* ctx;
+	struct ao2_iterator iter;
+	struct ast_json* j_res;
+	struct ast_json* j_tmp;
+
+	j_res = ast_json_array_create();
+
+	iter = ao2_iterator_init(g_index_ctxs, 0);
+	while((ctx = ao2_iterator_next(&iter)) != NULL) {
+		ao2_rdlock(ctx);
+		j_tmp = ast_json_pack("{s:s, s:i}",
+				"context",	ctx->reg.name,
+				"entries",	ctx->count + ctx->pending_count
+				);
+		ao2_unlock(ctx);
+
+		ast_mutex_lock(&g_stats_lock);
+		ast_json_object_set(j_tmp, "searches", ast_json_integer_create(ctx->stat_searches));
+		ast_json_object_set(j_tmp, "frames", ast_json_integer_create(ctx->stat_frames));
+		ast_json_object_set(j_tmp, "narrowed", ast_json_integer_create(ctx->stat_narrowed));
+		ast_json_object_set(j_tmp, "candidates", ast_json_integer_create(ctx->stat_candidates));
+		ast_json_object_set(j_tmp, "tolerance", ast_json_real_create((ctx->stat_frames > 0) ? ctx->stat_tolerance_sum / ctx->stat_frames : 0));
+		ast_mutex_unlock(&g_stats_lock);
+
+		ast_json_array_append(j_res, j_tmp);
+		ao2_ref(ctx, -1);
+	}
+	ao2_iterator_destroy(&iter);
+
+	return j_res;
+}
+
+/**
+ * ao2 destructor of the index ctx.
+ * @param obj
+ */
+static void destroy_index_ctx(void* obj)
+{
+	int i;
+	index_ctx_t* ctx;
+
+	ctx = obj;
+
+	for(i = 0; i < ctx->reg.audio_size; i++) {
+		sketch_destroy(ctx->sketches[i]);
+	}
+	sfree(ctx->sketches);
+
+	sfree(ctx->keys);
+	sfree(ctx->coefs);
+	sfree(ctx->audio_ids);
+	sfree(ctx->frame_idxs);
+	sfree(ctx->pending);
+	sfree(ctx->kd_points);
+	sfree(ctx->kd_refs);
+	sfree(ctx->buckets);
+	registry_ctx_clear(&ctx->reg);
+}
+
+/**
+ * Returns the index ctx of the given context name.
+ * The returned ctx is reference counted. Need to unref after use.
+ * @param name
+ * @return
+ */
+static index_ctx_t* get_index_ctx(const char* name)
+{
+	return ao2_find(g_index_ctxs, name, OBJ_SEARCH_KEY);
+}
+
+/**
+ * Make the given ctx ready to search.
+ * The ctx must be write locked.
+ * @param ctx
+ * @return
+ */
+static bool prepare_index_ctx(index_ctx_t* ctx)
+{
+	int ret;
+
+	if(ctx->pending_count > 0) {
+		ret = merge_pending_entries(ctx);
+		if(ret == false) {
+			return false;
+		}
+	}
+
+	if((ctx->kd_dirty == true) && (g_coefs > 1)) {
+		ret = build_kd_tree(ctx);
+		if(ret == false) {
+			return false;
+		}
+	}
+
+	if(ctx->stats_dirty == true) {
+		update_bucket_stats(ctx);
+	}
+
+	return true;
+}
+
+/**
+ * Returns true if the given ctx does not need to be prepared.
+ * The ctx must be locked.
+ */
+static bool is_index_ctx_ready(const index_ctx_t* ctx)
+{
+	if(ctx->pending_count > 0) {
+		return false;
+	}
+
+	if((ctx->kd_dirty == true) && (g_coefs > 1)) {
+		return false;
+	}
+
+	if(ctx->stats_dirty == true) {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Lock the given ctx to search.
+ * Takes the read lock if the ctx is ready, so the searches of the same context run concurrently.
+ * Otherwise takes the write lock and prepares the ctx, and keeps the write lock for the search.
+ * Only the first search after the change takes the write lock.
+ * Must be unlocked with the ao2_unlock.
+ * @param ctx
+ */
+static void lock_search_index_ctx(index_ctx_t* ctx)
+{
+	ao2_rdlock(ctx);
+	if(is_index_ctx_ready(ctx) == true) {
+		return;
+	}
+	ao2_unlock(ctx);
+
+	ao2_wrlock(ctx);
+	prepare_index_ctx(ctx);
+}
+
+/**
+ * Sort the pending entries and merge it into the sorted entries.
+ * The ctx must be write locked.
+ * @param ctx
+ * @return
+ */
+static bool merge_pending_entries(index_ctx_t* ctx)
+{
+	int i;
+	int j;
+	int k;
+	int size;
+	int stride;
+	float* keys;
+	float* coefs;
+	int* audio_ids;
+	int* frame_idxs;
+	index_entry_t* entry;
+
+	qsort(ctx->pending, ctx->pending_count, sizeof(index_entry_t), compare_entry);
+
+	stride = g_coefs - 1;
+	size = ctx->count + ctx->pending_count;
+	keys = ast_calloc(size, sizeof(float));
+	coefs = (stride > 0) ? ast_calloc(size * stride, sizeof(float)) : NULL;
+	audio_ids = ast_calloc(size, sizeof(int));
+	frame_idxs = ast_calloc(size, sizeof(int));
+
+	i = 0;
+	j = 0;
+	for(k = 0; k < size; k++) {
+		if((j >= ctx->pending_count) || ((i < ctx->count) && (ctx->keys[i] <= ctx->pending[j].max[0]))) {
+			keys[k] = ctx->keys[i];
+			audio_ids[k] = ctx->audio_ids[i];
+			frame_idxs[k] = ctx->frame_idxs[i];
+			if(stride > 0) {
+				memcpy(&coefs[k * stride], &ctx->coefs[i * stride], sizeof(float) * stride);
+			}
+			i++;
+			continue;
+		}
+
+		entry = &ctx->pending[j];
+		keys[k] = entry->max[0];
+		audio_ids[k] = entry->audio_id;
+		frame_idxs[k] = entry->frame_idx;
+		if(stride > 0) {
+			memcpy(&coefs[k * stride], &entry->max[1], sizeof(float) * stride);
+		}
+		j++;
+	}
+
+	sfree(ctx->keys);
+	sfree(ctx->coefs);
+	sfree(ctx->audio_ids);
+	sfree(ctx->frame_idxs);
+	sfree(ctx->pending);
+
+	ctx->keys = keys;
+	ctx->coefs = coefs;
+	ctx->audio_ids = audio_ids;
+	ctx->frame_idxs = frame_idxs;
+	ctx->count = size;
+	ctx->size = size;
+
+	ctx->pending_count = 0;
+	ctx->pending_size = 0;
+
+	ctx->kd_dirty = true;
+	ctx->stats_dirty = true;
+
+	ast_log(LOG_DEBUG, "Merged index entries. context[%s], count[%d]\n", ctx->reg.name, ctx->count);
+
+	return true;
+}
+
+/**
+ * Build the k-d tree with the sorted entries.
+ * The ctx must be write locked.
+ * @param ctx
+ * @return
+ */
+static bool build_kd_tree(index_ctx_t* ctx)
+{
+	int i;
+	int stride;
+
+	sfree(ctx->kd_points);
+	sfree(ctx->kd_refs);
+
+	if(ctx->count > 0) {
+		stride = g_coefs - 1;
+		ctx->kd_points = ast_calloc(ctx->count * g_coefs, sizeof(float));
+		ctx->kd_refs = ast_calloc(ctx->count, sizeof(int));
+		for(i = 0; i < ctx->count; i++) {
+			ctx->kd_points[i * g_coefs] = ctx->keys[i];
+			memcpy(&ctx->kd_points[i * g_coefs + 1], &ctx->coefs[i * stride], sizeof(float) * stride);
+			ctx->kd_refs[i] = i;
+		}
+
+		build_kd_node(ctx, 0, ctx->count, 0);
+	}
+	ctx->kd_dirty = false;
+
+	ast_log(LOG_DEBUG, "Built k-d tree. context[%s], count[%d]\n", ctx->reg.name, ctx->count);
+
+	return true;
+}
+
+static void build_kd_node(index_ctx_t* ctx, int lo, int hi, int depth)
+{
+	int mid;
+
+	if(hi - lo <= DEF_INDEX_KD_LEAF_SIZE) {
+		return;
+	}
+
+	mid = lo + (hi - lo) / 2;
+	select_kd_node(ctx, lo, hi, mid, depth % g_coefs);
+
+	build_kd_node(ctx, lo, mid, depth + 1);
+	build_kd_node(ctx, mid + 1, hi, depth + 1);
+}
+
+/**
+ * Reorder the nodes of [lo, hi) to make the nth node has the nth smallest value of the dim.
+ * The nodes of [lo, nth) are not greater, the nodes of (nth, hi) are not less than the nth node.
+ */
+static void select_kd_node(index_ctx_t* ctx, int lo, int hi, int nth, int dim)
+{
+	int i;
+	int store;
+	float pivot;
+
+	hi--;
+	while(lo < hi) {
+		swap_kd_node(ctx, lo + (hi - lo) / 2, hi);
+		pivot = ctx->kd_points[hi * g_coefs + dim];
+
+		store = lo;
+		for(i = lo; i < hi; i++) {
+			if(ctx->kd_points[i * g_coefs + dim] < pivot) {
+				swap_kd_node(ctx, i, store);
+				store++;
+			}
+		}
+		swap_kd_node(ctx, store, hi);
+
+		if(store == nth) {
+			return;
+		}
+		else if(store < nth) {
+			lo = store + 1;
+		}
+		else {
+			hi = store - 1;
+		}
+	}
+}
+
+static void swap_kd_node(index_ctx_t* ctx, int a, int b)
+{
+	int i;
+	int ref;
+	float tmp;
+
+	if(a == b) {
+		return;
+	}
+
+	for(i = 0; i < g_coefs; i++) {
+		tmp = ctx->kd_points[a * g_coefs + i];
+		ctx->kd_points[a * g_coefs + i] = ctx->kd_points[b * g_coefs + i];
+		ctx->kd_points[b * g_coefs + i] = tmp;
+	}
+
+	ref = ctx->kd_refs[a];
+	ctx->kd_refs[a] = ctx->kd_refs[b];
+	ctx->kd_refs[b] = ref;
+}
+
+/**
+ * Count the entries of each max1 bucket, and set the stop limit of the query frame's range.
+ * The non-finite keys are not counted.
+ * The ctx must be write locked.
+ * @param ctx
+ */
+static void update_bucket_stats(index_ctx_t* ctx)
+{
+	int i;
+	int lo;
+	int hi;
+	int bucket;
+	int stops;
+	int stop_entries;
+
+	sfree(ctx->buckets);
+	ctx->bucket_min = 0;
+	ctx->bucket_count = 0;
+	ctx->stop_limit = 0;
+	ctx->stats_dirty = false;
+
+	/* finite keys of the sorted entries */
+	lo = 0;
+	while((lo < ctx->count) && (isfinite(ctx->keys[lo]) == 0)) {
+		lo++;
+	}
+	hi = ctx->count;
+	while((hi > lo) && (isfinite(ctx->keys[hi - 1]) == 0)) {
+		hi--;
+	}
+	if(lo == hi) {
+		return;
+	}
+
+	ctx->bucket_min = (int)floor(ctx->keys[lo] / DEF_INDEX_BUCKET_STEP);
+	ctx->bucket_count = MIN((int)floor(ctx->keys[hi - 1] / DEF_INDEX_BUCKET_STEP) - ctx->bucket_min + 1, DEF_INDEX_MAX_BUCKETS);
+	ctx->buckets = ast_calloc(ctx->bucket_count, sizeof(int));
+	for(i = lo; i < hi; i++) {
+		if(isfinite(ctx->keys[i]) == 0) {
+			continue;
+		}
+		bucket = get_bucket(ctx, ctx->keys[i]);
+		ctx->buckets[bucket]++;
+	}
+
+	if(g_stop_density == 0) {
+		return;
+	}
+	ctx->stop_limit = MAX(1, (int)(g_stop_density * ctx->count));
+
+	stops = 0;
+	stop_entries = 0;
+	for(i = 0; i < ctx->bucket_count; i++) {
+		if(ctx->buckets[i] > ctx->stop_limit) {
+			stops++;
+			stop_entries += ctx->buckets[i];
+		}
+	}
+	ast_log(LOG_DEBUG, "Updated index occupancy. context[%s], entries[%d], buckets[%d], stop_limit[%d], stop_buckets[%d], stop_entries[%d]\n",
+			ctx->reg.name, ctx->count, ctx->bucket_count, ctx->stop_limit, stops, stop_entries);
+}
+
+/**
+ * Returns the bucket of the given max1. The out of ranged value is the nearest end bucket.
+ */
+static int get_bucket(const index_ctx_t* ctx, const double value)
+{
+	double bucket;
+
+	bucket = floor(value / DEF_INDEX_BUCKET_STEP) - ctx->bucket_min;
+	if(bucket < 0) {
+		return 0;
+	}
+	if(bucket >= ctx->bucket_count) {
+		return ctx->bucket_count - 1;
+	}
+
+	return (int)bucket;
+}
+
+/**
+ * Returns true if the buckets of the given max1 range have more entries than the stop limit.
+ * @param ctx
+ * @param min
+ * @param max
+ * @return
+ */
+static bool is_stop_range(const index_ctx_t* ctx, const double min, const double max)
+{
+	int i;
+	int hi;
+	int entries;
+
+	if((ctx->stop_limit == 0) || (ctx->bucket_count == 0)) {
+		return false;
+	}
+
+	/* out of the entries */
+	if((isfinite(min) == 0) || (isfinite(max) == 0)
+			|| (floor(max / DEF_INDEX_BUCKET_STEP) < ctx->bucket_min)
+			|| (floor(min / DEF_INDEX_BUCKET_STEP) >= ctx->bucket_min + ctx->bucket_count)) {
+		return false;
+	}
+
+	entries = 0;
+	hi = get_bucket(ctx, max);
+	for(i = get_bucket(ctx, min); i <= hi; i++) {
+		entries += ctx->buckets[i];
+		if(entries > ctx->stop_limit) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Returns the max1 tolerance of the query frame which fits in the candidate budget.
+ * The expected candidates are the densest overlapped bucket's entries per max1 * range width.
+ * Returns the given tolerance if it already fits.
+ * @param ctx
+ * @param value: query frame's max1
+ * @param tolerance: requested tolerance
+ * @return
+ */
+static double get_budget_tolerance(const index_ctx_t* ctx, const double value, const double tolerance)
+{
+	int i;
+	int hi;
+	int entries;
+	double density;
+
+	if((g_budget == 0) || (ctx->bucket_count == 0) || (isfinite(value) == 0)) {
+		return tolerance;
+	}
+
+	/* out of the entries */
+	if((floor((value + tolerance) / DEF_INDEX_BUCKET_STEP) < ctx->bucket_min)
+			|| (floor((value - tolerance) / DEF_INDEX_BUCKET_STEP) >= ctx->bucket_min + ctx->bucket_count)) {
+		return tolerance;
+	}
+
+	entries = 0;
+	hi = get_bucket(ctx, value + tolerance);
+	for(i = get_bucket(ctx, value - tolerance); i <= hi; i++) {
+		entries = MAX(entries, ctx->buckets[i]);
+	}
+	density = entries / DEF_INDEX_BUCKET_STEP;
+	if(density * tolerance * 2 <= g_budget) {
+		return tolerance;
+	}
+
+	return g_budget / (density * 2);
+}
+
+/**
+ * Add the query's statistics into the context's search statistics.
+ * @param ctx
+ * @param query
+ */
+static void update_search_stats(index_ctx_t* ctx, const index_query_t* query)
+{
+	ast_mutex_lock(&g_stats_lock);
+	ctx->stat_searches++;
+	ctx->stat_frames += query->frames;
+	ctx->stat_narrowed += query->narrowed;
+	ctx->stat_candidates += query->candidates;
+	ctx->stat_tolerance_sum += query->tolerance_sum;
+	ast_mutex_unlock(&g_stats_lock);
+
+	ast_log(LOG_DEBUG, "Searched index. context[%s], frames[%d], candidates[%ld], budget[%d], tolerance[%f], narrowed[%d], effective_min[%f], effective_mean[%f]\n",
+			ctx->reg.name, query->frames, query->candidates, g_budget, query->tolerance, query->narrowed, query->tolerance_min,
+			(query->frames > 0) ? query->tolerance_sum / query->frames : query->tolerance);
+}
+
+/**
+ * Initiate the query with the search options.
+ */
+static void init_query(index_query_t* query, const index_ctx_t* ctx, struct ast_json* j_fprints, const int coefs, const double tolerance, const int freq_ignore_low, const int freq_ignore_high)
+{
+	query->ctx = ctx;
+	query->j_fprints = j_fprints;
+	query->coefs = coefs;
+	query->tolerance = tolerance;
+	query->freq_ignore_low = freq_ignore_low;
+	query->freq_ignore_high = freq_ignore_high;
+	query->frames = 0;
+	query->narrowed = 0;
+	query->candidates = 0;
+	query->tolerance_sum = 0;
+	query->tolerance_min = tolerance;
+}
+
+/**
+ * Returns the audios to skip with the sketch prefilter.
+ * Must be called with the ctx's read lock.
+ * @param query
+ * @return audio_size items. true for the audio to skip.
+ */
+static bool* create_excludes(const index_query_t* query)
+{
+	int i;
+	int checks;
+	int count;
+	int skips;
+	bool* excludes;
+	index_search_t search;
+	sketch_query_t* sketch;
+	const index_ctx_t* ctx;
+
+	ctx = query->ctx;
+	count = ast_json_array_size(query->j_fprints);
+
+	sketch = sketch_query_create(count);
+	for(i = 0; i < count; i++) {
+		checks = set_search_box(query, ast_json_array_get(query->j_fprints, i), &search);
+		if(checks < 0) {
+			continue;
+		}
+		sketch_query_add(sketch, search.min, search.max, (checks == g_coefs - 1) ? g_coefs : 1);
+	}
+
+	skips = 0;
+	excludes = ast_calloc(ctx->reg.audio_size + 1, sizeof(bool));
+	for(i = 0; i < ctx->reg.audio_size; i++) {
+		if((ctx->reg.audios[i] == NULL) || (ctx->sketches[i] == NULL)) {
+			continue;
+		}
+
+		if(sketch_query_check(sketch, ctx->sketches[i]) == false) {
+			excludes[i] = true;
+			skips++;
+		}
+	}
+	sketch_query_destroy(sketch);
+	ast_log(LOG_DEBUG, "Prefiltered audios. context[%s], audios[%d], skips[%d]\n", ctx->reg.name, ctx->reg.audio_size, skips);
+
+	return excludes;
+}
+
+/**
+ * Vote the query frames in [start, end), and add the part's statistics into the query.
+ * Runs on the worker thread for the split search. Must be called with the ctx's read lock.
+ * @param data: index_query_t
+ * @param vote
+ * @param start
+ * @param end
+ */
+static void search_range(void* data, vote_t* vote, const int start, const int end)
+{
+	int i;
+	index_query_t* query;
+	index_search_t search;
+	struct ast_json* j_fprint;
+
+	query = (index_query_t*)data;
+
+	memset(&search, 0x00, sizeof(search));
+	search.ctx = query->ctx;
+	search.vote = vote;
+	search.tolerance_min = query->tolerance;
+
+	for(i = start; i < end; i++) {
+		j_fprint = ast_json_array_get(query->j_fprints, i);
+		if(j_fprint == NULL) {
+			continue;
+		}
+		if(vote_next(vote, i, ast_json_integer_get(ast_json_object_get(j_fprint, "frame_idx"))) == false) {
+			break;
+		}
+
+		search_frame(query, &search, j_fprint);
+	}
+
+	add_query_stats(query, &search);
+}
+
+/**
+ * Vote the entries in the search range of the given query frame.
+ * The vote_next() of the frame should be called before.
+ * @param query
+ * @param search
+ * @param j_fprint
+ */
+static void search_frame(const index_query_t* query, index_search_t* search, struct ast_json* j_fprint)
+{
+	int k;
+	int lo;
+	int hi;
+	int checks;
+
+	checks = set_search_box(query, j_fprint, search);
+	if(checks < 0) {
+		return;
+	}
+
+	search->frames++;
+	search->tolerance_sum += search->tolerance;
+	search->tolerance_min = MIN(search->tolerance_min, search->tolerance);
+	if(search->tolerance < query->tolerance) {
+		search->narrowed++;
+	}
+
+	if(checks > 0) {
+		/* multi coefs. box query with the k-d tree */
+		search_kd_node(search, 0, query->ctx->count, 0);
+		return;
+	}
+
+	/* single coef. range query with the sorted keys */
+	lo = lower_bound(query->ctx->keys, query->ctx->count, search->min[0]);
+	hi = upper_bound(query->ctx->keys, query->ctx->count, search->max[0]);
+	for(k = lo; k < hi; k++) {
+		add_vote(search, k);
+	}
+}
+
+/**
+ * Add the search's statistics into the query.
+ */
+static void add_query_stats(index_query_t* query, const index_search_t* search)
+{
+	ast_mutex_lock(&g_stats_lock);
+	query->frames += search->frames;
+	query->narrowed += search->narrowed;
+	query->candidates += search->candidates;
+	query->tolerance_sum += search->tolerance_sum;
+	query->tolerance_min = MIN(query->tolerance_min, search->tolerance_min);
+	ast_mutex_unlock(&g_stats_lock);
+}
+
+/**
+ * Set the search box of the given query frame.
+ * The out of ranged coefs are not checked.
+ * @param query
+ * @param j_fprint
+ * @param search
+ * @return number of the checked coefs except the max1. -1 if the frame is ignored or in the stop bucket.
+ */
+static int set_search_box(const index_query_t* query, struct ast_json* j_fprint, index_search_t* search)
+{
+	int j;
+	int checks;
+	double freq;
+	double freq_low;
+	double freq_high;
+	char col_max[10];
+
+	if(j_fprint == NULL) {
+		return -1;
+	}
+
+	freq_low = (query->freq_ignore_low > 0) ? 10 * log10(query->freq_ignore_low) : 0;
+	freq_high = (query->freq_ignore_high > 0) ? 10 * log10(query->freq_ignore_high) : 0;
+
+	freq = (int)ast_json_real_get(ast_json_object_get(j_fprint, "max1"));
+
+	/* validate frequency range */
+	if((query->freq_ignore_low > 0) && (freq < freq_low)) {
+		/* ignore. frequency is too low */
+		return -1;
+	}
+	if((query->freq_ignore_high > 0) && (freq > freq_high)) {
+		/* ignore. frequency is too high */
+		return -1;
+	}
+	search->tolerance = get_budget_tolerance(query->ctx, freq, query->tolerance);
+	search->min[0] = freq - search->tolerance;
+	search->max[0] = freq + search->tolerance;
+
+	/* stop bucket. matches too many entries. */
+	if(is_stop_range(query->ctx, search->min[0], search->max[0]) == true) {
+		return -1;
+	}
+
+	checks = 0;
+	for(j = 1; j < g_coefs; j++) {
+		search->min[j] = -INFINITY;
+		search->max[j] = INFINITY;
+		if(j >= query->coefs) {
+			continue;
+		}
+
+		snprintf(col_max, sizeof(col_max), "max%d", j + 1);
+		freq = ast_json_real_get(ast_json_object_get(j_fprint, col_max));
+		if((query->freq_ignore_low > 0) && (freq < freq_low)) {
+			continue;
+		}
+		if((query->freq_ignore_high > 0) && (freq > freq_high)) {
+			continue;
+		}
+
+		search->min[j] = freq - query->tolerance;
+		search->max[j] = freq + query->tolerance;
+		checks++;
+	}
+
+	return checks;
+}
+
+/**
+ * Vote the nodes of [lo, hi) which are in the search box.
+ */
+static void search_kd_node(index_search_t* search, int lo, int hi, int depth)
+{
+	int i;
+	int j;
+	int mid;
+	int dim;
+	double value;
+	const float* point;
+	const index_ctx_t* ctx;
+
+	ctx = search->ctx;
+	while(lo < hi) {
+		if(hi - lo <= DEF_INDEX_KD_LEAF_SIZE) {
+			for(i = lo; i < hi; i++) {
+				point = &ctx->kd_points[i * g_coefs];
+				for(j = 0; j < g_coefs; j++) {
+					if((point[j] < search->min[j]) || (point[j] > search->max[j])) {
+						break;
+					}
+				}
+				if(j == g_coefs) {
+					add_vote(search, ctx->kd_refs[i]);
+				}
+			}
+			return;
+		}
+
+		mid = lo + (hi - lo) / 2;
+		dim = depth % g_coefs;
+		point = &ctx->kd_points[mid * g_coefs];
+		value = point[dim];
+
+		for(j = 0; j < g_coefs; j++) {
+			if((point[j] < search->min[j]) || (point[j] > search->max[j])) {
+				break;
+			}
+		}
+		if(j == g_coefs) {
+			add_vote(search, ctx->kd_refs[mid]);
+		}
+
+		/* visit the left side, loop for the right side */
+		if(search->min[dim] <= value) {
+			search_kd_node(search, lo, mid, depth + 1);
+		}
+		if(search->max[dim] < value) {
+			return;
+		}
+		lo = mid + 1;
+		depth++;
+	}
+}
+
+/**
+ * Vote to the audio and time offset of the given entry position.
+ */
+static void add_vote(index_search_t* search, int pos)
+{
+	search->candidates++;
+	vote_add(search->vote, search->ctx->audio_ids[pos], search->ctx->frame_idxs[pos]);
+}
+
+static int compare_entry(const void* a, const void* b)
+{
+	const index_entry_t* entry_a = a;
+	const index_entry_t* entry_b = b;
+
+	if(entry_a->max[0] < entry_b->max[0]) {
+		return -1;
+	}
+	else if(entry_a->max[0] > entry_b->max[0]) {
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Orders the batch items by the max1. The same max1 keeps the query and frame order.
+ */
+static int compare_batch_item(const void* a, const void* b)
+{
+	const index_batch_item_t* item_a = a;
+	const index_batch_item_t* item_b = b;
+
+	if(item_a->key < item_b->key) {
+		return -1;
+	}
+	else if(item_a->key > item_b->key) {
+		return 1;
+	}
+
+	if(item_a->query != item_b->query) {
+		return item_a->query - item_b->query;
+	}
+
+	return item_a->idx - item_b->idx;
+}
+
+/**
+ * Returns the first position where the key is not less than the given value.
+ */
+static int lower_bound(const float* keys, int count, double value)
+{
+	int lo;
+	int hi;
+	int mid;
+
+	lo = 0;
+	hi = count;
+	while(lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if(keys[mid] < value) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
+/**
+ * Returns the first position where the key is greater than the given value.
+ */
+static int upper_bound(const float* keys, int count, double value)
+{
+	int lo;
+	int hi;
+	int mid;
+
+	lo = 0;
+	hi = count;
+	while(lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if(keys[mid] <= value) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
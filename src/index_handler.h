@@ -0,0 +1,66 @@
+/*
+ * index_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_INDEX_HANDLER_H_
+#define SRC_INDEX_HANDLER_H_
+
+#include <asterisk/json.h>
+
+#include <stdbool.h>
+#include <sys/time.h>
+
+typedef struct _index_stream_t index_stream_t;
+
+bool index_init(const int coefs, const double stop_density, const int budget);
+bool index_term(void);
+
+bool index_add_audio(const char* context, const char* uuid, struct ast_json* j_fprints);
+bool index_delete_audio(const char* context, const char* uuid);
+bool index_delete_context(const char* context);
+
+struct ast_json* index_search(
+		const char* context,
+		struct ast_json* j_fprints,
+		const int coefs,
+		const double tolerance,
+		const int freq_ignore_low,
+		const int freq_ignore_high,
+		const int max_results,
+		const struct timeval deadline,
+		double* processed
+		);
+bool index_search_batch(
+		const char* context,
+		struct ast_json** j_fprints_list,
+		const struct timeval* deadlines,
+		const int count,
+		const int coefs,
+		const double tolerance,
+		const int freq_ignore_low,
+		const int freq_ignore_high,
+		const int max_results,
+		struct ast_json** j_results,
+		double* processed
+		);
+
+index_stream_t* index_stream_create(
+		const char* context,
+		const int count,
+		const int window,
+		const int coefs,
+		const double tolerance,
+		const int freq_ignore_low,
+		const int freq_ignore_high,
+		const int max_results
+		);
+bool index_stream_add(index_stream_t* stream, struct ast_json* j_fprints, const struct timeval deadline, double* processed);
+struct ast_json* index_stream_get_results(index_stream_t* stream, const int max_results);
+void index_stream_destroy(index_stream_t* stream);
+
+struct ast_json* index_get_stats(void);
+
+#endif /* SRC_INDEX_HANDLER_H_ */
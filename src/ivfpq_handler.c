@@ -0,0 +1,1093 @@
+/*
+ * ivfpq_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Approximate nearest neighbour index of the full MFCC frame vectors(IVF-PQ).
+ *  The coarse k-means quantizer splits the vectors into the inverted lists,
+ *  and the residual of each vector(vector - list centroid) is product quantized
+ *  into DEF_IVFPQ_SUBS bytes.
+ *
+ *  The quantizers are trained per context with its own vectors. Until the context
+ *  has enough vectors to train, the raw vectors are kept and searched exactly.
+ *  When the raw vectors reach DEF_IVFPQ_TRAIN_MIN at the ingest(or the load), the context
+ *  is trained on the background thread with the copy of the raw vectors. The searches
+ *  keep using the raw vectors with the read lock until the trained lists are installed.
+ *  The vectors added after the training are encoded at the ingest.
+ *
+ *  The search probes the nearest lists of each query frame, and the nearest
+ *  reference frames(DEF_IVFPQ_NEIGHBORS) vote to the (audio, time offset).
+ *
+ *  Each context is a separated segment in the hash container and has its own lock.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/json.h>
+#include <asterisk/lock.h>
+#include <asterisk/astobj2.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <float.h>
+
+#include "ivfpq_handler.h"
+#include "vote_handler.h"
+#include "registry_handler.h"
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+#define DEF_IVFPQ_MAX_DIMS			16
+#define DEF_IVFPQ_SUBS				4		// product quantizer sub spaces. bytes of each encoded vector.
+#define DEF_IVFPQ_SUB_CENTROIDS		256		// centroids of each sub space. 1 byte code.
+#define DEF_IVFPQ_TRAIN_MIN			4096	// min vectors to train. the smaller context is searched exactly.
+#define DEF_IVFPQ_TRAIN_TAIL		1024	// max raw vectors encoded with the write lock at the end of the training
+#define DEF_IVFPQ_TRAIN_SAMPLES		16384	// max vectors for the k-means
+#define DEF_IVFPQ_KMEANS_ITERS		10
+#define DEF_IVFPQ_MIN_LISTS			8
+#define DEF_IVFPQ_MAX_LISTS			1024
+#define DEF_IVFPQ_MAX_PROBES		64
+#define DEF_IVFPQ_NEIGHBORS			8		// nearest reference frames voted by each query frame
+#define DEF_IVFPQ_CTX_BUCKETS		31
+#define DEF_IVFPQ_TERM_WAIT			10000	// ms. max wait of the training threads at the term
+
+typedef struct _ivfpq_list_t {
+	int count;
+	int size;
+	uint8_t* codes;		///< DEF_IVFPQ_SUBS bytes for each vector
+	int* audio_ids;
+	int* frame_idxs;
+} ivfpq_list_t;
+
+typedef struct _ivfpq_ctx_t {
+	registry_t reg;		///< context name and audio uuids. must be the first member.
+
+	/* quantizers and the inverted lists. valid after the training. */
+	bool trained;
+	bool training;			///< the training thread is running
+	int revision;			///< increased at the deletion. the training of the old revision is discarded.
+	int count;				///< encoded vectors
+	int list_count;
+	float* centroids;		///< coarse centroids. g_dims values for each list.
+	float* sub_centroids;	///< DEF_IVFPQ_SUB_CENTROIDS centroids of each sub space. sub space m starts at g_sub_starts[m] * DEF_IVFPQ_SUB_CENTROIDS.
+	ivfpq_list_t* lists;
+
+	/* raw vectors. not trained yet. */
+	int raw_count;
+	int raw_size;
+	float* raws;		///< g_dims values for each vector
+	int* raw_audio_ids;
+	int* raw_frame_idxs;
+} ivfpq_ctx_t;
+
+typedef struct _ivfpq_query_t {
+	const ivfpq_ctx_t* ctx;
+
+	int count;
+	float* vectors;		///< g_dims values for each query frame
+	int* frame_idxs;
+} ivfpq_query_t;
+
+typedef struct _ivfpq_neighbor_t {
+	float dist;
+	int audio_id;
+	int frame_idx;
+} ivfpq_neighbor_t;
+
+static int g_dims = 0;
+static int g_probes = 0;
+static int g_sub_starts[DEF_IVFPQ_SUBS + 1];	///< first dimension of each sub space
+static struct ao2_container* g_ivfpq_ctxs = NULL;	///< ivfpq ctxs. key: context name
+static struct ao2_container* g_trainings = NULL;	///< ivfpq ctxs of the running training threads
+static bool g_stop = false;		///< stops the training threads
+
+static void destroy_ivfpq_ctx(void* obj);
+static ivfpq_ctx_t* get_ivfpq_ctx(const char* name);
+
+static bool get_vector(struct ast_json* j_vector, float* vec);
+static void start_training(ivfpq_ctx_t* ctx);
+static void* run_training(void* data);
+static bool train_ivfpq_ctx(ivfpq_ctx_t* ctx);
+static float* copy_raws(const ivfpq_ctx_t* ctx, const int start, const int end, int** audio_ids, int** frame_idxs);
+static void clear_lists(ivfpq_ctx_t* ctx);
+static void kmeans(const float* data, const int count, const int dims, const int k, float* centroids);
+static int get_nearest(const float* centroids, const int k, const int dims, const float* vec);
+static float get_distance(const float* a, const float* b, const int dims);
+static void add_raw_vector(ivfpq_ctx_t* ctx, const float* vec, const int audio_id, const int frame_idx);
+static void add_encoded_vector(ivfpq_ctx_t* ctx, const float* vec, const int audio_id, const int frame_idx);
+static void search_range(void* data, vote_t* vote, const int start, const int end);
+static int search_raws(const ivfpq_ctx_t* ctx, const float* vec, ivfpq_neighbor_t* neighbors);
+static int search_lists(const ivfpq_ctx_t* ctx, const float* vec, ivfpq_neighbor_t* neighbors);
+static int add_neighbor(ivfpq_neighbor_t* neighbors, int count, const float dist, const int audio_id, const int frame_idx);
+
+/**
+ * Initiate the ivfpq engine.
+ * @param dims: coefs of the frame vector.
+ * @param probes: inverted lists probed by each query frame.
+ * @return
+ */
+bool ivfpq_init(const int dims, const int probes)
+{
+	int i;
+
+	if((dims < DEF_IVFPQ_SUBS) || (dims > DEF_IVFPQ_MAX_DIMS)) {
+		ast_log(LOG_ERROR, "Wrong dims count. min[%d], max[%d], dims[%d]\n", DEF_IVFPQ_SUBS, DEF_IVFPQ_MAX_DIMS, dims);
+		return false;
+	}
+
+	if(probes < 1) {
+		ast_log(LOG_ERROR, "Wrong probes count. probes[%d]\n", probes);
+		return false;
+	}
+
+	g_dims = dims;
+	g_probes = probes;
+	if(g_probes > DEF_IVFPQ_MAX_PROBES) {
+		ast_log(LOG_NOTICE, "Too many probes. Set to max. probes[%d], max[%d]\n", probes, DEF_IVFPQ_MAX_PROBES);
+		g_probes = DEF_IVFPQ_MAX_PROBES;
+	}
+	for(i = 0; i <= DEF_IVFPQ_SUBS; i++) {
+		g_sub_starts[i] = i * dims / DEF_IVFPQ_SUBS;
+	}
+
+	g_ivfpq_ctxs = registry_container_create(DEF_IVFPQ_CTX_BUCKETS);
+	if(g_ivfpq_ctxs == NULL) {
+		ast_log(LOG_ERROR, "Could not create ivfpq ctx container.\n");
+		return false;
+	}
+
+	g_trainings = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, 1, NULL, NULL, NULL);
+	if(g_trainings == NULL) {
+		ast_log(LOG_ERROR, "Could not create ivfpq training container.\n");
+		ao2_ref(g_ivfpq_ctxs, -1);
+		g_ivfpq_ctxs = NULL;
+		return false;
+	}
+	g_stop = false;
+
+	return true;
+}
+
+/**
+ * Stop the training threads and release the indexes.
+ * @return false if the training threads are still running.
+ */
+bool ivfpq_term(void)
+{
+	int i;
+
+	if(g_trainings != NULL) {
+		g_stop = true;
+		for(i = 0; i < DEF_IVFPQ_TERM_WAIT / 10; i++) {
+			if(ao2_container_count(g_trainings) == 0) {
+				break;
+			}
+			usleep(10000);
+		}
+		if(ao2_container_count(g_trainings) != 0) {
+			ast_log(LOG_WARNING, "Could not stop all of the training threads. count[%d]\n", ao2_container_count(g_trainings));
+			return false;
+		}
+		ao2_ref(g_trainings, -1);
+		g_trainings = NULL;
+	}
+
+	ao2_cleanup(g_ivfpq_ctxs);
+	g_ivfpq_ctxs = NULL;
+
+	return true;
+}
+
+/**
+ * Add the given audio's frame vectors into the context's index.
+ * The vectors are encoded if the context has been trained.
+ * @param context
+ * @param uuid
+ * @param j_vectors: [{"frame_idx": <idx>, "mfcc1": <coef>, ..., "mfccN": <coef>}, ...]
+ * @return
+ */
+bool ivfpq_add_audio(const char* context, const char* uuid, struct ast_json* j_vectors)
+{
+	int i;
+	int ret;
+	int count;
+	int audio_id;
+	int frame_idx;
+	float vec[DEF_IVFPQ_MAX_DIMS];
+	ivfpq_ctx_t* ctx;
+	struct ast_json* j_vector;
+
+	if((context == NULL) || (uuid == NULL) || (j_vectors == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	/* get or create the context's segment */
+	ao2_lock(g_ivfpq_ctxs);
+	ctx = ao2_find(g_ivfpq_ctxs, context, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if(ctx == NULL) {
+		ctx = registry_ctx_create(sizeof(ivfpq_ctx_t), destroy_ivfpq_ctx, context);
+		ao2_link_flags(g_ivfpq_ctxs, ctx, OBJ_NOLOCK);
+	}
+	ao2_unlock(g_ivfpq_ctxs);
+
+	ao2_wrlock(ctx);
+
+	audio_id = registry_get_audio_id(&ctx->reg, uuid);
+	if(audio_id >= 0) {
+		ast_log(LOG_NOTICE, "The given audio is already indexed. context[%s], uuid[%s]\n", context, uuid);
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		return true;
+	}
+	audio_id = registry_create_audio_id(&ctx->reg, uuid);
+
+	count = 0;
+	for(i = 0; i < ast_json_array_size(j_vectors); i++) {
+		j_vector = ast_json_array_get(j_vectors, i);
+
+		ret = get_vector(j_vector, vec);
+		if(ret == false) {
+			continue;
+		}
+		frame_idx = ast_json_integer_get(ast_json_object_get(j_vector, "frame_idx"));
+
+		if(ctx->trained == true) {
+			add_encoded_vector(ctx, vec, audio_id, frame_idx);
+		}
+		else {
+			add_raw_vector(ctx, vec, audio_id, frame_idx);
+		}
+		count++;
+	}
+
+	start_training(ctx);
+	ao2_unlock(ctx);
+	ao2_ref(ctx, -1);
+
+	ast_log(LOG_DEBUG, "Added vector info. context[%s], uuid[%s], audio_id[%d], count[%d]\n", context, uuid, audio_id, count);
+
+	return true;
+}
+
+/**
+ * Delete the given audio's vectors from the context's index.
+ * The trained quantizers are kept.
+ * @param context
+ * @param uuid
+ * @return
+ */
+bool ivfpq_delete_audio(const char* context, const char* uuid)
+{
+	int i;
+	int j;
+	int k;
+	int audio_id;
+	ivfpq_ctx_t* ctx;
+	ivfpq_list_t* list;
+
+	if((context == NULL) || (uuid == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	ctx = get_ivfpq_ctx(context);
+	if(ctx == NULL) {
+		return false;
+	}
+
+	ao2_wrlock(ctx);
+
+	audio_id = registry_get_audio_id(&ctx->reg, uuid);
+	if(audio_id < 0) {
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		return false;
+	}
+
+	/* compact the inverted lists */
+	for(k = 0; k < ctx->list_count; k++) {
+		list = &ctx->lists[k];
+
+		j = 0;
+		for(i = 0; i < list->count; i++) {
+			if(list->audio_ids[i] == audio_id) {
+				continue;
+			}
+			memcpy(&list->codes[j * DEF_IVFPQ_SUBS], &list->codes[i * DEF_IVFPQ_SUBS], DEF_IVFPQ_SUBS);
+			list->audio_ids[j] = list->audio_ids[i];
+			list->frame_idxs[j] = list->frame_idxs[i];
+			j++;
+		}
+		ctx->count -= list->count - j;
+		list->count = j;
+	}
+
+	/* compact the raw vectors */
+	j = 0;
+	for(i = 0; i < ctx->raw_count; i++) {
+		if(ctx->raw_audio_ids[i] == audio_id) {
+			continue;
+		}
+		memcpy(&ctx->raws[j * g_dims], &ctx->raws[i * g_dims], sizeof(float) * g_dims);
+		ctx->raw_audio_ids[j] = ctx->raw_audio_ids[i];
+		ctx->raw_frame_idxs[j] = ctx->raw_frame_idxs[i];
+		j++;
+	}
+	ctx->raw_count = j;
+	ctx->revision++;
+
+	/* release the audio id */
+	registry_release_audio_id(&ctx->reg, audio_id);
+
+	ao2_unlock(ctx);
+	ao2_ref(ctx, -1);
+
+	ast_log(LOG_DEBUG, "Deleted vector info. context[%s], uuid[%s], audio_id[%d]\n", context, uuid, audio_id);
+
+	return true;
+}
+
+/**
+ * Delete the given context's index.
+ * @param context
+ * @return
+ */
+bool ivfpq_delete_context(const char* context)
+{
+	ivfpq_ctx_t* ctx;
+
+	if(context == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	/* the segment is released after the running searches are done */
+	ctx = ao2_find(g_ivfpq_ctxs, context, OBJ_SEARCH_KEY | OBJ_UNLINK);
+	if(ctx == NULL) {
+		return false;
+	}
+	ao2_ref(ctx, -1);
+
+	return true;
+}
+
+/**
+ * Search the given frame vectors from the context's index.
+ * Each query frame gives one vote to the each (audio, time offset) of its nearest reference frames.
+ * Returns the audio which has the most voted time offset.
+ * @param context
+ * @param j_vectors
+ * @param max_results: max number of the ranked results.
+ * @param deadline: the query observations after this are not searched. zero for no deadline.
+ * @param processed: ratio(0 ~ 1) of the searched query observations. NULL for ignore.
+ * @return [{"audio_uuid": <uuid>, "match_count": <count>, "offset": <frame offset>}, ...] sorted by the rank, NULL if not found.
+ */
+struct ast_json* ivfpq_search(const char* context, struct ast_json* j_vectors, const int max_results, const struct timeval deadline, double* processed)
+{
+	int i;
+	int ret;
+	ivfpq_ctx_t* ctx;
+	ivfpq_query_t query;
+	vote_t* vote;
+	struct ast_json* j_vector;
+	struct ast_json* j_res;
+
+	if((context == NULL) || (j_vectors == NULL) || (max_results < 1)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	ctx = get_ivfpq_ctx(context);
+	if(ctx == NULL) {
+		ast_log(LOG_NOTICE, "Could not find vector info. context[%s]\n", context);
+		return NULL;
+	}
+
+	/* parse the query vectors */
+	memset(&query, 0x00, sizeof(query));
+	query.vectors = ast_calloc(ast_json_array_size(j_vectors) + 1, sizeof(float) * g_dims);
+	query.frame_idxs = ast_calloc(ast_json_array_size(j_vectors) + 1, sizeof(int));
+	for(i = 0; i < ast_json_array_size(j_vectors); i++) {
+		j_vector = ast_json_array_get(j_vectors, i);
+
+		ret = get_vector(j_vector, &query.vectors[query.count * g_dims]);
+		if(ret == false) {
+			continue;
+		}
+		query.frame_idxs[query.count] = ast_json_integer_get(ast_json_object_get(j_vector, "frame_idx"));
+		query.count++;
+	}
+
+	/* the raw vectors are searched until the background training is done */
+	ao2_rdlock(ctx);
+	if((ctx->count == 0) && (ctx->raw_count == 0)) {
+		ast_log(LOG_NOTICE, "Could not find vector info. context[%s]\n", context);
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		sfree(query.vectors);
+		sfree(query.frame_idxs);
+		return NULL;
+	}
+
+	query.ctx = ctx;
+	vote = vote_run(ctx->reg.audio_size, query.count, max_results, NULL, deadline, search_range, &query);
+
+	if(processed != NULL) {
+		*processed = vote_get_processed(vote);
+	}
+
+	/* get the top ranked audios */
+	j_res = vote_get_results(vote, ctx->reg.audios, max_results);
+	ao2_unlock(ctx);
+	ao2_ref(ctx, -1);
+
+	vote_destroy(vote);
+	sfree(query.vectors);
+	sfree(query.frame_idxs);
+
+	return j_res;
+}
+
+/**
+ * Vote the query frames in [start, end).
+ * Runs on the worker thread for the split search. Must be called with the ctx's read lock.
+ * @param data: ivfpq_query_t
+ * @param vote
+ * @param start
+ * @param end
+ */
+static void search_range(void* data, vote_t* vote, const int start, const int end)
+{
+	int i;
+	int k;
+	int count;
+	const ivfpq_query_t* query;
+	ivfpq_neighbor_t neighbors[DEF_IVFPQ_NEIGHBORS];
+
+	query = data;
+	for(i = start; i < end; i++) {
+		if(vote_next(vote, i, query->frame_idxs[i]) == false) {
+			break;
+		}
+
+		if(query->ctx->trained == true) {
+			count = search_lists(query->ctx, &query->vectors[i * g_dims], neighbors);
+		}
+		else {
+			count = search_raws(query->ctx, &query->vectors[i * g_dims], neighbors);
+		}
+
+		for(k = 0; k < count; k++) {
+			vote_add(vote, neighbors[k].audio_id, neighbors[k].frame_idx);
+		}
+	}
+}
+
+/**
+ * Find the nearest raw vectors with the exact distance.
+ * @param ctx
+ * @param vec
+ * @param neighbors: DEF_IVFPQ_NEIGHBORS items.
+ * @return found neighbors.
+ */
+static int search_raws(const ivfpq_ctx_t* ctx, const float* vec, ivfpq_neighbor_t* neighbors)
+{
+	int i;
+	int count;
+	float dist;
+
+	count = 0;
+	for(i = 0; i < ctx->raw_count; i++) {
+		dist = get_distance(&ctx->raws[i * g_dims], vec, g_dims);
+		count = add_neighbor(neighbors, count, dist, ctx->raw_audio_ids[i], ctx->raw_frame_idxs[i]);
+	}
+
+	return count;
+}
+
+/**
+ * Find the nearest encoded vectors in the nearest lists.
+ * The distance is the asymmetric distance of the query residual and the encoded residual.
+ * @param ctx
+ * @param vec
+ * @param neighbors: DEF_IVFPQ_NEIGHBORS items.
+ * @return found neighbors.
+ */
+static int search_lists(const ivfpq_ctx_t* ctx, const float* vec, ivfpq_neighbor_t* neighbors)
+{
+	int i;
+	int j;
+	int m;
+	int c;
+	int probes;
+	int probe_count;
+	int count;
+	int sub_dims;
+	float dist;
+	float residual[DEF_IVFPQ_MAX_DIMS];
+	float probe_dists[DEF_IVFPQ_MAX_PROBES];
+	int probe_ids[DEF_IVFPQ_MAX_PROBES];
+	float luts[DEF_IVFPQ_SUBS][DEF_IVFPQ_SUB_CENTROIDS];
+	const float* sub_centroids;
+	const uint8_t* code;
+	const ivfpq_list_t* list;
+
+	/* pick the nearest lists */
+	probes = MIN(g_probes, ctx->list_count);
+	probe_count = 0;
+	for(i = 0; i < ctx->list_count; i++) {
+		dist = get_distance(&ctx->centroids[i * g_dims], vec, g_dims);
+		if((probe_count == probes) && (dist >= probe_dists[probe_count - 1])) {
+			continue;
+		}
+
+		for(j = MIN(probe_count, probes - 1); j > 0; j--) {
+			if(probe_dists[j - 1] <= dist) {
+				break;
+			}
+			probe_dists[j] = probe_dists[j - 1];
+			probe_ids[j] = probe_ids[j - 1];
+		}
+		probe_dists[j] = dist;
+		probe_ids[j] = i;
+		if(probe_count < probes) {
+			probe_count++;
+		}
+	}
+
+	count = 0;
+	for(i = 0; i < probe_count; i++) {
+		list = &ctx->lists[probe_ids[i]];
+		if(list->count == 0) {
+			continue;
+		}
+
+		/* distance tables of the query residual */
+		for(j = 0; j < g_dims; j++) {
+			residual[j] = vec[j] - ctx->centroids[probe_ids[i] * g_dims + j];
+		}
+		for(m = 0; m < DEF_IVFPQ_SUBS; m++) {
+			sub_dims = g_sub_starts[m + 1] - g_sub_starts[m];
+			sub_centroids = &ctx->sub_centroids[g_sub_starts[m] * DEF_IVFPQ_SUB_CENTROIDS];
+			for(c = 0; c < DEF_IVFPQ_SUB_CENTROIDS; c++) {
+				luts[m][c] = get_distance(&sub_centroids[c * sub_dims], &residual[g_sub_starts[m]], sub_dims);
+			}
+		}
+
+		for(j = 0; j < list->count; j++) {
+			code = &list->codes[j * DEF_IVFPQ_SUBS];
+
+			dist = 0;
+			for(m = 0; m < DEF_IVFPQ_SUBS; m++) {
+				dist += luts[m][code[m]];
+			}
+			count = add_neighbor(neighbors, count, dist, list->audio_ids[j], list->frame_idxs[j]);
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Insert the neighbor into the sorted neighbors if it's near enough.
+ * @return neighbor count
+ */
+static int add_neighbor(ivfpq_neighbor_t* neighbors, int count, const float dist, const int audio_id, const int frame_idx)
+{
+	int i;
+
+	if((count == DEF_IVFPQ_NEIGHBORS) && (dist >= neighbors[count - 1].dist)) {
+		return count;
+	}
+
+	for(i = MIN(count, DEF_IVFPQ_NEIGHBORS - 1); i > 0; i--) {
+		if(neighbors[i - 1].dist <= dist) {
+			break;
+		}
+		neighbors[i] = neighbors[i - 1];
+	}
+	neighbors[i].dist = dist;
+	neighbors[i].audio_id = audio_id;
+	neighbors[i].frame_idx = frame_idx;
+
+	return MIN(count + 1, DEF_IVFPQ_NEIGHBORS);
+}
+
+/**
+ * Start the background training of the context if it has enough raw vectors.
+ * The ctx must be write locked.
+ * @param ctx
+ */
+static void start_training(ivfpq_ctx_t* ctx)
+{
+	int ret;
+	pthread_t thread;
+
+	if((ctx->trained == true) || (ctx->training == true) || (ctx->raw_count < DEF_IVFPQ_TRAIN_MIN) || (g_stop == true)) {
+		return;
+	}
+
+	/* the thread takes the reference */
+	ao2_ref(ctx, 1);
+	ao2_link(g_trainings, ctx);
+	ctx->training = true;
+	ret = ast_pthread_create_detached_background(&thread, NULL, run_training, ctx);
+	if(ret != 0) {
+		ast_log(LOG_ERROR, "Could not create training thread. context[%s]\n", ctx->reg.name);
+		ctx->training = false;
+		ao2_unlink(g_trainings, ctx);
+		ao2_ref(ctx, -1);
+		return;
+	}
+	ast_log(LOG_DEBUG, "Started vector quantizers training. context[%s], vectors[%d]\n", ctx->reg.name, ctx->raw_count);
+}
+
+/**
+ * Training thread of the context.
+ * Retries if the raw vectors have been deleted during the training.
+ * @param data: ivfpq_ctx_t. The reference is released at the end.
+ * @return
+ */
+static void* run_training(void* data)
+{
+	int ret;
+	bool retry;
+	ivfpq_ctx_t* ctx;
+
+	ctx = data;
+	while(g_stop == false) {
+		ret = train_ivfpq_ctx(ctx);
+		if(ret == true) {
+			break;
+		}
+
+		ao2_rdlock(ctx);
+		retry = (ctx->trained == false) && (ctx->raw_count >= DEF_IVFPQ_TRAIN_MIN);
+		ao2_unlock(ctx);
+		if(retry == false) {
+			break;
+		}
+	}
+
+	ao2_wrlock(ctx);
+	ctx->training = false;
+	ao2_unlock(ctx);
+
+	ao2_unlink(g_trainings, ctx);
+	ao2_ref(ctx, -1);
+
+	return NULL;
+}
+
+/**
+ * Train the coarse quantizer and the product quantizer with the raw vectors,
+ * and encode all of the raw vectors.
+ * The quantizers are trained and the vectors are encoded into the staging lists
+ * without the ctx's lock. Only the last raw vectors(less than DEF_IVFPQ_TRAIN_TAIL)
+ * are encoded with the write lock, and the staging lists are installed.
+ * The ctx must not be locked.
+ * @param ctx
+ * @return false if the training is discarded.
+ */
+static bool train_ivfpq_ctx(ivfpq_ctx_t* ctx)
+{
+	int i;
+	int j;
+	int m;
+	int list;
+	int sub_dims;
+	int revision;
+	int encoded;
+	int raw_count;
+	int sample_count;
+	int* audio_ids;
+	int* frame_idxs;
+	float* raws;
+	float* samples;
+	float* residuals;
+	float* subs;
+	ivfpq_ctx_t staging;
+
+	/* evenly spread samples */
+	ao2_rdlock(ctx);
+	if((ctx->trained == true) || (ctx->raw_count < DEF_IVFPQ_SUB_CENTROIDS)) {
+		ao2_unlock(ctx);
+		return false;
+	}
+	revision = ctx->revision;
+	raw_count = ctx->raw_count;
+	sample_count = MIN(raw_count, DEF_IVFPQ_TRAIN_SAMPLES);
+	samples = ast_calloc(sample_count, sizeof(float) * g_dims);
+	for(i = 0; i < sample_count; i++) {
+		j = (int)((int64_t)i * raw_count / sample_count);
+		memcpy(&samples[i * g_dims], &ctx->raws[j * g_dims], sizeof(float) * g_dims);
+	}
+	ao2_unlock(ctx);
+
+	memset(&staging, 0x00, sizeof(staging));
+
+	/* coarse quantizer */
+	staging.list_count = (int)sqrt(raw_count);
+	staging.list_count = MAX(staging.list_count, DEF_IVFPQ_MIN_LISTS);
+	staging.list_count = MIN(staging.list_count, DEF_IVFPQ_MAX_LISTS);
+	staging.centroids = ast_calloc(staging.list_count, sizeof(float) * g_dims);
+	kmeans(samples, sample_count, g_dims, staging.list_count, staging.centroids);
+
+	/* product quantizer of the residuals */
+	residuals = ast_calloc(sample_count, sizeof(float) * g_dims);
+	for(i = 0; i < sample_count; i++) {
+		list = get_nearest(staging.centroids, staging.list_count, g_dims, &samples[i * g_dims]);
+		for(j = 0; j < g_dims; j++) {
+			residuals[i * g_dims + j] = samples[i * g_dims + j] - staging.centroids[list * g_dims + j];
+		}
+	}
+	sfree(samples);
+
+	staging.sub_centroids = ast_calloc(g_dims * DEF_IVFPQ_SUB_CENTROIDS, sizeof(float));
+	subs = ast_calloc(sample_count, sizeof(float) * g_dims);
+	for(m = 0; m < DEF_IVFPQ_SUBS; m++) {
+		sub_dims = g_sub_starts[m + 1] - g_sub_starts[m];
+		for(i = 0; i < sample_count; i++) {
+			memcpy(&subs[i * sub_dims], &residuals[i * g_dims + g_sub_starts[m]], sizeof(float) * sub_dims);
+		}
+		kmeans(subs, sample_count, sub_dims, DEF_IVFPQ_SUB_CENTROIDS, &staging.sub_centroids[g_sub_starts[m] * DEF_IVFPQ_SUB_CENTROIDS]);
+	}
+	sfree(subs);
+	sfree(residuals);
+
+	/* encode the copy of the raw vectors. the vectors added meanwhile are encoded at the next round. */
+	staging.lists = ast_calloc(staging.list_count, sizeof(ivfpq_list_t));
+	encoded = 0;
+	while(g_stop == false) {
+		ao2_rdlock(ctx);
+		if((ctx->revision != revision) || (ctx->raw_count - encoded <= DEF_IVFPQ_TRAIN_TAIL)) {
+			ao2_unlock(ctx);
+			break;
+		}
+		raw_count = ctx->raw_count;
+		raws = copy_raws(ctx, encoded, raw_count, &audio_ids, &frame_idxs);
+		ao2_unlock(ctx);
+
+		for(i = 0; i < raw_count - encoded; i++) {
+			add_encoded_vector(&staging, &raws[i * g_dims], audio_ids[i], frame_idxs[i]);
+		}
+		sfree(raws);
+		sfree(audio_ids);
+		sfree(frame_idxs);
+		encoded = raw_count;
+	}
+
+	/* install. the deleted vectors could be in the staging lists. */
+	ao2_wrlock(ctx);
+	if((g_stop == true) || (ctx->revision != revision)) {
+		ao2_unlock(ctx);
+		ast_log(LOG_DEBUG, "Discarded vector quantizers training. context[%s]\n", ctx->reg.name);
+		clear_lists(&staging);
+		return false;
+	}
+
+	for(i = encoded; i < ctx->raw_count; i++) {
+		add_encoded_vector(&staging, &ctx->raws[i * g_dims], ctx->raw_audio_ids[i], ctx->raw_frame_idxs[i]);
+	}
+	ctx->count = staging.count;
+	ctx->list_count = staging.list_count;
+	ctx->centroids = staging.centroids;
+	ctx->sub_centroids = staging.sub_centroids;
+	ctx->lists = staging.lists;
+	ctx->trained = true;
+
+	sfree(ctx->raws);
+	sfree(ctx->raw_audio_ids);
+	sfree(ctx->raw_frame_idxs);
+	ctx->raw_count = 0;
+	ctx->raw_size = 0;
+
+	ast_log(LOG_VERBOSE, "Trained vector quantizers. context[%s], vectors[%d], samples[%d], lists[%d]\n",
+			ctx->reg.name, ctx->count, sample_count, ctx->list_count);
+	ao2_unlock(ctx);
+
+	return true;
+}
+
+/**
+ * Copy the raw vectors in [start, end).
+ * The ctx must be locked.
+ * @param ctx
+ * @param start
+ * @param end
+ * @param audio_ids: copied audio ids. Need to free after use.
+ * @param frame_idxs: copied frame indexes. Need to free after use.
+ * @return copied vectors. Need to free after use.
+ */
+static float* copy_raws(const ivfpq_ctx_t* ctx, const int start, const int end, int** audio_ids, int** frame_idxs)
+{
+	float* raws;
+
+	raws = ast_calloc(end - start, sizeof(float) * g_dims);
+	*audio_ids = ast_calloc(end - start, sizeof(int));
+	*frame_idxs = ast_calloc(end - start, sizeof(int));
+
+	memcpy(raws, &ctx->raws[start * g_dims], sizeof(float) * g_dims * (end - start));
+	memcpy(*audio_ids, &ctx->raw_audio_ids[start], sizeof(int) * (end - start));
+	memcpy(*frame_idxs, &ctx->raw_frame_idxs[start], sizeof(int) * (end - start));
+
+	return raws;
+}
+
+/**
+ * Release the quantizers and the inverted lists of the ctx.
+ * @param ctx
+ */
+static void clear_lists(ivfpq_ctx_t* ctx)
+{
+	int i;
+
+	for(i = 0; i < ctx->list_count; i++) {
+		if(ctx->lists == NULL) {
+			break;
+		}
+		sfree(ctx->lists[i].codes);
+		sfree(ctx->lists[i].audio_ids);
+		sfree(ctx->lists[i].frame_idxs);
+	}
+	sfree(ctx->lists);
+	sfree(ctx->centroids);
+	sfree(ctx->sub_centroids);
+	ctx->list_count = 0;
+	ctx->count = 0;
+}
+
+/**
+ * Lloyd's k-means. The initial centroids are the evenly spread data.
+ * The empty cluster is re-seeded with the other data.
+ * Stops early at the term.
+ * @param data: dims values for each
+ * @param count
+ * @param dims
+ * @param k
+ * @param centroids: k * dims values. Filled with the result.
+ */
+static void kmeans(const float* data, const int count, const int dims, const int k, float* centroids)
+{
+	int i;
+	int j;
+	int c;
+	int iter;
+	int changes;
+	int* assigns;
+	int* counts;
+
+	assigns = ast_calloc(count, sizeof(int));
+	counts = ast_calloc(k, sizeof(int));
+
+	for(c = 0; c < k; c++) {
+		i = (int)((int64_t)c * count / k);
+		memcpy(&centroids[c * dims], &data[i * dims], sizeof(float) * dims);
+	}
+
+	for(iter = 0; iter < DEF_IVFPQ_KMEANS_ITERS; iter++) {
+		if(g_stop == true) {
+			break;
+		}
+
+		changes = 0;
+		for(i = 0; i < count; i++) {
+			c = get_nearest(centroids, k, dims, &data[i * dims]);
+			if((iter == 0) || (c != assigns[i])) {
+				changes++;
+			}
+			assigns[i] = c;
+		}
+		if(changes == 0) {
+			break;
+		}
+
+		memset(centroids, 0x00, sizeof(float) * k * dims);
+		memset(counts, 0x00, sizeof(int) * k);
+		for(i = 0; i < count; i++) {
+			c = assigns[i];
+			for(j = 0; j < dims; j++) {
+				centroids[c * dims + j] += data[i * dims + j];
+			}
+			counts[c]++;
+		}
+
+		for(c = 0; c < k; c++) {
+			if(counts[c] == 0) {
+				i = (int)(((int64_t)c * 7919 + iter * 104729) % count);
+				memcpy(&centroids[c * dims], &data[i * dims], sizeof(float) * dims);
+				continue;
+			}
+
+			for(j = 0; j < dims; j++) {
+				centroids[c * dims + j] /= counts[c];
+			}
+		}
+	}
+
+	sfree(assigns);
+	sfree(counts);
+}
+
+/**
+ * Returns the nearest centroid of the given vector.
+ */
+static int get_nearest(const float* centroids, const int k, const int dims, const float* vec)
+{
+	int c;
+	int best;
+	float dist;
+	float best_dist;
+
+	best = 0;
+	best_dist = FLT_MAX;
+	for(c = 0; c < k; c++) {
+		dist = get_distance(&centroids[c * dims], vec, dims);
+		if(dist < best_dist) {
+			best_dist = dist;
+			best = c;
+		}
+	}
+
+	return best;
+}
+
+/**
+ * Returns the squared euclidean distance.
+ */
+static float get_distance(const float* a, const float* b, const int dims)
+{
+	int i;
+	float diff;
+	float dist;
+
+	dist = 0;
+	for(i = 0; i < dims; i++) {
+		diff = a[i] - b[i];
+		dist += diff * diff;
+	}
+
+	return dist;
+}
+
+static void add_raw_vector(ivfpq_ctx_t* ctx, const float* vec, const int audio_id, const int frame_idx)
+{
+	if(ctx->raw_count >= ctx->raw_size) {
+		ctx->raw_size = (ctx->raw_size * 2) + 256;
+		ctx->raws = ast_realloc(ctx->raws, sizeof(float) * g_dims * ctx->raw_size);
+		ctx->raw_audio_ids = ast_realloc(ctx->raw_audio_ids, sizeof(int) * ctx->raw_size);
+		ctx->raw_frame_idxs = ast_realloc(ctx->raw_frame_idxs, sizeof(int) * ctx->raw_size);
+	}
+
+	memcpy(&ctx->raws[ctx->raw_count * g_dims], vec, sizeof(float) * g_dims);
+	ctx->raw_audio_ids[ctx->raw_count] = audio_id;
+	ctx->raw_frame_idxs[ctx->raw_count] = frame_idx;
+	ctx->raw_count++;
+}
+
+/**
+ * Encode the vector and add it into its nearest list.
+ * The ctx must be trained.
+ */
+static void add_encoded_vector(ivfpq_ctx_t* ctx, const float* vec, const int audio_id, const int frame_idx)
+{
+	int i;
+	int m;
+	int sub_dims;
+	int idx;
+	float residual[DEF_IVFPQ_MAX_DIMS];
+	ivfpq_list_t* list;
+
+	idx = get_nearest(ctx->centroids, ctx->list_count, g_dims, vec);
+	list = &ctx->lists[idx];
+	if(list->count >= list->size) {
+		list->size = (list->size * 2) + 16;
+		list->codes = ast_realloc(list->codes, DEF_IVFPQ_SUBS * list->size);
+		list->audio_ids = ast_realloc(list->audio_ids, sizeof(int) * list->size);
+		list->frame_idxs = ast_realloc(list->frame_idxs, sizeof(int) * list->size);
+	}
+
+	for(i = 0; i < g_dims; i++) {
+		residual[i] = vec[i] - ctx->centroids[idx * g_dims + i];
+	}
+	for(m = 0; m < DEF_IVFPQ_SUBS; m++) {
+		sub_dims = g_sub_starts[m + 1] - g_sub_starts[m];
+		list->codes[list->count * DEF_IVFPQ_SUBS + m] = get_nearest(&ctx->sub_centroids[g_sub_starts[m] * DEF_IVFPQ_SUB_CENTROIDS],
+				DEF_IVFPQ_SUB_CENTROIDS, sub_dims, &residual[g_sub_starts[m]]);
+	}
+	list->audio_ids[list->count] = audio_id;
+	list->frame_idxs[list->count] = frame_idx;
+	list->count++;
+	ctx->count++;
+}
+
+/**
+ * Get the mfcc1 ~ mfccN values of the given vector info.
+ * @param j_vector
+ * @param vec: g_dims values.
+ * @return false if the vector info is not valid.
+ */
+static bool get_vector(struct ast_json* j_vector, float* vec)
+{
+	int i;
+	char col[16];
+	struct ast_json* j_tmp;
+
+	if(j_vector == NULL) {
+		return false;
+	}
+
+	for(i = 0; i < g_dims; i++) {
+		snprintf(col, sizeof(col), "mfcc%d", i + 1);
+		j_tmp = ast_json_object_get(j_vector, col);
+		if(j_tmp == NULL) {
+			return false;
+		}
+		vec[i] = ast_json_real_get(j_tmp);
+		if(isfinite(vec[i]) == 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * ao2 destructor of the ivfpq ctx.
+ * @param obj
+ */
+static void destroy_ivfpq_ctx(void* obj)
+{
+	ivfpq_ctx_t* ctx;
+
+	ctx = obj;
+
+
+	clear_lists(ctx);
+
+	sfree(ctx->raws);
+	sfree(ctx->raw_audio_ids);
+	sfree(ctx->raw_frame_idxs);
+	registry_ctx_clear(&ctx->reg);
+}
+
+/**
+ * Returns the ivfpq ctx of the given context name.
+ * The returned ctx is reference counted. Need to unref after use.
+ * @param name
+ * @return
+ */
+static ivfpq_ctx_t* get_ivfpq_ctx(const char* name)
+{
+	return ao2_find(g_ivfpq_ctxs, name, OBJ_SEARCH_KEY);
+}
@@ -0,0 +1,25 @@
+/*
+ * ivfpq_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_IVFPQ_HANDLER_H_
+#define SRC_IVFPQ_HANDLER_H_
+
+#include <asterisk/json.h>
+
+#include <stdbool.h>
+#include <sys/time.h>
+
+bool ivfpq_init(const int dims, const int probes);
+bool ivfpq_term(void);
+
+bool ivfpq_add_audio(const char* context, const char* uuid, struct ast_json* j_vectors);
+bool ivfpq_delete_audio(const char* context, const char* uuid);
+bool ivfpq_delete_context(const char* context);
+
+struct ast_json* ivfpq_search(const char* context, struct ast_json* j_vectors, const int max_results, const struct timeval deadline, double* processed);
+
+#endif /* SRC_IVFPQ_HANDLER_H_ */
@@ -0,0 +1,608 @@
+/*
+ * landmark_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Landmark(spectral peak pair) inverted index.
+ *  Keeps the postings(audio id, frame offset) of each context sorted by the landmark hash,
+ *  and the open addressing table of the hash to the posting list.
+ *  The search does one table probe for each query landmark.
+ *
+ *  The ngram engine keeps its quantized mfcc n-gram hashes in the same index.
+ *
+ *  Each context is a separated segment in the hash container and has its own lock.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/json.h>
+#include <asterisk/lock.h>
+#include <asterisk/astobj2.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "landmark_handler.h"
+#include "vote_handler.h"
+#include "registry_handler.h"
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+#define DEF_LANDMARK_CTX_BUCKETS	31
+
+typedef struct _landmark_entry_t {
+	uint32_t hash;
+	int audio_id;
+	int frame_idx;
+} landmark_entry_t;
+
+typedef struct _landmark_posting_t {
+	int audio_id;
+	int frame_idx;
+} landmark_posting_t;
+
+typedef struct _landmark_slot_t {
+	uint32_t hash;
+	int start;		///< first posting position
+	int count;		///< posting count. 0 for the empty slot.
+} landmark_slot_t;
+
+typedef struct _landmark_ctx_t {
+	registry_t reg;		///< context name and audio uuids. must be the first member.
+
+	/* postings. sorted by the hash. */
+	int count;
+	uint32_t* hashes;
+	landmark_posting_t* postings;
+
+	/* hash table. slot_size is the power of 2. */
+	bool slot_dirty;
+	int slot_size;
+	landmark_slot_t* slots;
+
+	/* added, but not merged into the postings yet. */
+	int pending_count;
+	int pending_size;
+	landmark_entry_t* pending;
+} landmark_ctx_t;
+
+typedef struct _landmark_query_t {
+	const landmark_ctx_t* ctx;
+	struct ast_json* j_landmarks;
+} landmark_query_t;
+
+static struct ao2_container* g_landmark_ctxs = NULL;	///< landmark ctxs. key: context name
+
+static void destroy_landmark_ctx(void* obj);
+static landmark_ctx_t* get_landmark_ctx(const char* name);
+
+static bool prepare_landmark_ctx(landmark_ctx_t* ctx);
+static void lock_search_landmark_ctx(landmark_ctx_t* ctx);
+static void search_range(void* data, vote_t* vote, const int start, const int end);
+static bool merge_pending_entries(landmark_ctx_t* ctx);
+static bool build_slots(landmark_ctx_t* ctx);
+static const landmark_slot_t* get_slot(const landmark_ctx_t* ctx, uint32_t hash);
+static uint32_t get_slot_idx(uint32_t hash, int slot_size);
+static int compare_entry(const void* a, const void* b);
+
+bool landmark_init(void)
+{
+	g_landmark_ctxs = registry_container_create(DEF_LANDMARK_CTX_BUCKETS);
+	if(g_landmark_ctxs == NULL) {
+		ast_log(LOG_ERROR, "Could not create landmark ctx container.\n");
+		return false;
+	}
+
+	return true;
+}
+
+bool landmark_term(void)
+{
+	ao2_cleanup(g_landmark_ctxs);
+	g_landmark_ctxs = NULL;
+
+	return true;
+}
+
+/**
+ * Add the given audio's landmarks into the context's inverted index.
+ * The landmarks are merged into the postings at the next search.
+ * @param context
+ * @param uuid
+ * @param j_landmarks
+ * @return
+ */
+bool landmark_add_audio(const char* context, const char* uuid, struct ast_json* j_landmarks)
+{
+	int i;
+	int count;
+	int audio_id;
+	landmark_ctx_t* ctx;
+	landmark_entry_t* entry;
+	struct ast_json* j_landmark;
+
+	if((context == NULL) || (uuid == NULL) || (j_landmarks == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	/* get or create the context's segment */
+	ao2_lock(g_landmark_ctxs);
+	ctx = ao2_find(g_landmark_ctxs, context, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if(ctx == NULL) {
+		ctx = registry_ctx_create(sizeof(landmark_ctx_t), destroy_landmark_ctx, context);
+		ao2_link_flags(g_landmark_ctxs, ctx, OBJ_NOLOCK);
+	}
+	ao2_unlock(g_landmark_ctxs);
+
+	ao2_wrlock(ctx);
+
+	audio_id = registry_get_audio_id(&ctx->reg, uuid);
+	if(audio_id >= 0) {
+		ast_log(LOG_NOTICE, "The given audio is already indexed. context[%s], uuid[%s]\n", context, uuid);
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		return true;
+	}
+	audio_id = registry_create_audio_id(&ctx->reg, uuid);
+
+	count = ast_json_array_size(j_landmarks);
+	if(ctx->pending_count + count > ctx->pending_size) {
+		ctx->pending_size = ctx->pending_count + count;
+		ctx->pending = ast_realloc(ctx->pending, sizeof(landmark_entry_t) * ctx->pending_size);
+	}
+
+	for(i = 0; i < count; i++) {
+		j_landmark = ast_json_array_get(j_landmarks, i);
+		if(j_landmark == NULL) {
+			continue;
+		}
+
+		entry = &ctx->pending[ctx->pending_count];
+		entry->hash = ast_json_integer_get(ast_json_object_get(j_landmark, "hash"));
+		entry->audio_id = audio_id;
+		entry->frame_idx = ast_json_integer_get(ast_json_object_get(j_landmark, "frame_idx"));
+		ctx->pending_count++;
+	}
+	ao2_unlock(ctx);
+	ao2_ref(ctx, -1);
+
+	ast_log(LOG_DEBUG, "Added landmark info. context[%s], uuid[%s], audio_id[%d], count[%d]\n", context, uuid, audio_id, count);
+
+	return true;
+}
+
+/**
+ * Delete the given audio's landmarks from the context's inverted index.
+ * @param context
+ * @param uuid
+ * @return
+ */
+bool landmark_delete_audio(const char* context, const char* uuid)
+{
+	int i;
+	int j;
+	int audio_id;
+	landmark_ctx_t* ctx;
+
+	if((context == NULL) || (uuid == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	ctx = get_landmark_ctx(context);
+	if(ctx == NULL) {
+		return false;
+	}
+
+	ao2_wrlock(ctx);
+
+	audio_id = registry_get_audio_id(&ctx->reg, uuid);
+	if(audio_id < 0) {
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		return false;
+	}
+
+	/* compact postings. keeps the order. */
+	j = 0;
+	for(i = 0; i < ctx->count; i++) {
+		if(ctx->postings[i].audio_id == audio_id) {
+			continue;
+		}
+		ctx->hashes[j] = ctx->hashes[i];
+		ctx->postings[j] = ctx->postings[i];
+		j++;
+	}
+	ctx->count = j;
+	ctx->slot_dirty = true;
+
+	/* compact pending entries */
+	j = 0;
+	for(i = 0; i < ctx->pending_count; i++) {
+		if(ctx->pending[i].audio_id == audio_id) {
+			continue;
+		}
+		ctx->pending[j] = ctx->pending[i];
+		j++;
+	}
+	ctx->pending_count = j;
+
+	/* release the audio id */
+	registry_release_audio_id(&ctx->reg, audio_id);
+
+	ao2_unlock(ctx);
+	ao2_ref(ctx, -1);
+
+	ast_log(LOG_DEBUG, "Deleted landmark info. context[%s], uuid[%s], audio_id[%d]\n", context, uuid, audio_id);
+
+	return true;
+}
+
+/**
+ * Delete the given context's inverted index.
+ * @param context
+ * @return
+ */
+bool landmark_delete_context(const char* context)
+{
+	landmark_ctx_t* ctx;
+
+	if(context == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	/* the segment is released after the running searches are done */
+	ctx = ao2_find(g_landmark_ctxs, context, OBJ_SEARCH_KEY | OBJ_UNLINK);
+	if(ctx == NULL) {
+		return false;
+	}
+	ao2_ref(ctx, -1);
+
+	return true;
+}
+
+/**
+ * Search the given landmarks from the context's inverted index.
+ * Each query landmark gives one vote to the each (audio, time offset) which has the same landmark.
+ * Returns the audio which has the most voted time offset.
+ * @param context
+ * @param j_landmarks
+ * @param max_results: max number of the ranked results.
+ * @param deadline: the query observations after this are not searched. zero for no deadline.
+ * @param processed: ratio(0 ~ 1) of the searched query observations. NULL for ignore.
+ * @return [{"audio_uuid": <uuid>, "match_count": <count>, "offset": <frame offset>}, ...] sorted by the rank, NULL if not found.
+ */
+struct ast_json* landmark_search(const char* context, struct ast_json* j_landmarks, const int max_results, const struct timeval deadline, double* processed)
+{
+	vote_t* vote;
+	landmark_ctx_t* ctx;
+	landmark_query_t query;
+	struct ast_json* j_res;
+
+	if((context == NULL) || (j_landmarks == NULL) || (max_results < 1)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	ctx = get_landmark_ctx(context);
+	if(ctx == NULL) {
+		ast_log(LOG_NOTICE, "Could not find landmark info. context[%s]\n", context);
+		return NULL;
+	}
+
+	/* merge the pending entries and build the hash table first */
+	lock_search_landmark_ctx(ctx);
+	if(ctx->count == 0) {
+		ast_log(LOG_NOTICE, "Could not find landmark info. context[%s]\n", context);
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		return NULL;
+	}
+
+	query.ctx = ctx;
+	query.j_landmarks = j_landmarks;
+	vote = vote_run(ctx->reg.audio_size, ast_json_array_size(j_landmarks), max_results, NULL, deadline, search_range, &query);
+
+	if(processed != NULL) {
+		*processed = vote_get_processed(vote);
+	}
+
+	/* get the top ranked audios */
+	j_res = vote_get_results(vote, ctx->reg.audios, max_results);
+	ao2_unlock(ctx);
+	ao2_ref(ctx, -1);
+
+	vote_destroy(vote);
+
+	return j_res;
+}
+
+/**
+ * Vote the query landmarks in [start, end).
+ * Runs on the worker thread for the split search. Must be called with the ctx's read lock.
+ * @param data: landmark_query_t
+ * @param vote
+ * @param start
+ * @param end
+ */
+static void search_range(void* data, vote_t* vote, const int start, const int end)
+{
+	int i;
+	int k;
+	uint32_t hash;
+	const landmark_query_t* query;
+	const landmark_slot_t* slot;
+	struct ast_json* j_landmark;
+
+	query = data;
+	for(i = start; i < end; i++) {
+		j_landmark = ast_json_array_get(query->j_landmarks, i);
+		if(j_landmark == NULL) {
+			continue;
+		}
+		if(vote_next(vote, i, ast_json_integer_get(ast_json_object_get(j_landmark, "frame_idx"))) == false) {
+			break;
+		}
+
+		hash = ast_json_integer_get(ast_json_object_get(j_landmark, "hash"));
+		slot = get_slot(query->ctx, hash);
+		if(slot == NULL) {
+			continue;
+		}
+
+		for(k = slot->start; k < slot->start + slot->count; k++) {
+			vote_add(vote, query->ctx->postings[k].audio_id, query->ctx->postings[k].frame_idx);
+		}
+	}
+}
+
+/**
+ * ao2 destructor of the landmark ctx.
+ * @param obj
+ */
+static void destroy_landmark_ctx(void* obj)
+{
+	landmark_ctx_t* ctx;
+
+	ctx = obj;
+
+
+	sfree(ctx->hashes);
+	sfree(ctx->postings);
+	sfree(ctx->slots);
+	sfree(ctx->pending);
+	registry_ctx_clear(&ctx->reg);
+}
+
+/**
+ * Returns the landmark ctx of the given context name.
+ * The returned ctx is reference counted. Need to unref after use.
+ * @param name
+ * @return
+ */
+static landmark_ctx_t* get_landmark_ctx(const char* name)
+{
+	return ao2_find(g_landmark_ctxs, name, OBJ_SEARCH_KEY);
+}
+
+/**
+ * Make the given ctx ready to search.
+ * The ctx must be write locked.
+ * @param ctx
+ * @return
+ */
+static bool prepare_landmark_ctx(landmark_ctx_t* ctx)
+{
+	int ret;
+
+	if(ctx->pending_count > 0) {
+		ret = merge_pending_entries(ctx);
+		if(ret == false) {
+			return false;
+		}
+	}
+
+	if(ctx->slot_dirty == true) {
+		ret = build_slots(ctx);
+		if(ret == false) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Lock the given ctx to search.
+ * Takes the read lock if the ctx is ready, so the searches of the same context run concurrently.
+ * Otherwise takes the write lock and prepares the ctx, and keeps the write lock for the search.
+ * Must be unlocked with the ao2_unlock.
+ * @param ctx
+ */
+static void lock_search_landmark_ctx(landmark_ctx_t* ctx)
+{
+	ao2_rdlock(ctx);
+	if((ctx->pending_count == 0) && (ctx->slot_dirty == false)) {
+		return;
+	}
+	ao2_unlock(ctx);
+
+	ao2_wrlock(ctx);
+	prepare_landmark_ctx(ctx);
+}
+
+/**
+ * Sort the pending entries and merge it into the postings.
+ * The ctx must be write locked.
+ * @param ctx
+ * @return
+ */
+static bool merge_pending_entries(landmark_ctx_t* ctx)
+{
+	int i;
+	int j;
+	int k;
+	int size;
+	uint32_t* hashes;
+	landmark_posting_t* postings;
+
+	qsort(ctx->pending, ctx->pending_count, sizeof(landmark_entry_t), compare_entry);
+
+	size = ctx->count + ctx->pending_count;
+	hashes = ast_calloc(size, sizeof(uint32_t));
+	postings = ast_calloc(size, sizeof(landmark_posting_t));
+
+	i = 0;
+	j = 0;
+	for(k = 0; k < size; k++) {
+		if((j >= ctx->pending_count) || ((i < ctx->count) && (ctx->hashes[i] <= ctx->pending[j].hash))) {
+			hashes[k] = ctx->hashes[i];
+			postings[k] = ctx->postings[i];
+			i++;
+			continue;
+		}
+
+		hashes[k] = ctx->pending[j].hash;
+		postings[k].audio_id = ctx->pending[j].audio_id;
+		postings[k].frame_idx = ctx->pending[j].frame_idx;
+		j++;
+	}
+
+	sfree(ctx->hashes);
+	sfree(ctx->postings);
+	sfree(ctx->pending);
+
+	ctx->hashes = hashes;
+	ctx->postings = postings;
+	ctx->count = size;
+
+	ctx->pending_count = 0;
+	ctx->pending_size = 0;
+
+	ctx->slot_dirty = true;
+
+	ast_log(LOG_DEBUG, "Merged landmark entries. context[%s], count[%d]\n", ctx->reg.name, ctx->count);
+
+	return true;
+}
+
+/**
+ * Build the hash table of the postings.
+ * The ctx must be write locked.
+ * @param ctx
+ * @return
+ */
+static bool build_slots(landmark_ctx_t* ctx)
+{
+	int i;
+	int start;
+	int uniques;
+	uint32_t idx;
+	landmark_slot_t* slot;
+
+	/* count the unique hashes */
+	uniques = 0;
+	for(i = 0; i < ctx->count; i++) {
+		if((i == 0) || (ctx->hashes[i] != ctx->hashes[i - 1])) {
+			uniques++;
+		}
+	}
+
+	/* keep the load factor under 0.5 */
+	ctx->slot_size = 16;
+	while(ctx->slot_size < uniques * 2) {
+		ctx->slot_size *= 2;
+	}
+	sfree(ctx->slots);
+	ctx->slots = ast_calloc(ctx->slot_size, sizeof(landmark_slot_t));
+
+	start = 0;
+	for(i = 1; i <= ctx->count; i++) {
+		if((i < ctx->count) && (ctx->hashes[i] == ctx->hashes[start])) {
+			continue;
+		}
+
+		/* linear probing */
+		idx = get_slot_idx(ctx->hashes[start], ctx->slot_size);
+		while(1) {
+			slot = &ctx->slots[idx];
+			if(slot->count == 0) {
+				break;
+			}
+			idx = (idx + 1) & (ctx->slot_size - 1);
+		}
+		slot->hash = ctx->hashes[start];
+		slot->start = start;
+		slot->count = i - start;
+
+		start = i;
+	}
+	ctx->slot_dirty = false;
+
+	ast_log(LOG_DEBUG, "Built landmark hash table. context[%s], uniques[%d], slot_size[%d]\n", ctx->reg.name, uniques, ctx->slot_size);
+
+	return true;
+}
+
+/**
+ * Returns the slot of the given hash. NULL if not exist.
+ */
+static const landmark_slot_t* get_slot(const landmark_ctx_t* ctx, uint32_t hash)
+{
+	uint32_t idx;
+	const landmark_slot_t* slot;
+
+	if(ctx->slots == NULL) {
+		return NULL;
+	}
+
+	idx = get_slot_idx(hash, ctx->slot_size);
+	while(1) {
+		slot = &ctx->slots[idx];
+		if(slot->count == 0) {
+			return NULL;
+		}
+
+		if(slot->hash == hash) {
+			return slot;
+		}
+		idx = (idx + 1) & (ctx->slot_size - 1);
+	}
+
+	return NULL;
+}
+
+static uint32_t get_slot_idx(uint32_t hash, int slot_size)
+{
+	/* murmur3 finalizer */
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+
+	return hash & (slot_size - 1);
+}
+
+static int compare_entry(const void* a, const void* b)
+{
+	const landmark_entry_t* entry_a = a;
+	const landmark_entry_t* entry_b = b;
+
+	if(entry_a->hash < entry_b->hash) {
+		return -1;
+	}
+	else if(entry_a->hash > entry_b->hash) {
+		return 1;
+	}
+
+	return 0;
+}
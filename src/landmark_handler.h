@@ -0,0 +1,25 @@
+/*
+ * landmark_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_LANDMARK_HANDLER_H_
+#define SRC_LANDMARK_HANDLER_H_
+
+#include <asterisk/json.h>
+
+#include <stdbool.h>
+#include <sys/time.h>
+
+bool landmark_init(void);
+bool landmark_term(void);
+
+bool landmark_add_audio(const char* context, const char* uuid, struct ast_json* j_landmarks);
+bool landmark_delete_audio(const char* context, const char* uuid);
+bool landmark_delete_context(const char* context);
+
+struct ast_json* landmark_search(const char* context, struct ast_json* j_landmarks, const int max_results, const struct timeval deadline, double* processed);
+
+#endif /* SRC_LANDMARK_HANDLER_H_ */
@@ -0,0 +1,587 @@
+/*
+ * monitor_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Passive monitoring of the channel.
+ *  The monitor taps the channel's audio with the spy audiohook, so the channel can be bridged
+ *  or go on the dialplan. The monitor thread fingerprints the tapped audio into the sliding
+ *  window(fp_monitor), and emits the TiresiasDetect manager event and sets the channel variables
+ *  when the context's audio is detected.
+ *  The memory of each monitor is bounded by the window, and the cpu by the step(each window search
+ *  is given the step as its time budget). The number of the monitors is bounded by the monitor_max.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/module.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/lock.h>
+#include <asterisk/astobj2.h>
+#include <asterisk/channel.h>
+#include <asterisk/datastore.h>
+#include <asterisk/audiohook.h>
+#include <asterisk/format_cache.h>
+#include <asterisk/manager.h>
+#include <asterisk/pbx.h>
+#include <asterisk/app.h>
+#include <asterisk/time.h>
+
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "app_tiresias.h"
+#include "fp_handler.h"
+#include "fp_stream_handler.h"
+#include "monitor_handler.h"
+
+/*** DOCUMENTATION
+	<function name="TIRESIAS_MONITOR" language="en_US">
+		<synopsis>
+			Monitor the channel's audio with the tiresias passively
+		</synopsis>
+		<syntax>
+			<parameter name="context">
+				<para>context name. Required to start.</para>
+			</parameter>
+			<parameter name="window_ms">
+				<para>Sliding window duration in milliseconds</para>
+			</parameter>
+			<parameter name="step_ms">
+				<para>Time between the window searches in milliseconds</para>
+			</parameter>
+			<parameter name="direction">
+				<enumlist>
+					<enum name="read"><para>Audio from the channel. Default.</para></enum>
+					<enum name="write"><para>Audio to the channel.</para></enum>
+					<enum name="both"><para>Mixed audio of the both directions.</para></enum>
+				</enumlist>
+			</parameter>
+		</syntax>
+		<description>
+			<para>Set to on to start, off to stop the monitoring. The channel's previous monitoring is stopped.</para>
+			<para>When the context's audio is detected, the TiresiasDetect manager event is emitted and
+			the TIRMONDETECTED, TIRMONFILEUUID, TIRMONFILENAME and TIRMONPOSITION variables are set.</para>
+			<para>Returns 1 if the channel is monitored, 0 otherwise.</para>
+		</description>
+	</function>
+ ***/
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+#define DEF_MONITOR_SOURCE			"TiresiasMonitor"
+#define DEF_MONITOR_FRAME_SAMPLES	160		// 20 ms of the 8 kHz
+#define DEF_MONITOR_WINDOW			5000	// ms
+#define DEF_MONITOR_STEP			1000	// ms
+#define DEF_MONITOR_MAX				256		// max monitored channels
+#define DEF_MONITOR_TERM_WAIT		3000	// ms. max wait of the monitor threads at the term
+
+/**
+ * Monitor of the channel. ao2 object.
+ * Referenced by the channel's datastore, the monitor thread and the g_monitors.
+ */
+typedef struct _monitor_t {
+	struct ast_audiohook audiohook;
+	struct ast_channel* chan;		///< channel's reference. released when the thread ends.
+	enum ast_audiohook_direction direction;
+
+	char* context;
+	fp_monitor_t* fp;		///< sliding window search. used by the monitor thread only.
+
+	int detections;
+} monitor_t;
+
+static struct ao2_container* g_monitors = NULL;	///< running monitors
+static int g_monitor_window = DEF_MONITOR_WINDOW;
+static int g_monitor_step = DEF_MONITOR_STEP;
+static int g_monitor_max = DEF_MONITOR_MAX;
+
+static int monitor_read(struct ast_channel *chan, const char *cmd, char *data, char *buf, size_t len);
+static int monitor_write(struct ast_channel *chan, const char *cmd, char *data, const char *value);
+static bool start_monitor(struct ast_channel* chan, const char* context, const int window_ms, const int step_ms, const enum ast_audiohook_direction direction);
+static void stop_monitor(struct ast_channel* chan);
+static void destroy_monitor(void* obj);
+static void destroy_monitor_datastore(void* data);
+static void* run_monitor(void* data);
+static void emit_detection(monitor_t* monitor, struct ast_json* j_res);
+
+static const struct ast_datastore_info g_monitor_datastore_info = {
+	.type = "tiresias_monitor",
+	.destroy = destroy_monitor_datastore,
+};
+
+static struct ast_custom_function g_monitor_function = {
+	.name = "TIRESIAS_MONITOR",
+	.read = monitor_read,
+	.write = monitor_write,
+};
+
+/**
+ * Initiate the monitoring with the global configuration.
+ * monitor_window_ms: default window(ms).
+ * monitor_step_ms: default step(ms).
+ * monitor_max: max number of the monitored channels. 0 for no limit.
+ * @return
+ */
+bool monitor_init(void)
+{
+	int ret;
+	const char* tmp_const;
+	struct ast_json* j_global;
+
+	j_global = ast_json_object_get(g_app->j_conf, "global");
+
+	g_monitor_window = DEF_MONITOR_WINDOW;
+	tmp_const = ast_json_string_get(ast_json_object_get(j_global, "monitor_window_ms"));
+	if(tmp_const != NULL) {
+		g_monitor_window = atoi(tmp_const);
+	}
+	if(g_monitor_window <= 0) {
+		ast_log(LOG_WARNING, "Wrong monitor_window_ms. Set to default. monitor_window_ms[%d], default[%d]\n", g_monitor_window, DEF_MONITOR_WINDOW);
+		g_monitor_window = DEF_MONITOR_WINDOW;
+	}
+
+	g_monitor_step = DEF_MONITOR_STEP;
+	tmp_const = ast_json_string_get(ast_json_object_get(j_global, "monitor_step_ms"));
+	if(tmp_const != NULL) {
+		g_monitor_step = atoi(tmp_const);
+	}
+	if(g_monitor_step <= 0) {
+		ast_log(LOG_WARNING, "Wrong monitor_step_ms. Set to default. monitor_step_ms[%d], default[%d]\n", g_monitor_step, DEF_MONITOR_STEP);
+		g_monitor_step = DEF_MONITOR_STEP;
+	}
+
+	g_monitor_max = DEF_MONITOR_MAX;
+	tmp_const = ast_json_string_get(ast_json_object_get(j_global, "monitor_max"));
+	if(tmp_const != NULL) {
+		g_monitor_max = atoi(tmp_const);
+	}
+	if(g_monitor_max < 0) {
+		ast_log(LOG_WARNING, "Wrong monitor_max. Set to default. monitor_max[%d], default[%d]\n", g_monitor_max, DEF_MONITOR_MAX);
+		g_monitor_max = DEF_MONITOR_MAX;
+	}
+
+	g_monitors = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, 1, NULL, NULL, NULL);
+	if(g_monitors == NULL) {
+		ast_log(LOG_ERROR, "Could not create monitor container.\n");
+		return false;
+	}
+
+	ret = ast_custom_function_register(&g_monitor_function);
+	if(ret != 0) {
+		ast_log(LOG_ERROR, "Could not register the monitor function.\n");
+		return false;
+	}
+	ast_log(LOG_VERBOSE, "Initiated monitoring. window[%d], step[%d], max[%d]\n", g_monitor_window, g_monitor_step, g_monitor_max);
+
+	return true;
+}
+
+/**
+ * Stop all of the monitors, and wait their threads.
+ * @return
+ */
+bool monitor_term(void)
+{
+	int i;
+	monitor_t* monitor;
+	struct ao2_iterator iter;
+
+	ast_custom_function_unregister(&g_monitor_function);
+
+	if(g_monitors == NULL) {
+		return true;
+	}
+
+	iter = ao2_iterator_init(g_monitors, 0);
+	while((monitor = ao2_iterator_next(&iter)) != NULL) {
+		ast_audiohook_update_status(&monitor->audiohook, AST_AUDIOHOOK_STATUS_SHUTDOWN);
+		ao2_ref(monitor, -1);
+	}
+	ao2_iterator_destroy(&iter);
+
+	for(i = 0; i < DEF_MONITOR_TERM_WAIT / 10; i++) {
+		if(ao2_container_count(g_monitors) == 0) {
+			break;
+		}
+		usleep(10000);
+	}
+	if(ao2_container_count(g_monitors) != 0) {
+		ast_log(LOG_WARNING, "Could not stop all of the monitors. count[%d]\n", ao2_container_count(g_monitors));
+		return false;
+	}
+
+	ao2_ref(g_monitors, -1);
+	g_monitors = NULL;
+
+	return true;
+}
+
+/**
+ * TIRESIAS_MONITOR()
+ * Returns 1 if the channel is monitored, 0 otherwise.
+ */
+static int monitor_read(struct ast_channel *chan, const char *cmd, char *data, char *buf, size_t len)
+{
+	struct ast_datastore* datastore;
+
+	if(chan == NULL) {
+		ast_log(LOG_WARNING, "TIRESIAS_MONITOR requires a channel.\n");
+		return -1;
+	}
+
+	ast_channel_lock(chan);
+	datastore = ast_channel_datastore_find(chan, &g_monitor_datastore_info, NULL);
+	ast_channel_unlock(chan);
+
+	ast_copy_string(buf, (datastore != NULL) ? "1" : "0", len);
+
+	return 0;
+}
+
+/**
+ * TIRESIAS_MONITOR(context[,window_ms[,step_ms[,direction]]])=on|off
+ */
+static int monitor_write(struct ast_channel *chan, const char *cmd, char *data, const char *value)
+{
+	int ret;
+	int window_ms;
+	int step_ms;
+	enum ast_audiohook_direction direction;
+
+	AST_DECLARE_APP_ARGS(args,
+		AST_APP_ARG(context);
+		AST_APP_ARG(window_ms);
+		AST_APP_ARG(step_ms);
+		AST_APP_ARG(direction);
+	);
+
+	if(chan == NULL) {
+		ast_log(LOG_WARNING, "TIRESIAS_MONITOR requires a channel.\n");
+		return -1;
+	}
+
+	if(ast_false(value) != 0) {
+		stop_monitor(chan);
+		return 0;
+	}
+
+	if(ast_true(value) == 0) {
+		ast_log(LOG_WARNING, "Wrong TIRESIAS_MONITOR value. value[%s]\n", value);
+		return -1;
+	}
+
+	AST_STANDARD_APP_ARGS(args, data);
+
+	/* get context */
+	ret = ast_strlen_zero(args.context);
+	if(ret == 1) {
+		ast_log(LOG_NOTICE, "Wrong context info.\n");
+		return -1;
+	}
+
+	/* get window_ms */
+	window_ms = g_monitor_window;
+	ret = ast_strlen_zero(args.window_ms);
+	if(ret != 1) {
+		window_ms = atoi(args.window_ms);
+	}
+
+	/* get step_ms */
+	step_ms = g_monitor_step;
+	ret = ast_strlen_zero(args.step_ms);
+	if(ret != 1) {
+		step_ms = atoi(args.step_ms);
+	}
+
+	/* get direction */
+	direction = AST_AUDIOHOOK_DIRECTION_READ;
+	ret = ast_strlen_zero(args.direction);
+	if(ret != 1) {
+		if(strcasecmp(args.direction, "write") == 0) {
+			direction = AST_AUDIOHOOK_DIRECTION_WRITE;
+		}
+		else if(strcasecmp(args.direction, "both") == 0) {
+			direction = AST_AUDIOHOOK_DIRECTION_BOTH;
+		}
+		else if(strcasecmp(args.direction, "read") != 0) {
+			ast_log(LOG_WARNING, "Wrong direction. direction[%s]\n", args.direction);
+			return -1;
+		}
+	}
+
+	ret = start_monitor(chan, args.context, window_ms, step_ms, direction);
+	if(ret == false) {
+		ast_log(LOG_NOTICE, "Could not start the monitoring. channel[%s], context[%s]\n", ast_channel_name(chan), args.context);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Start the monitoring of the channel. The channel's previous monitoring is stopped.
+ * @param chan
+ * @param context
+ * @param window_ms
+ * @param step_ms
+ * @param direction
+ * @return
+ */
+static bool start_monitor(struct ast_channel* chan, const char* context, const int window_ms, const int step_ms, const enum ast_audiohook_direction direction)
+{
+	int ret;
+	int coefs;
+	double tolerance;
+	pthread_t thread;
+	monitor_t* monitor;
+	fp_monitor_t* fp;
+	const char* tmp_const;
+	struct ast_datastore* datastore;
+
+	if((chan == NULL) || (context == NULL) || (window_ms <= 0) || (step_ms <= 0)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	stop_monitor(chan);
+
+	if((g_monitor_max > 0) && (ao2_container_count(g_monitors) >= g_monitor_max)) {
+		ast_log(LOG_NOTICE, "Too many monitors. max[%d]\n", g_monitor_max);
+		return false;
+	}
+
+	/* get coefs */
+	coefs = 1;
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "global"), "coefs"));
+	if(tmp_const != NULL) {
+		coefs = atoi(tmp_const);
+	}
+
+	/* get tolerance */
+	tolerance = -1;
+	tmp_const = ast_json_string_get(ast_json_object_get(ast_json_object_get(g_app->j_conf, "global"), "tolerance"));
+	if(tmp_const != NULL) {
+		tolerance = atof(tmp_const);
+	}
+
+	fp = fp_monitor_create(context, window_ms, step_ms, coefs, tolerance, -1, -1);
+	if(fp == NULL) {
+		ast_log(LOG_NOTICE, "Could not create the sliding window search. context[%s]\n", context);
+		return false;
+	}
+
+	monitor = ao2_alloc(sizeof(monitor_t), destroy_monitor);
+	if(monitor == NULL) {
+		ast_log(LOG_ERROR, "Could not create monitor.\n");
+		fp_monitor_destroy(fp);
+		return false;
+	}
+	monitor->direction = direction;
+	monitor->context = ast_strdup(context);
+	monitor->fp = fp;
+
+	ast_audiohook_init(&monitor->audiohook, AST_AUDIOHOOK_TYPE_SPY, DEF_MONITOR_SOURCE, 0);
+
+	datastore = ast_datastore_alloc(&g_monitor_datastore_info, NULL);
+	if(datastore == NULL) {
+		ast_log(LOG_ERROR, "Could not create monitor datastore.\n");
+		ao2_ref(monitor, -1);
+		return false;
+	}
+	datastore->data = ao2_bump(monitor);
+	ast_module_ref(AST_MODULE_SELF);
+
+	ast_channel_lock(chan);
+	ast_channel_datastore_add(chan, datastore);
+	ast_channel_unlock(chan);
+
+	ret = ast_audiohook_attach(chan, &monitor->audiohook);
+	if(ret != 0) {
+		ast_log(LOG_ERROR, "Could not attach the audiohook. channel[%s]\n", ast_channel_name(chan));
+		stop_monitor(chan);
+		ao2_ref(monitor, -1);
+		return false;
+	}
+
+	/* the thread takes the references of the monitor and the channel */
+	monitor->chan = ast_channel_ref(chan);
+	ao2_link(g_monitors, monitor);
+	ret = ast_pthread_create_detached_background(&thread, NULL, run_monitor, monitor);
+	if(ret != 0) {
+		ast_log(LOG_ERROR, "Could not create monitor thread. channel[%s]\n", ast_channel_name(chan));
+		ao2_unlink(g_monitors, monitor);
+		monitor->chan = ast_channel_unref(monitor->chan);
+		ast_audiohook_detach(&monitor->audiohook);
+		stop_monitor(chan);
+		ao2_ref(monitor, -1);
+		return false;
+	}
+	ast_log(LOG_VERBOSE, "Started monitoring. channel[%s], context[%s], window[%d], step[%d], direction[%d]\n",
+			ast_channel_name(chan), context, window_ms, step_ms, direction);
+
+	return true;
+}
+
+/**
+ * Remove the channel's monitor datastore. The monitor is stopped.
+ * @param chan
+ */
+static void stop_monitor(struct ast_channel* chan)
+{
+	struct ast_datastore* datastore;
+
+	ast_channel_lock(chan);
+	datastore = ast_channel_datastore_find(chan, &g_monitor_datastore_info, NULL);
+	if(datastore != NULL) {
+		ast_channel_datastore_remove(chan, datastore);
+	}
+	ast_channel_unlock(chan);
+
+	if(datastore != NULL) {
+		ast_datastore_free(datastore);
+	}
+}
+
+static void destroy_monitor(void* obj)
+{
+	monitor_t* monitor;
+
+	monitor = obj;
+
+	ast_audiohook_destroy(&monitor->audiohook);
+	fp_monitor_destroy(monitor->fp);
+	sfree(monitor->context);
+}
+
+/**
+ * The channel does not need the monitor anymore.
+ * The monitor thread is woken up and ends.
+ */
+static void destroy_monitor_datastore(void* data)
+{
+	monitor_t* monitor;
+
+	monitor = data;
+	if(monitor == NULL) {
+		return;
+	}
+
+	ast_audiohook_update_status(&monitor->audiohook, AST_AUDIOHOOK_STATUS_SHUTDOWN);
+	ao2_ref(monitor, -1);
+	ast_module_unref(AST_MODULE_SELF);
+}
+
+/**
+ * Monitor thread. Fingerprints the tapped audio until the audiohook is detached or stopped.
+ * Holds the monitor's reference and the channel's reference.
+ */
+static void* run_monitor(void* data)
+{
+	monitor_t* monitor;
+	struct ast_frame* frame;
+	struct ast_json* j_res;
+	struct ast_json* j_stats;
+
+	monitor = data;
+
+	ast_audiohook_lock(&monitor->audiohook);
+	while(monitor->audiohook.status == AST_AUDIOHOOK_STATUS_RUNNING) {
+		ast_audiohook_trigger_wait(&monitor->audiohook);
+		if(monitor->audiohook.status != AST_AUDIOHOOK_STATUS_RUNNING) {
+			break;
+		}
+
+		while((frame = ast_audiohook_read_frame(&monitor->audiohook, DEF_MONITOR_FRAME_SAMPLES, monitor->direction, ast_format_slin)) != NULL) {
+			/* the channel's audio keeps flowing while the window is searched */
+			ast_audiohook_unlock(&monitor->audiohook);
+			fp_monitor_write(monitor->fp, frame->data.ptr, frame->samples);
+			ast_frfree(frame);
+
+			j_res = fp_monitor_get_detection(monitor->fp);
+			if(j_res != NULL) {
+				emit_detection(monitor, j_res);
+				ast_json_unref(j_res);
+			}
+			ast_audiohook_lock(&monitor->audiohook);
+		}
+	}
+	ast_audiohook_unlock(&monitor->audiohook);
+	ast_audiohook_detach(&monitor->audiohook);
+
+	j_stats = fp_monitor_get_stats(monitor->fp);
+	ast_log(LOG_VERBOSE, "Finished monitoring. channel[%s], context[%s], detections[%d], frames[%d], searches[%d], skipped[%d]\n",
+			ast_channel_name(monitor->chan),
+			monitor->context,
+			monitor->detections,
+			(int)ast_json_integer_get(ast_json_object_get(j_stats, "frames")),
+			(int)ast_json_integer_get(ast_json_object_get(j_stats, "searches")),
+			(int)ast_json_integer_get(ast_json_object_get(j_stats, "skipped"))
+			);
+	ast_json_unref(j_stats);
+
+	monitor->chan = ast_channel_unref(monitor->chan);
+	ao2_unlink(g_monitors, monitor);
+	ao2_ref(monitor, -1);
+
+	return NULL;
+}
+
+/**
+ * Emit the TiresiasDetect manager event and set the channel variables.
+ * TIRMONDETECTED: count of the detections.
+ * TIRMONFILEUUID, TIRMONFILENAME: last detected audio.
+ * TIRMONPOSITION: monitored time(ms) at the last detection.
+ * @param monitor
+ * @param j_res
+ */
+static void emit_detection(monitor_t* monitor, struct ast_json* j_res)
+{
+	int position;
+	int match_count;
+	char* tmp;
+	const char* uuid;
+	const char* name;
+
+	monitor->detections++;
+	uuid = ast_json_string_get(ast_json_object_get(j_res, "uuid"));
+	name = ast_json_string_get(ast_json_object_get(j_res, "name"));
+	match_count = ast_json_integer_get(ast_json_object_get(j_res, "match_count"));
+	position = ast_json_integer_get(ast_json_object_get(j_res, "position"));
+	ast_log(LOG_VERBOSE, "Detected. channel[%s], context[%s], uuid[%s], name[%s], match_count[%d], position[%d]\n",
+			ast_channel_name(monitor->chan), monitor->context, uuid? : "", name? : "", match_count, position);
+
+	ast_asprintf(&tmp, "%d", monitor->detections);
+	pbx_builtin_setvar_helper(monitor->chan, "TIRMONDETECTED", tmp);
+	sfree(tmp);
+
+	pbx_builtin_setvar_helper(monitor->chan, "TIRMONFILEUUID", uuid? : "");
+	pbx_builtin_setvar_helper(monitor->chan, "TIRMONFILENAME", name? : "");
+
+	ast_asprintf(&tmp, "%d", position);
+	pbx_builtin_setvar_helper(monitor->chan, "TIRMONPOSITION", tmp);
+	sfree(tmp);
+
+	manager_event(EVENT_FLAG_CALL, "TiresiasDetect",
+			"Channel: %s\r\n"
+			"Uniqueid: %s\r\n"
+			"Context: %s\r\n"
+			"FileUuid: %s\r\n"
+			"FileName: %s\r\n"
+			"MatchCount: %d\r\n"
+			"Position: %d\r\n"
+			"Detections: %d\r\n",
+			ast_channel_name(monitor->chan),
+			ast_channel_uniqueid(monitor->chan),
+			monitor->context,
+			uuid? : "",
+			name? : "",
+			match_count,
+			position,
+			monitor->detections
+			);
+}
@@ -0,0 +1,16 @@
+/*
+ * monitor_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_MONITOR_HANDLER_H_
+#define SRC_MONITOR_HANDLER_H_
+
+#include <stdbool.h>
+
+bool monitor_init(void);
+bool monitor_term(void);
+
+#endif /* SRC_MONITOR_HANDLER_H_ */
@@ -0,0 +1,193 @@
+/*
+ * registry_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Per context audio id registry of the engines.
+ *  Each engine keeps its ctx of the context in the ao2 container, and the ctx
+ *  starts with the registry. The registry maps the audio uuid to the audio id,
+ *  which is the index of the engine's per audio arrays.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/strings.h>
+#include <asterisk/astobj2.h>
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "registry_handler.h"
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+static int hash_registry(const void* obj, const int flags);
+static int cmp_registry(void* obj, void* arg, int flags);
+
+/**
+ * Create the ao2 container of the engine ctxs.
+ * The ctxs are searched by the context name.
+ * @param buckets
+ * @return
+ */
+struct ao2_container* registry_container_create(const int buckets)
+{
+	return ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, 0, buckets, hash_registry, NULL, cmp_registry);
+}
+
+/**
+ * Create the engine ctx. The ctx is ao2 object.
+ * The given size must include the registry at the start of the ctx.
+ * @param size
+ * @param destructor: ao2 destructor of the ctx. Need to call the registry_ctx_clear().
+ * @param name: context name
+ * @return
+ */
+void* registry_ctx_create(const size_t size, ao2_destructor_fn destructor, const char* name)
+{
+	registry_t* reg;
+
+	if((size < sizeof(registry_t)) || (name == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	reg = ao2_alloc_options(size, destructor, AO2_ALLOC_OPT_LOCK_RWLOCK);
+	if(reg == NULL) {
+		return NULL;
+	}
+	memset(reg, 0x00, size);
+	reg->name = ast_strdup(name);
+
+	return reg;
+}
+
+/**
+ * Release the registry of the ctx.
+ * @param reg
+ */
+void registry_ctx_clear(registry_t* reg)
+{
+	int i;
+
+	if(reg == NULL) {
+		return;
+	}
+
+	for(i = 0; i < reg->audio_size; i++) {
+		sfree(reg->audios[i]);
+	}
+	sfree(reg->audios);
+	reg->audio_size = 0;
+	sfree(reg->name);
+}
+
+/**
+ * Returns the audio id of the given uuid.
+ * @param reg
+ * @param uuid
+ * @return -1 if not registered.
+ */
+int registry_get_audio_id(const registry_t* reg, const char* uuid)
+{
+	int i;
+
+	if((reg == NULL) || (uuid == NULL)) {
+		return -1;
+	}
+
+	for(i = 0; i < reg->audio_size; i++) {
+		if(reg->audios[i] == NULL) {
+			continue;
+		}
+
+		if(strcmp(reg->audios[i], uuid) == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * Create new audio id for the given uuid.
+ * Reuses the released audio id if exists. Otherwise, the audio_size is increased,
+ * and the engine needs to grow its per audio arrays.
+ * @param reg
+ * @param uuid
+ * @return
+ */
+int registry_create_audio_id(registry_t* reg, const char* uuid)
+{
+	int i;
+
+	if((reg == NULL) || (uuid == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return -1;
+	}
+
+	for(i = 0; i < reg->audio_size; i++) {
+		if(reg->audios[i] == NULL) {
+			reg->audios[i] = ast_strdup(uuid);
+			return i;
+		}
+	}
+
+	reg->audios = ast_realloc(reg->audios, sizeof(char*) * (reg->audio_size + 1));
+	reg->audios[reg->audio_size] = ast_strdup(uuid);
+	reg->audio_size++;
+
+	return reg->audio_size - 1;
+}
+
+/**
+ * Release the given audio id. The id can be reused by the next audio.
+ * @param reg
+ * @param audio_id
+ */
+void registry_release_audio_id(registry_t* reg, const int audio_id)
+{
+	if((reg == NULL) || (audio_id < 0) || (audio_id >= reg->audio_size)) {
+		return;
+	}
+
+	sfree(reg->audios[audio_id]);
+}
+
+static int hash_registry(const void* obj, const int flags)
+{
+	const registry_t* reg;
+	const char* key;
+
+	if((flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_KEY) {
+		key = obj;
+	}
+	else {
+		reg = obj;
+		key = reg->name;
+	}
+
+	return ast_str_hash(key);
+}
+
+static int cmp_registry(void* obj, void* arg, int flags)
+{
+	const registry_t* reg;
+	const registry_t* reg_arg;
+	const char* key;
+
+	reg = obj;
+	if((flags & OBJ_SEARCH_MASK) == OBJ_SEARCH_KEY) {
+		key = arg;
+	}
+	else {
+		reg_arg = arg;
+		key = reg_arg->name;
+	}
+
+	return (strcmp(reg->name, key) == 0) ? CMP_MATCH : 0;
+}
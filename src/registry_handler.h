@@ -0,0 +1,34 @@
+/*
+ * registry_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_REGISTRY_HANDLER_H_
+#define SRC_REGISTRY_HANDLER_H_
+
+#include <asterisk/astobj2.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Per context audio id registry of the engine.
+ * Must be the first member of the engine's ctx.
+ */
+typedef struct _registry_t {
+	char* name;			///< context name
+	char** audios;		///< audio uuids. audio id is the index of the array.
+	int audio_size;
+} registry_t;
+
+struct ao2_container* registry_container_create(const int buckets);
+void* registry_ctx_create(const size_t size, ao2_destructor_fn destructor, const char* name);
+void registry_ctx_clear(registry_t* reg);
+
+int registry_get_audio_id(const registry_t* reg, const char* uuid);
+int registry_create_audio_id(registry_t* reg, const char* uuid);
+void registry_release_audio_id(registry_t* reg, const int audio_id);
+
+#endif /* SRC_REGISTRY_HANDLER_H_ */
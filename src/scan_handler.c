@@ -0,0 +1,803 @@
+/*
+ * scan_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Brute force fingerprint scan.
+ *  Keeps the fingerprints of each context in the column arrays(max1 ~ maxN, audio id, frame index),
+ *  and compares the block of the query frames against the cache sized block of the entries.
+ *  The tolerance check is done with AVX2 if the cpu supports it, otherwise with the scalar code.
+ *
+ *  For the small and medium context, the linear scan does not need the index build
+ *  and is faster than the index lookup.
+ *
+ *  The entries of each audio are kept in one range. The audios filtered by the
+ *  sketch prefilter are skipped by range, so their entries are not compared at all.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/json.h>
+#include <asterisk/lock.h>
+#include <asterisk/astobj2.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+#include "scan_handler.h"
+#include "vote_handler.h"
+#include "registry_handler.h"
+#include "sketch_handler.h"
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+#define DEF_SCAN_MAX_COEFS		8
+#define DEF_SCAN_CTX_BUCKETS	31
+#define DEF_SCAN_QUERY_BLOCK	8		// query frames of each block
+#define DEF_SCAN_ENTRY_BLOCK	4096	// entries of each block. keeps the columns in the cache.
+
+typedef struct _scan_ctx_t {
+	registry_t reg;		///< context name and audio uuids. must be the first member.
+
+	sketch_t** sketches;	///< prefilter sketch of each audio.
+	int* audio_starts;		///< first entry position of each audio.
+	int* audio_counts;		///< entry count of each audio.
+
+	/* column arrays */
+	int count;
+	int size;
+	float* cols[DEF_SCAN_MAX_COEFS];	///< max1 ~ maxN
+	int* audio_ids;
+	int* frame_idxs;
+} scan_ctx_t;
+
+typedef struct _scan_query_t {
+	bool valid;		///< false if the frame is ignored
+	int frame_idx;
+
+	int dims;		///< number of the checked coefs
+	int dim_idxs[DEF_SCAN_MAX_COEFS];
+	float min[DEF_SCAN_MAX_COEFS];
+	float max[DEF_SCAN_MAX_COEFS];
+
+	/* matched entry positions */
+	int hit_count;
+	int hit_size;
+	int* hits;
+} scan_query_t;
+
+typedef struct _scan_range_t {
+	int start;
+	int end;
+} scan_range_t;
+
+typedef struct _scan_search_t {
+	const scan_ctx_t* ctx;
+
+	/* entry ranges to compare. sorted. */
+	int range_count;
+	scan_range_t* ranges;
+
+	struct ast_json* j_fprints;
+	int coefs;
+	double tolerance;
+	int freq_ignore_low;
+	int freq_ignore_high;
+} scan_search_t;
+
+/**
+ * Compares the query against the entries in [start, end).
+ * Writes the matched entry positions into the hits and returns the count.
+ */
+typedef int (*scan_block_fn)(const scan_ctx_t* ctx, const scan_query_t* query, int start, int end, int* hits);
+
+static int g_coefs = 0;
+static struct ao2_container* g_scan_ctxs = NULL;	///< scan ctxs. key: context name
+static scan_block_fn g_scan_block = NULL;
+
+static void destroy_scan_ctx(void* obj);
+static scan_ctx_t* get_scan_ctx(const char* name);
+static void update_audio_ranges(scan_ctx_t* ctx);
+
+static bool* create_excludes(const scan_search_t* search);
+static bool create_entry_ranges(scan_search_t* search, const bool* excludes);
+static int compare_range(const void* a, const void* b);
+static void search_range(void* data, vote_t* vote, const int start, const int end);
+static bool set_scan_query(scan_query_t* query, struct ast_json* j_fprint, const int coefs, const double tolerance, const int freq_ignore_low, const int freq_ignore_high);
+static int scan_block_scalar(const scan_ctx_t* ctx, const scan_query_t* query, int start, int end, int* hits);
+#ifdef SCAN_X86
+static int scan_block_avx2(const scan_ctx_t* ctx, const scan_query_t* query, int start, int end, int* hits);
+#endif
+
+bool scan_init(const int coefs)
+{
+	if((coefs < 1) || (coefs > DEF_SCAN_MAX_COEFS)) {
+		ast_log(LOG_ERROR, "Wrong coefs count. max[%d], coefs[%d]\n", DEF_SCAN_MAX_COEFS, coefs);
+		return false;
+	}
+
+	g_coefs = coefs;
+
+	g_scan_ctxs = registry_container_create(DEF_SCAN_CTX_BUCKETS);
+	if(g_scan_ctxs == NULL) {
+		ast_log(LOG_ERROR, "Could not create scan ctx container.\n");
+		return false;
+	}
+
+	/* select the block scanner */
+	g_scan_block = scan_block_scalar;
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")) {
+		g_scan_block = scan_block_avx2;
+	}
+#endif
+	ast_log(LOG_VERBOSE, "Initiated scan engine. scanner[%s]\n", (g_scan_block == scan_block_scalar) ? "scalar" : "avx2");
+
+	return true;
+}
+
+bool scan_term(void)
+{
+	ao2_cleanup(g_scan_ctxs);
+	g_scan_ctxs = NULL;
+
+	return true;
+}
+
+/**
+ * Add the given audio's fingerprints into the context's columns.
+ * @param context
+ * @param uuid
+ * @param j_fprints
+ * @return
+ */
+bool scan_add_audio(const char* context, const char* uuid, struct ast_json* j_fprints)
+{
+	int i;
+	int j;
+	int count;
+	int audio_id;
+	char col_max[10];
+	float vals[DEF_SCAN_MAX_COEFS];
+	scan_ctx_t* ctx;
+	sketch_t* sketch;
+	struct ast_json* j_fprint;
+
+	if((context == NULL) || (uuid == NULL) || (j_fprints == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	/* get or create the context's segment */
+	ao2_lock(g_scan_ctxs);
+	ctx = ao2_find(g_scan_ctxs, context, OBJ_SEARCH_KEY | OBJ_NOLOCK);
+	if(ctx == NULL) {
+		ctx = registry_ctx_create(sizeof(scan_ctx_t), destroy_scan_ctx, context);
+		ao2_link_flags(g_scan_ctxs, ctx, OBJ_NOLOCK);
+	}
+	ao2_unlock(g_scan_ctxs);
+
+	ao2_wrlock(ctx);
+
+	audio_id = registry_get_audio_id(&ctx->reg, uuid);
+	if(audio_id >= 0) {
+		ast_log(LOG_NOTICE, "The given audio is already added. context[%s], uuid[%s]\n", context, uuid);
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		return true;
+	}
+	audio_id = registry_create_audio_id(&ctx->reg, uuid);
+	if(audio_id == ctx->reg.audio_size - 1) {
+		/* new audio id. grow the per audio arrays */
+		ctx->sketches = ast_realloc(ctx->sketches, sizeof(sketch_t*) * ctx->reg.audio_size);
+		ctx->sketches[audio_id] = NULL;
+		ctx->audio_starts = ast_realloc(ctx->audio_starts, sizeof(int) * ctx->reg.audio_size);
+		ctx->audio_starts[audio_id] = 0;
+		ctx->audio_counts = ast_realloc(ctx->audio_counts, sizeof(int) * ctx->reg.audio_size);
+		ctx->audio_counts[audio_id] = 0;
+	}
+
+	count = ast_json_array_size(j_fprints);
+	if(ctx->count + count > ctx->size) {
+		ctx->size = MAX(ctx->size * 2, ctx->count + count);
+		for(j = 0; j < g_coefs; j++) {
+			ctx->cols[j] = ast_realloc(ctx->cols[j], sizeof(float) * ctx->size);
+		}
+		ctx->audio_ids = ast_realloc(ctx->audio_ids, sizeof(int) * ctx->size);
+		ctx->frame_idxs = ast_realloc(ctx->frame_idxs, sizeof(int) * ctx->size);
+	}
+
+	sketch = sketch_create(count, g_coefs);
+	ctx->audio_starts[audio_id] = ctx->count;
+	for(i = 0; i < count; i++) {
+		j_fprint = ast_json_array_get(j_fprints, i);
+		if(j_fprint == NULL) {
+			continue;
+		}
+
+		for(j = 0; j < g_coefs; j++) {
+			snprintf(col_max, sizeof(col_max), "max%d", j + 1);
+			vals[j] = ast_json_real_get(ast_json_object_get(j_fprint, col_max));
+			ctx->cols[j][ctx->count] = vals[j];
+		}
+		sketch_add(sketch, vals);
+		ctx->audio_ids[ctx->count] = audio_id;
+		ctx->frame_idxs[ctx->count] = ast_json_integer_get(ast_json_object_get(j_fprint, "frame_idx"));
+		ctx->count++;
+	}
+	ctx->audio_counts[audio_id] = ctx->count - ctx->audio_starts[audio_id];
+	ctx->sketches[audio_id] = sketch;
+	ao2_unlock(ctx);
+	ao2_ref(ctx, -1);
+
+	ast_log(LOG_DEBUG, "Added scan info. context[%s], uuid[%s], audio_id[%d], count[%d]\n", context, uuid, audio_id, count);
+
+	return true;
+}
+
+/**
+ * Delete the given audio's fingerprints from the context's columns.
+ * @param context
+ * @param uuid
+ * @return
+ */
+bool scan_delete_audio(const char* context, const char* uuid)
+{
+	int i;
+	int j;
+	int k;
+	int audio_id;
+	scan_ctx_t* ctx;
+
+	if((context == NULL) || (uuid == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	ctx = get_scan_ctx(context);
+	if(ctx == NULL) {
+		return false;
+	}
+
+	ao2_wrlock(ctx);
+
+	audio_id = registry_get_audio_id(&ctx->reg, uuid);
+	if(audio_id < 0) {
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		return false;
+	}
+
+	/* compact columns */
+	j = 0;
+	for(i = 0; i < ctx->count; i++) {
+		if(ctx->audio_ids[i] == audio_id) {
+			continue;
+		}
+
+		for(k = 0; k < g_coefs; k++) {
+			ctx->cols[k][j] = ctx->cols[k][i];
+		}
+		ctx->audio_ids[j] = ctx->audio_ids[i];
+		ctx->frame_idxs[j] = ctx->frame_idxs[i];
+		j++;
+	}
+	ctx->count = j;
+
+	/* release the audio id */
+	registry_release_audio_id(&ctx->reg, audio_id);
+	sketch_destroy(ctx->sketches[audio_id]);
+	ctx->sketches[audio_id] = NULL;
+	update_audio_ranges(ctx);
+
+	ao2_unlock(ctx);
+	ao2_ref(ctx, -1);
+
+	ast_log(LOG_DEBUG, "Deleted scan info. context[%s], uuid[%s], audio_id[%d]\n", context, uuid, audio_id);
+
+	return true;
+}
+
+/**
+ * Delete the given context's columns.
+ * @param context
+ * @return
+ */
+bool scan_delete_context(const char* context)
+{
+	scan_ctx_t* ctx;
+
+	if(context == NULL) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	/* the segment is released after the running searches are done */
+	ctx = ao2_find(g_scan_ctxs, context, OBJ_SEARCH_KEY | OBJ_UNLINK);
+	if(ctx == NULL) {
+		return false;
+	}
+	ao2_ref(ctx, -1);
+
+	return true;
+}
+
+/**
+ * Scan the given fingerprints against the context's all entries.
+ * The matching rule is same as the index engine's.
+ * @param context
+ * @param j_fprints
+ * @param coefs
+ * @param tolerance
+ * @param freq_ignore_low
+ * @param freq_ignore_high
+ * @param max_results: max number of the ranked results.
+ * @param deadline: the query observations after this are not searched. zero for no deadline.
+ * @param processed: ratio(0 ~ 1) of the searched query observations. NULL for ignore.
+ * @return [{"audio_uuid": <uuid>, "match_count": <count>, "offset": <frame offset>}, ...] sorted by the rank, NULL if not found.
+ */
+struct ast_json* scan_search(
+		const char* context,
+		struct ast_json* j_fprints,
+		const int coefs,
+		const double tolerance,
+		const int freq_ignore_low,
+		const int freq_ignore_high,
+		const int max_results,
+		const struct timeval deadline,
+		double* processed
+		)
+{
+	scan_ctx_t* ctx;
+	scan_search_t search;
+	vote_t* vote;
+	bool* excludes;
+	struct ast_json* j_res;
+
+	if((context == NULL) || (j_fprints == NULL) || (max_results < 1)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	if((coefs < 1) || (coefs > g_coefs)) {
+		ast_log(LOG_WARNING, "Wrong coefs count. max[%d], coefs[%d]\n", g_coefs, coefs);
+		return NULL;
+	}
+
+	ctx = get_scan_ctx(context);
+	if(ctx == NULL) {
+		ast_log(LOG_NOTICE, "Could not find scan info. context[%s]\n", context);
+		return NULL;
+	}
+
+	ao2_rdlock(ctx);
+	if(ctx->count == 0) {
+		ast_log(LOG_NOTICE, "Could not find scan info. context[%s]\n", context);
+		ao2_unlock(ctx);
+		ao2_ref(ctx, -1);
+		return NULL;
+	}
+
+	memset(&search, 0x00, sizeof(search));
+	search.ctx = ctx;
+	search.j_fprints = j_fprints;
+	search.coefs = coefs;
+	search.tolerance = tolerance;
+	search.freq_ignore_low = freq_ignore_low;
+	search.freq_ignore_high = freq_ignore_high;
+
+	/* skip the audios which can not match */
+	excludes = create_excludes(&search);
+	create_entry_ranges(&search, excludes);
+	vote = vote_run(ctx->reg.audio_size, ast_json_array_size(j_fprints), max_results, excludes, deadline, search_range, &search);
+	sfree(excludes);
+	sfree(search.ranges);
+
+	if(processed != NULL) {
+		*processed = vote_get_processed(vote);
+	}
+
+	/* get the top ranked audios */
+	j_res = vote_get_results(vote, ctx->reg.audios, max_results);
+	ao2_unlock(ctx);
+	ao2_ref(ctx, -1);
+
+	vote_destroy(vote);
+
+	return j_res;
+}
+
+/**
+ * Returns the audios to skip with the sketch prefilter.
+ * Must be called with the ctx's read lock.
+ * @param search
+ * @return audio_size items. true for the audio to skip.
+ */
+static bool* create_excludes(const scan_search_t* search)
+{
+	int i;
+	int j;
+	int count;
+	int skips;
+	bool* excludes;
+	double mins[DEF_SCAN_MAX_COEFS];
+	double maxs[DEF_SCAN_MAX_COEFS];
+	scan_query_t query;
+	sketch_query_t* sketch;
+	const scan_ctx_t* ctx;
+
+	ctx = search->ctx;
+	count = ast_json_array_size(search->j_fprints);
+
+	memset(&query, 0x00, sizeof(query));
+	sketch = sketch_query_create(count);
+	for(i = 0; i < count; i++) {
+		set_scan_query(&query, ast_json_array_get(search->j_fprints, i), search->coefs, search->tolerance, search->freq_ignore_low, search->freq_ignore_high);
+		if(query.valid == false) {
+			continue;
+		}
+
+		for(j = 0; j < query.dims; j++) {
+			mins[j] = query.min[j];
+			maxs[j] = query.max[j];
+		}
+
+		/* all coefs are checked in order, or the max1 only */
+		sketch_query_add(sketch, mins, maxs, (query.dims == g_coefs) ? g_coefs : 1);
+	}
+
+	skips = 0;
+	excludes = ast_calloc(ctx->reg.audio_size + 1, sizeof(bool));
+	for(i = 0; i < ctx->reg.audio_size; i++) {
+		if((ctx->reg.audios[i] == NULL) || (ctx->sketches[i] == NULL)) {
+			continue;
+		}
+
+		if(sketch_query_check(sketch, ctx->sketches[i]) == false) {
+			excludes[i] = true;
+			skips++;
+		}
+	}
+	sketch_query_destroy(sketch);
+	ast_log(LOG_DEBUG, "Prefiltered audios. context[%s], audios[%d], skips[%d]\n", ctx->reg.name, ctx->reg.audio_size, skips);
+
+	return excludes;
+}
+
+/**
+ * Create the sorted entry ranges of the not excluded audios.
+ * The adjacent ranges are merged.
+ * @param search
+ * @param excludes
+ * @return
+ */
+static bool create_entry_ranges(scan_search_t* search, const bool* excludes)
+{
+	int i;
+	int count;
+	const scan_ctx_t* ctx;
+	scan_range_t* ranges;
+
+	ctx = search->ctx;
+	ranges = ast_calloc(ctx->reg.audio_size + 1, sizeof(scan_range_t));
+	count = 0;
+	for(i = 0; i < ctx->reg.audio_size; i++) {
+		if((ctx->reg.audios[i] == NULL) || (ctx->audio_counts[i] == 0)) {
+			continue;
+		}
+		if((excludes != NULL) && (excludes[i] == true)) {
+			continue;
+		}
+
+		ranges[count].start = ctx->audio_starts[i];
+		ranges[count].end = ctx->audio_starts[i] + ctx->audio_counts[i];
+		count++;
+	}
+	qsort(ranges, count, sizeof(scan_range_t), compare_range);
+
+	/* merge the adjacent ranges */
+	search->range_count = 0;
+	for(i = 0; i < count; i++) {
+		if((search->range_count > 0) && (ranges[search->range_count - 1].end == ranges[i].start)) {
+			ranges[search->range_count - 1].end = ranges[i].end;
+			continue;
+		}
+		ranges[search->range_count] = ranges[i];
+		search->range_count++;
+	}
+	search->ranges = ranges;
+
+	return true;
+}
+
+static int compare_range(const void* a, const void* b)
+{
+	const scan_range_t* range_a;
+	const scan_range_t* range_b;
+
+	range_a = a;
+	range_b = b;
+	if(range_a->start < range_b->start) {
+		return -1;
+	}
+	if(range_a->start > range_b->start) {
+		return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Vote the query frames in [start, end).
+ * Compares the query block against each entry block, then votes in the query order.
+ * Runs on the worker thread for the split search. Must be called with the ctx's read lock.
+ * @param data: scan_search_t
+ * @param vote
+ * @param start
+ * @param end
+ */
+static void search_range(void* data, vote_t* vote, const int start, const int end)
+{
+	int i;
+	int j;
+	int base;
+	int r;
+	int entry;
+	int entry_end;
+	int block;
+	const scan_range_t* range;
+	const scan_search_t* search;
+	const scan_ctx_t* ctx;
+	scan_query_t* query;
+	scan_query_t queries[DEF_SCAN_QUERY_BLOCK];
+
+	search = data;
+	ctx = search->ctx;
+	memset(queries, 0x00, sizeof(queries));
+
+	for(base = start; base < end; base += DEF_SCAN_QUERY_BLOCK) {
+		block = MIN(DEF_SCAN_QUERY_BLOCK, end - base);
+		for(i = 0; i < block; i++) {
+			set_scan_query(&queries[i], ast_json_array_get(search->j_fprints, base + i), search->coefs, search->tolerance, search->freq_ignore_low, search->freq_ignore_high);
+		}
+
+		/* compare the query block against each entry block of the ranges */
+		for(r = 0; r < search->range_count; r++) {
+			range = &search->ranges[r];
+			for(entry = range->start; entry < range->end; entry += DEF_SCAN_ENTRY_BLOCK) {
+				entry_end = MIN(entry + DEF_SCAN_ENTRY_BLOCK, range->end);
+				for(i = 0; i < block; i++) {
+					query = &queries[i];
+					if(query->valid == false) {
+						continue;
+					}
+
+					if(query->hit_count + (entry_end - entry) > query->hit_size) {
+						query->hit_size = query->hit_count + (entry_end - entry);
+						query->hits = ast_realloc(query->hits, sizeof(int) * query->hit_size);
+					}
+					query->hit_count += g_scan_block(ctx, query, entry, entry_end, query->hits + query->hit_count);
+				}
+			}
+		}
+
+		/* vote in the query order */
+		for(i = 0; i < block; i++) {
+			query = &queries[i];
+			if(vote_next(vote, base + i, query->frame_idx) == false) {
+				break;
+			}
+			for(j = 0; j < query->hit_count; j++) {
+				vote_add(vote, ctx->audio_ids[query->hits[j]], ctx->frame_idxs[query->hits[j]]);
+			}
+		}
+		if(vote_is_expired(vote) == true) {
+			break;
+		}
+	}
+
+	for(i = 0; i < DEF_SCAN_QUERY_BLOCK; i++) {
+		sfree(queries[i].hits);
+	}
+}
+
+/**
+ * ao2 destructor of the scan ctx.
+ * @param obj
+ */
+static void destroy_scan_ctx(void* obj)
+{
+	int i;
+	scan_ctx_t* ctx;
+
+	ctx = obj;
+
+	for(i = 0; i < ctx->reg.audio_size; i++) {
+		sketch_destroy(ctx->sketches[i]);
+	}
+	sfree(ctx->sketches);
+	sfree(ctx->audio_starts);
+	sfree(ctx->audio_counts);
+
+	for(i = 0; i < DEF_SCAN_MAX_COEFS; i++) {
+		sfree(ctx->cols[i]);
+	}
+	sfree(ctx->audio_ids);
+	sfree(ctx->frame_idxs);
+	registry_ctx_clear(&ctx->reg);
+}
+
+/**
+ * Returns the scan ctx of the given context name.
+ * The returned ctx is reference counted. Need to unref after use.
+ * @param name
+ * @return
+ */
+static scan_ctx_t* get_scan_ctx(const char* name)
+{
+	return ao2_find(g_scan_ctxs, name, OBJ_SEARCH_KEY);
+}
+
+/**
+ * Update the entry range of each audio. The entries of each audio are in one range.
+ * Must be called with the ctx's write lock.
+ * @param ctx
+ */
+static void update_audio_ranges(scan_ctx_t* ctx)
+{
+	int i;
+	int audio_id;
+
+	for(i = 0; i < ctx->reg.audio_size; i++) {
+		ctx->audio_starts[i] = 0;
+		ctx->audio_counts[i] = 0;
+	}
+
+	for(i = 0; i < ctx->count; i++) {
+		audio_id = ctx->audio_ids[i];
+		if(ctx->audio_counts[audio_id] == 0) {
+			ctx->audio_starts[audio_id] = i;
+		}
+		ctx->audio_counts[audio_id]++;
+	}
+}
+
+/**
+ * Set the query's search box with the given query frame.
+ * The max1 is always checked. The other coefs are checked if they are in the frequency range.
+ * Keeps the query's hit buffer and resets the hit count.
+ * @return
+ */
+static bool set_scan_query(scan_query_t* query, struct ast_json* j_fprint, const int coefs, const double tolerance, const int freq_ignore_low, const int freq_ignore_high)
+{
+	int j;
+	double freq;
+	double freq_low;
+	double freq_high;
+	char col_max[10];
+
+	query->valid = false;
+	query->frame_idx = 0;
+	query->dims = 0;
+	query->hit_count = 0;
+	if(j_fprint == NULL) {
+		return false;
+	}
+	query->frame_idx = ast_json_integer_get(ast_json_object_get(j_fprint, "frame_idx"));
+
+	freq_low = (freq_ignore_low > 0) ? 10 * log10(freq_ignore_low) : 0;
+	freq_high = (freq_ignore_high > 0) ? 10 * log10(freq_ignore_high) : 0;
+
+	for(j = 0; j < coefs; j++) {
+		snprintf(col_max, sizeof(col_max), "max%d", j + 1);
+		freq = ast_json_real_get(ast_json_object_get(j_fprint, col_max));
+		if(j == 0) {
+			freq = (int)freq;
+		}
+
+		/* validate frequency range */
+		if(((freq_ignore_low > 0) && (freq < freq_low)) || ((freq_ignore_high > 0) && (freq > freq_high))) {
+			if(j == 0) {
+				/* ignore the frame */
+				return false;
+			}
+			continue;
+		}
+
+		query->dim_idxs[query->dims] = j;
+		query->min[query->dims] = freq - tolerance;
+		query->max[query->dims] = freq + tolerance;
+		query->dims++;
+	}
+	query->valid = true;
+
+	return true;
+}
+
+static int scan_block_scalar(const scan_ctx_t* ctx, const scan_query_t* query, int start, int end, int* hits)
+{
+	int i;
+	int d;
+	int count;
+	float val;
+
+	count = 0;
+	for(i = start; i < end; i++) {
+		for(d = 0; d < query->dims; d++) {
+			val = ctx->cols[query->dim_idxs[d]][i];
+			if((val < query->min[d]) || (val > query->max[d])) {
+				break;
+			}
+		}
+		if(d == query->dims) {
+			hits[count] = i;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+#ifdef SCAN_X86
+/**
+ * Compares 8 entries at once.
+ * The mask of each block is kept in the register until all coefs are checked.
+ */
+__attribute__((target("avx2")))
+static int scan_block_avx2(const scan_ctx_t* ctx, const scan_query_t* query, int start, int end, int* hits)
+{
+	int i;
+	int d;
+	int count;
+	int bits;
+	__m256 vals;
+	__m256 mask;
+	__m256 mins[DEF_SCAN_MAX_COEFS];
+	__m256 maxs[DEF_SCAN_MAX_COEFS];
+	const float* cols[DEF_SCAN_MAX_COEFS];
+
+	for(d = 0; d < query->dims; d++) {
+		mins[d] = _mm256_set1_ps(query->min[d]);
+		maxs[d] = _mm256_set1_ps(query->max[d]);
+		cols[d] = ctx->cols[query->dim_idxs[d]];
+	}
+
+	count = 0;
+	for(i = start; i + 8 <= end; i += 8) {
+		vals = _mm256_loadu_ps(cols[0] + i);
+		mask = _mm256_and_ps(_mm256_cmp_ps(vals, mins[0], _CMP_GE_OQ), _mm256_cmp_ps(vals, maxs[0], _CMP_LE_OQ));
+		for(d = 1; d < query->dims; d++) {
+			if(_mm256_testz_ps(mask, mask)) {
+				break;
+			}
+			vals = _mm256_loadu_ps(cols[d] + i);
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(vals, mins[d], _CMP_GE_OQ));
+			mask = _mm256_and_ps(mask, _mm256_cmp_ps(vals, maxs[d], _CMP_LE_OQ));
+		}
+
+		bits = _mm256_movemask_ps(mask);
+		while(bits != 0) {
+			hits[count] = i + __builtin_ctz(bits);
+			count++;
+			bits &= bits - 1;
+		}
+	}
+
+	/* rest of the entries */
+	count += scan_block_scalar(ctx, query, i, end, hits + count);
+
+	return count;
+}
+#endif
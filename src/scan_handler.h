@@ -0,0 +1,35 @@
+/*
+ * scan_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_SCAN_HANDLER_H_
+#define SRC_SCAN_HANDLER_H_
+
+#include <asterisk/json.h>
+
+#include <stdbool.h>
+#include <sys/time.h>
+
+bool scan_init(const int coefs);
+bool scan_term(void);
+
+bool scan_add_audio(const char* context, const char* uuid, struct ast_json* j_fprints);
+bool scan_delete_audio(const char* context, const char* uuid);
+bool scan_delete_context(const char* context);
+
+struct ast_json* scan_search(
+		const char* context,
+		struct ast_json* j_fprints,
+		const int coefs,
+		const double tolerance,
+		const int freq_ignore_low,
+		const int freq_ignore_high,
+		const int max_results,
+		const struct timeval deadline,
+		double* processed
+		);
+
+#endif /* SRC_SCAN_HANDLER_H_ */
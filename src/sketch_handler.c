@@ -0,0 +1,362 @@
+/*
+ * sketch_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Per reference sketch prefilter.
+ *  Each reference(audio) keeps the bloom filter of its quantized frame codes.
+ *  The frame code is the quantized max1, and the quantized max1 ~ maxN.
+ *
+ *  Before the frame level voting, the query frames' codes are checked against
+ *  each reference's sketch. The query frame can match to the reference only
+ *  if one of its codes is in the sketch(the bloom filter has no false negative).
+ *  The reference which has too few matchable frames is skipped by the search.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#include "sketch_handler.h"
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+#define DEF_SKETCH_STEP			0.5		// quantization step of the coefs
+#define DEF_SKETCH_BITS_PER_CODE	10		// about 1% false positive with 4 hashes
+#define DEF_SKETCH_HASHES		4
+#define DEF_SKETCH_MIN_BITS		64
+#define DEF_SKETCH_MAX_DIMS		8
+#define DEF_SKETCH_MAX_CODES	16		// max codes of each query frame. wider frame is not filtered.
+
+struct _sketch_t {
+	int dims;			///< coefs of the reference frame
+	uint32_t mask;		///< bit count - 1
+	uint64_t* bits;
+};
+
+struct _sketch_query_t {
+	int count;			///< query frames
+	int unbounded;		///< frames which can not be filtered. always matchable.
+
+	/* codes of each frame. frame i has codes[starts[i]] ~ codes[starts[i + 1] - 1]. */
+	int frame_count;
+	int* starts;
+	int* dims;
+	int code_count;
+	int code_size;
+	uint64_t* codes;
+};
+
+static double g_threshold = 0;	///< min ratio of the matchable query frames
+
+static uint64_t get_code(const int64_t* bins, const int dims);
+static uint64_t mix(uint64_t key);
+static void add_bloom(sketch_t* sketch, const uint64_t code);
+static bool check_bloom(const sketch_t* sketch, const uint64_t code);
+
+/**
+ * Initiate the sketch prefilter.
+ * @param threshold: min ratio(0 ~ 1) of the query frames which can match to the reference.
+ * The reference under the threshold is skipped. 0 skips only the references which can not match at all.
+ * @return
+ */
+bool sketch_init(const double threshold)
+{
+	if((threshold < 0) || (threshold > 1)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	g_threshold = threshold;
+	ast_log(LOG_VERBOSE, "Initiated sketch prefilter. threshold[%f]\n", threshold);
+
+	return true;
+}
+
+/**
+ * Create the reference's sketch.
+ * @param count: frame count of the reference.
+ * @param dims: coefs of each frame.
+ * @return
+ */
+sketch_t* sketch_create(const int count, const int dims)
+{
+	uint32_t bits;
+	sketch_t* sketch;
+
+	if((count < 0) || (dims < 1) || (dims > DEF_SKETCH_MAX_DIMS)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	/* 2 codes for each frame */
+	bits = DEF_SKETCH_MIN_BITS;
+	while(bits < (uint32_t)count * 2 * DEF_SKETCH_BITS_PER_CODE) {
+		bits <<= 1;
+	}
+
+	sketch = ast_calloc(1, sizeof(sketch_t));
+	sketch->dims = dims;
+	sketch->mask = bits - 1;
+	sketch->bits = ast_calloc(bits / 64, sizeof(uint64_t));
+
+	return sketch;
+}
+
+void sketch_destroy(sketch_t* sketch)
+{
+	if(sketch == NULL) {
+		return;
+	}
+
+	sfree(sketch->bits);
+	sfree(sketch);
+}
+
+/**
+ * Add the reference frame.
+ * @param sketch
+ * @param vals: max1 ~ maxN. sketch's dims values.
+ */
+void sketch_add(sketch_t* sketch, const float* vals)
+{
+	int i;
+	int64_t bins[DEF_SKETCH_MAX_DIMS];
+
+	for(i = 0; i < sketch->dims; i++) {
+		bins[i] = (int64_t)floor(vals[i] / DEF_SKETCH_STEP);
+	}
+
+	add_bloom(sketch, get_code(bins, 1));
+	if(sketch->dims > 1) {
+		add_bloom(sketch, get_code(bins, sketch->dims));
+	}
+}
+
+/**
+ * Create the query sketch.
+ * @param count: expected query frame count.
+ * @return
+ */
+sketch_query_t* sketch_query_create(const int count)
+{
+	sketch_query_t* query;
+
+	query = ast_calloc(1, sizeof(sketch_query_t));
+	query->frame_count = MAX(count, 1);
+	query->starts = ast_calloc(query->frame_count + 1, sizeof(int));
+	query->dims = ast_calloc(query->frame_count, sizeof(int));
+	query->code_size = query->frame_count * 2;
+	query->codes = ast_calloc(query->code_size, sizeof(uint64_t));
+
+	return query;
+}
+
+void sketch_query_destroy(sketch_query_t* query)
+{
+	if(query == NULL) {
+		return;
+	}
+
+	sfree(query->starts);
+	sfree(query->dims);
+	sfree(query->codes);
+	sfree(query);
+}
+
+/**
+ * Add the query frame's search box.
+ * The dims should be 1(max1 only) or the references' dims(all coefs).
+ * @param query
+ * @param mins
+ * @param maxs
+ * @param dims
+ */
+void sketch_query_add(sketch_query_t* query, const double* mins, const double* maxs, const int dims)
+{
+	int i;
+	int combos;
+	int64_t width;
+	int64_t los[DEF_SKETCH_MAX_DIMS];
+	int64_t his[DEF_SKETCH_MAX_DIMS];
+	int64_t bins[DEF_SKETCH_MAX_DIMS];
+
+	if(query->count >= query->frame_count) {
+		query->frame_count *= 2;
+		query->starts = ast_realloc(query->starts, sizeof(int) * (query->frame_count + 1));
+		query->dims = ast_realloc(query->dims, sizeof(int) * query->frame_count);
+	}
+
+	/* count the codes of the box. the too wide(or broken) side makes the frame unbounded before the multiply. */
+	combos = 1;
+	for(i = 0; (i < dims) && (i < DEF_SKETCH_MAX_DIMS); i++) {
+		if((isfinite(mins[i]) == 0) || (isfinite(maxs[i]) == 0)
+				|| (maxs[i] < mins[i])
+				|| ((maxs[i] - mins[i]) / DEF_SKETCH_STEP > DEF_SKETCH_MAX_CODES)
+				) {
+			combos = DEF_SKETCH_MAX_CODES + 1;
+			break;
+		}
+		los[i] = (int64_t)floor(mins[i] / DEF_SKETCH_STEP);
+		his[i] = (int64_t)floor(maxs[i] / DEF_SKETCH_STEP);
+		width = his[i] - los[i] + 1;
+		if((width < 1) || (width > DEF_SKETCH_MAX_CODES)) {
+			combos = DEF_SKETCH_MAX_CODES + 1;
+			break;
+		}
+		combos *= (int)width;
+		if(combos > DEF_SKETCH_MAX_CODES) {
+			break;
+		}
+	}
+
+	query->starts[query->count] = query->code_count;
+	query->dims[query->count] = dims;
+	query->count++;
+	if((dims > DEF_SKETCH_MAX_DIMS) || (combos > DEF_SKETCH_MAX_CODES)) {
+		/* too wide. can not be filtered. */
+		query->unbounded++;
+		query->dims[query->count - 1] = 0;
+		query->starts[query->count] = query->code_count;
+		return;
+	}
+
+	if(query->code_count + combos > query->code_size) {
+		query->code_size = MAX(query->code_size * 2, query->code_count + combos);
+		query->codes = ast_realloc(query->codes, sizeof(uint64_t) * query->code_size);
+	}
+
+	/* all of the bin combinations in the box */
+	memcpy(bins, los, sizeof(int64_t) * dims);
+	while(1) {
+		query->codes[query->code_count] = get_code(bins, dims);
+		query->code_count++;
+
+		for(i = 0; i < dims; i++) {
+			if(bins[i] < his[i]) {
+				bins[i]++;
+				break;
+			}
+			bins[i] = los[i];
+		}
+		if(i == dims) {
+			break;
+		}
+	}
+	query->starts[query->count] = query->code_count;
+}
+
+/**
+ * Returns true if the reference has enough matchable query frames.
+ * @param query
+ * @param sketch
+ * @return
+ */
+bool sketch_query_check(const sketch_query_t* query, const sketch_t* sketch)
+{
+	int i;
+	int j;
+	int hits;
+	int need;
+
+	if((query == NULL) || (sketch == NULL) || (query->count == 0)) {
+		return true;
+	}
+
+	need = (int)ceil(g_threshold * query->count);
+	if(need < 1) {
+		need = 1;
+	}
+
+	hits = query->unbounded;
+	for(i = 0; (i < query->count) && (hits < need); i++) {
+		if(query->dims[i] == 0) {
+			/* counted already */
+			continue;
+		}
+
+		if((query->dims[i] != 1) && (query->dims[i] != sketch->dims)) {
+			/* the sketch does not have the codes of this dims */
+			hits++;
+			continue;
+		}
+
+		for(j = query->starts[i]; j < query->starts[i + 1]; j++) {
+			if(check_bloom(sketch, query->codes[j]) == true) {
+				hits++;
+				break;
+			}
+		}
+	}
+
+	return (hits >= need) ? true : false;
+}
+
+static uint64_t get_code(const int64_t* bins, const int dims)
+{
+	int i;
+	uint64_t code;
+
+	code = mix((uint64_t)dims);
+	for(i = 0; i < dims; i++) {
+		code = mix(code ^ (uint64_t)bins[i]);
+	}
+
+	return code;
+}
+
+/**
+ * murmur3 64bit finalizer
+ */
+static uint64_t mix(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+
+	return key;
+}
+
+static void add_bloom(sketch_t* sketch, const uint64_t code)
+{
+	int i;
+	uint32_t h1;
+	uint32_t h2;
+	uint32_t idx;
+
+	h1 = (uint32_t)code;
+	h2 = (uint32_t)(code >> 32) | 1;
+	for(i = 0; i < DEF_SKETCH_HASHES; i++) {
+		idx = (h1 + i * h2) & sketch->mask;
+		sketch->bits[idx >> 6] |= (uint64_t)1 << (idx & 63);
+	}
+}
+
+static bool check_bloom(const sketch_t* sketch, const uint64_t code)
+{
+	int i;
+	uint32_t h1;
+	uint32_t h2;
+	uint32_t idx;
+
+	h1 = (uint32_t)code;
+	h2 = (uint32_t)(code >> 32) | 1;
+	for(i = 0; i < DEF_SKETCH_HASHES; i++) {
+		idx = (h1 + i * h2) & sketch->mask;
+		if((sketch->bits[idx >> 6] & ((uint64_t)1 << (idx & 63))) == 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
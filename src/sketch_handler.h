@@ -0,0 +1,27 @@
+/*
+ * sketch_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_SKETCH_HANDLER_H_
+#define SRC_SKETCH_HANDLER_H_
+
+#include <stdbool.h>
+
+typedef struct _sketch_t sketch_t;
+typedef struct _sketch_query_t sketch_query_t;
+
+bool sketch_init(const double threshold);
+
+sketch_t* sketch_create(const int count, const int dims);
+void sketch_destroy(sketch_t* sketch);
+void sketch_add(sketch_t* sketch, const float* vals);
+
+sketch_query_t* sketch_query_create(const int count);
+void sketch_query_destroy(sketch_query_t* query);
+void sketch_query_add(sketch_query_t* query, const double* mins, const double* maxs, const int dims);
+bool sketch_query_check(const sketch_query_t* query, const sketch_t* sketch);
+
+#endif /* SRC_SKETCH_HANDLER_H_ */
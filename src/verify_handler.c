@@ -0,0 +1,285 @@
+/*
+ * verify_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Second stage of the search.
+ *  The coarse vote gives the top candidates and their time offsets. Each candidate's
+ *  reference frames around the offset are aligned to the query frames with the
+ *  banded dynamic time warping, and the candidates are ranked by the alignment cost
+ *  (mean frame distance of the best warping path).
+ *
+ *  The alignment runs only on the few candidates, so the coarse stage can use the
+ *  loose tolerance for the recall.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/json.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "verify_handler.h"
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+#define DEF_VERIFY_BAND			8		// max frames of the warping from the coarse offset
+#define DEF_VERIFY_MIN_FRAMES	8		// min overlapped frames to verify
+
+typedef struct _verify_rank_t {
+	int idx;		///< coarse rank
+	double cost;	///< alignment cost. negative if not verified.
+} verify_rank_t;
+
+static int g_candidates = 0;		///< coarse candidates to verify. 0 disables the verification.
+static double g_threshold = 0;		///< max alignment cost of the confirmed candidate. 0 confirms all.
+
+static double get_cost(const float* query, const int query_count, const float* frames, const bool* exists, const int dims);
+static double get_distance(const float* a, const float* b, const int dims);
+static int compare_rank(const void* a, const void* b);
+
+/**
+ * Initiate the verification.
+ * @param candidates: top candidates of the coarse vote to verify. 0 disables the verification.
+ * @param threshold: max alignment cost of the confirmed candidate. 0 confirms all of the verified candidates.
+ * @return
+ */
+bool verify_init(const int candidates, const double threshold)
+{
+	if((candidates < 0) || (threshold < 0)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	g_candidates = candidates;
+	g_threshold = threshold;
+	ast_log(LOG_VERBOSE, "Initiated search verification. candidates[%d], threshold[%f]\n", candidates, threshold);
+
+	return true;
+}
+
+/**
+ * Returns the number of the coarse candidates to verify.
+ * 0 if the verification is disabled.
+ */
+int verify_get_candidates(void)
+{
+	return g_candidates;
+}
+
+/**
+ * Verify the coarse candidates and rank them with the alignment cost.
+ * Sets the "verify_cost" of the verified candidate. The candidate which could not
+ * be verified(too few overlapped frames) is ranked after the verified ones.
+ * If the threshold is set, the unconfirmed candidates are dropped.
+ * @param j_search: coarse candidates. [{"audio_uuid": <uuid>, "match_count": <count>, "offset": <frame offset>}, ...]
+ * @param query: query frames. dims values for each frame.
+ * @param query_count
+ * @param dims
+ * @param fn: reference frame loader.
+ * @param data: fn's data.
+ * @param max_results
+ * @return ranked candidates. Need to unref after use.
+ */
+struct ast_json* verify_rank(
+		struct ast_json* j_search,
+		const float* query,
+		const int query_count,
+		const int dims,
+		verify_load_fn fn,
+		void* data,
+		const int max_results
+		)
+{
+	int i;
+	int ret;
+	int count;
+	int offset;
+	int frame_count;
+	float* frames;
+	bool* exists;
+	const char* uuid;
+	verify_rank_t* ranks;
+	struct ast_json* j_cand;
+	struct ast_json* j_res;
+
+	if((j_search == NULL) || (query == NULL) || (fn == NULL) || (dims < 1) || (max_results < 1)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	count = ast_json_array_size(j_search);
+	ranks = ast_calloc(count + 1, sizeof(verify_rank_t));
+
+	/* reference frames of the coarse offset with the band of the both sides */
+	frame_count = query_count + (DEF_VERIFY_BAND * 2);
+	frames = ast_calloc(frame_count, sizeof(float) * dims);
+	exists = ast_calloc(frame_count, sizeof(bool));
+
+	for(i = 0; i < count; i++) {
+		j_cand = ast_json_array_get(j_search, i);
+		uuid = ast_json_string_get(ast_json_object_get(j_cand, "audio_uuid"));
+		offset = ast_json_integer_get(ast_json_object_get(j_cand, "offset"));
+
+		ranks[i].idx = i;
+		ranks[i].cost = -1;
+		if(uuid == NULL) {
+			continue;
+		}
+
+		memset(exists, 0x00, sizeof(bool) * frame_count);
+		ret = fn(data, uuid, offset - DEF_VERIFY_BAND, frame_count, frames, exists);
+		if(ret == false) {
+			ast_log(LOG_NOTICE, "Could not load the candidate's frames. uuid[%s]\n", uuid);
+			continue;
+		}
+
+		ranks[i].cost = get_cost(query, query_count, frames, exists, dims);
+		ast_log(LOG_DEBUG, "Verified the candidate. uuid[%s], offset[%d], match_count[%d], cost[%f]\n",
+				uuid, offset, (int)ast_json_integer_get(ast_json_object_get(j_cand, "match_count")), ranks[i].cost);
+	}
+	sfree(frames);
+	sfree(exists);
+
+	/* rank with the cost. keeps the coarse rank of the same costs. */
+	qsort(ranks, count, sizeof(verify_rank_t), compare_rank);
+
+	j_res = ast_json_array_create();
+	for(i = 0; i < count; i++) {
+		if(ast_json_array_size(j_res) >= max_results) {
+			break;
+		}
+
+		if((g_threshold > 0) && ((ranks[i].cost < 0) || (ranks[i].cost > g_threshold))) {
+			continue;
+		}
+
+		j_cand = ast_json_deep_copy(ast_json_array_get(j_search, ranks[i].idx));
+		if(ranks[i].cost >= 0) {
+			ast_json_object_set(j_cand, "verify_cost", ast_json_real_create(ranks[i].cost));
+		}
+		ast_json_array_append(j_res, j_cand);
+	}
+	sfree(ranks);
+
+	return j_res;
+}
+
+/**
+ * Returns the banded dtw cost of the query and the reference frames.
+ * The query frame i is expected to be aligned to the frames[i + DEF_VERIFY_BAND].
+ * The path starts and ends anywhere in the band, and the query frames
+ * which have no reference frame on the diagonal are not aligned.
+ * @param query
+ * @param query_count
+ * @param frames: query_count + DEF_VERIFY_BAND * 2 frames.
+ * @param exists
+ * @param dims
+ * @return mean frame distance of the best path. -1 if it could not be aligned.
+ */
+static double get_cost(const float* query, const int query_count, const float* frames, const bool* exists, const int dims)
+{
+	int i;
+	int j;
+	int k;
+	int start;
+	int end;
+	double dist;
+	double best;
+	double prev[DEF_VERIFY_BAND * 2 + 1];
+	double cur[DEF_VERIFY_BAND * 2 + 1];
+
+	/* overlapped query frames */
+	start = 0;
+	while((start < query_count) && (exists[start + DEF_VERIFY_BAND] == false)) {
+		start++;
+	}
+	end = query_count;
+	while((end > start) && (exists[end - 1 + DEF_VERIFY_BAND] == false)) {
+		end--;
+	}
+	if(end - start < DEF_VERIFY_MIN_FRAMES) {
+		return -1;
+	}
+
+	/* the cell k of the row i is the reference frame (i + k). the diagonal is k == DEF_VERIFY_BAND. */
+	for(i = start; i < end; i++) {
+		for(k = 0; k <= DEF_VERIFY_BAND * 2; k++) {
+			j = i + k;
+			dist = (exists[j] == true) ? get_distance(&query[i * dims], &frames[j * dims], dims) : INFINITY;
+
+			if(i == start) {
+				cur[k] = dist;
+				continue;
+			}
+
+			best = prev[k];
+			if((k < DEF_VERIFY_BAND * 2) && (prev[k + 1] < best)) {
+				best = prev[k + 1];
+			}
+			if((k > 0) && (cur[k - 1] < best)) {
+				best = cur[k - 1];
+			}
+			cur[k] = dist + best;
+		}
+		memcpy(prev, cur, sizeof(prev));
+	}
+
+	best = INFINITY;
+	for(k = 0; k <= DEF_VERIFY_BAND * 2; k++) {
+		if(prev[k] < best) {
+			best = prev[k];
+		}
+	}
+	if(isfinite(best) == 0) {
+		return -1;
+	}
+
+	return best / (end - start);
+}
+
+/**
+ * Returns the euclidean distance of the frames.
+ * The non-finite coefs(i.e. log of the silence) are not compared.
+ */
+static double get_distance(const float* a, const float* b, const int dims)
+{
+	int i;
+	double diff;
+	double dist;
+
+	dist = 0;
+	for(i = 0; i < dims; i++) {
+		diff = a[i] - b[i];
+		if(isfinite(diff) == 0) {
+			continue;
+		}
+		dist += diff * diff;
+	}
+
+	return sqrt(dist);
+}
+
+static int compare_rank(const void* a, const void* b)
+{
+	const verify_rank_t* rank_a = a;
+	const verify_rank_t* rank_b = b;
+
+	/* not verified one is the last */
+	if((rank_a->cost < 0) != (rank_b->cost < 0)) {
+		return (rank_a->cost < 0) ? 1 : -1;
+	}
+
+	if((rank_a->cost >= 0) && (rank_a->cost != rank_b->cost)) {
+		return (rank_a->cost < rank_b->cost) ? -1 : 1;
+	}
+
+	return rank_a->idx - rank_b->idx;
+}
@@ -0,0 +1,35 @@
+/*
+ * verify_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_VERIFY_HANDLER_H_
+#define SRC_VERIFY_HANDLER_H_
+
+#include <asterisk/json.h>
+
+#include <stdbool.h>
+
+/**
+ * Loads the candidate's reference frames [start, start + count) in frame order.
+ * The frames[i * dims] ~ frames[i * dims + dims - 1] are the frame (start + i).
+ * The exists[i] must be false if the frame (start + i) is not exist.
+ */
+typedef bool (*verify_load_fn)(void* data, const char* uuid, const int start, const int count, float* frames, bool* exists);
+
+bool verify_init(const int candidates, const double threshold);
+int verify_get_candidates(void);
+
+struct ast_json* verify_rank(
+		struct ast_json* j_search,
+		const float* query,
+		const int query_count,
+		const int dims,
+		verify_load_fn fn,
+		void* data,
+		const int max_results
+		);
+
+#endif /* SRC_VERIFY_HANDLER_H_ */
@@ -0,0 +1,905 @@
+/*
+ * vote_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Time offset consistent voting.
+ *  Each matched reference frame votes to the (audio, reference frame - query frame) bin.
+ *  The score of the audio is the count of its peak bin, so the random matches
+ *  spread over the long reference do not pile up.
+ *
+ *  The search keeps the exact scores of the top ranks(i.e. the max results of the search).
+ *  The audio which can not reach the lowest score of the current top ranks with the
+ *  remaining query observations can not be ranked anymore, so it is pruned and its votes
+ *  are not counted anymore. The scores of the ranked audios are never cut short.
+ *
+ *  The long query can be split into the parts and voted on the worker threads.
+ *  Each part votes into its own vote table without the pruning(the part does not
+ *  know the other parts' votes), and the tables are merged at the end.
+ *
+ *  The search can be given the deadline. The observations after the deadline are
+ *  not voted, and the votes so far are ranked as the partial result.
+ *
+ *  The vote table can be a sliding window of the observations(i.e. the monitor).
+ *  The voted slots of each observation are logged, and the votes of the observation
+ *  out of the window are expired. The expired slot is kept as the tombstone until the
+ *  table is resized. The peaks of the expired audios are recomputed before the ranking.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/json.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vote_handler.h"
+#include "worker_handler.h"
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+#define DEF_VOTE_BIN_WIDTH		2		// frames of each offset bin
+#define DEF_VOTE_SLOT_SIZE		1024	// initial hash table size. should be power of 2.
+#define DEF_VOTE_CACHE_LINE		64		// the vote tables of the parts do not share the cache line.
+#define DEF_VOTE_DEADLINE_STEP	16		// observations between the deadline checks
+
+typedef struct _vote_slot_t {
+	uint64_t key;	///< audio id << 32 | offset bin
+	int count;		///< 0 for the empty or the expired slot
+	int stamp;		///< last voted observation. 0 for the empty slot.
+} vote_slot_t;
+
+typedef struct _vote_log_t {
+	uint64_t* keys;	///< voted slots of the observation
+	int count;
+	int size;
+} vote_log_t;
+
+struct _vote_t {
+	void* mem;		///< allocated memory of the vote table
+	int audio_size;
+	bool pruning;	///< false for the part of the split search
+
+	int count;		///< total query observations
+	int remains;	///< query observations not voted yet except the current one
+	int stamp;		///< current observation
+	int frame_idx;	///< current observation's query frame
+
+	struct timeval deadline;	///< zero for no deadline
+	int processed;	///< voted observations
+	bool expired;	///< the deadline has passed
+
+	/* offset histogram. open addressing hash table. */
+	int slot_size;
+	int slot_count;
+	vote_slot_t* slots;
+	void* slots_mem;
+
+	/* per audio */
+	int* scores;	///< peak bin count
+	int* offsets;	///< peak bin
+	bool* pruned;
+	void* audios_mem;
+
+	/* current top ranks. the audios out of these can be pruned. */
+	int ranks;		///< number of the ranks to keep exact
+	int* rank_ids;	///< audio ids of the current top ranks
+	int rank_count;
+	int threshold;	///< lowest score of the top ranks. 0 until the ranks are filled.
+
+	/* sliding window. 0 window keeps all of the votes. */
+	int window;			///< observations kept voted
+	vote_log_t* logs;	///< voted slots of the last window observations
+	bool* dirty;		///< the audio's peak has been expired. need to recompute.
+	int dirty_count;
+} __attribute__((aligned(DEF_VOTE_CACHE_LINE)));
+
+typedef struct _vote_part_t {
+	vote_range_fn fn;
+	void* data;
+
+	int count;		///< total query observations
+	int parts;
+	vote_t** votes;	///< vote table of each part
+} vote_part_t;
+
+static vote_slot_t* get_slot(vote_t* vote, uint64_t key);
+static bool resize_slots(vote_t* vote);
+static uint32_t get_slot_idx(uint64_t key, int slot_size);
+static int get_bin(int offset);
+static bool is_ranked_higher(const vote_t* vote, const int a, const int b);
+static void sift_down_rank(const vote_t* vote, int* heap, int size, int idx);
+static void* calloc_aligned(size_t size, void** mem);
+static vote_t* create_vote(const int audio_size, const int count, const int ranks, const bool pruning, const struct timeval deadline);
+static void update_ranks(vote_t* vote, const int audio_id);
+static void merge_vote(vote_t* vote, const vote_t* part);
+static void run_part(void* data, const int idx);
+static void set_excludes(vote_t* vote, const bool* excludes);
+static void add_log(vote_t* vote, const uint64_t key);
+static void expire_log(vote_t* vote, vote_log_t* log);
+
+/**
+ * Create the vote table.
+ * @param audio_size: max audio id + 1
+ * @param count: total number of the query observations(frames or landmarks).
+ * @param ranks: number of the top ranks to keep the exact scores. Usually the max results of the search.
+ * @param excludes: audios to skip(i.e. filtered by the prefilter). audio_size items. NULL for none.
+ * @param deadline: the observations after this are not voted. zero for no deadline.
+ * @return
+ */
+vote_t* vote_create(const int audio_size, const int count, const int ranks, const bool* excludes, const struct timeval deadline)
+{
+	vote_t* vote;
+
+	if((audio_size < 0) || (ranks < 1)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	vote = create_vote(audio_size, count, ranks, true, deadline);
+	set_excludes(vote, excludes);
+
+	return vote;
+}
+
+void vote_destroy(vote_t* vote)
+{
+	int i;
+	void* mem;
+
+	if(vote == NULL) {
+		return;
+	}
+
+	for(i = 0; (vote->logs != NULL) && (i < vote->window); i++) {
+		sfree(vote->logs[i].keys);
+	}
+	sfree(vote->logs);
+	sfree(vote->dirty);
+
+	sfree(vote->slots_mem);
+	sfree(vote->audios_mem);
+	sfree(vote->rank_ids);
+	mem = vote->mem;
+	sfree(mem);
+}
+
+/**
+ * Vote the query observations with the given range function.
+ * If the query is long enough, splits the observations into the parts
+ * and runs the parts on the worker threads. Otherwise runs in the caller thread.
+ * @param audio_size: max audio id + 1
+ * @param count: total number of the query observations.
+ * @param ranks: number of the top ranks to keep the exact scores. Usually the max results of the search.
+ * @param excludes: audios to skip(i.e. filtered by the prefilter). audio_size items. NULL for none.
+ * @param deadline: the observations after this are not voted. zero for no deadline.
+ * @param fn
+ * @param data: fn's data. Shared by the parts, so should not be changed by the fn.
+ * @return voted table. Need to destroy after use.
+ */
+vote_t* vote_run(const int audio_size, const int count, const int ranks, const bool* excludes, const struct timeval deadline, vote_range_fn fn, void* data)
+{
+	int i;
+	int parts;
+	vote_t* vote;
+	vote_part_t part;
+
+	if((audio_size < 0) || (ranks < 1) || (fn == NULL)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	parts = worker_get_parts(count);
+	if(parts <= 1) {
+		vote = create_vote(audio_size, count, ranks, true, deadline);
+		set_excludes(vote, excludes);
+		fn(data, vote, 0, count);
+		return vote;
+	}
+
+	part.fn = fn;
+	part.data = data;
+	part.count = count;
+	part.parts = parts;
+	part.votes = ast_calloc(parts, sizeof(vote_t*));
+	for(i = 0; i < parts; i++) {
+		part.votes[i] = create_vote(audio_size, count, ranks, false, deadline);
+		set_excludes(part.votes[i], excludes);
+	}
+
+	worker_run(run_part, &part, parts);
+
+	/* merge in the part order */
+	vote = create_vote(audio_size, count, ranks, false, deadline);
+	for(i = 0; i < parts; i++) {
+		merge_vote(vote, part.votes[i]);
+		vote_destroy(part.votes[i]);
+	}
+	sfree(part.votes);
+	ast_log(LOG_DEBUG, "Voted with the split search. count[%d], parts[%d], processed[%d]\n", count, parts, vote->processed);
+
+	return vote;
+}
+
+/**
+ * Move to the next query observation.
+ * The engines stop the search when this returns false.
+ * The observations can be given in any order(i.e. the batched search).
+ * @param vote
+ * @param idx: observation index. 0 ~ count - 1.
+ * @param frame_idx: query frame index of the observation.
+ * @return false if the deadline has passed.
+ */
+bool vote_next(vote_t* vote, const int idx, const int frame_idx)
+{
+	if((vote->expired == false)
+			&& (ast_tvzero(vote->deadline) == 0)
+			&& ((vote->processed % DEF_VOTE_DEADLINE_STEP) == 0)
+			&& (ast_tvcmp(ast_tvnow(), vote->deadline) >= 0)
+			) {
+		vote->expired = true;
+	}
+	if(vote->expired == true) {
+		return false;
+	}
+
+	/* the observation out of the window */
+	if(vote->window > 0) {
+		expire_log(vote, &vote->logs[idx % vote->window]);
+	}
+
+	vote->processed++;
+	vote->stamp = idx + 1;
+	vote->remains = vote->count - vote->processed;
+	vote->frame_idx = frame_idx;
+
+	return true;
+}
+
+/**
+ * Vote to the given audio's offset bin.
+ * Each bin gets only one vote for each query observation.
+ * @param vote
+ * @param audio_id
+ * @param frame_idx: reference frame index.
+ */
+void vote_add(vote_t* vote, const int audio_id, const int frame_idx)
+{
+	uint64_t key;
+	int bin;
+	vote_slot_t* slot;
+
+	/* added after the vote table was created(i.e. the streaming search) */
+	if(audio_id >= vote->audio_size) {
+		return;
+	}
+
+	if(vote->pruned[audio_id] == true) {
+		return;
+	}
+
+	/* can not reach to the top ranks anymore */
+	if((vote->pruning == true) && (vote->scores[audio_id] + vote->remains + 1 < vote->threshold)) {
+		vote->pruned[audio_id] = true;
+		return;
+	}
+
+	bin = get_bin(frame_idx - vote->frame_idx);
+	key = ((uint64_t)(uint32_t)audio_id << 32) | (uint32_t)bin;
+
+	slot = get_slot(vote, key);
+	if(slot->stamp == vote->stamp) {
+		return;
+	}
+	if(slot->stamp == 0) {
+		slot->key = key;
+		vote->slot_count++;
+	}
+	slot->stamp = vote->stamp;
+	slot->count++;
+	if(vote->window > 0) {
+		add_log(vote, key);
+	}
+
+	if(slot->count > vote->scores[audio_id]) {
+		vote->scores[audio_id] = slot->count;
+		vote->offsets[audio_id] = bin * DEF_VOTE_BIN_WIDTH;
+		if(vote->pruning == true) {
+			update_ranks(vote, audio_id);
+		}
+	}
+
+	if(vote->slot_count * 2 > vote->slot_size) {
+		resize_slots(vote);
+	}
+}
+
+/**
+ * Keep only the votes of the last window observations.
+ * The vote of the observation idx is expired when the observation idx + window is voted.
+ * The scores can decrease, so the pruning is disabled.
+ * Must be called before the first observation.
+ * @param vote
+ * @param window: observations kept voted.
+ * @return
+ */
+bool vote_set_window(vote_t* vote, const int window)
+{
+	if((vote == NULL) || (window < 1) || (vote->processed > 0)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	vote->window = window;
+	vote->pruning = false;
+	vote->logs = ast_calloc(window, sizeof(vote_log_t));
+	vote->dirty = ast_calloc(vote->audio_size + 1, sizeof(bool));
+
+	return true;
+}
+
+/**
+ * Recompute the peaks of the audios whose peak votes have been expired.
+ * One pass over the table. Must be called before the results of the sliding window are read.
+ * @param vote
+ */
+void vote_update_scores(vote_t* vote)
+{
+	int i;
+	int audio_id;
+	int bin;
+	const vote_slot_t* slot;
+
+	if((vote == NULL) || (vote->dirty_count == 0)) {
+		return;
+	}
+
+	for(i = 0; i < vote->audio_size; i++) {
+		if(vote->dirty[i] == false) {
+			continue;
+		}
+		vote->scores[i] = 0;
+		vote->offsets[i] = 0;
+	}
+
+	for(i = 0; i < vote->slot_size; i++) {
+		slot = &vote->slots[i];
+		if(slot->count == 0) {
+			continue;
+		}
+
+		audio_id = (int)(uint32_t)(slot->key >> 32);
+		if(vote->dirty[audio_id] == false) {
+			continue;
+		}
+
+		bin = (int32_t)(uint32_t)slot->key;
+		if(slot->count > vote->scores[audio_id]) {
+			vote->scores[audio_id] = slot->count;
+			vote->offsets[audio_id] = bin * DEF_VOTE_BIN_WIDTH;
+		}
+	}
+
+	memset(vote->dirty, 0x00, sizeof(bool) * vote->audio_size);
+	vote->dirty_count = 0;
+}
+
+/**
+ * Set the deadline of the following observations.
+ * The streaming search is given the deadline only after the query has been captured.
+ * The sliding window is given the new deadline for each add, so its expiry is cleared.
+ * @param vote
+ * @param deadline: zero for no deadline.
+ */
+void vote_set_deadline(vote_t* vote, const struct timeval deadline)
+{
+	vote->deadline = deadline;
+	if(vote->window > 0) {
+		vote->expired = false;
+	}
+}
+
+/**
+ * Returns true if the search has been stopped by the deadline.
+ */
+bool vote_is_expired(const vote_t* vote)
+{
+	return vote->expired;
+}
+
+/**
+ * Returns the ratio(0 ~ 1) of the voted query observations.
+ * 1 if the search has not been stopped by the deadline.
+ */
+double vote_get_processed(const vote_t* vote)
+{
+	if((vote->expired == false) || (vote->count == 0)) {
+		return 1;
+	}
+
+	return (double)vote->processed / vote->count;
+}
+
+/**
+ * Returns true if the given audio has been pruned.
+ * The engines can skip the pruned audio's frames.
+ */
+bool vote_is_pruned(const vote_t* vote, const int audio_id)
+{
+	return vote->pruned[audio_id];
+}
+
+/**
+ * Get the top ranked audio ids in one pass over the scores.
+ * Keeps the bounded min heap of the max_count candidates.
+ * The higher score ranks first. The lower audio id ranks first for the same score.
+ * @param vote
+ * @param max_count
+ * @param audio_ids: result. Must have the max_count size. Sorted by the rank.
+ * @return count of the ranked audios.
+ */
+int vote_get_ranks(const vote_t* vote, const int max_count, int* audio_ids)
+{
+	int i;
+	int size;
+	int tmp;
+
+	if((vote == NULL) || (max_count < 1) || (audio_ids == NULL)) {
+		return 0;
+	}
+
+	/* audio_ids[0] is the lowest ranked candidate */
+	size = 0;
+	for(i = 0; i < vote->audio_size; i++) {
+		if(vote->scores[i] == 0) {
+			continue;
+		}
+
+		if(size < max_count) {
+			audio_ids[size] = i;
+			size++;
+			if(size == max_count) {
+				for(tmp = size / 2 - 1; tmp >= 0; tmp--) {
+					sift_down_rank(vote, audio_ids, size, tmp);
+				}
+			}
+			continue;
+		}
+
+		if(is_ranked_higher(vote, i, audio_ids[0]) == false) {
+			continue;
+		}
+		audio_ids[0] = i;
+		sift_down_rank(vote, audio_ids, size, 0);
+	}
+
+	/* heap sort. the lowest ranked one goes to the end. */
+	if(size < max_count) {
+		for(tmp = size / 2 - 1; tmp >= 0; tmp--) {
+			sift_down_rank(vote, audio_ids, size, tmp);
+		}
+	}
+	for(i = size - 1; i > 0; i--) {
+		tmp = audio_ids[0];
+		audio_ids[0] = audio_ids[i];
+		audio_ids[i] = tmp;
+		sift_down_rank(vote, audio_ids, i, 0);
+	}
+
+	return size;
+}
+
+/**
+ * Returns the top ranked results.
+ * @param vote
+ * @param audios: audio uuids. audio id is the index of the array.
+ * @param max_count
+ * @return [{"audio_uuid": <uuid>, "match_count": <count>, "offset": <frame offset>}, ...], NULL if nothing voted.
+ */
+struct ast_json* vote_get_results(const vote_t* vote, char** audios, const int max_count)
+{
+	int i;
+	int count;
+	int* audio_ids;
+	struct ast_json* j_res;
+
+	if((vote == NULL) || (audios == NULL) || (max_count < 1)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return NULL;
+	}
+
+	audio_ids = ast_calloc(max_count, sizeof(int));
+	count = vote_get_ranks(vote, max_count, audio_ids);
+	if(count == 0) {
+		sfree(audio_ids);
+		return NULL;
+	}
+
+	j_res = ast_json_array_create();
+	for(i = 0; i < count; i++) {
+		// deleted after the vote(i.e. the streaming search)
+		if(audios[audio_ids[i]] == NULL) {
+			continue;
+		}
+
+		ast_json_array_append(j_res,
+				ast_json_pack("{s:s, s:i, s:i}",
+						"audio_uuid",	audios[audio_ids[i]],
+						"match_count",	vote->scores[audio_ids[i]],
+						"offset",		vote->offsets[audio_ids[i]]
+						)
+				);
+	}
+	sfree(audio_ids);
+
+	return j_res;
+}
+
+/**
+ * Returns the given audio's score(the count of its peak offset bin).
+ */
+int vote_get_score(const vote_t* vote, const int audio_id)
+{
+	if((audio_id < 0) || (audio_id >= vote->audio_size)) {
+		return 0;
+	}
+
+	return vote->scores[audio_id];
+}
+
+/**
+ * Returns the given audio's peak offset(reference frame - query frame).
+ */
+int vote_get_offset(const vote_t* vote, const int audio_id)
+{
+	if((audio_id < 0) || (audio_id >= vote->audio_size)) {
+		return 0;
+	}
+
+	return vote->offsets[audio_id];
+}
+
+static vote_slot_t* get_slot(vote_t* vote, uint64_t key)
+{
+	uint32_t idx;
+	vote_slot_t* slot;
+
+	idx = get_slot_idx(key, vote->slot_size);
+	while(1) {
+		slot = &vote->slots[idx];
+		if((slot->stamp == 0) || (slot->key == key)) {
+			return slot;
+		}
+		idx = (idx + 1) & (vote->slot_size - 1);
+	}
+
+	return NULL;
+}
+
+/**
+ * Double the hash table size.
+ * The expired slots are dropped. If most of the slots have been expired,
+ * the table is rebuilt in the same size.
+ */
+static bool resize_slots(vote_t* vote)
+{
+	int i;
+	int live;
+	int old_size;
+	vote_slot_t* old_slots;
+	vote_slot_t* slot;
+	void* old_mem;
+
+	old_size = vote->slot_size;
+	old_slots = vote->slots;
+	old_mem = vote->slots_mem;
+
+	live = 0;
+	for(i = 0; i < old_size; i++) {
+		if(old_slots[i].count != 0) {
+			live++;
+		}
+	}
+
+	vote->slot_size = (live * 4 > old_size) ? old_size * 2 : old_size;
+	vote->slots = calloc_aligned(vote->slot_size * sizeof(vote_slot_t), &vote->slots_mem);
+	for(i = 0; i < old_size; i++) {
+		if(old_slots[i].count == 0) {
+			continue;
+		}
+
+		slot = get_slot(vote, old_slots[i].key);
+		*slot = old_slots[i];
+	}
+	vote->slot_count = live;
+	sfree(old_mem);
+
+	return true;
+}
+
+static uint32_t get_slot_idx(uint64_t key, int slot_size)
+{
+	/* murmur3 64bit finalizer */
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+
+	return (uint32_t)key & (slot_size - 1);
+}
+
+/**
+ * Returns true if the audio a ranks higher than the audio b.
+ */
+static bool is_ranked_higher(const vote_t* vote, const int a, const int b)
+{
+	if(vote->scores[a] != vote->scores[b]) {
+		return vote->scores[a] > vote->scores[b];
+	}
+
+	return a < b;
+}
+
+/**
+ * Sift down of the rank min heap. The lowest ranked one is on the top.
+ */
+static void sift_down_rank(const vote_t* vote, int* heap, int size, int idx)
+{
+	int child;
+	int tmp;
+
+	while(1) {
+		child = idx * 2 + 1;
+		if(child >= size) {
+			break;
+		}
+		if((child + 1 < size) && (is_ranked_higher(vote, heap[child], heap[child + 1]) == true)) {
+			child++;
+		}
+		if(is_ranked_higher(vote, heap[idx], heap[child]) == false) {
+			break;
+		}
+
+		tmp = heap[idx];
+		heap[idx] = heap[child];
+		heap[child] = tmp;
+		idx = child;
+	}
+}
+
+/**
+ * Returns the offset bin. Rounds toward negative infinity.
+ */
+static int get_bin(int offset)
+{
+	if(offset >= 0) {
+		return offset / DEF_VOTE_BIN_WIDTH;
+	}
+
+	return -((-offset + DEF_VOTE_BIN_WIDTH - 1) / DEF_VOTE_BIN_WIDTH);
+}
+
+/**
+ * Allocate the zero filled memory which starts at the cache line boundary.
+ * @param size
+ * @param mem: allocated memory. Need to free after use.
+ * @return aligned address in the mem.
+ */
+static void* calloc_aligned(size_t size, void** mem)
+{
+	uintptr_t addr;
+
+	*mem = ast_calloc(1, size + DEF_VOTE_CACHE_LINE - 1);
+	addr = ((uintptr_t)*mem + DEF_VOTE_CACHE_LINE - 1) & ~((uintptr_t)DEF_VOTE_CACHE_LINE - 1);
+
+	return (void*)addr;
+}
+
+/**
+ * Create the vote table.
+ * The table and its arrays are cache line aligned, so the parts' tables do not share the cache line.
+ * @param audio_size
+ * @param count
+ * @param ranks: number of the top ranks to keep exact.
+ * @param pruning: false for the part of the split search.
+ * @param deadline: zero for no deadline.
+ * @return
+ */
+static vote_t* create_vote(const int audio_size, const int count, const int ranks, const bool pruning, const struct timeval deadline)
+{
+	vote_t* vote;
+	void* mem;
+	size_t size;
+	char* tmp;
+
+	vote = calloc_aligned(sizeof(vote_t), &mem);
+	vote->mem = mem;
+	vote->audio_size = audio_size;
+	vote->pruning = pruning;
+	vote->count = count;
+	vote->remains = count;
+	vote->deadline = deadline;
+	vote->ranks = ranks;
+	vote->rank_ids = ast_calloc(ranks, sizeof(int));
+
+	vote->slot_size = DEF_VOTE_SLOT_SIZE;
+	vote->slots = calloc_aligned(vote->slot_size * sizeof(vote_slot_t), &vote->slots_mem);
+
+	/* scores, offsets, pruned */
+	size = (audio_size + 1) * (sizeof(int) * 2 + sizeof(bool));
+	tmp = calloc_aligned(size, &vote->audios_mem);
+	vote->scores = (int*)tmp;
+	vote->offsets = (int*)(tmp + (audio_size + 1) * sizeof(int));
+	vote->pruned = (bool*)(tmp + (audio_size + 1) * sizeof(int) * 2);
+
+	return vote;
+}
+
+/**
+ * Update the current top ranks with the given audio's increased score.
+ * The ranks are small(the max results), so the linear scans are enough.
+ * @param vote
+ * @param audio_id
+ */
+static void update_ranks(vote_t* vote, const int audio_id)
+{
+	int i;
+	int low;
+
+	for(i = 0; i < vote->rank_count; i++) {
+		if(vote->rank_ids[i] == audio_id) {
+			break;
+		}
+	}
+
+	if(i == vote->rank_count) {
+		if(vote->rank_count < vote->ranks) {
+			vote->rank_ids[vote->rank_count] = audio_id;
+			vote->rank_count++;
+		}
+		else {
+			/* replace the lowest rank */
+			low = 0;
+			for(i = 1; i < vote->rank_count; i++) {
+				if(vote->scores[vote->rank_ids[i]] < vote->scores[vote->rank_ids[low]]) {
+					low = i;
+				}
+			}
+			if(vote->scores[audio_id] <= vote->scores[vote->rank_ids[low]]) {
+				return;
+			}
+			vote->rank_ids[low] = audio_id;
+		}
+	}
+
+	if(vote->rank_count < vote->ranks) {
+		return;
+	}
+
+	vote->threshold = vote->scores[vote->rank_ids[0]];
+	for(i = 1; i < vote->rank_count; i++) {
+		vote->threshold = MIN(vote->threshold, vote->scores[vote->rank_ids[i]]);
+	}
+}
+
+/**
+ * Add the part's offset histogram into the vote table.
+ * The peak bins are updated with the merged counts.
+ * @param vote
+ * @param part
+ */
+static void merge_vote(vote_t* vote, const vote_t* part)
+{
+	int i;
+	int audio_id;
+	int bin;
+	vote_slot_t* slot;
+	const vote_slot_t* part_slot;
+
+	vote->processed += part->processed;
+	if(part->expired == true) {
+		vote->expired = true;
+	}
+
+	for(i = 0; i < part->slot_size; i++) {
+		part_slot = &part->slots[i];
+		if(part_slot->count == 0) {
+			continue;
+		}
+
+		slot = get_slot(vote, part_slot->key);
+		if(slot->stamp == 0) {
+			slot->key = part_slot->key;
+			slot->stamp = part_slot->stamp;
+			vote->slot_count++;
+		}
+		slot->count += part_slot->count;
+
+		audio_id = (int)(uint32_t)(part_slot->key >> 32);
+		bin = (int32_t)(uint32_t)part_slot->key;
+		if(slot->count > vote->scores[audio_id]) {
+			vote->scores[audio_id] = slot->count;
+			vote->offsets[audio_id] = bin * DEF_VOTE_BIN_WIDTH;
+		}
+
+		if(vote->slot_count * 2 > vote->slot_size) {
+			resize_slots(vote);
+		}
+	}
+}
+
+/**
+ * Worker task. Votes the idx'th part of the query observations into the part's vote table.
+ */
+static void run_part(void* data, const int idx)
+{
+	int start;
+	int end;
+	vote_part_t* part;
+
+	part = data;
+	start = (int)((long)part->count * idx / part->parts);
+	end = (int)((long)part->count * (idx + 1) / part->parts);
+
+	part->fn(part->data, part->votes[idx], start, end);
+}
+
+/**
+ * Mark the excluded audios as pruned. The pruned audio is not voted.
+ */
+static void set_excludes(vote_t* vote, const bool* excludes)
+{
+	if(excludes == NULL) {
+		return;
+	}
+
+	memcpy(vote->pruned, excludes, sizeof(bool) * vote->audio_size);
+}
+
+/**
+ * Log the voted slot of the current observation.
+ */
+static void add_log(vote_t* vote, const uint64_t key)
+{
+	vote_log_t* log;
+
+	log = &vote->logs[(vote->stamp - 1) % vote->window];
+	if(log->count >= log->size) {
+		log->size = (log->size * 2) + 16;
+		log->keys = ast_realloc(log->keys, sizeof(uint64_t) * log->size);
+	}
+	log->keys[log->count] = key;
+	log->count++;
+}
+
+/**
+ * Expire the logged votes of the observation.
+ * The audio whose peak could be expired is marked to recompute its peak.
+ */
+static void expire_log(vote_t* vote, vote_log_t* log)
+{
+	int i;
+	int audio_id;
+	vote_slot_t* slot;
+
+	for(i = 0; i < log->count; i++) {
+		slot = get_slot(vote, log->keys[i]);
+		if(slot->count == 0) {
+			continue;
+		}
+		slot->count--;
+
+		audio_id = (int)(uint32_t)(log->keys[i] >> 32);
+		if((slot->count + 1 >= vote->scores[audio_id]) && (vote->dirty[audio_id] == false)) {
+			vote->dirty[audio_id] = true;
+			vote->dirty_count++;
+		}
+	}
+	log->count = 0;
+}
@@ -0,0 +1,41 @@
+/*
+ * vote_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_VOTE_HANDLER_H_
+#define SRC_VOTE_HANDLER_H_
+
+#include <asterisk/json.h>
+
+#include <stdbool.h>
+#include <sys/time.h>
+
+typedef struct _vote_t vote_t;
+
+/**
+ * Votes the query observations in [start, end) into the given vote table.
+ */
+typedef void (*vote_range_fn)(void* data, vote_t* vote, const int start, const int end);
+
+vote_t* vote_create(const int audio_size, const int count, const int ranks, const bool* excludes, const struct timeval deadline);
+void vote_destroy(vote_t* vote);
+vote_t* vote_run(const int audio_size, const int count, const int ranks, const bool* excludes, const struct timeval deadline, vote_range_fn fn, void* data);
+
+bool vote_next(vote_t* vote, const int idx, const int frame_idx);
+void vote_add(vote_t* vote, const int audio_id, const int frame_idx);
+bool vote_is_pruned(const vote_t* vote, const int audio_id);
+void vote_set_deadline(vote_t* vote, const struct timeval deadline);
+bool vote_set_window(vote_t* vote, const int window);
+void vote_update_scores(vote_t* vote);
+bool vote_is_expired(const vote_t* vote);
+double vote_get_processed(const vote_t* vote);
+
+int vote_get_ranks(const vote_t* vote, const int max_count, int* audio_ids);
+struct ast_json* vote_get_results(const vote_t* vote, char** audios, const int max_count);
+int vote_get_score(const vote_t* vote, const int audio_id);
+int vote_get_offset(const vote_t* vote, const int audio_id);
+
+#endif /* SRC_VOTE_HANDLER_H_ */
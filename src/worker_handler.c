@@ -0,0 +1,254 @@
+/*
+ * worker_handler.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ *
+ *  Search worker threads.
+ *  The search splits its query observations into the parts and runs the parts
+ *  on the worker threads. The caller thread runs the parts too, so the search
+ *  goes on even if all of the workers are busy with the other calls' searches.
+ */
+
+#define _GNU_SOURCE
+
+#include <asterisk.h>
+#include <asterisk/logger.h>
+#include <asterisk/utils.h>
+#include <asterisk/lock.h>
+
+#include <stdbool.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "worker_handler.h"
+
+#define sfree(p) { if(p != NULL) ast_free(p); p=NULL; }
+
+#define DEF_WORKER_MAX_THREADS	64
+
+typedef struct _worker_batch_t {
+	worker_fn fn;
+	void* data;
+
+	int count;		///< total tasks
+	int next;		///< next task to run
+	int done;		///< finished tasks
+
+	ast_cond_t cond;	///< signaled when all tasks are finished
+
+	struct _worker_batch_t* next_batch;
+} worker_batch_t;
+
+static ast_mutex_t g_worker_lock;
+static ast_cond_t g_worker_cond;		///< signaled when new batch is queued
+static worker_batch_t* g_batches = NULL;	///< batches which have the not started tasks
+static pthread_t* g_threads = NULL;
+static int g_thread_count = 0;
+static int g_threshold = 0;
+static bool g_stop = false;
+
+static void* worker_loop(void* data);
+static bool run_next_task(worker_batch_t* batch);
+static void unlink_batch(worker_batch_t* batch);
+
+/**
+ * Start the worker threads.
+ * @param threads: number of the worker threads. 0 for the single threaded search.
+ * @param threshold: minimum query observations to split the search.
+ * @return
+ */
+bool worker_init(const int threads, const int threshold)
+{
+	int i;
+	int ret;
+
+	if((threads < 0) || (threshold < 1)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	ast_mutex_init(&g_worker_lock);
+	ast_cond_init(&g_worker_cond, NULL);
+	g_batches = NULL;
+	g_stop = false;
+	g_threshold = threshold;
+
+	g_thread_count = MIN(threads, DEF_WORKER_MAX_THREADS);
+	g_threads = ast_calloc(g_thread_count + 1, sizeof(pthread_t));
+	for(i = 0; i < g_thread_count; i++) {
+		ret = ast_pthread_create_background(&g_threads[i], NULL, worker_loop, NULL);
+		if(ret != 0) {
+			ast_log(LOG_WARNING, "Could not create worker thread. idx[%d]\n", i);
+			break;
+		}
+	}
+	g_thread_count = i;
+	ast_log(LOG_VERBOSE, "Started search workers. threads[%d], threshold[%d]\n", g_thread_count, g_threshold);
+
+	return true;
+}
+
+void worker_term(void)
+{
+	int i;
+
+	ast_mutex_lock(&g_worker_lock);
+	g_stop = true;
+	ast_cond_broadcast(&g_worker_cond);
+	ast_mutex_unlock(&g_worker_lock);
+
+	for(i = 0; i < g_thread_count; i++) {
+		pthread_join(g_threads[i], NULL);
+	}
+	sfree(g_threads);
+	g_thread_count = 0;
+
+	ast_cond_destroy(&g_worker_cond);
+	ast_mutex_destroy(&g_worker_lock);
+}
+
+/**
+ * Returns the number of the parts to split the given query observations.
+ * Returns 1 if the search should stay in the caller thread.
+ * @param count: query observations.
+ * @return
+ */
+int worker_get_parts(const int count)
+{
+	int parts;
+
+	if((g_thread_count == 0) || (count < g_threshold)) {
+		return 1;
+	}
+
+	/* each part has threshold / 2 observations at least */
+	parts = count * 2 / g_threshold;
+
+	return MAX(2, MIN(parts, g_thread_count + 1));
+}
+
+/**
+ * Run the count tasks on the worker threads and the caller thread.
+ * Returns after all of the tasks are finished.
+ * @param fn
+ * @param data
+ * @param count
+ * @return
+ */
+bool worker_run(worker_fn fn, void* data, const int count)
+{
+	int i;
+	worker_batch_t batch;
+	worker_batch_t* tmp;
+
+	if((fn == NULL) || (count < 0)) {
+		ast_log(LOG_WARNING, "Wrong input parameter.\n");
+		return false;
+	}
+
+	if((g_thread_count == 0) || (count < 2)) {
+		for(i = 0; i < count; i++) {
+			fn(data, i);
+		}
+		return true;
+	}
+
+	memset(&batch, 0x00, sizeof(batch));
+	batch.fn = fn;
+	batch.data = data;
+	batch.count = count;
+	ast_cond_init(&batch.cond, NULL);
+
+	/* queue the batch at the end */
+	ast_mutex_lock(&g_worker_lock);
+	if(g_batches == NULL) {
+		g_batches = &batch;
+	}
+	else {
+		for(tmp = g_batches; tmp->next_batch != NULL; tmp = tmp->next_batch);
+		tmp->next_batch = &batch;
+	}
+	ast_cond_broadcast(&g_worker_cond);
+
+	/* run the own tasks too */
+	while(run_next_task(&batch) == true);
+
+	while(batch.done < batch.count) {
+		ast_cond_wait(&batch.cond, &g_worker_lock);
+	}
+	ast_mutex_unlock(&g_worker_lock);
+
+	ast_cond_destroy(&batch.cond);
+
+	return true;
+}
+
+static void* worker_loop(void* data)
+{
+	ast_mutex_lock(&g_worker_lock);
+	while(1) {
+		if(g_stop == true) {
+			break;
+		}
+
+		if(g_batches == NULL) {
+			ast_cond_wait(&g_worker_cond, &g_worker_lock);
+			continue;
+		}
+
+		run_next_task(g_batches);
+	}
+	ast_mutex_unlock(&g_worker_lock);
+
+	return NULL;
+}
+
+/**
+ * Run the next task of the given batch.
+ * Must be called with the g_worker_lock. The lock is released while the task runs.
+ * @param batch
+ * @return false if the batch has no more task to start.
+ */
+static bool run_next_task(worker_batch_t* batch)
+{
+	int idx;
+
+	if(batch->next >= batch->count) {
+		return false;
+	}
+
+	idx = batch->next;
+	batch->next++;
+	if(batch->next == batch->count) {
+		unlink_batch(batch);
+	}
+
+	ast_mutex_unlock(&g_worker_lock);
+	batch->fn(batch->data, idx);
+	ast_mutex_lock(&g_worker_lock);
+
+	batch->done++;
+	if(batch->done == batch->count) {
+		ast_cond_signal(&batch->cond);
+	}
+
+	return true;
+}
+
+/**
+ * Remove the batch from the queue.
+ * Must be called with the g_worker_lock.
+ */
+static void unlink_batch(worker_batch_t* batch)
+{
+	worker_batch_t** tmp;
+
+	for(tmp = &g_batches; *tmp != NULL; tmp = &(*tmp)->next_batch) {
+		if(*tmp == batch) {
+			*tmp = batch->next_batch;
+			batch->next_batch = NULL;
+			return;
+		}
+	}
+}
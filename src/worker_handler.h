@@ -0,0 +1,24 @@
+/*
+ * worker_handler.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: pchero
+ */
+
+#ifndef SRC_WORKER_HANDLER_H_
+#define SRC_WORKER_HANDLER_H_
+
+#include <stdbool.h>
+
+/**
+ * Task of the worker. Runs the idx'th task of the given data.
+ */
+typedef void (*worker_fn)(void* data, const int idx);
+
+bool worker_init(const int threads, const int threshold);
+void worker_term(void);
+
+int worker_get_parts(const int count);
+bool worker_run(worker_fn fn, void* data, const int count);
+
+#endif /* SRC_WORKER_HANDLER_H_ */